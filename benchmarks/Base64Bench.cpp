@@ -0,0 +1,171 @@
+// base64 benchmark: encode and decode throughput of every implementation this CPU supports,
+// plus the bit-at-a-time code base64.h used before, for several input sizes
+//
+// usage: bench_base64 [--seconds S] [--json results.json]
+//
+// throughput is counted in raw (decoded) bytes for both directions
+
+#include "utils/base64.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <json.hpp>
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        double seconds = 0.2;          // per measurement
+        std::string jsonPath;
+    };
+
+    // the implementation replaced by the vectorized one, kept as a baseline
+    namespace legacy {
+        const std::string chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+        std::string encode(const uint8_t* data, size_t len) {
+            std::string out;
+            out.reserve((len * 4 + 2) / 3);
+            int val = 0;
+            int valb = -6;
+            for (size_t i = 0; i < len; i++) {
+                val = (val << 8) + data[i];
+                valb += 8;
+                while (valb >= 0) {
+                    out.push_back(chars[(val >> valb) & 0x3F]);
+                    valb -= 6;
+                }
+            }
+            if (valb > -6) out.push_back(chars[((val << 8) >> (valb + 8)) & 0x3F]);
+            while (out.size() % 4) out.push_back('=');
+            return out;
+        }
+
+        std::vector<uint8_t> decode(const std::string& s) {
+            std::vector<int> T(256, -1);
+            for (int i = 0; i < 64; i++) T[chars[i]] = i;
+            std::vector<uint8_t> out;
+            out.reserve(s.size() * 3 / 4);
+            int val = 0;
+            int valb = -8;
+            for (unsigned char c : s) {
+                if (T[c] == -1) break;
+                val = (val << 6) + T[c];
+                valb += 6;
+                if (valb >= 0) {
+                    out.push_back(uint8_t((val >> valb) & 0xFF));
+                    valb -= 8;
+                }
+            }
+            return out;
+        }
+    }
+
+    // run op repeatedly for about seconds, returns GB/s over bytes per call
+    template <typename Op>
+    double throughput(size_t bytes, double seconds, Op op) {
+        size_t calls = 0;
+        size_t batch = std::max<size_t>(1, (1 << 20) / std::max<size_t>(bytes, 1));
+        auto start = Clock::now();
+        auto deadline = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+        Clock::time_point now;
+        do {
+            for (size_t i = 0; i < batch; i++) op();
+            calls += batch;
+            now = Clock::now();
+        } while (now < deadline);
+        double elapsed = std::chrono::duration<double>(now - start).count();
+        return static_cast<double>(bytes) * calls / elapsed / 1e9;
+    }
+
+    bool parseArgs(int argc, char* argv[], Options& opts) {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    std::cerr << "[Bench] Missing value for " << arg << "\n";
+                    std::exit(2);
+                }
+                return argv[++i];
+            };
+
+            if (arg == "--seconds") opts.seconds = std::stod(value());
+            else if (arg == "--json") opts.jsonPath = value();
+            else {
+                std::cerr << "[Bench] Unknown argument: " << arg << "\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+}
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    if (!parseArgs(argc, argv, opts)) {
+        return 2;
+    }
+
+    // sizes of an iv, a wrapped AES key, a typical message and bulk data
+    const size_t sizes[] = {16, 256, 4096, 65536, 1 << 20};
+
+    std::mt19937 rng(7);
+    std::vector<uint8_t> data(sizes[std::size(sizes) - 1]);
+    for (auto& b : data) b = static_cast<uint8_t>(rng());
+
+    std::string detected = base64::implementation();
+    std::vector<nlohmann::json> rows;
+
+    std::printf("\n%-10s %10s %14s %14s\n", "impl", "bytes", "encode GB/s", "decode GB/s");
+
+    for (const char* impl : {"legacy", "scalar", "sse4.1", "avx2"}) {
+        bool isLegacy = std::string(impl) == "legacy";
+        if (!isLegacy && !base64::useImplementation(impl)) {
+            continue;
+        }
+
+        for (size_t size : sizes) {
+            std::string text = base64::encode(data.data(), size);
+            std::vector<char> textOut(base64::encodedLength(size));
+            std::vector<uint8_t> bytesOut(base64::decodedMaxLength(text.size()));
+            size_t sink = 0;
+
+            double encodeRate = isLegacy
+                ? throughput(size, opts.seconds, [&] { sink += legacy::encode(data.data(), size).size(); })
+                : throughput(size, opts.seconds, [&] { sink += base64::encode(data.data(), size, textOut.data()); });
+            double decodeRate = isLegacy
+                ? throughput(size, opts.seconds, [&] { sink += legacy::decode(text).size(); })
+                : throughput(size, opts.seconds, [&] { sink += base64::decode(text.data(), text.size(), bytesOut.data()); });
+
+            if (sink == 0) std::printf("unreachable\n");
+            std::printf("%-10s %10zu %14.2f %14.2f\n", impl, size, encodeRate, decodeRate);
+            rows.push_back({{"impl", impl}, {"bytes", size},
+                            {"encode_gbps", encodeRate}, {"decode_gbps", decodeRate}});
+        }
+    }
+    base64::useImplementation(detected);
+
+    std::printf("\nruntime dispatch picks: %s\n", detected.c_str());
+
+    if (!opts.jsonPath.empty()) {
+        nlohmann::json out;
+        out["config"] = {{"seconds", opts.seconds}, {"dispatch", detected}};
+        out["results"] = rows;
+
+        std::ofstream file(opts.jsonPath);
+        if (!file.is_open()) {
+            std::cerr << "[Bench] Failed to write " << opts.jsonPath << "\n";
+            return 1;
+        }
+        file << out.dump(4) << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,305 @@
+// storage benchmark: builds a synthetic dataset in a temporary directory and
+// measures latency percentiles and throughput of each FileStorage operation
+//
+// usage: bench_storage [--users N] [--messages N] [--conversations N] [--threads N]
+//                      [--message-size BYTES] [--lookups N] [--time-limit SECONDS]
+//                      [--io uring|pool] [--json results.json] [--dir PATH] [--keep]
+//
+// every run works in a new em_bench_* directory under --dir (default: the temp directory)
+// and removes only that one
+//
+// compare runs between commits with the same flags, e.g.
+//   bench_storage --users 10000 --messages 100000 --json before.json
+
+#include "storage/FileStorage.h"
+#include "crypto/CryptoManager.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <json.hpp>
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        size_t users = 1000;
+        size_t messages = 10000;
+        size_t conversations = 0;      // 0 = users / 2
+        size_t threads = 1;
+        size_t messageSize = 256;
+        size_t lookups = 2000;         // login and load operations
+        double timeLimit = 60.0;       // seconds per operation, remaining ops are skipped
+        bool preferIoUring = true;
+        std::string jsonPath;
+        std::string dir;               // parent of the run's own directory, temp by default
+        bool keep = false;             // leave the run's directory behind
+    };
+
+    struct Result {
+        std::string op;
+        size_t ops = 0;
+        size_t failures = 0;
+        double seconds = 0;
+        bool truncated = false;        // time limit hit before all ops ran
+        std::vector<double> latenciesUs;
+    };
+
+    double percentile(std::vector<double>& sorted, double p) {
+        if (sorted.empty()) return 0;
+        size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+        return sorted[std::min(index, sorted.size() - 1)];
+    }
+
+    std::string userName(size_t i) {
+        return "bench_user_" + std::to_string(i);
+    }
+
+    // run op(i) for i in [0, count) on opts.threads threads, op returns success
+    template <typename Op>
+    Result measure(const std::string& name, size_t count, const Options& opts, Op op) {
+        Result result;
+        result.op = name;
+
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> failures{0};
+        std::atomic<bool> expired{false};
+        std::vector<std::vector<double>> perThread(opts.threads);
+        auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(opts.timeLimit));
+
+        auto worker = [&](size_t t) {
+            auto& latencies = perThread[t];
+            for (;;) {
+                size_t i = next.fetch_add(1);
+                if (i >= count) return;
+
+                auto start = Clock::now();
+                if (start > deadline) {
+                    expired = true;
+                    return;
+                }
+                bool ok = op(i);
+                auto end = Clock::now();
+
+                latencies.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+                if (!ok) failures++;
+            }
+        };
+
+        auto begin = Clock::now();
+        std::vector<std::thread> threads;
+        for (size_t t = 1; t < opts.threads; t++) {
+            threads.emplace_back(worker, t);
+        }
+        worker(0);
+        for (auto& t : threads) t.join();
+        result.seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+
+        for (auto& latencies : perThread) {
+            result.latenciesUs.insert(result.latenciesUs.end(), latencies.begin(), latencies.end());
+        }
+        std::sort(result.latenciesUs.begin(), result.latenciesUs.end());
+        result.ops = result.latenciesUs.size();
+        result.failures = failures;
+        result.truncated = expired;
+        return result;
+    }
+
+    nlohmann::json toJson(Result& r) {
+        double opsPerSec = r.seconds > 0 ? r.ops / r.seconds : 0;
+        return {
+            {"op", r.op},
+            {"ops", r.ops},
+            {"failures", r.failures},
+            {"seconds", r.seconds},
+            {"ops_per_sec", opsPerSec},
+            {"p50_us", percentile(r.latenciesUs, 0.50)},
+            {"p90_us", percentile(r.latenciesUs, 0.90)},
+            {"p99_us", percentile(r.latenciesUs, 0.99)},
+            {"max_us", r.latenciesUs.empty() ? 0 : r.latenciesUs.back()},
+            {"truncated", r.truncated}
+        };
+    }
+
+    void printRow(const nlohmann::json& row) {
+        std::printf("%-20s %9zu %12.1f %11.1f %11.1f %11.1f%s\n",
+                    row["op"].get<std::string>().c_str(),
+                    row["ops"].get<size_t>(),
+                    row["ops_per_sec"].get<double>(),
+                    row["p50_us"].get<double>(),
+                    row["p99_us"].get<double>(),
+                    row["max_us"].get<double>(),
+                    row["truncated"].get<bool>() ? "  (time limit)" : "");
+    }
+
+    bool parseArgs(int argc, char* argv[], Options& opts) {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    std::cerr << "[Bench] Missing value for " << arg << "\n";
+                    std::exit(2);
+                }
+                return argv[++i];
+            };
+
+            if (arg == "--users") opts.users = std::stoul(value());
+            else if (arg == "--messages") opts.messages = std::stoul(value());
+            else if (arg == "--conversations") opts.conversations = std::stoul(value());
+            else if (arg == "--threads") opts.threads = std::max<size_t>(1, std::stoul(value()));
+            else if (arg == "--message-size") opts.messageSize = std::stoul(value());
+            else if (arg == "--lookups") opts.lookups = std::stoul(value());
+            else if (arg == "--time-limit") opts.timeLimit = std::stod(value());
+            else if (arg == "--io") opts.preferIoUring = value() != "pool";
+            else if (arg == "--json") opts.jsonPath = value();
+            else if (arg == "--dir") opts.dir = value();
+            else if (arg == "--keep") opts.keep = true;
+            else {
+                std::cerr << "[Bench] Unknown argument: " << arg << "\n";
+                return false;
+            }
+        }
+
+        if (opts.users < 2) opts.users = 2;
+        if (opts.conversations == 0) opts.conversations = std::max<size_t>(1, opts.users / 2);
+        return true;
+    }
+
+}
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    if (!parseArgs(argc, argv, opts)) {
+        return 2;
+    }
+
+    // a fresh directory of its own, the only one removed afterwards: --dir names its parent
+    // and may well hold real data
+    std::filesystem::path parent = opts.dir.empty()
+        ? std::filesystem::temp_directory_path() : std::filesystem::path(opts.dir);
+    std::filesystem::path dir = parent / ("em_bench_" + std::to_string(Clock::now().time_since_epoch().count()));
+    std::error_code created;
+    if (!std::filesystem::create_directories(dir, created)) {
+        std::cerr << "[Bench] Cannot create a fresh directory " << dir.string() << "\n";
+        return 1;
+    }
+
+    // one ciphertext reused for every message, encryption is not what is measured
+    CryptoManager crypto;
+    CryptoManager::AESEncrypted payload =
+        crypto.aesEncrypt(std::string(opts.messageSize, 'm'), crypto.generateAESKey());
+    std::string wrappedKey(256, 'k');
+
+    // conversation c is between users 2c and 2c+1 (mod users)
+    auto pairOf = [&](size_t c) {
+        return std::make_pair(userName((2 * c) % opts.users), userName((2 * c + 1) % opts.users));
+    };
+
+    std::vector<nlohmann::json> rows;
+    std::string backend;
+
+    {
+        auto store = std::make_unique<FileStorage>(dir.string(), opts.preferIoUring);
+        backend = store->ioBackend() == AsyncFileIO::Backend::IoUring ? "io_uring" : "thread_pool";
+
+        // credentials only, RSA key generation would dominate the measurement
+        Result create = measure("create_user", opts.users, opts, [&](size_t i) {
+            return store->createUser(userName(i), "hash");
+        });
+        rows.push_back(toJson(create));
+
+        Result login = measure("login_user", opts.lookups, opts, [&](size_t i) {
+            return store->loginUser(userName((i * 7919) % opts.users), "hash");
+        });
+        rows.push_back(toJson(login));
+
+        Result append = measure("append_message", opts.messages, opts, [&](size_t i) {
+            auto [from, to] = pairOf(i % opts.conversations);
+            return store->appendConversationMessage(from, to, payload, wrappedKey, wrappedKey,
+                                                    static_cast<long>(i));
+        });
+        rows.push_back(toJson(append));
+    }
+
+    // reopen so loads start from a cold cache
+    auto openStart = Clock::now();
+    auto store = std::make_unique<FileStorage>(dir.string(), opts.preferIoUring);
+    Result reopen;
+    reopen.op = "open";
+    reopen.ops = 1;
+    reopen.seconds = std::chrono::duration<double>(Clock::now() - openStart).count();
+    reopen.latenciesUs.push_back(reopen.seconds * 1e6);
+    rows.push_back(toJson(reopen));
+
+    std::mt19937_64 rng(42);
+    std::vector<size_t> picks(opts.lookups);
+    for (auto& p : picks) p = rng() % opts.conversations;
+
+    Result load = measure("load_conversation", opts.lookups, opts, [&](size_t i) {
+        auto [a, b] = pairOf(picks[i]);
+        return !store->loadConversation(a, b).is_null();
+    });
+    rows.push_back(toJson(load));
+
+    Result range = measure("load_range_last50", opts.lookups, opts, [&](size_t i) {
+        auto [a, b] = pairOf(picks[i]);
+        size_t perConversation = opts.messages / opts.conversations;
+        size_t offset = perConversation > 50 ? perConversation - 50 : 0;
+        store->loadConversationRange(a, b, offset, 50);
+        return true;
+    });
+    rows.push_back(toJson(range));
+
+    Result summaries = measure("list_conversations", opts.lookups, opts, [&](size_t i) {
+        store->listConversationSummaries(userName(i % opts.users));
+        return true;
+    });
+    rows.push_back(toJson(summaries));
+
+    store.reset();
+
+    std::printf("\nusers=%zu messages=%zu conversations=%zu threads=%zu io=%s\n\n",
+                opts.users, opts.messages, opts.conversations, opts.threads, backend.c_str());
+    std::printf("%-20s %9s %12s %11s %11s %11s\n", "op", "ops", "ops/s", "p50 us", "p99 us", "max us");
+    for (const auto& row : rows) {
+        printRow(row);
+    }
+
+    if (!opts.jsonPath.empty()) {
+        nlohmann::json out;
+        out["config"] = {
+            {"users", opts.users},
+            {"messages", opts.messages},
+            {"conversations", opts.conversations},
+            {"threads", opts.threads},
+            {"message_size", opts.messageSize},
+            {"lookups", opts.lookups},
+            {"io_backend", backend}
+        };
+        out["results"] = rows;
+
+        std::ofstream file(opts.jsonPath);
+        if (!file.is_open()) {
+            std::cerr << "[Bench] Failed to write " << opts.jsonPath << "\n";
+            return 1;
+        }
+        file << out.dump(4) << "\n";
+    }
+
+    if (!opts.keep) {
+        std::error_code ec;
+        std::filesystem::remove_all(dir, ec);
+    }
+    return 0;
+}
@@ -0,0 +1,198 @@
+// TLS handshake benchmark: full versus resumed handshakes per second on one core
+// client and server run in this thread over an in-memory BIO pair, so no socket or kernel
+// time is counted. The server rate only counts time spent in the server's side of the
+// handshake, which is what a server core pays per connecting client
+//
+// usage: bench_tls [--seconds S] [--version 1.2|1.3] [--json results.json]
+//
+// the contexts are the ones TcpServer and TcpConnection use (TlsContext), so resumption goes
+// through the server session cache / ticket keys and the client per-peer session cache
+
+#include "network/TlsContext.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <json.hpp>
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        double seconds = 2.0;          // per measurement
+        std::string version = "1.3";
+        std::string jsonPath;
+    };
+
+    struct Result {
+        size_t handshakes = 0;
+        size_t resumed = 0;
+        double elapsed = 0;            // both sides, seconds
+        double serverElapsed = 0;      // server side only
+    };
+
+    // one handshake between fresh SSL objects, then let the client take its tickets
+    // returns false on failure, resumed tells whether the server resumed a session
+    bool handshake(TlsContext& server, TlsContext& client, const std::string& peer,
+                   Clock::duration& serverTime, bool& resumed) {
+        auto timed = [&](auto op) {
+            auto start = Clock::now();
+            auto result = op();
+            serverTime += Clock::now() - start;
+            return result;
+        };
+
+        SSL* serverSsl = timed([&] { return SSL_new(server.context().native_handle()); });
+        SSL* clientSsl = SSL_new(client.context().native_handle());
+        SSL_set1_host(clientSsl, "localhost");
+        SSL_set_tlsext_host_name(clientSsl, "localhost");
+        client.prepareClient(clientSsl, peer);
+
+        BIO* clientBio;
+        BIO* serverBio;
+        BIO_new_bio_pair(&clientBio, 0, &serverBio, 0);
+        SSL_set_bio(clientSsl, clientBio, clientBio);
+        SSL_set_bio(serverSsl, serverBio, serverBio);
+        SSL_set_connect_state(clientSsl);
+        SSL_set_accept_state(serverSsl);
+
+        bool clientDone = false;
+        bool serverDone = false;
+        bool ok = true;
+        for (int round = 0; round < 16 && !(clientDone && serverDone) && ok; round++) {
+            if (!clientDone) {
+                int rc = SSL_do_handshake(clientSsl);
+                clientDone = rc == 1;
+                ok = clientDone || SSL_get_error(clientSsl, rc) == SSL_ERROR_WANT_READ;
+            }
+            if (!serverDone && ok) {
+                int rc = timed([&] { return SSL_do_handshake(serverSsl); });
+                serverDone = rc == 1;
+                ok = serverDone || SSL_get_error(serverSsl, rc) == SSL_ERROR_WANT_READ;
+            }
+        }
+        ok = ok && clientDone && serverDone;
+
+        if (ok) {
+            // TLS 1.3 tickets arrive after the handshake, reading hands them to the session cache
+            char byte;
+            SSL_read(clientSsl, &byte, 1);
+            resumed = SSL_session_reused(serverSsl) == 1;
+            SSL_shutdown(clientSsl);
+            timed([&] { return SSL_shutdown(serverSsl); });
+        }
+
+        SSL_free(clientSsl);
+        timed([&] { SSL_free(serverSsl); return 0; });
+        return ok;
+    }
+
+    Result run(TlsContext& server, TlsContext& client, bool resume, double seconds) {
+        Result result;
+        Clock::duration serverTime{};
+        std::string peer = "localhost:0";
+
+        // resumed runs start from a session the first handshake leaves behind
+        if (resume) {
+            bool resumed;
+            Clock::duration ignored{};
+            handshake(server, client, peer, ignored, resumed);
+        }
+
+        auto start = Clock::now();
+        auto deadline = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+        Clock::time_point now;
+        do {
+            // a peer name never seen before means nothing to resume
+            if (!resume) peer = "localhost:" + std::to_string(result.handshakes + 1);
+
+            bool resumed = false;
+            if (!handshake(server, client, peer, serverTime, resumed)) {
+                std::cerr << "[Bench] Handshake failed\n";
+                std::exit(1);
+            }
+            result.handshakes++;
+            result.resumed += resumed ? 1 : 0;
+            now = Clock::now();
+        } while (now < deadline);
+
+        result.elapsed = std::chrono::duration<double>(now - start).count();
+        result.serverElapsed = std::chrono::duration<double>(serverTime).count();
+        return result;
+    }
+
+    bool parseArgs(int argc, char* argv[], Options& opts) {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    std::cerr << "[Bench] Missing value for " << arg << "\n";
+                    std::exit(2);
+                }
+                return argv[++i];
+            };
+
+            if (arg == "--seconds") opts.seconds = std::stod(value());
+            else if (arg == "--version") opts.version = value();
+            else if (arg == "--json") opts.jsonPath = value();
+            else {
+                std::cerr << "[Bench] Unknown argument: " << arg << "\n";
+                return false;
+            }
+        }
+        if (opts.version != "1.2" && opts.version != "1.3") {
+            std::cerr << "[Bench] --version must be 1.2 or 1.3\n";
+            return false;
+        }
+        return true;
+    }
+
+}
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    if (!parseArgs(argc, argv, opts)) {
+        return 2;
+    }
+
+    auto credentials = TlsContext::selfSigned("localhost");
+    auto server = TlsContext::server(credentials);
+    auto client = TlsContext::client(credentials.certificatePem);
+
+    int version = opts.version == "1.2" ? TLS1_2_VERSION : TLS1_3_VERSION;
+    SSL_CTX_set_min_proto_version(client->context().native_handle(), version);
+    SSL_CTX_set_max_proto_version(client->context().native_handle(), version);
+
+    std::vector<nlohmann::json> rows;
+    std::printf("\n%-8s %12s %10s %16s %16s\n", "mode", "handshakes", "resumed", "server hs/s/core", "both ends hs/s");
+
+    for (bool resume : {false, true}) {
+        Result r = run(*server, *client, resume, opts.seconds);
+        double serverRate = r.handshakes / r.serverElapsed;
+        double totalRate = r.handshakes / r.elapsed;
+        const char* mode = resume ? "resumed" : "full";
+
+        std::printf("%-8s %12zu %10zu %16.0f %16.0f\n", mode, r.handshakes, r.resumed, serverRate, totalRate);
+        rows.push_back({{"mode", mode}, {"handshakes", r.handshakes}, {"resumed", r.resumed},
+                        {"server_per_second", serverRate}, {"total_per_second", totalRate}});
+    }
+
+    if (!opts.jsonPath.empty()) {
+        nlohmann::json out;
+        out["config"] = {{"seconds", opts.seconds}, {"tls_version", opts.version},
+                         {"openssl", OpenSSL_version(OPENSSL_VERSION)}};
+        out["results"] = rows;
+
+        std::ofstream file(opts.jsonPath);
+        if (!file.is_open()) {
+            std::cerr << "[Bench] Failed to write " << opts.jsonPath << "\n";
+            return 1;
+        }
+        file << out.dump(4) << "\n";
+    }
+    return 0;
+}
@@ -1,6 +1,7 @@
 #ifndef ENCRYPTEDMESSENGER_CLIENT_H
 #define ENCRYPTEDMESSENGER_CLIENT_H
 
+#include <chrono>
 #include <string>
 #include "network/TcpConnection.h"
 #include "json.hpp"  // nlohmann::json
@@ -10,9 +11,21 @@
 // account creation, and messages to the server through TcpConnection
 class Client {
 public:
+    static constexpr std::chrono::milliseconds kDefaultTimeout{500};
+
     // construct a client with an existing TCP connection
     // the connection is owned via shared_ptr for safe lifetime management
-    explicit Client(std::shared_ptr<TcpConnection> connection);
+    // timeout bounds the wait for each response
+    explicit Client(std::shared_ptr<TcpConnection> connection,
+                    std::chrono::milliseconds timeout = kDefaultTimeout);
+
+    // change the response timeout for later requests
+    void setTimeout(std::chrono::milliseconds timeout) { timeout_ = timeout; }
+
+    // ask the server to switch this connection to format (json, msgpack or cbor)
+    // and optionally to deflate compression
+    // returns true once both sides use them, on failure the connection stays as it was
+    bool hello(WireFormat format, Compression compression = Compression::None);
 
     // send a request to create a new account on the server
     // hashes the password before transmission
@@ -30,12 +43,49 @@ public:
     // receive messages from conversation with this user and withUser
     bool getMessages(const std::string &withUser);
 
-    // for receiving messages
+    // fetch conversation list with unread counts in one request
+    bool listConversations();
+
+    // acknowledge messages up to seq in conversation with withUser
+    bool markRead(const std::string &withUser, uint64_t seq);
+
+    // check the server is answering, server heartbeats are answered by TcpConnection itself
+    bool ping();
+
+    // create a group with this user and members
+    bool createGroup(const std::string& group, const std::vector<std::string>& members);
+
+    // send a message to every member of group
+    bool sendGroupMessage(const std::string& group, const std::string& message);
+
+    // fetch members, this user's epoch keys and messages of group into lastGroup_
+    bool getGroup(const std::string& group);
+
+    // wait until at least count group messages were pushed into groupInbox_, false on timeout
+    bool waitForGroupMessages(size_t count);
+
+    // fetch the server's metrics into lastStats_, only answered on the local socket
+    bool stats();
+
+    // for receiving messages, byte fields (ciphertext, iv, tag, aes_for_*) are
+    // base64 strings over json and nlohmann binary values over msgpack/cbor
     std::vector<nlohmann::json> lastMessages_;
 
+    // for receiving conversation list: peer, last_timestamp, last_seq, unread
+    std::vector<nlohmann::json> lastConversations_;
+
+    // get_group response: group, members, epoch, keys (epoch -> wrapped key), messages
+    nlohmann::json lastGroup_;
+
+    // stats response: counters, histograms (latencies in microseconds) and server
+    nlohmann::json lastStats_;
+
+    // group messages the server pushed while this user was online, oldest first
+    std::vector<nlohmann::json> groupInbox_;
+
 private:
     // used to check if tcpConnection function calls fail or pass
-    void handleResponse(const std::string& status, const std::string& message);
+    void handleResponse(const nlohmann::json& response);
 
     // helper for checking success/error response from server
     bool waitForResponse();
@@ -50,6 +100,8 @@ private:
     // pending action system
     std::string pendingAction_;
     std::string lastLoginUsername_;
+    WireFormat pendingFormat_ = WireFormat::Json;
+    Compression pendingCompression_ = Compression::None;
 
     // server response checking/debug
     std::string lastStatus_;
@@ -58,7 +110,7 @@ private:
     std::condition_variable responseCv_;
     bool responseReady_ = false;
     // timeout for server responses
-    int timeoutMs_ = 500;
+    std::chrono::milliseconds timeout_;
 };
 
 #endif //ENCRYPTEDMESSENGER_CLIENT_H
\ No newline at end of file
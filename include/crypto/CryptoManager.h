@@ -1,7 +1,9 @@
 #ifndef ENCRYPTEDMESSENGER_CRYPTOMANAGER_H
 #define ENCRYPTEDMESSENGER_CRYPTOMANAGER_H
 
+#include <openssl/types.h>
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 #include <optional>
@@ -20,14 +22,31 @@ public:
 
     RSAKeyPair generateRSAKeyPair();
 
+    // convert between PEM text and compact DER bytes (keystore format)
+    // public keys are SubjectPublicKeyInfo, private keys PKCS#1
+    // throw std::runtime_error on malformed input
+    static std::string publicKeyPemToDer(const std::string& publicKeyPem);
+    static std::string publicKeyDerToPem(const std::string& publicKeyDer);
+    static std::string privateKeyPemToDer(const std::string& privateKeyPem);
+    static std::string privateKeyDerToPem(const std::string& privateKeyDer);
+
     // get stored public key for user (from fileStorage)
     std::optional<std::string> getPublicKey(const std::string& username) const;
 
+    // parsed public key, shared by whoever caches it and the encryptions using it
+    using PublicKey = std::shared_ptr<EVP_PKEY>;
+
+    // parse a PEM public key once for any number of rsaEncrypt calls, nullptr if it does not parse
+    static PublicKey loadPublicKey(const std::string& publicKeyPem);
+
     // ---------RSA encryption---------
 
     // encrypt message using PEM public key
     std::string rsaEncrypt(const std::string& plaintext, const std::string& publicKeyPem);
 
+    // same with a key from loadPublicKey, skips parsing the PEM
+    std::string rsaEncrypt(const std::string& plaintext, const PublicKey& publicKey);
+
     // decrypt message using PEM private key
     std::string rsaDecrypt(const std::string& ciphertext, const std::string& privateKeyPem);
 
@@ -0,0 +1,139 @@
+#ifndef ENCRYPTEDMESSENGER_ACTIONTABLE_H
+#define ENCRYPTEDMESSENGER_ACTIONTABLE_H
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include "network/Request.h"
+
+// compile-time registry of protocol actions
+// every action is one Spec row: its handler, the request fields it needs and how it is
+// scheduled. Table places the rows with a perfect hash found at compile time, so a lookup
+// is one hash of the name, one slot read and one string compare however many actions exist
+namespace actions {
+
+    // which limiter bucket a request is charged to
+    enum class RateClass : uint8_t {
+        Free,      // negotiation, never limited
+        Auth,      // account creation and login, password guessing
+        Write,     // stores data
+        Read       // reads data
+    };
+
+    // worker pool priority of the action's offloaded work, lower value runs first
+    // when requests queue up for a worker
+    enum class Priority : uint8_t {
+        High,
+        Normal,
+        Bulk
+    };
+
+    // request fields an action cannot run without
+    namespace field {
+        constexpr uint32_t To           = 1u << 0;
+        constexpr uint32_t Message      = 1u << 1;
+        constexpr uint32_t With         = 1u << 2;
+        constexpr uint32_t Username     = 1u << 3;
+        constexpr uint32_t PasswordHash = 1u << 4;
+        constexpr uint32_t Seq          = 1u << 5;
+        constexpr uint32_t Group        = 1u << 6;
+        constexpr uint32_t Members      = 1u << 7;
+    }
+
+    // true when every field in mask is present (non-empty / non-zero)
+    constexpr bool hasFields(const Request& request, uint32_t mask) {
+        uint32_t present = 0;
+        if (!request.to.empty())           present |= field::To;
+        if (!request.message.empty())      present |= field::Message;
+        if (!request.with.empty())         present |= field::With;
+        if (!request.username.empty())     present |= field::Username;
+        if (!request.passwordHash.empty()) present |= field::PasswordHash;
+        if (request.seq != 0)              present |= field::Seq;
+        if (!request.group.empty())        present |= field::Group;
+        if (!request.members.empty())      present |= field::Members;
+        return (present & mask) == mask;
+    }
+
+    template <typename Handler>
+    struct Spec {
+        std::string_view name;
+        Handler handler;
+        bool requiresAuth = false;       // rejected before the handler without a login
+        RateClass rate = RateClass::Free;
+        Priority priority = Priority::Normal;
+        uint32_t required = 0;           // field:: mask checked before the handler
+        std::string_view missingReply = {};   // json sent when a required field is missing
+    };
+
+    // seeded FNV-1a with a final mix so the low bits depend on every character
+    constexpr uint64_t hash(std::string_view name, uint64_t seed) {
+        uint64_t h = 0xcbf29ce484222325ull ^ seed;
+        for (char c : name) {
+            h ^= static_cast<uint8_t>(c);
+            h *= 0x100000001b3ull;
+        }
+        h ^= h >> 29;
+        h *= 0xbf58476d1ce4e5b9ull;
+        return h ^ (h >> 32);
+    }
+
+    template <typename Handler, size_t N>
+    class Table {
+    public:
+        static_assert(N > 0 && N < 255, "slots store row indexes as uint8_t");
+
+        // searches seeds until every name lands in its own slot
+        // duplicate names can never be separated and leave the table invalid
+        constexpr explicit Table(const std::array<Spec<Handler>, N>& specs) : specs_(specs) {
+            for (uint64_t seed = 0; seed < kMaxSeeds; seed++) {
+                if (place(seed)) {
+                    seed_ = seed;
+                    valid_ = true;
+                    return;
+                }
+            }
+        }
+
+        // row for name, nullptr for unknown actions
+        constexpr const Spec<Handler>* find(std::string_view name) const {
+            uint8_t slot = slots_[hash(name, seed_) & (kSlots - 1)];
+            if (slot == 0 || specs_[slot - 1].name != name) return nullptr;
+            return &specs_[slot - 1];
+        }
+
+        constexpr bool valid() const { return valid_; }
+        constexpr size_t size() const { return N; }
+        constexpr const Spec<Handler>* begin() const { return specs_.data(); }
+        constexpr const Spec<Handler>* end() const { return specs_.data() + N; }
+
+    private:
+        // at most half full keeps the seed search short
+        static constexpr size_t kSlots = std::bit_ceil(N * 2);
+        static constexpr uint64_t kMaxSeeds = 1 << 16;
+
+        constexpr bool place(uint64_t seed) {
+            slots_ = {};
+            for (size_t i = 0; i < N; i++) {
+                uint8_t& slot = slots_[hash(specs_[i].name, seed) & (kSlots - 1)];
+                if (slot != 0) return false;
+                slot = static_cast<uint8_t>(i + 1);
+            }
+            return true;
+        }
+
+        std::array<Spec<Handler>, N> specs_;
+        std::array<uint8_t, kSlots> slots_{};   // row index + 1, 0 marks an empty slot
+        uint64_t seed_ = 0;
+        bool valid_ = false;
+    };
+
+    template <typename Handler, size_t N>
+    constexpr Table<Handler, N> makeTable(const std::array<Spec<Handler>, N>& specs) {
+        return Table<Handler, N>(specs);
+    }
+
+}
+
+#endif //ENCRYPTEDMESSENGER_ACTIONTABLE_H
@@ -0,0 +1,37 @@
+#ifndef ENCRYPTEDMESSENGER_BUFFERPOOL_H
+#define ENCRYPTEDMESSENGER_BUFFERPOOL_H
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// reusable output buffers for connection writes, shared by every connection
+// streamed responses are written one pooled buffer at a time, so their memory stays at
+// a few buffers whatever the response length
+class BufferPool {
+public:
+    // capacity of pooled buffers, also the size streams fill before handing a buffer to the socket
+    static constexpr size_t kBufferSize = 64 * 1024;
+
+    explicit BufferPool(size_t maxFree = 256);
+
+    // process-wide pool used by TcpConnection
+    static BufferPool& shared();
+
+    // empty buffer with capacity of at least kBufferSize
+    std::string acquire();
+
+    // return a buffer, kept only if its capacity is near kBufferSize so oversized ones are freed
+    void release(std::string buffer);
+
+    // buffers currently waiting for reuse
+    size_t freeCount() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<std::string> free_;
+    size_t maxFree_;
+};
+
+#endif //ENCRYPTEDMESSENGER_BUFFERPOOL_H
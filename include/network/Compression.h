@@ -0,0 +1,69 @@
+#ifndef ENCRYPTEDMESSENGER_COMPRESSION_H
+#define ENCRYPTEDMESSENGER_COMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <zlib.h>
+
+// optional compression of a connection, negotiated with {"action":"hello","compression":"deflate"}
+// once on (after the hello answer) every byte in both directions travels in blocks
+//   u8 flags | u32 payload length (little-endian) | payload
+// that carry the bytes of the frames below them (json text or binary frames) in order.
+// A block with kDeflated set holds the next part of one raw deflate stream that lives as long
+// as the connection, flushed per block, so keys and values repeated across messages compress
+// against everything sent before. Blocks under kThreshold bytes are sent stored
+enum class Compression {
+    None,
+    Deflate
+};
+
+namespace compression {
+
+    constexpr size_t kBlockHeader = 5;
+    constexpr uint8_t kDeflated = 1;
+
+    // smaller writes cost more in block overhead and cpu than they save
+    constexpr size_t kThreshold = 256;
+
+    // "none" or "deflate"
+    std::optional<Compression> fromName(std::string_view name);
+    const char* name(Compression compression);
+
+    // sending half of a connection's deflate stream
+    // (about 256 KiB of zlib state, only allocated for connections that negotiate it)
+    class Deflater {
+    public:
+        Deflater();
+        ~Deflater();
+        Deflater(const Deflater&) = delete;
+        Deflater& operator=(const Deflater&) = delete;
+
+        // append data to out as one block, deflated when at least kThreshold bytes
+        void appendBlock(std::string& out, std::string_view data);
+
+    private:
+        z_stream stream_{};
+    };
+
+    // receiving half, inflates blocks in the order they arrive
+    class Inflater {
+    public:
+        Inflater();
+        ~Inflater();
+        Inflater(const Inflater&) = delete;
+        Inflater& operator=(const Inflater&) = delete;
+
+        // append the payload of one deflated block to out
+        // false on corrupt data or when out would grow past maxOut
+        bool inflate(std::string_view payload, std::string& out, size_t maxOut);
+
+    private:
+        z_stream stream_{};
+    };
+
+}
+
+#endif //ENCRYPTEDMESSENGER_COMPRESSION_H
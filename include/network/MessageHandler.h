@@ -1,31 +1,82 @@
 #ifndef ENCRYPTEDMESSENGER_MESSAGEHANDLER_H
 #define ENCRYPTEDMESSENGER_MESSAGEHANDLER_H
 
+#include <functional>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 #include "crypto/CryptoManager.h"
 #include "network/tcpConnection.h"
-#include "storage/FileStorage.h"
+#include "server/MessageStore.h"
 
 class TcpServer; // forward declaration
 
 class MessageHandler {
 public:
-    MessageHandler(TcpServer* server, FileStorage& storage);
+    MessageHandler(TcpServer* server, MessageStore& storage);
 
     // called by tcpServer for send message action
+    // the RSA work runs on the server's worker pool and storage is asynchronous,
+    // true means queued and the response follows on completion
     bool processMessage(
         TcpConnection::pointer sender,
         const std::string& to,
         const std::string& message
     );
 
-    // called by tcpServer for receive message action
-    bool fetchMessages(TcpConnection::pointer requester, const std::string &withUser);
+    // called by tcpServer for receive message action, the response is streamed in batches
+    // limit 0 returns everything from offset onwards
+    bool fetchMessages(TcpConnection::pointer requester,
+                       const std::string &withUser,
+                       size_t offset = 0,
+                       size_t limit = 0);
+
+    // called by tcpServer for list conversations action
+    bool listConversations(TcpConnection::pointer requester);
+
+    // called by tcpServer for mark read action
+    bool markRead(TcpConnection::pointer requester, const std::string& withUser, uint64_t seq);
+
+    // called by tcpServer for create group action, members as listed in the request's array
+    // the creator is always a member
+    bool createGroup(TcpConnection::pointer requester, const std::string& group,
+                     const std::vector<std::string_view>& members);
+
+    // called by tcpServer for send group action
+    // encrypted once under the group's epoch key, stored, then pushed to online members
+    bool sendGroupMessage(TcpConnection::pointer sender, const std::string& group, const std::string& message);
+
+    // called by tcpServer for get group action: members, the requester's epoch keys and messages
+    bool getGroup(TcpConnection::pointer requester, const std::string& group, size_t offset, size_t limit);
+
+    static constexpr size_t kMaxGroupMembers = 1000;
 
 private:
+    // key messages of a group are sealed with in this process
+    struct EpochKey {
+        uint64_t epoch = 0;
+        std::vector<uint8_t> key;
+    };
+
+    using EpochWaiter = std::function<void(const EpochKey*)>;
+
+    // pass the current key of group to waiter, starting the next epoch on a worker (one RSA
+    // wrap per member) when this process has none yet. Sends arriving meanwhile wait for that
+    // same epoch. nullptr if a member's key is missing or storage fails, io thread only
+    void withEpochKey(const TcpConnection::pointer& sender, const std::string& group,
+                      const MessageStore::GroupInfo& info, EpochWaiter waiter);
+
+    // encrypt, store and fan out one group message, on the io thread once the key is known
+    void sealGroupMessage(const TcpConnection::pointer& sender, const std::string& group,
+                          std::vector<std::string> members, const EpochKey& key, const std::string& message);
+
     TcpServer* server_;       // not owned
-    FileStorage& storage_;    // reference to storage system
+    MessageStore& storage_;   // reference to storage engine
     CryptoManager crypto_;    // encryption
+    // epoch keys are only held in memory, after a restart each group moves to a new epoch
+    std::unordered_map<std::string, EpochKey> epochKeys_;
+    std::unordered_map<std::string, std::vector<EpochWaiter>> pendingEpochs_;   // group -> sends waiting for its new epoch
 };
 
 #endif //ENCRYPTEDMESSENGER_MESSAGEHANDLER_H
\ No newline at end of file
@@ -0,0 +1,24 @@
+#ifndef ENCRYPTEDMESSENGER_OUTGOINGSTREAM_H
+#define ENCRYPTEDMESSENGER_OUTGOINGSTREAM_H
+
+#include <string>
+
+// response written in pieces, pulled by the connection's write queue one buffer at a time
+// the next piece is only requested once the previous one reached the socket, which is the
+// flow control: a slow reader stops production instead of growing a backlog
+// called on the connection's executor only
+class OutgoingStream {
+public:
+    enum class State {
+        Ready,      // buffer holds the next piece
+        Pending,    // nothing available yet, the stream calls TcpConnection::resumeStream later
+        Done        // finished, buffer may hold the last piece
+    };
+
+    virtual ~OutgoingStream() = default;
+
+    // append the next piece to buffer (empty, pooled, BufferPool::kBufferSize capacity)
+    virtual State next(std::string& buffer) = 0;
+};
+
+#endif //ENCRYPTEDMESSENGER_OUTGOINGSTREAM_H
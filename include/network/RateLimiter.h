@@ -0,0 +1,84 @@
+#ifndef ENCRYPTEDMESSENGER_RATELIMITER_H
+#define ENCRYPTEDMESSENGER_RATELIMITER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "network/ActionTable.h"
+
+// sustained rate and burst of one action class, perSecond 0 means unlimited
+struct RateLimit {
+    double perSecond = 0;
+    double burst = 1;
+};
+
+// token bucket kept as a single atomic (GCRA form): instead of a token count it stores the
+// time the bucket will be full again, so taking a token is one compare-and-swap and no lock
+class TokenBucket {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // zero when a token was taken, otherwise how long until the next one is available
+    Clock::duration take(const RateLimit& limit, Clock::time_point now);
+
+    // return a token take() handed out, when the request was turned down elsewhere
+    void giveBack(const RateLimit& limit);
+
+private:
+    std::atomic<int64_t> fullAt_{0};   // nanoseconds since the clock epoch
+};
+
+// token bucket limits per action class (ActionSpec::rate), applied per connection and per
+// logged in username so a user cannot get around them by opening more connections
+class RateLimiter {
+public:
+    using Clock = TokenBucket::Clock;
+    static constexpr size_t kRateClasses = static_cast<size_t>(actions::RateClass::Read) + 1;
+
+    // one bucket per action class
+    using Buckets = std::array<TokenBucket, kRateClasses>;
+
+    struct Limits {
+        std::array<RateLimit, kRateClasses> perConnection;
+        std::array<RateLimit, kRateClasses> perUser;
+
+        // generous enough for interactive clients, tight on account creation and login
+        static Limits defaults();
+    };
+
+    explicit RateLimiter(Limits limits = Limits::defaults());
+
+    // buckets shared by every connection logged in as username, dropped with the last of them
+    // takes a lock, called once per login rather than per request. Users whose buckets are
+    // gone are forgotten a few map buckets at a time, never in one pass over everyone
+    std::shared_ptr<Buckets> userBuckets(const std::string& username);
+
+    // takes a token from the connection bucket and, when logged in, the user bucket
+    // a request is charged to both or neither: the connection token goes back when the
+    // user bucket is empty
+    // zero when the request may run, otherwise how long the client should wait
+    Clock::duration check(Buckets& connection, Buckets* user, actions::RateClass rate,
+                          Clock::time_point now = Clock::now()) const;
+
+    const Limits& limits() const { return limits_; }
+
+    // users with an entry, including ones not swept yet
+    size_t trackedUsers();
+
+private:
+    // drop expired entries from the next few map buckets
+    void sweep_NoLock();
+
+    Limits limits_;
+    std::mutex mutex_;                                            // guards users_ and sweepBucket_
+    std::unordered_map<std::string, std::weak_ptr<Buckets>> users_;
+    size_t sweepBucket_ = 0;                                      // next map bucket sweep_NoLock() visits
+};
+
+#endif //ENCRYPTEDMESSENGER_RATELIMITER_H
@@ -0,0 +1,35 @@
+#ifndef ENCRYPTEDMESSENGER_REQUEST_H
+#define ENCRYPTEDMESSENGER_REQUEST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// fields of one client request, filled by JsonUtils::parseRequest (json frames)
+// or wire::requestFromJson (binary frames)
+// string fields view the receive buffer, or arena for strings that had escapes,
+// so a request is only valid while the frame it was parsed from is
+// missing fields are empty / 0
+struct Request {
+    std::string_view action;
+    std::string_view to;
+    std::string_view message;
+    std::string_view with;
+    std::string_view username;
+    std::string_view passwordHash;   // "password_hash"
+    std::string_view encoding;       // hello: "json", "msgpack" or "cbor"
+    std::string_view compression;    // hello: "none" or "deflate"
+    std::string_view group;          // group actions: group name
+    std::vector<std::string_view> members;   // create_group: usernames, a json array of strings
+    uint64_t offset = 0;
+    uint64_t limit = 0;
+    uint64_t seq = 0;
+
+    // unescaped strings, allocated once (frame size) on the first escape
+    std::unique_ptr<char[]> arena;
+    size_t arenaUsed = 0;
+};
+
+#endif //ENCRYPTEDMESSENGER_REQUEST_H
@@ -0,0 +1,104 @@
+#ifndef ENCRYPTEDMESSENGER_REQUESTCONTEXT_H
+#define ENCRYPTEDMESSENGER_REQUESTCONTEXT_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include "utils/Metrics.h"
+#include "utils/Trace.h"
+
+// one protocol request, from TcpServer::handleAction until the last work done for it is gone
+// the handler runs with it as the current request. TcpServer::offload and the storage callbacks
+// of MessageHandler carry it along (bind), so replies queued from a worker's completion still
+// count for it. Its latency is recorded when the last reference is dropped, right after the
+// final reply was queued, so asynchronous actions are measured end to end. Its trace::RequestTrace
+// is made current alongside it, so spans anywhere below add to its breakdown
+class RequestContext {
+public:
+    using pointer = std::shared_ptr<RequestContext>;
+    using Clock = std::chrono::steady_clock;
+
+    // what is recorded per action, registered once per action name
+    struct ActionMetrics {
+        metrics::Counter* requests = nullptr;
+        metrics::Counter* errors = nullptr;       // requests with an error reply
+        metrics::Histogram* latency = nullptr;
+
+        static ActionMetrics forAction(std::string_view action);
+    };
+
+    // start is when its frame arrived, so parsing counts towards the latency
+    // name must outlive the request (an action table name)
+    RequestContext(const ActionMetrics& metrics, std::string_view name, Clock::time_point start = Clock::now())
+        : metrics_(metrics), start_(start), trace_(name, start) {
+        metrics_.requests->add();
+    }
+
+    ~RequestContext() {
+        auto end = Clock::now();
+        bool error = error_.load(std::memory_order_relaxed);
+        metrics_.latency->record(end - start_);
+        if (error) {
+            metrics_.errors->add();
+        }
+        trace_.finish(end, error);
+    }
+
+    RequestContext(const RequestContext&) = delete;
+    RequestContext& operator=(const RequestContext&) = delete;
+
+    // request the calling thread is working for, empty outside of one
+    static const pointer& current() { return current_; }
+
+    // makes request the current one until the scope ends
+    class Scope {
+    public:
+        explicit Scope(pointer request)
+            : trace_(request ? &request->trace_ : nullptr),
+              previous_(std::exchange(current_, std::move(request))) {}
+        ~Scope() { current_ = std::move(previous_); }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        trace::RequestTrace::Scope trace_;
+        pointer previous_;
+    };
+
+    // f wrapped to run with the calling thread's current request current again
+    template <typename F>
+    static auto bind(F f) {
+        return [request = current_, f = std::move(f)](auto&&... args) mutable {
+            Scope scope(request);
+            return f(std::forward<decltype(args)>(args)...);
+        };
+    }
+
+    // called by TcpConnection for each reply queued while this request is current
+    void onReply(bool error, size_t bytes) {
+        if (error) {
+            error_.store(true, std::memory_order_relaxed);
+        }
+        trace_.addResponseBytes(bytes);
+    }
+
+    trace::RequestTrace& trace() { return trace_; }
+
+    // worker pool priority of the work offloaded for this request, lower runs first
+    void setPriority(unsigned priority) { priority_ = priority; }
+    unsigned priority() const { return priority_; }
+
+private:
+    static thread_local pointer current_;
+
+    ActionMetrics metrics_;   // registry metrics live as long as the process
+    Clock::time_point start_;
+    trace::RequestTrace trace_;
+    std::atomic<bool> error_{false};
+    unsigned priority_ = 0;
+};
+
+#endif //ENCRYPTEDMESSENGER_REQUESTCONTEXT_H
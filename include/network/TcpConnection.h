@@ -4,44 +4,144 @@
 #include <memory>
 #include <string>
 #include <array>
+#include <atomic>
+#include <deque>
 #include <json.hpp>
+#include "network/Compression.h"
+#include "network/OutgoingStream.h"
+#include "network/RateLimiter.h"
+#include "network/TimerWheel.h"
+#include "network/TlsContext.h"
+#include "network/WireFormat.h"
+#include "server/Session.h"
+#include "utils/JsonUtils.h"
 
 class TcpServer; // Forward declaration
 
+// why a connection was closed, counted by the server
+enum class CloseReason : uint8_t {
+    Closed,             // peer closed, socket error or local disconnect()
+    IdleTimeout,        // no request for ConnectionTimeouts::idle
+    ReadTimeout,        // a partial frame was not completed within ConnectionTimeouts::read
+    WriteTimeout,       // a write made no progress within ConnectionTimeouts::write
+    FrameTooLarge,      // a request frame is over ConnectionLimits::maxFrame
+    InboundOverflow,    // unprocessed input over ConnectionLimits::maxInbound
+    OutboundOverflow,   // queued output over ConnectionLimits::maxOutbound
+    CompressionError,   // a compressed block did not inflate
+    TlsHandshakeFailed  // tls handshake error, nothing is sent back
+};
+
+// reason code sent to the peer before a limit closes its connection, e.g. "frame_too_large"
+const char* closeReasonName(CloseReason reason);
+
+// per connection memory caps, applied by the server to every accepted connection
+struct ConnectionLimits {
+    size_t maxFrame = 1024 * 1024;           // largest request frame, at most wire::kMaxFrame
+    size_t maxInbound = 2 * 1024 * 1024;     // received bytes not yet dispatched
+    size_t maxOutbound = 16 * 1024 * 1024;   // bytes queued for the socket, peers over it are dropped
+    size_t pauseReadsAbove = 1024 * 1024;    // stop reading requests while more than this is queued
+    size_t resumeReadsBelow = 256 * 1024;    // and start again once the queue drains to this
+
+    // protocol maximum only, used for client side connections
+    static ConnectionLimits unlimited();
+};
+
+// server side connection timeouts, zero disables one
+struct ConnectionTimeouts {
+    TimerWheel::Clock::duration idle = std::chrono::minutes(5);
+    TimerWheel::Clock::duration read = std::chrono::seconds(30);
+    TimerWheel::Clock::duration write = std::chrono::seconds(30);
+    // send {"status":"ping"} after this long without a request, clients answer with a pong action
+    TimerWheel::Clock::duration heartbeat = TimerWheel::Clock::duration::zero();
+};
 
-// represents a single TCP client connection.
+// represents a single client connection, over TCP or a unix domain socket.
 // handles reading, writing, and parsing of json messages.
 // owned and managed by TcpServer.
 class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
 public:
     using pointer = std::shared_ptr<TcpConnection>;
+    // holds either kind of stream socket, so both listeners share everything below
+    using Socket = asio::generic::stream_protocol::socket;
 
     // factory method to create a new shared TcpConnection instance.
     static pointer create(asio::io_context& io_context, TcpServer* server);
 
     // get a reference to the socket so the server can accept connections into it.
-    asio::ip::tcp::socket& socket();
+    Socket& socket();
+
+    // executor of this connection's socket, storage completions are posted here
+    asio::any_io_executor executor() { return socket_.get_executor(); }
 
-    // start asynchronous reading from the connection.
+    // start asynchronous reading from the connection, no-op if already reading.
     bool beginRead();
 
-    // send a string message from connected client.
+    // send a json text message, re-encoded when a binary wire format is in use
     void send(const std::string& message);
 
-    // set username when user logs in
-    void setUsername(const std::string& username) { username_ = username; }
+    // send value in this connection's wire format
+    void sendJson(const nlohmann::json& value);
+
+    // queue a response produced piece by piece, frames sent later wait until it is done
+    void sendStream(std::shared_ptr<OutgoingStream> stream);
+
+    // queue a frame already encoded in this connection's wire format without copying it,
+    // the same buffer can sit in many connections' queues (group deliveries)
+    void sendShared(std::shared_ptr<const std::string> frame);
+
+    // a stream that returned Pending has data again
+    void resumeStream();
+
+    // frames after this call are read and written in format
+    // called by the server after answering hello, by the client on its success response
+    void setWireFormat(WireFormat format) { format_ = format; }
+    WireFormat wireFormat() const { return format_; }
+
+    // bytes after this call are read and written in compression blocks (see Compression.h)
+    // called like setWireFormat, while handling the hello frame or its answer
+    void setCompression(Compression compression);
+    Compression compression() const { return inflater_ ? Compression::Deflate : Compression::None; }
+
+    // session of the user logged in over this connection, set by the server on login
+    void setSession(Session::pointer session) { session_ = std::move(session); }
+    const Session::pointer& session() const { return session_; }
+
+    // return username of connected client, empty until logged in
+    const std::string& getUsername() const;
+
+    // rate limit buckets of this connection, and of its user once logged in (else nullptr)
+    RateLimiter::Buckets& rateBuckets() { return rateBuckets_; }
+    RateLimiter::Buckets* userRateBuckets() { return session_ ? session_->rateBuckets() : nullptr; }
 
-    // return username of connected client
-    const std::string& getUsername() const { return username_; }
+    // connect to socket, and with tls run the client handshake (resuming when it can)
+    bool connect(const std::string& host, int port, std::shared_ptr<TlsContext> tls = nullptr);
 
-    // connect to socket
-    bool connect(const std::string& host, int port);
+    // connect to a server's unix domain socket (ServerOptions::localPath), always without tls
+    bool connectLocal(const std::string& path);
+
+    // true for unix domain socket connections
+    bool isLocal() const;
+
+    // server side: run the tls handshake on the accepted socket, done reports its result
+    // reads and writes go through tls afterwards
+    void handshake(std::shared_ptr<TlsContext> tls, std::function<void(const std::error_code&)> done);
+
+    // true when the tls handshake resumed an earlier session instead of running in full
+    bool tlsResumed() const;
+    bool usesTls() const { return tls_ != nullptr; }
 
     // close the connection and notify the server.
-    void disconnect();
+    void disconnect(CloseReason reason = CloseReason::Closed);
+
+    // server side: caps on buffered input and queued output
+    void setLimits(const ConnectionLimits& limits) { limits_ = limits; }
 
-    // callback for client
-    std::function<void(const std::string& status, const std::string& message)> onServerResponse_;
+    // server side: enforce timeouts from wheel, which must outlive the connection or stopTimers()
+    void startTimers(TimerWheel& wheel, const ConnectionTimeouts& timeouts);
+    void stopTimers();
+
+    // callback for client, receives the whole response object
+    std::function<void(const nlohmann::json& response)> onServerResponse_;
 
 private:
     TcpConnection(asio::io_context& io_context, TcpServer* server);
@@ -49,18 +149,90 @@ private:
     // begin asynchronous read operation for incoming messages.
     void readAction();
 
-    // called when a complete json message is received.
-    void handleAction(const nlohmann::json& message);
+    // dispatch every complete frame in incomingBuffer_, the format may change between frames
+    // false when a limit closed the connection
+    bool processIncoming();
+
+    // unpack complete compression blocks of data into incomingBuffer_, keeping a partial one
+    // false when the connection was closed over a bad block
+    bool decodeBlocks(std::string_view data);
+
+    // send the peer reason and close once everything already being written is out
+    // drops queued output, must run on the socket's executor
+    void closeWithReason(CloseReason reason);
+
+    // bytes waiting in the write queue plus the write in flight
+    size_t pendingOutbound() const { return queuedBytes_ + (writing_ ? outgoingBytes().size() : 0); }
+
+    // called when a complete frame is received, frame views incomingBuffer_
+    // json requests are parsed without a DOM, responses (client side) into nlohmann::json
+    void handleFrame(std::string_view frame);
+
+    // one write queue entry: encoded bytes, or a stream pulled until done
+    struct WriteEntry {
+        std::string data = {};
+        std::shared_ptr<OutgoingStream> stream = nullptr;
+        bool startCompression = false;   // everything after this entry is written in blocks
+        std::shared_ptr<const std::string> shared = nullptr;   // frame queued on several connections
+    };
+
+    // write bytes already encoded for the wire
+    void write(std::string frame);
+
+    // append to the write queue on the socket's executor
+    void enqueue(WriteEntry entry);
+
+    // start the next write if none is in flight
+    void pumpWrites();
+    void startWrite(std::string data, std::shared_ptr<const std::string> shared = nullptr);
+
+    // bytes of the write in flight
+    const std::string& outgoingBytes() const { return outgoingShared_ ? *outgoingShared_ : outgoing_; }
 
     // handles server to client responses
     void handleServerResponse(const nlohmann::json &msg);
 
-    std::string username_;           // assign when login
-    asio::ip::tcp::socket socket_;   // active socket for this client
+    // timer callback: close on an expired timeout, send a heartbeat, re-arm for the next deadline
+    void checkTimeouts();
+
+    Session::pointer session_;       // assigned on login
+    using TlsStream = asio::ssl::stream<Socket&>;
+
+    Socket socket_;                  // active socket for this client
+    std::unique_ptr<TlsStream> tls_;             // layered over socket_ when tls is used
+    std::shared_ptr<TlsContext> tlsContext_;     // kept alive for tls_
     asio::io_context& io_context_;   // used for I/O
     TcpServer* server_;              // reference to parent server
     std::array<char, 1024> buffer_;  // temp buffer for reads
     std::string incomingBuffer_;     // persistent buffer for data
+    JsonUtils::ObjectScanner scanner_;  // position of the next object in incomingBuffer_ (json)
+    WireFormat format_ = WireFormat::Json;
+    std::unique_ptr<compression::Inflater> inflater_;   // set once blocks are read
+    std::unique_ptr<compression::Deflater> deflater_;   // set once blocks are written
+    std::string blockBuffer_;           // received bytes of an incomplete block
+    bool processing_ = false;           // inside processIncoming()
+    bool blocksFollow_ = false;         // compression turned on by the frame just handled
+    std::atomic<bool> reading_{false};  // read loop started
+    std::deque<WriteEntry> writeQueue_;  // frames and streams in send order, executor only
+    std::string outgoing_;              // buffer of the write in flight
+    std::shared_ptr<const std::string> outgoingShared_;   // or the shared frame being written
+    bool writing_ = false;
+    size_t queuedBytes_ = 0;            // encoded bytes in writeQueue_ (streams count once written)
+    ConnectionLimits limits_ = ConnectionLimits::unlimited();
+    bool readPaused_ = false;           // read loop stopped until the write queue drains
+    bool closing_ = false;              // closeWithReason() called, output after it is dropped
+    CloseReason closeReason_ = CloseReason::Closed;
+    RateLimiter::Buckets rateBuckets_;                         // limits for this connection
+
+    // timeouts (server side only), times are taken once per read or write
+    TimerWheel::Timer timer_;
+    TimerWheel* wheel_ = nullptr;
+    ConnectionTimeouts timeouts_;
+    TimerWheel::Clock::time_point lastRead_;       // last read completion
+    TimerWheel::Clock::time_point lastFrame_;      // last complete request
+    TimerWheel::Clock::time_point partialSince_;   // start of the unfinished frame, epoch when none
+    TimerWheel::Clock::time_point writeStarted_;   // start of the write in flight
+    TimerWheel::Clock::time_point lastPing_;       // last heartbeat sent
 };
 
 #endif //ENCRYPTEDMESSENGER_TCPCONNECTION_H
\ No newline at end of file
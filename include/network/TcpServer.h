@@ -2,43 +2,238 @@
 #define ENCRYPTEDMESSENGER_TCPSERVER_H
 
 #include <asio.hpp>
+#include <deque>
 #include <memory>
+#include <span>
+#include <unordered_map>
 #include <vector>
 #include "MessageHandler.h"
+#include "network/ActionTable.h"
+#include "network/RateLimiter.h"
+#include "network/TimerWheel.h"
+#include "network/WorkerPool.h"
 #include "network/tcpConnection.h"
-#include "storage/FileStorage.h"
+#include "network/Request.h"
+#include "network/RequestContext.h"
+#include "server/MessageStore.h"
+#include "server/Session.h"
+
+// tunables of a TcpServer, defaults suit an interactive deployment
+struct ServerOptions {
+    RateLimiter::Limits rateLimits = RateLimiter::Limits::defaults();
+    ConnectionTimeouts timeouts;
+    ConnectionLimits limits;
+    // accept tls instead of plain tcp when set (TlsContext::server)
+    std::shared_ptr<TlsContext> tls;
+    // replace the tls session ticket key this often, a ticket then resumes for one to two
+    // periods. zero keeps the first key while the server runs
+    TimerWheel::Clock::duration ticketKeyRotation = std::chrono::hours(1);
+    // also accept on this unix domain socket when set, for gateways on the same host
+    // (no tls there, access is governed by the socket file's permissions)
+    std::string localPath;
+    // resolution of connection timeouts
+    TimerWheel::Clock::duration timerTick = std::chrono::milliseconds(100);
+    // how long a user's session is kept after its last connection closed, a login within it
+    // resumes the session with its caches, cursors and rate limit state
+    Session::Clock::duration sessionLinger = std::chrono::minutes(5);
+    // threads for RSA, key generation and blocking storage calls, 0 = one per hardware thread
+    size_t workerThreads = 0;
+    // requests waiting for a worker before new ones are turned away with "Server busy"
+    size_t workerQueue = 4096;
+    // write the metrics in Prometheus text format to this file every metricsInterval when set
+    std::string metricsPath;
+    TimerWheel::Clock::duration metricsInterval = std::chrono::seconds(10);
+    // write sampled request traces in Chrome trace format to this file when set
+    std::string tracePath;
+    double traceSampleRate = 0.01;   // share of requests traced, 0..1
+    // append requests slower than their action's threshold to this file when set, one json
+    // line each with a breakdown by stage
+    std::string slowLogPath;
+    std::chrono::milliseconds slowThreshold{500};
+    std::unordered_map<std::string, std::chrono::milliseconds> slowThresholds;   // by action name
+};
 
 // manages incoming TCP connections and delegates handling to TcpConnection.
 // responsible for accepting new clients and maintaining a list of active connections.
 class TcpServer {
 public:
+    using Handler = void (TcpServer::*)(TcpConnection::pointer, const Request&);
+    using ActionSpec = actions::Spec<Handler>;
+
     // construct server on given io_context and port number.
+    // uses FileStorage under data/ as the storage engine
     TcpServer(asio::io_context& io_context, unsigned short port);
 
+    // connection lifecycle counters, readable from any thread
+    struct ConnectionStats {
+        std::atomic<uint64_t> accepted{0};
+        std::atomic<uint64_t> closed{0};          // every close, including the timeouts below
+        std::atomic<uint64_t> idleTimeouts{0};
+        std::atomic<uint64_t> readTimeouts{0};
+        std::atomic<uint64_t> writeTimeouts{0};
+        std::atomic<uint64_t> heartbeats{0};      // pongs received
+        std::atomic<uint64_t> framesTooLarge{0};
+        std::atomic<uint64_t> inboundOverflows{0};
+        std::atomic<uint64_t> outboundOverflows{0};
+        std::atomic<uint64_t> tlsHandshakes{0};   // completed, full or resumed
+        std::atomic<uint64_t> tlsResumed{0};
+        std::atomic<uint64_t> tlsFailures{0};
+        std::atomic<uint64_t> tlsKeyRotations{0};   // ticket keys replaced
+        std::atomic<uint64_t> deliveries{0};      // frames pushed to online users
+        std::atomic<uint64_t> deliveryEncodings{0};   // serializations behind them
+        std::atomic<uint64_t> sessionsCreated{0};
+        std::atomic<uint64_t> sessionsResumed{0};     // logins that found their session lingering
+        std::atomic<uint64_t> sessionsExpired{0};
+    };
+
+    // construct server with a specific storage engine (e.g. MemoryStorage for load tests)
+    // and optionally its own limits and timeouts
+    TcpServer(asio::io_context& io_context, unsigned short port, std::unique_ptr<MessageStore> storage,
+              ServerOptions options = {});
+
+    // removes the unix domain socket file, if any
+    ~TcpServer();
+
     // start listening for new incoming connections.
     void startAccept();
 
+    // same for the unix domain socket listener
+    void startAcceptLocal();
+
     // handle completion of an asynchronous accept operation.
     void handleAccept(TcpConnection::pointer new_connection, const std::error_code& error);
 
-    // decides which function to call from given action
-    void handleAction(TcpConnection::pointer connection, const nlohmann::json& message);
+    // looks the action up in the action table, checks login, rate limits and required fields,
+    // then runs its handler. received is when its frame of frameBytes started to be parsed
+    void handleAction(TcpConnection::pointer connection, const Request& request,
+                      RequestContext::Clock::time_point received = RequestContext::Clock::now(),
+                      size_t frameBytes = 0);
+
+    // table row for an action name, nullptr if the protocol has no such action
+    static const ActionSpec* findAction(std::string_view name);
+
+    // every row of the action table
+    static std::span<const ActionSpec> actions();
 
     // remove a connection from the active list (called when a client disconnects).
-    void removeConnection(TcpConnection::pointer connection);
+    void removeConnection(TcpConnection::pointer connection, CloseReason reason = CloseReason::Closed);
+
+    const ConnectionStats& stats() const { return stats_; }
+
+    // queue depth and throughput of the worker pool
+    const WorkerPool::Stats& workerStats() const { return workers_.stats(); }
+
+    // process wide metrics plus this server's connection and worker counters,
+    // as Prometheus text (the metrics file) and as json (the stats action)
+    std::string metricsText() const;
+    nlohmann::json metricsJson() const;
+
+    // run work() on the worker pool, then done(result) on connection's executor
+    // work of one connection runs in the order it was offloaded, ahead of queued work
+    // of lower priority actions
+    // answers "Server busy" itself and returns false when the pool's queue is full, and
+    // "Internal error" in place of done() when work throws
+    template <typename Work, typename Done>
+    bool offload(const TcpConnection::pointer& connection, Work work, Done done) {
+        // every half runs for the request being handled
+        const auto& request = RequestContext::current();
+        unsigned priority = request ? request->priority() : WorkerPool::kDefaultPriority;
+        if (workers_.submit(connection.get(), priority, RequestContext::bind(std::move(work)), connection->executor(),
+                            RequestContext::bind(std::move(done)),
+                            RequestContext::bind([connection](const std::string&) {
+                                connection->send(R"({"status":"error","message":"Internal error"})");
+                            }))) {
+            return true;
+        }
+        connection->send(R"({"status":"error","message":"Server busy"})");
+        return false;
+    }
+
+    // connections currently open, must be called on the server's io thread
+    size_t connectionCount() const { return active_connections_.size(); }
+
+    // sessions with a connection or lingering, likewise
+    size_t sessionCount() const { return sessions_.size(); }
+
+    // push frame to every logged in connection of users except skip, on the server's io thread
+    // frame is encoded once per wire format in use and the buffer is shared by all their queues
+    // (binary formats carry the byte fields of frame["record"] raw)
+    // returns the number of connections it was queued on
+    size_t deliver(const std::vector<std::string>& users, const nlohmann::json& frame,
+                   const TcpConnection* skip = nullptr);
 
 private:
     // handler declarations
-    void handleCreateAccount(TcpConnection::pointer connection, const nlohmann::json &data);
-    void handleLogin(TcpConnection::pointer connection, const nlohmann::json &data);
-    void handleSendMessage(TcpConnection::pointer connection, const nlohmann::json &data);
-    void handleGetMessages(TcpConnection::pointer connection, const nlohmann::json &data);
+    void handleHello(TcpConnection::pointer connection, const Request& request);
+    void handleCreateAccount(TcpConnection::pointer connection, const Request& request);
+    void handleLogin(TcpConnection::pointer connection, const Request& request);
+    void handleSendMessage(TcpConnection::pointer connection, const Request& request);
+    void handleGetMessages(TcpConnection::pointer connection, const Request& request);
+    void handleListConversations(TcpConnection::pointer connection, const Request& request);
+    void handleMarkRead(TcpConnection::pointer connection, const Request& request);
+    void handlePing(TcpConnection::pointer connection, const Request& request);
+    void handlePong(TcpConnection::pointer connection, const Request& request);
+    void handleCreateGroup(TcpConnection::pointer connection, const Request& request);
+    void handleSendGroup(TcpConnection::pointer connection, const Request& request);
+    void handleGetGroup(TcpConnection::pointer connection, const Request& request);
+    void handleStats(TcpConnection::pointer connection, const Request& request);
+
+    static const auto& actionTable();
+
+    // advance the timer wheel once per tick
+    void scheduleTick();
+
+    // session of username, resumed when it is still kept, else a new one
+    Session::pointer openSession(const std::string& username);
+
+    // take connection off its session, which starts lingering if it was the last one
+    void closeSession(const TcpConnection::pointer& connection);
+
+    // drop sessions that lingered for sessionLinger_ without a login
+    void expireSessions(Session::Clock::time_point now);
+
+    // new ticket key once ticketKeyRotation_ has passed since the last one
+    void rotateTicketKeys(TimerWheel::Clock::time_point now);
+
+    // write metricsPath_ on a worker every metricsInterval_
+    void scheduleMetricsFile();
+
+    // counters of this server as (name, help, type, value), shared by both metrics renderings
+    struct ServerMetric {
+        const char* name;
+        const char* help;
+        const char* type;
+        double value;
+    };
+    std::vector<ServerMetric> serverMetrics() const;
 
     asio::io_context& io_context_;                           // reference to shared io_context
     asio::ip::tcp::acceptor acceptor_;                       // accepts incoming connections
+    std::unique_ptr<asio::local::stream_protocol::acceptor> localAcceptor_;   // when localPath_ is set
+    std::string localPath_;
     std::vector<TcpConnection::pointer> active_connections_; // active connected clients
-    FileStorage storage_;                                    // write to user storage
+    std::unordered_map<std::string, Session::pointer> sessions_;   // username -> session
+    std::deque<std::pair<Session::pointer, Session::Clock::time_point>> lingering_;   // by detach time
+    Session::Clock::duration sessionLinger_;
+    std::unique_ptr<MessageStore> storage_;                  // pluggable storage engine
     MessageHandler messageHandler_;                          // handle message functionality
+    RateLimiter rateLimiter_;                                // per connection and per user limits
+    ConnectionTimeouts timeouts_;                            // applied to every accepted connection
+    ConnectionLimits limits_;                                // likewise
+    std::shared_ptr<TlsContext> tls_;                        // nullptr for plain tcp
+    TimerWheel::Clock::duration ticketKeyRotation_;
+    TimerWheel::Clock::time_point nextTicketKey_;            // when rotateTicketKeys replaces it
+    TimerWheel timerWheel_;                                  // timeouts of all connections
+    asio::steady_timer tickTimer_;                           // drives timerWheel_
+    std::string metricsPath_;
+    TimerWheel::Clock::duration metricsInterval_;
+    asio::steady_timer metricsTimer_;                        // drives the metrics file
+    std::vector<RequestContext::ActionMetrics> actionMetrics_;   // by action table row
+    std::shared_ptr<trace::Tracer> tracer_;                  // when tracing, outlives requests in flight
+    std::shared_ptr<trace::SlowLog> slowLog_;                // likewise for the slow log
+    std::vector<RequestContext::Clock::duration> slowAfter_; // by action table row
+    ConnectionStats stats_;
+    WorkerPool workers_;                                     // last, joined before the rest goes away
 };
 
 #endif //ENCRYPTEDMESSENGER_TCPSERVER_H
\ No newline at end of file
@@ -0,0 +1,81 @@
+#ifndef ENCRYPTEDMESSENGER_TIMERWHEEL_H
+#define ENCRYPTEDMESSENGER_TIMERWHEEL_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// hierarchical timer wheel shared by all connections of a server
+// kLevels wheels of kSlots slots, level n counts in steps of kSlots^n ticks. A timer sits in
+// the coarsest level that still separates its expiry and is moved down a level each time
+// that level's slot comes round, so scheduling, cancelling and expiring are O(1) and no
+// per-timer heap allocation is made. Not thread-safe, used from the server's io thread only
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t kSlotBits = 6;
+    static constexpr size_t kSlots = size_t(1) << kSlotBits;
+    static constexpr size_t kLevels = 4;
+
+    // intrusive timer, owned by whoever is timed (e.g. a TcpConnection)
+    // must be cancelled before it is destroyed while still scheduled
+    class Timer {
+    public:
+        explicit Timer(std::function<void()> callback = {}) : callback_(std::move(callback)) {}
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+        void setCallback(std::function<void()> callback) { callback_ = std::move(callback); }
+        bool scheduled() const { return wheel_ != nullptr; }
+
+    private:
+        friend class TimerWheel;
+
+        std::function<void()> callback_;
+        TimerWheel* wheel_ = nullptr;   // set while linked into a slot
+        Timer* prev_ = nullptr;
+        Timer* next_ = nullptr;
+        Timer** head_ = nullptr;        // slot the timer is linked into
+        uint64_t expiry_ = 0;           // absolute tick
+    };
+
+    explicit TimerWheel(Clock::duration tick, Clock::time_point start = Clock::now());
+    ~TimerWheel();
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // (re)arm timer to fire after delay, rounded up to whole ticks, at least one tick
+    // delays past the last level are clamped to it
+    void schedule(Timer& timer, Clock::duration delay);
+
+    // unlink timer, no-op if it is not scheduled
+    void cancel(Timer& timer);
+
+    // run every timer due at now, callbacks may schedule or cancel any timer
+    // returns how many fired
+    size_t advance(Clock::time_point now);
+
+    Clock::duration tick() const { return tick_; }
+
+    // number of scheduled timers
+    size_t size() const { return size_; }
+
+private:
+    void insert(Timer& timer);
+    void unlink(Timer& timer);
+
+    // move the timers of one slot of level down to where they belong now
+    void cascade(size_t level);
+
+    Clock::duration tick_;
+    Clock::time_point start_;
+    uint64_t now_ = 0;   // ticks processed so far
+    size_t size_ = 0;
+    std::array<std::array<Timer*, kSlots>, kLevels> slots_{};
+};
+
+#endif //ENCRYPTEDMESSENGER_TIMERWHEEL_H
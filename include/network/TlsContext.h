@@ -0,0 +1,83 @@
+#ifndef ENCRYPTEDMESSENGER_TLSCONTEXT_H
+#define ENCRYPTEDMESSENGER_TLSCONTEXT_H
+
+#include <asio.hpp>
+#include <asio/ssl.hpp>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// TLS settings shared by every connection of a server, or every connection a client makes
+// servers keep resumable sessions in memory: TLS 1.2 session ids in OpenSSL's session cache
+// and TLS 1.3 tickets sealed with ticket keys held here. Clients remember the last session
+// per peer and offer it on the next connect, so reconnects skip the full handshake
+class TlsContext {
+public:
+    enum class Role { Server, Client };
+
+    // PEM certificate (chain) and its private key
+    struct Credentials {
+        std::string certificatePem;
+        std::string privateKeyPem;
+    };
+
+    // self-signed P-256 certificate for commonName, for tests, benchmarks and local setups
+    // throws std::runtime_error if OpenSSL fails
+    static Credentials selfSigned(const std::string& commonName, int days = 365);
+
+    // server side, throws std::runtime_error if the credentials do not load
+    static std::shared_ptr<TlsContext> server(const Credentials& credentials,
+                                              size_t sessionCacheSize = 20000);
+
+    // client side, verifies the server against trustedCertificatePem
+    // or the system store when empty
+    static std::shared_ptr<TlsContext> client(const std::string& trustedCertificatePem = {});
+
+    ~TlsContext();
+
+    TlsContext(const TlsContext&) = delete;
+    TlsContext& operator=(const TlsContext&) = delete;
+
+    asio::ssl::context& context() { return context_; }
+    Role role() const { return role_; }
+
+    // server: new tickets use a fresh key, tickets sealed with the previous key are
+    // still accepted (and replaced) until the next rotation
+    void rotateTicketKeys();
+
+    // client: prepare ssl to resume the last session with peer ("host:port") and to
+    // remember the session the server hands out this time
+    void prepareClient(SSL* ssl, const std::string& peer);
+
+    // client: sessions currently remembered
+    size_t cachedSessions() const;
+
+private:
+    TlsContext(Role role, asio::ssl::context::method method);
+
+    struct TicketKey {
+        std::array<unsigned char, 16> name;
+        std::array<unsigned char, 32> aesKey;
+        std::array<unsigned char, 32> hmacKey;
+    };
+
+    // OpenSSL callbacks, find their TlsContext through the SSL_CTX ex data
+    static int ticketKeyCallback(SSL* ssl, unsigned char* keyName, unsigned char* iv,
+                                 EVP_CIPHER_CTX* cipher, EVP_MAC_CTX* mac, int encrypt);
+    static int newSessionCallback(SSL* ssl, SSL_SESSION* session);
+
+    static TicketKey makeTicketKey();
+
+    Role role_;
+    asio::ssl::context context_;
+
+    mutable std::mutex mutex_;                                 // guards the two below
+    std::vector<TicketKey> ticketKeys_;                        // [0] seals new tickets
+    std::unordered_map<std::string, SSL_SESSION*> sessions_;   // client, one reference each
+};
+
+#endif //ENCRYPTEDMESSENGER_TLSCONTEXT_H
@@ -0,0 +1,53 @@
+#ifndef ENCRYPTEDMESSENGER_WIREFORMAT_H
+#define ENCRYPTEDMESSENGER_WIREFORMAT_H
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <json.hpp>
+#include "network/Request.h"
+
+// encoding of the frames on one connection, json until the client's hello request picks another
+//   json      bare objects, delimited by their braces
+//   msgpack   u32 payload length (little-endian) | MessagePack payload
+//   cbor      u32 payload length (little-endian) | CBOR payload
+// binary encodings carry the message byte fields (ciphertext, iv, tag, wrapped keys) raw
+// instead of base64
+enum class WireFormat {
+    Json,
+    MsgPack,
+    Cbor
+};
+
+namespace wire {
+
+    // length prefix of a binary frame
+    constexpr size_t kFrameHeader = 4;
+
+    // larger binary frames close the connection
+    constexpr size_t kMaxFrame = 16 * 1024 * 1024;
+
+    // "json", "msgpack" or "cbor"
+    std::optional<WireFormat> formatFromName(std::string_view name);
+    const char* formatName(WireFormat format);
+
+    // value as one complete frame, length prefix included
+    std::string encodeFrame(const nlohmann::json& value, WireFormat format);
+
+    // same, appended to out (e.g. a pooled send buffer)
+    void appendFrame(std::string& out, const nlohmann::json& value, WireFormat format);
+
+    // payload of a binary frame (prefix stripped), discarded value if malformed
+    nlohmann::json decodePayload(std::string_view payload, WireFormat format);
+
+    // known request fields of a decoded object, views point into value
+    // false if value is not an object or a known field has the wrong type
+    bool requestFromJson(const nlohmann::json& value, Request& request);
+
+    // base64 byte fields of a stored message -> raw binary, for binary encodings
+    void toBinaryFields(nlohmann::json& message);
+
+}
+
+#endif //ENCRYPTEDMESSENGER_WIREFORMAT_H
@@ -0,0 +1,130 @@
+#ifndef ENCRYPTEDMESSENGER_WORKERPOOL_H
+#define ENCRYPTEDMESSENGER_WORKERPOOL_H
+
+#include <algorithm>
+#include <array>
+#include <asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// bounded pool of worker threads for the blocking parts of a request (RSA, key generation,
+// storage calls that wait on the disk), sized apart from the network threads
+// work runs on a worker, its completion is posted back to the executor it is given
+// (a connection's executor) so replies and connection state stay on the io thread
+// tasks submitted under the same order key run one at a time in submission order (a
+// connection's messages keep their order), tasks under different keys run concurrently
+// a free worker takes the ready task with the lowest priority value, oldest first within
+// one value. strict, so a steady stream of higher priority work holds lower ones back
+class WorkerPool {
+public:
+    static constexpr unsigned kPriorities = 3;
+    static constexpr unsigned kDefaultPriority = 1;
+
+    // counters for monitoring, readable from any thread
+    struct Stats {
+        std::atomic<uint64_t> submitted{0};
+        std::atomic<uint64_t> completed{0};
+        std::atomic<uint64_t> rejected{0};    // queue was full
+        std::atomic<uint64_t> queued{0};      // waiting right now, including behind their order key
+        std::atomic<uint64_t> running{0};
+        std::atomic<uint64_t> peakQueued{0};
+        std::atomic<uint64_t> waitMicros{0};  // time spent queued, summed over completed tasks
+    };
+
+    // threads 0 picks one per hardware thread, maxQueued bounds the tasks waiting for one
+    explicit WorkerPool(size_t threads = 0, size_t maxQueued = 4096);
+
+    // runs the tasks still queued, then joins
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // run work() on a worker and done(result) on resume, done() if work returns void
+    // false if the queue is full, nothing runs then and the caller answers for itself
+    template <typename Work, typename Done>
+    bool submit(Work work, asio::any_io_executor resume, Done done) {
+        return submit(nullptr, std::move(work), std::move(resume), std::move(done));
+    }
+
+    // same, after every earlier task of order (nullptr for no ordering)
+    template <typename Work, typename Done>
+    bool submit(const void* order, Work work, asio::any_io_executor resume, Done done) {
+        return submit(order, kDefaultPriority, std::move(work), std::move(resume), std::move(done));
+    }
+
+    // same, ahead of ready tasks with a higher priority value (clamped to kPriorities - 1)
+    // a task behind its order key becomes ready when the key's earlier task is done
+    template <typename Work, typename Done>
+    bool submit(const void* order, unsigned priority, Work work, asio::any_io_executor resume, Done done) {
+        return submit(order, priority, std::move(work), std::move(resume), std::move(done),
+                      [](const std::string&) {});
+    }
+
+    // same, with failed(what) posted to resume instead of done when work throws, so the
+    // caller hears back either way (the exception is logged by the worker)
+    template <typename Work, typename Done, typename Failed>
+    bool submit(const void* order, unsigned priority, Work work, asio::any_io_executor resume, Done done,
+                Failed failed) {
+        return enqueue(order, std::min(priority, kPriorities - 1),
+                       [work = std::move(work), resume = std::move(resume), done = std::move(done),
+                        failed = std::move(failed)]() mutable {
+            try {
+                if constexpr (std::is_void_v<std::invoke_result_t<Work&>>) {
+                    work();
+                    asio::post(resume, std::move(done));
+                } else {
+                    asio::post(resume, [done = std::move(done), result = work()]() mutable {
+                        done(std::move(result));
+                    });
+                }
+            } catch (const std::exception& e) {
+                asio::post(resume, [failed = std::move(failed), what = std::string(e.what())]() mutable {
+                    failed(what);
+                });
+                throw;
+            }
+        });
+    }
+
+    size_t threads() const { return workers_.size(); }
+    size_t maxQueued() const { return maxQueued_; }
+    const Stats& stats() const { return stats_; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Task {
+        const void* order = nullptr;
+        unsigned priority = kDefaultPriority;
+        std::function<void()> run;
+        Clock::time_point queuedAt;
+    };
+
+    bool enqueue(const void* order, unsigned priority, std::function<void()> task);
+    bool hasReady() const;
+    void run();
+
+    size_t maxQueued_;
+    std::vector<std::thread> workers_;
+    std::array<std::deque<Task>, kPriorities> ready_;             // ready for any worker, by priority
+    std::unordered_map<const void*, std::deque<Task>> ordered_;   // key -> tasks behind its running one
+    size_t pending_ = 0;                                          // queued here or in ordered_
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+    Stats stats_;
+};
+
+#endif //ENCRYPTEDMESSENGER_WORKERPOOL_H
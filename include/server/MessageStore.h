@@ -1,9 +1,287 @@
 #ifndef ENCRYPTEDMESSENGER_MESSAGESTORE_H
 #define ENCRYPTEDMESSENGER_MESSAGESTORE_H
 
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <asio.hpp>
+#include <json.hpp>
+#include "crypto/CryptoManager.h"
+#include "utils/Metrics.h"
+#include "utils/base64.h"
 
+// storage engine interface used by the server for users, keys and conversations
+// backends: FileStorage (data/ directory on disk) and MemoryStorage (process memory only)
 class MessageStore {
-};
+public:
+    // result of an atomic account creation
+    enum class CreateUserResult {
+        Created,
+        AlreadyExists,
+        UserWriteFailed,
+        KeyWriteFailed
+    };
+
+    // one row of a user's conversation list
+    struct ConversationSummary {
+        std::string peer;
+        long lastTimestamp = 0;
+        uint64_t lastSeq = 0;      // messages are numbered from 1 within a conversation
+        uint64_t unread = 0;       // messages after the user's read cursor
+    };
+
+    virtual ~MessageStore() = default;
+
+    // ---------users---------
+
+    // check name is free, store credentials and generate RSA keys as one operation
+    // partially created state is rolled back on failure
+    virtual CreateUserResult createAccount(const std::string& username,
+                                           const std::string& password_hash) = 0;
+
+    // verify username and hashed password
+    virtual bool loginUser(const std::string& username, const std::string& password_hash) = 0;
+
+    // check if username is taken
+    virtual bool userExists(const std::string& username) = 0;
+
+    // remove user, keys and every conversation they are part of
+    virtual bool deleteUser(const std::string& username) = 0;
+
+    // ---------keys---------
+
+    // return public key PEM for user, or empty string on failure
+    virtual std::string getUserPublicKey(const std::string& username) = 0;
+
+    // ---------conversations---------
+
+    // append to conversation shared between 2 users
+    virtual bool appendConversationMessage(
+        const std::string& from,
+        const std::string& to,
+        const CryptoManager::AESEncrypted& ciphertext,
+        const std::string& aesForSender,
+        const std::string& aesForRecipient,
+        long timestamp
+    ) = 0;
+
+    // whole conversation as {"messages": [...]}, or null json if none exists
+    virtual nlohmann::json loadConversation(const std::string& userA, const std::string& userB) = 0;
+
+    // up to limit messages starting at offset as a json array
+    // limit 0 reads to the end, empty array if nothing is in range
+    virtual nlohmann::json loadConversationRange(const std::string& userA,
+                                                 const std::string& userB,
+                                                 size_t offset,
+                                                 size_t limit) = 0;
+
+    // ---------asynchronous conversations---------
+    // handlers are posted to executor, usually the requesting connection's
+    // the defaults run the blocking call inline, backends with real async I/O override them
+
+    using AppendHandler = std::function<void(bool stored)>;
+    using RangeHandler  = std::function<void(nlohmann::json messages)>;
+
+    virtual void appendConversationMessageAsync(
+        const std::string& from,
+        const std::string& to,
+        const CryptoManager::AESEncrypted& ciphertext,
+        const std::string& aesForSender,
+        const std::string& aesForRecipient,
+        long timestamp,
+        asio::any_io_executor executor,
+        AppendHandler handler
+    ) {
+        bool stored = appendConversationMessage(from, to, ciphertext, aesForSender, aesForRecipient, timestamp);
+        asio::post(executor, [handler = std::move(handler), stored] { handler(stored); });
+    }
+
+    virtual void loadConversationRangeAsync(const std::string& userA,
+                                            const std::string& userB,
+                                            size_t offset,
+                                            size_t limit,
+                                            asio::any_io_executor executor,
+                                            RangeHandler handler) {
+        nlohmann::json messages = loadConversationRange(userA, userB, offset, limit);
+        asio::post(executor, [handler = std::move(handler), messages = std::move(messages)]() mutable {
+            handler(std::move(messages));
+        });
+    }
+
+    // users this user has a conversation with
+    virtual std::vector<std::string> listConversations(const std::string& username) = 0;
+
+    // every conversation of user as {"<peer>": [messages...], ...}
+    virtual nlohmann::json exportConversations(const std::string& username) = 0;
+
+    // conversation list with unread counts, newest first
+    // served from in-memory metadata, does not load conversations
+    virtual std::vector<ConversationSummary> listConversationSummaries(const std::string& username) = 0;
 
+    // acknowledge messages up to seq in conversation with peer, clamped to its last message
+    // returns the cursor stored afterwards (never lower than before), nullopt if there is no
+    // such conversation
+    virtual std::optional<uint64_t> markRead(const std::string& username, const std::string& peer, uint64_t seq) = 0;
+
+    // ---------groups---------
+    // membership is stored once per group. Messages are encrypted once, with the key of the
+    // group's current epoch, and that key is wrapped for every member when the epoch starts
+
+    struct GroupInfo {
+        std::vector<std::string> members;
+        uint64_t epoch = 0;        // newest epoch, 0 until the first one starts
+    };
+
+    // store a new group, false if the name is taken
+    virtual bool createGroup(const std::string& group, const std::vector<std::string>& members) = 0;
+
+    // remove the group with its keys and messages, false if there is no such group
+    virtual bool deleteGroup(const std::string& group) = 0;
+
+    // nullopt for an unknown group
+    virtual std::optional<GroupInfo> getGroup(const std::string& group) = 0;
+
+    // record epoch (GroupInfo::epoch + 1) with its key wrapped per member: member -> wrapped key
+    // false for an unknown group or when epoch is not the next one
+    virtual bool startGroupEpoch(const std::string& group,
+                                 uint64_t epoch,
+                                 const std::unordered_map<std::string, std::string>& wrappedKeys) = 0;
+
+    // member's wrapped key of every epoch they were part of, epoch -> wrapped key
+    virtual std::map<uint64_t, std::string> groupKeys(const std::string& group, const std::string& member) = 0;
+
+    // append a message encrypted under epoch's key
+    // returns the stored record (with its seq), null json on failure
+    virtual nlohmann::json appendGroupMessage(const std::string& group,
+                                              const std::string& from,
+                                              uint64_t epoch,
+                                              const CryptoManager::AESEncrypted& ciphertext,
+                                              long timestamp) = 0;
+
+    // like loadConversationRange
+    virtual nlohmann::json loadGroupMessages(const std::string& group, size_t offset, size_t limit) = 0;
+
+    // record as returned by appendGroupMessage, posted to executor
+    using GroupAppendHandler = std::function<void(nlohmann::json record)>;
+
+    virtual void appendGroupMessageAsync(const std::string& group,
+                                         const std::string& from,
+                                         uint64_t epoch,
+                                         const CryptoManager::AESEncrypted& ciphertext,
+                                         long timestamp,
+                                         asio::any_io_executor executor,
+                                         GroupAppendHandler handler) {
+        nlohmann::json record = appendGroupMessage(group, from, epoch, ciphertext, timestamp);
+        asio::post(executor, [handler = std::move(handler), record = std::move(record)]() mutable {
+            handler(std::move(record));
+        });
+    }
+
+    // latency of storage calls by operation, recorded by the server around the calls it makes
+    static metrics::Histogram& callLatency(std::string_view op) {
+        return metrics::Registry::global().histogram(
+            "messenger_storage_seconds", "Storage engine call latency, by operation",
+            "op=\"" + std::string(op) + "\"");
+    }
+
+    // conversation id shared by both users, always alphabetical: userA_userB with both names
+    // escaped, so no two pairs share an id and it is usable as a folder name
+    static std::string conversationKey(const std::string& userA, const std::string& userB) {
+        return (userA < userB) ? (escapeName(userA) + "_" + escapeName(userB))
+                               : (escapeName(userB) + "_" + escapeName(userA));
+    }
+
+    // bytes other than a-z, 0-9, '-' and '.' as %XX: '_' is left to the separator, '/' and
+    // friends never reach a path, and names differing in case differ on any filesystem
+    static std::string escapeName(const std::string& name) {
+        static constexpr char kHex[] = "0123456789ABCDEF";
+        std::string out;
+        out.reserve(name.size());
+        for (unsigned char c : name) {
+            if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '.') {
+                out.push_back(static_cast<char>(c));
+            } else {
+                out.push_back('%');
+                out.push_back(kHex[c >> 4]);
+                out.push_back(kHex[c & 0xF]);
+            }
+        }
+        return out;
+    }
+
+protected:
+    // newest first, shared by backends when building conversation lists
+    static void sortSummaries(std::vector<ConversationSummary>& summaries) {
+        std::sort(summaries.begin(), summaries.end(),
+                  [](const ConversationSummary& a, const ConversationSummary& b) {
+                      return a.lastTimestamp != b.lastTimestamp
+                          ? a.lastTimestamp > b.lastTimestamp
+                          : a.peer < b.peer;
+                  });
+    }
+
+    // copy of messages[offset, offset + limit), limit 0 reads to the end
+    static nlohmann::json sliceMessages(const nlohmann::json& messages, size_t offset, size_t limit) {
+        nlohmann::json range = nlohmann::json::array();
+        if (!messages.is_array() || offset >= messages.size()) {
+            return range;
+        }
+
+        size_t end = (limit == 0) ? messages.size() : offset + std::min(limit, messages.size() - offset);
+        for (size_t i = offset; i < end; ++i) {
+            range.push_back(messages[i]);
+        }
+        return range;
+    }
+
+    // stored message record, identical for every backend
+    static nlohmann::json makeMessageEntry(
+        uint64_t seq,
+        const std::string& from,
+        const std::string& to,
+        const CryptoManager::AESEncrypted& ciphertext,
+        const std::string& aesForSender,
+        const std::string& aesForRecipient,
+        long timestamp
+    ) {
+        nlohmann::json entry;
+        entry["seq"]               = seq;
+        entry["from"]              = from;
+        entry["to"]                = to;
+        entry["timestamp"]         = timestamp;
+        entry["ciphertext"]        = base64::encode(ciphertext.ciphertext);
+        entry["iv"]                = base64::encode(ciphertext.iv);
+        entry["tag"]               = base64::encode(ciphertext.tag);
+        entry["aes_for_sender"]    = base64::encode(aesForSender);
+        entry["aes_for_recipient"] = base64::encode(aesForRecipient);
+        return entry;
+    }
+
+    // stored group message record, the key is found through its epoch
+    static nlohmann::json makeGroupMessageEntry(
+        uint64_t seq,
+        const std::string& group,
+        const std::string& from,
+        uint64_t epoch,
+        const CryptoManager::AESEncrypted& ciphertext,
+        long timestamp
+    ) {
+        nlohmann::json entry;
+        entry["seq"]        = seq;
+        entry["group"]      = group;
+        entry["from"]       = from;
+        entry["epoch"]      = epoch;
+        entry["timestamp"]  = timestamp;
+        entry["ciphertext"] = base64::encode(ciphertext.ciphertext);
+        entry["iv"]         = base64::encode(ciphertext.iv);
+        entry["tag"]        = base64::encode(ciphertext.tag);
+        return entry;
+    }
+};
 
-#endif //ENCRYPTEDMESSENGER_MESSAGESTORE_H
\ No newline at end of file
+#endif //ENCRYPTEDMESSENGER_MESSAGESTORE_H
@@ -1,9 +1,44 @@
 #ifndef ENCRYPTEDMESSENGER_SERVER_H
 #define ENCRYPTEDMESSENGER_SERVER_H
 
+#include <asio.hpp>
+#include <memory>
+#include "network/tcpServer.h"
+#include "server/MessageStore.h"
 
+// the messenger server process: the io thread, the storage engine and the listeners and
+// workers of the TcpServer built on them. Sessions live in the TcpServer for as long as
+// the Server runs, across the connections of their users
 class Server {
+public:
+    struct Options {
+        unsigned short port = 5555;
+        ServerOptions network;
+    };
+
+    // serves storage on options.port (and options.network.localPath when set)
+    Server(Options options, std::unique_ptr<MessageStore> storage);
+
+    // uses FileStorage under data/ as the storage engine
+    explicit Server(Options options);
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    // runs the io thread on the caller until stop() or SIGINT / SIGTERM
+    void run();
+
+    // any thread
+    void stop();
+
+    TcpServer& network() { return *network_; }
+    asio::io_context& io() { return io_; }
+
+private:
+    asio::io_context io_;
+    asio::signal_set signals_;
+    std::unique_ptr<TcpServer> network_;
 };
 
 
-#endif //ENCRYPTEDMESSENGER_SERVER_H
\ No newline at end of file
+#endif //ENCRYPTEDMESSENGER_SERVER_H
@@ -1,9 +1,101 @@
 #ifndef ENCRYPTEDMESSENGER_SESSION_H
 #define ENCRYPTEDMESSENGER_SESSION_H
 
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "crypto/CryptoManager.h"
+#include "network/RateLimiter.h"
 
+class TcpConnection;
+
+// protocol state of one logged in user, kept apart from the sockets it is used over
+// the server keeps one session per username while a connection is logged in as it and for a
+// linger period after the last one closed, so a reconnect finds its key cache, read cursors
+// and rate limit state again instead of starting from storage and full buckets
+// connections and cursors belong to the server's io thread, the key cache is also used by
+// workers and has its own lock
 class Session {
+public:
+    using pointer = std::shared_ptr<Session>;
+    using Clock = std::chrono::steady_clock;
+
+    // public keys kept per session, a user rarely talks to more peers than this
+    // past it the least recently used key makes room
+    static constexpr size_t kMaxCachedKeys = 256;
+
+    Session(std::string username, std::shared_ptr<RateLimiter::Buckets> rateBuckets);
+
+    const std::string& username() const { return username_; }
+
+    // rate limit buckets of the user, shared by all of its connections
+    RateLimiter::Buckets* rateBuckets() { return rateBuckets_.get(); }
+
+    // ---------connections---------
+    // the logged in connections are the session's subscriptions, deliveries for the user
+    // are pushed to each of them
+
+    void attach(const std::shared_ptr<TcpConnection>& connection);
+
+    // true when connection was the last one, the session lingers from then on
+    bool detach(const TcpConnection* connection);
+
+    const std::vector<std::shared_ptr<TcpConnection>>& connections() const { return connections_; }
+
+    // when the last connection went away, meaningless while one is attached
+    Clock::time_point detachedAt() const { return detachedAt_; }
+
+    // ---------keys---------
+
+    // parsed public key of user, from the PEM load(user) returns the first time and from the
+    // cache after that. keys are never replaced while a username exists
+    // nullptr when there is no key or it does not parse, which is not cached
+    template <typename Load>
+    CryptoManager::PublicKey publicKey(const std::string& user, Load load) {
+        if (CryptoManager::PublicKey cached = cachedKey(user)) {
+            return cached;
+        }
+        // loading and parsing run unlocked, two workers may both do it for the same user
+        CryptoManager::PublicKey key = CryptoManager::loadPublicKey(load(user));
+        if (key) {
+            cacheKey(user, key);
+        }
+        return key;
+    }
+
+    // keys cached right now
+    size_t cachedKeys() const;
+
+    // ---------cursors---------
+
+    // highest read cursor stored for the conversation with peer through this session, 0 if
+    // none. Stored cursors never move back, so a mark_read at or below it changes nothing
+    uint64_t readCursor(const std::string& peer) const;
+    void setReadCursor(const std::string& peer, uint64_t seq);
+
+private:
+    using KeyOrder = std::list<std::pair<std::string, CryptoManager::PublicKey>>;
+
+    // cached key of user made the most recently used one, nullptr if none
+    CryptoManager::PublicKey cachedKey(const std::string& user);
+    void cacheKey(const std::string& user, CryptoManager::PublicKey key);
+
+    std::string username_;
+    std::shared_ptr<RateLimiter::Buckets> rateBuckets_;
+    std::vector<std::shared_ptr<TcpConnection>> connections_;
+    Clock::time_point detachedAt_{};
+
+    mutable std::mutex keysMutex_;                                    // guards the two below
+    KeyOrder keyOrder_;                                               // most recently used first
+    std::unordered_map<std::string, KeyOrder::iterator> keys_;        // username -> its entry
+
+    std::unordered_map<std::string, uint64_t> readCursors_; // peer -> seq
 };
 
 
-#endif //ENCRYPTEDMESSENGER_SESSION_H
\ No newline at end of file
+#endif //ENCRYPTEDMESSENGER_SESSION_H
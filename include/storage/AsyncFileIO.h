@@ -0,0 +1,92 @@
+#ifndef ENCRYPTEDMESSENGER_ASYNCFILEIO_H
+#define ENCRYPTEDMESSENGER_ASYNCFILEIO_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+// asynchronous whole-file reads, replacing writes, appends and fsyncs
+// runs on io_uring on linux when the kernel allows it, otherwise on a small thread pool
+// operations on the same path run in submission order, different paths run concurrently
+// handlers are invoked on an internal I/O thread, callers post them where they need them
+class AsyncFileIO {
+public:
+    using ReadHandler  = std::function<void(std::error_code ec, std::string data)>;
+    using WriteHandler = std::function<void(std::error_code ec)>;
+
+    enum class Backend {
+        ThreadPool,
+        IoUring
+    };
+
+    // threads is the size of the fallback pool, preferIoUring false forces the pool
+    explicit AsyncFileIO(size_t threads = 2, bool preferIoUring = true);
+    ~AsyncFileIO();
+
+    AsyncFileIO(const AsyncFileIO&) = delete;
+    AsyncFileIO& operator=(const AsyncFileIO&) = delete;
+
+    // read whole file, no_such_file_or_directory if it does not exist
+    void readFile(const std::string& path, ReadHandler handler);
+
+    // replace file contents atomically (temp file + rename), if sync the file is fsynced
+    // before the rename and its directory after it, so the new contents survive a crash
+    // a queued replace of the same path that has not started yet is superseded
+    void writeFile(const std::string& path, std::string data, bool sync, WriteHandler handler);
+
+    // append to file, creating it if missing, fsync after if sync
+    void appendFile(const std::string& path, std::string data, bool sync, WriteHandler handler);
+
+    // block until every submitted operation has completed
+    void drain();
+
+    Backend backend() const { return backend_; }
+
+    // ---------engine plumbing---------
+
+    enum class OpKind {
+        Read,
+        Replace,
+        Append
+    };
+
+    // one queued operation, handlers of coalesced replaces are merged
+    struct Op {
+        OpKind kind;
+        std::string path;
+        std::string data;           // bytes to write, or bytes read
+        bool sync = false;
+        bool started = false;
+        ReadHandler onRead;
+        std::vector<WriteHandler> onWrite;
+    };
+
+    // executes operations, calls AsyncFileIO::complete when done
+    class Engine {
+    public:
+        virtual ~Engine() = default;
+        virtual void start(const std::shared_ptr<Op>& op) = 0;
+    };
+
+    // called by engines when an operation finishes
+    void complete(const std::shared_ptr<Op>& op, std::error_code ec);
+
+private:
+    void submit(std::shared_ptr<Op> op);
+
+    Backend backend_ = Backend::ThreadPool;
+    std::unique_ptr<Engine> engine_;
+
+    std::mutex mutex_;
+    std::condition_variable idle_;
+    std::unordered_map<std::string, std::deque<std::shared_ptr<Op>>> queues_;  // path -> ops, head in flight
+    size_t outstanding_ = 0;
+};
+
+#endif //ENCRYPTEDMESSENGER_ASYNCFILEIO_H
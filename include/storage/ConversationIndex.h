@@ -0,0 +1,83 @@
+#ifndef ENCRYPTEDMESSENGER_CONVERSATIONINDEX_H
+#define ENCRYPTEDMESSENGER_CONVERSATIONINDEX_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include "storage/SnapshotTable.h"
+
+// persisted user -> conversation partners map plus per-conversation metadata
+// (last sequence, last timestamp, read cursor of each member)
+// backed by two SnapshotTables in data/messages/index, both usable straight after mapping
+// (own directory so opening never lists the conversation folders, whose names always contain '_'):
+//   conversations.*   pair key (u32 len | first | second) -> u64 lastSeq | i64 lastTimestamp | u64 read of first | u64 read of second
+//   peers.*           username -> (u32 len | peer name)*
+// "first" is the alphabetically smaller member, integers are little-endian
+// not thread-safe, FileStorage calls it under its file mutex
+class ConversationIndex {
+public:
+    struct Meta {
+        uint64_t lastSeq = 0;
+        long lastTimestamp = 0;
+    };
+
+    explicit ConversationIndex(std::string messagesDir);
+
+    // map both tables, on first start move folders to their escaped names
+    // (MessageStore::conversationKey), then scan messagesDir/*/conversation.json
+    bool open();
+
+    // route table writes through writer (not owned)
+    void setWriter(SnapshotTable::Writer* writer);
+
+    // record newest message of a pair, registers the pair on its first message
+    // and moves the sender's read cursor up to seq
+    bool recordMessage(const std::string& from, const std::string& to, uint64_t seq, long timestamp);
+
+    // advance user's read cursor in conversation with peer, never moves backwards
+    // returns the cursor afterwards, nullopt if the pair is unknown
+    std::optional<uint64_t> markRead(const std::string& username, const std::string& peer, uint64_t seq);
+
+    // forget every pair involving user, returns their partners
+    std::vector<std::string> removeUser(const std::string& username);
+
+    // conversation partners of user, empty if none
+    std::vector<std::string> peersOf(const std::string& username) const;
+
+    bool contains(const std::string& userA, const std::string& userB) const;
+
+    // metadata for pair, nullopt if no conversation
+    std::optional<Meta> meta(const std::string& userA, const std::string& userB) const;
+
+    // highest sequence username has acknowledged in conversation with peer
+    uint64_t readSeq(const std::string& username, const std::string& peer) const;
+
+private:
+    // stored pair record, reads are indexed by alphabetical position
+    struct Record {
+        Meta meta;
+        uint64_t read[2] = {0, 0};
+    };
+
+    std::optional<Record> loadRecord(const std::string& userA, const std::string& userB) const;
+    void storeRecord(const std::string& userA, const std::string& userB, const Record& record);
+    void addPeer(const std::string& username, const std::string& peer);
+    void removePeer(const std::string& username, const std::string& peer);
+    void applyMessage(const std::string& from, const std::string& to, uint64_t seq, long timestamp);
+
+    void migrateFolders();
+    void rebuildFromConversations();
+
+    static std::string pairKey(const std::string& userA, const std::string& userB);
+    static std::string encodeRecord(const Record& record);
+    static std::optional<Record> decodeRecord(const std::string& value);
+    static std::vector<std::string> decodePeers(const std::string& value);
+    static std::string encodePeers(const std::vector<std::string>& peers);
+
+    std::string messagesDir_;
+    SnapshotTable pairs_;      // pair key -> Record
+    SnapshotTable peers_;      // username -> partner names
+};
+
+#endif //ENCRYPTEDMESSENGER_CONVERSATIONINDEX_H
@@ -3,34 +3,55 @@
 
 #include <string>
 #include <json.hpp>
+#include <list>
+#include <memory>
 #include <mutex>
 #include <fstream>
+#include <unordered_map>
 #include "crypto/CryptoManager.h"
-
-// manages user data stored in data/users.json
+#include "server/MessageStore.h"
+#include "storage/KeyStore.h"
+#include "storage/ConversationIndex.h"
+#include "storage/SnapshotTable.h"
+#include "storage/AsyncFileIO.h"
+
+// manages users, keys and conversations under data/
+// users, keys and the conversation index are SnapshotTables: mapped at startup, changes logged
 // provides thread-safe account creation and validation
-class FileStorage {
+// conversation reads and writes go through AsyncFileIO, recently used and
+// not yet written conversations are kept in memory so reads never see stale files
+class FileStorage : public MessageStore {
 public:
+    // paths from USERS_PATH, KEY_PATH and MESSAGE_PATH
     FileStorage();
 
+    // user table, keys/ and messages/ under dataDir, used by benchmarks and tests
+    explicit FileStorage(const std::string& dataDir, bool preferIoUring = true);
+
+    ~FileStorage() override;
+
+    // check, create and generate keys under one lock, rolls back on failure
+    CreateUserResult createAccount(const std::string& username,
+                                   const std::string& password_hash) override;
+
     // wrapper for createUser atomic operation
     bool createUser(const std::string &username, const std::string &password_hash);
 
     // add new user, returns true if created successfully, false if username exists
     bool createUser_NoLock(const std::string& username, const std::string& password_hash);
 
-    // make keys for encryption on account creation
-    bool createUserKeyFiles_NoLock(const std::string& username);
+    // make keys for encryption on account creation, stored in the key table under data/keys
+    bool createUserKeys_NoLock(const std::string& username);
 
-    // verify username and hashed password against users.json data
-    bool loginUser(const std::string& username, const std::string& password_hash);
+    // verify username and hashed password against the user table
+    bool loginUser(const std::string& username, const std::string& password_hash) override;
 
     // return public key PEM for user, or empty string on failure
-    std::string getUserPublicKey(const std::string& username);
+    std::string getUserPublicKey(const std::string& username) override;
 
     // check if username is taken
     bool userExists_NoLock(const std::string &username);
-    bool userExists(const std::string & username);
+    bool userExists(const std::string & username) override;
 
     // append to message json shared between 2 users
     bool appendConversationMessage(
@@ -40,35 +61,176 @@ public:
     const std::string& aesForSender,
     const std::string& aesForRecipient,
     long timestamp
-    );
-
-    // write users.json data to storage
+    ) override;
+
+    // same as above without blocking the caller, the file is written and fsynced off-thread
+    void appendConversationMessageAsync(
+        const std::string& from,
+        const std::string& to,
+        const CryptoManager::AESEncrypted& ciphertext,
+        const std::string& aesForSender,
+        const std::string& aesForRecipient,
+        long timestamp,
+        asio::any_io_executor executor,
+        AppendHandler handler
+    ) override;
+
+    // served from the conversation cache, a miss is read asynchronously
+    void loadConversationRangeAsync(const std::string& userA,
+                                    const std::string& userB,
+                                    size_t offset,
+                                    size_t limit,
+                                    asio::any_io_executor executor,
+                                    RangeHandler handler) override;
+
+    // snapshot the user table now and fsync it. Changes are in its log already, but log
+    // appends are not fsynced and a crash may lose the latest ones
     bool saveUser_NoLock();
     bool saveUser();
 
     // danger
-    bool deleteUserJson_NoLock(const std::string& username);
+    bool deleteUserRecord_NoLock(const std::string& username);
     bool deleteUserKeys_NoLock(const std::string& username);
     bool deleteUserConversations_NoLock(const std::string& username);
-    bool deleteUser(const std::string &username);
+    // true while a conversation of username is being loaded or written
+    bool conversationsBusy_NoLock(const std::string& username) const;
+    bool deleteUser(const std::string &username) override;
 
     // get message json shared between 2 users
-    nlohmann::json loadConversation(const std::string &userA, const std::string &userB);
+    nlohmann::json loadConversation(const std::string &userA, const std::string &userB) override;
+
+    // slice of the messages array, see MessageStore
+    nlohmann::json loadConversationRange(const std::string& userA,
+                                         const std::string& userB,
+                                         size_t offset,
+                                         size_t limit) override;
+
+    // answered from the conversation index, no directory scans
+    std::vector<std::string> listConversations(const std::string& username) override;
+    nlohmann::json exportConversations(const std::string& username) override;
+    std::vector<ConversationSummary> listConversationSummaries(const std::string& username) override;
+    std::optional<uint64_t> markRead(const std::string& username, const std::string& peer, uint64_t seq) override;
+
+    // groups live under messages/groups/<escaped group>/: group.json holds members and wrapped epoch
+    // keys, conversation.json the messages (cached and written like a conversation)
+    bool createGroup(const std::string& group, const std::vector<std::string>& members) override;
+    bool deleteGroup(const std::string& group) override;
+    std::optional<GroupInfo> getGroup(const std::string& group) override;
+    bool startGroupEpoch(const std::string& group,
+                         uint64_t epoch,
+                         const std::unordered_map<std::string, std::string>& wrappedKeys) override;
+    std::map<uint64_t, std::string> groupKeys(const std::string& group, const std::string& member) override;
+    nlohmann::json appendGroupMessage(const std::string& group,
+                                      const std::string& from,
+                                      uint64_t epoch,
+                                      const CryptoManager::AESEncrypted& ciphertext,
+                                      long timestamp) override;
+    void appendGroupMessageAsync(const std::string& group,
+                                 const std::string& from,
+                                 uint64_t epoch,
+                                 const CryptoManager::AESEncrypted& ciphertext,
+                                 long timestamp,
+                                 asio::any_io_executor executor,
+                                 GroupAppendHandler handler) override;
+    nlohmann::json loadGroupMessages(const std::string& group, size_t offset, size_t limit) override;
 
     // allow tcpServer to access mutex
     std::mutex& mutex() { return file_mutex_; }
 
+    // io_uring or thread pool, for logs and benchmarks
+    AsyncFileIO::Backend ioBackend() const { return io_.backend(); }
+
 private:
+    FileStorage(std::string usersPath, std::string keyDir, std::string messageDir, bool preferIoUring);
+
+    // table files are written through io_, snapshots are fsynced
+    class TableWriter : public SnapshotTable::Writer {
+    public:
+        explicit TableWriter(AsyncFileIO& io) : io_(io) {}
+        void append(const std::string& path, std::string bytes) override;
+        void replace(const std::string& path, std::string bytes, std::function<void(bool ok)> done) override;
+
+    private:
+        AsyncFileIO& io_;
+    };
+
+    // in-memory copy of one conversation.json
+    struct CachedConversation {
+        bool loaded = false;        // false while the file is being read
+        bool exists = false;        // file existed or a message was appended
+        nlohmann::json document = nlohmann::json::object({{"messages", nlohmann::json::array()}});
+        size_t pendingWrites = 0;   // never evicted while > 0
+        std::vector<std::function<void()>> waiters;  // run under file_mutex_ once loaded
+        std::list<std::string>::iterator lruPos;
+    };
+    using ConversationPtr = std::shared_ptr<CachedConversation>;
+
+    // run fn under file_mutex_ once the conversation is in memory
+    // inline if cached, otherwise after an asynchronous read, caller holds file_mutex_
+    void withConversation_NoLock(const std::string& key, std::function<void(const ConversationPtr&)> fn);
+
+    // serialize, replace the file and call done(ok) from the I/O thread
+    void appendConversation_NoLock(const std::string& from,
+                                   const std::string& to,
+                                   nlohmann::json message,
+                                   long timestamp,
+                                   std::function<void(bool)> done);
+
+    // number message, append it to the cached document of key and replace its file
+    // appended(stored) runs under file_mutex_ once numbered, done(ok) from the I/O thread
+    void appendMessage_NoLock(const std::string& key,
+                              nlohmann::json message,
+                              std::function<void(const nlohmann::json&)> appended,
+                              std::function<void(bool)> done);
+
+    // in-memory copy of one group.json
+    struct GroupRecord {
+        std::vector<std::string> members;
+        std::vector<std::unordered_map<std::string, std::string>> epochs;   // [epoch - 1]: member -> key
+    };
+
+    // cached or read from group.json, nullptr for an unknown group
+    GroupRecord* loadGroup_NoLock(const std::string& group);
+    // queue group.json for writing, done(ok) from the I/O thread
+    void writeGroup_NoLock(const std::string& group, const GroupRecord& record, std::function<void(bool)> done);
+    // conversation cache key and folder of a group, below messages/
+    // escaped like pair keys, so names differing only in case get their own folder on NTFS too
+    static std::string groupKey(const std::string& group) { return "groups/" + escapeName(group); }
+
+    // drop least recently used conversations that have no writes in flight
+    void evictConversations_NoLock();
+
+    std::string conversationFile(const std::string& key) const;
+
     // if data, keys, and messages directories are missing
     void initializeDirectories();
-    // load users.json data into memory
+    // map the user table, importing users.json left by older versions
     bool loadUser();
+    bool importUsersJson_NoLock();
+    // read conversation.json for a pair, caller holds file_mutex_
+    nlohmann::json loadConversation_NoLock(const std::string& userA, const std::string& userB);
+    // same for any folder below messages/, cached copy first
+    nlohmann::json loadDocument_NoLock(const std::string& folderName);
 
 private:
-    // hardcoded path to user account file
-    std::string userFilePath_ = USERS_PATH;
-    nlohmann::json data_;      // in-memory cache of user credentials
+    // legacy user account file and data directories
+    std::string userFilePath_;
+    std::string keyDir_;
+    std::string messageDir_;
+    SnapshotTable users_;      // username -> password hash
+    KeyStore keyStore_;        // DER keypairs for every user, one mapped file
+    ConversationIndex conversationIndex_;  // user -> partners, per-conversation metadata
     std::mutex file_mutex_;    // thread-safe access control for reads/writes
+
+    static constexpr size_t kConversationCacheSize = 256;
+    std::unordered_map<std::string, ConversationPtr> conversationCache_;  // conversation key -> contents
+    std::list<std::string> conversationLru_;                              // most recently used first
+    std::unordered_map<std::string, GroupRecord> groups_;                 // group name -> members, keys
+
+    // declared last: destroyed first, drains writes while the members above are alive
+    // (the table writer only forwards to io_ and holds no state)
+    AsyncFileIO io_;
+    TableWriter tableWriter_{io_};
 };
 
 #endif //ENCRYPTEDMESSENGER_FILESTORAGE_H
\ No newline at end of file
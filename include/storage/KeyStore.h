@@ -0,0 +1,53 @@
+#ifndef ENCRYPTEDMESSENGER_KEYSTORE_H
+#define ENCRYPTEDMESSENGER_KEYSTORE_H
+
+#include <cstdint>
+#include <string>
+#include <shared_mutex>
+#include "crypto/CryptoManager.h"
+#include "storage/SnapshotTable.h"
+
+// every user's RSA keypair as DER in one SnapshotTable (keys.snap.* / keys.log.* in the key dir)
+// replaces the per-user data/keys/<name>/{public,private}.pem layout, imported on start
+//
+// value layout: u32 pubLen | pub DER | priv DER (little-endian)
+// opening maps the snapshot, lookups probe it in place
+class KeyStore {
+public:
+    explicit KeyStore(std::string dir);
+
+    // map the key table
+    bool open();
+
+    // store keypair given as PEM, replaces any existing entry
+    bool put(const std::string& username, const CryptoManager::RSAKeyPair& keys);
+
+    // drop keys for user, true if nothing is left for them
+    bool remove(const std::string& username);
+
+    bool contains(const std::string& username) const;
+
+    // PEM for user, or empty string if unknown
+    std::string publicKeyPem(const std::string& username) const;
+    std::string privateKeyPem(const std::string& username) const;
+
+    // import data/keys/<name>/{public,private}.pem directories not yet in the store
+    // imported directories are removed once the table is fsynced, returns number of users imported
+    size_t importPemDirectory(const std::string& keyDir);
+
+    // number of users with keys
+    size_t size() const;
+
+    // route table writes through writer (not owned)
+    void setWriter(SnapshotTable::Writer* writer);
+
+private:
+    // DER halves of a stored value, false if it is malformed
+    static bool splitValue(const std::string& value, std::string& pubDer, std::string& privDer);
+
+    std::string dir_;
+    SnapshotTable table_;                // username -> keypair
+    mutable std::shared_mutex mutex_;    // lookups shared, changes exclusive
+};
+
+#endif //ENCRYPTEDMESSENGER_KEYSTORE_H
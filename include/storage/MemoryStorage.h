@@ -0,0 +1,79 @@
+#ifndef ENCRYPTEDMESSENGER_MEMORYSTORAGE_H
+#define ENCRYPTEDMESSENGER_MEMORYSTORAGE_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include <json.hpp>
+#include "crypto/CryptoManager.h"
+#include "server/MessageStore.h"
+
+// storage engine that keeps users, keys and conversations in process memory
+// nothing touches disk, used for load tests and benchmarks of the network and crypto layers
+class MemoryStorage : public MessageStore {
+public:
+    MemoryStorage() = default;
+
+    CreateUserResult createAccount(const std::string& username,
+                                   const std::string& password_hash) override;
+    bool loginUser(const std::string& username, const std::string& password_hash) override;
+    bool userExists(const std::string& username) override;
+    bool deleteUser(const std::string& username) override;
+
+    std::string getUserPublicKey(const std::string& username) override;
+
+    bool appendConversationMessage(
+        const std::string& from,
+        const std::string& to,
+        const CryptoManager::AESEncrypted& ciphertext,
+        const std::string& aesForSender,
+        const std::string& aesForRecipient,
+        long timestamp
+    ) override;
+
+    nlohmann::json loadConversation(const std::string& userA, const std::string& userB) override;
+    nlohmann::json loadConversationRange(const std::string& userA,
+                                         const std::string& userB,
+                                         size_t offset,
+                                         size_t limit) override;
+
+    std::vector<std::string> listConversations(const std::string& username) override;
+    nlohmann::json exportConversations(const std::string& username) override;
+    std::vector<ConversationSummary> listConversationSummaries(const std::string& username) override;
+    std::optional<uint64_t> markRead(const std::string& username, const std::string& peer, uint64_t seq) override;
+
+    bool createGroup(const std::string& group, const std::vector<std::string>& members) override;
+    bool deleteGroup(const std::string& group) override;
+    std::optional<GroupInfo> getGroup(const std::string& group) override;
+    bool startGroupEpoch(const std::string& group,
+                         uint64_t epoch,
+                         const std::unordered_map<std::string, std::string>& wrappedKeys) override;
+    std::map<uint64_t, std::string> groupKeys(const std::string& group, const std::string& member) override;
+    nlohmann::json appendGroupMessage(const std::string& group,
+                                      const std::string& from,
+                                      uint64_t epoch,
+                                      const CryptoManager::AESEncrypted& ciphertext,
+                                      long timestamp) override;
+    nlohmann::json loadGroupMessages(const std::string& group, size_t offset, size_t limit) override;
+
+private:
+    struct UserRecord {
+        std::string passwordHash;
+        CryptoManager::RSAKeyPair keys;
+    };
+
+    struct GroupRecord {
+        std::vector<std::string> members;
+        std::vector<std::unordered_map<std::string, std::string>> epochs;   // [epoch - 1]: member -> key
+        std::vector<nlohmann::json> messages;
+    };
+
+    std::unordered_map<std::string, UserRecord> users_;                           // username -> record
+    std::unordered_map<std::string, std::vector<nlohmann::json>> conversations_;  // conversationKey -> messages
+    std::unordered_map<std::string, std::unordered_map<std::string, uint64_t>> peers_; // user -> partner -> read seq
+    std::unordered_map<std::string, GroupRecord> groups_;                         // group name -> record
+    std::mutex mutex_;
+};
+
+#endif //ENCRYPTEDMESSENGER_MEMORYSTORAGE_H
@@ -0,0 +1,113 @@
+#ifndef ENCRYPTEDMESSENGER_SNAPSHOTTABLE_H
+#define ENCRYPTEDMESSENGER_SNAPSHOTTABLE_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "utils/MappedFile.h"
+
+// persistent string -> bytes table for state needed at startup (users, keys, conversation metadata)
+// an immutable open-addressing hash table snapshot is memory-mapped and probed in place,
+// changes since the snapshot are appended to a log and kept in an in-memory overlay,
+// so opening costs one mmap plus a bounded log tail, not a pass over every entry
+//
+// files in dir:
+//   <name>.snap.<gen>   every change made before log generation <gen>
+//   <name>.log.<gen>    changes made after it, logs are replayed in generation order
+// not thread-safe, owners lock around it
+class SnapshotTable {
+public:
+    // destination of file writes, without one writes are synchronous
+    class Writer {
+    public:
+        virtual ~Writer() = default;
+
+        // append bytes to the file at path, creating it if missing, without fsync
+        virtual void append(const std::string& path, std::string bytes) = 0;
+
+        // durably replace the file at path (temp file, fsync, rename), then call done
+        virtual void replace(const std::string& path, std::string bytes, std::function<void(bool ok)> done) = 0;
+    };
+
+    SnapshotTable(std::string dir, std::string name);
+
+    // route writes through writer (not owned), nullptr restores synchronous writes
+    void setWriter(Writer* writer) { writer_ = writer; }
+
+    // map the newest snapshot and replay the logs after it, torn log tails are truncated
+    bool open();
+
+    std::optional<std::string> get(std::string_view key) const;
+    bool contains(std::string_view key) const;
+
+    // both append one log record, and compact when the overlay has grown large
+    void put(const std::string& key, std::string value);
+    void erase(const std::string& key);
+
+    // live entries
+    size_t size() const { return size_; }
+
+    // true if nothing was found on disk by open()
+    bool fresh() const { return fresh_; }
+
+    // visit every live entry, order unspecified
+    void forEach(const std::function<void(std::string_view key, std::string_view value)>& fn) const;
+
+    // write the whole table as a new snapshot and start a new log generation
+    void compact();
+
+    // same, but the snapshot is written and fsynced before returning, together with its
+    // directory. Log appends are not fsynced: call this before dropping another copy of data
+    // that was just put
+    bool persist();
+
+    // durably replace the file at path: temp file, fsync, rename, then fsync its directory
+    static bool syncReplace(const std::string& path, const std::string& bytes);
+
+    // fsync a directory so entries created or renamed in it survive a crash (no-op on Windows)
+    static bool syncDirectory(const std::string& dir);
+
+private:
+    void maybeCompact();
+    // serve from a snapshot image of the current entries, returns its generation
+    uint64_t buildSnapshot();
+    bool mapSnapshot(uint64_t gen);
+    bool replayLog(uint64_t gen);
+    void appendRecord(uint8_t op, const std::string& key, const std::string& value);
+    void applyPut(const std::string& key, std::string value);
+    void applyErase(const std::string& key);
+    std::optional<std::string_view> findInBase(std::string_view key) const;
+    std::string snapPath(uint64_t gen) const;
+    std::string logPath(uint64_t gen) const;
+
+    // remove snapshots and logs older than gen once a snapshot of gen is on disk
+    static void removeOlder(const std::string& dir, const std::string& name, uint64_t gen);
+
+    std::string dir_;
+    std::string name_;
+    Writer* writer_ = nullptr;
+
+    // current snapshot: mapped file, or the buffer just built by compact()
+    MappedFile mapped_;
+    std::shared_ptr<const std::string> built_;
+    const char* base_ = nullptr;
+    size_t baseSize_ = 0;
+    uint64_t capacity_ = 0;     // slots in the snapshot hash table, power of two
+
+    // string_view lookups without building a std::string
+    struct KeyHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view key) const { return std::hash<std::string_view>{}(key); }
+    };
+
+    std::unordered_map<std::string, std::optional<std::string>, KeyHash, std::equal_to<>> overlay_;  // nullopt = erased
+    size_t size_ = 0;
+    uint64_t gen_ = 0;          // log generation receiving appends
+    bool fresh_ = true;
+};
+
+#endif //ENCRYPTEDMESSENGER_SNAPSHOTTABLE_H
@@ -0,0 +1,43 @@
+#ifndef ENCRYPTEDMESSENGER_BYTEORDER_H
+#define ENCRYPTEDMESSENGER_BYTEORDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// little-endian integers for the binary storage and wire formats
+namespace byteorder {
+
+    inline void putU32(std::string& out, uint32_t v) {
+        for (int i = 0; i < 4; i++) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+    }
+
+    inline void putU64(std::string& out, uint64_t v) {
+        for (int i = 0; i < 8; i++) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+    }
+
+    // overwrite 4 bytes at pos
+    inline void setU32(std::string& out, size_t pos, uint32_t v) {
+        for (int i = 0; i < 4; i++) out[pos + i] = static_cast<char>((v >> (8 * i)) & 0xFF);
+    }
+
+    // overwrite 8 bytes at pos
+    inline void setU64(std::string& out, size_t pos, uint64_t v) {
+        for (int i = 0; i < 8; i++) out[pos + i] = static_cast<char>((v >> (8 * i)) & 0xFF);
+    }
+
+    inline uint32_t getU32(const char* p) {
+        uint32_t v = 0;
+        for (int i = 0; i < 4; i++) v |= static_cast<uint32_t>(static_cast<uint8_t>(p[i])) << (8 * i);
+        return v;
+    }
+
+    inline uint64_t getU64(const char* p) {
+        uint64_t v = 0;
+        for (int i = 0; i < 8; i++) v |= static_cast<uint64_t>(static_cast<uint8_t>(p[i])) << (8 * i);
+        return v;
+    }
+
+}
+
+#endif //ENCRYPTEDMESSENGER_BYTEORDER_H
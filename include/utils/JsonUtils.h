@@ -1,9 +1,41 @@
 #ifndef ENCRYPTEDMESSENGER_JSONUTILS_H
 #define ENCRYPTEDMESSENGER_JSONUTILS_H
 
+#include <cstddef>
+#include <string_view>
+#include "network/Request.h"
 
+// json helpers for the request hot path, no DOM is built
 class JsonUtils {
-};
+public:
+    // parse one json object into request in a single pass
+    // known fields are read straight into request, unknown keys and their values are skipped
+    // without allocating. returns false if the object is malformed or a known field has the wrong type
+    static bool parseRequest(std::string_view json, Request& request);
+
+    // finds complete top-level objects in a growing stream buffer,
+    // resumes where the last call stopped and ignores braces inside strings
+    class ObjectScanner {
+    public:
+        // true when an object is complete, it then spans [begin(), end()) of buffer
+        bool next(std::string_view buffer);
+
+        size_t begin() const { return begin_; }
+        size_t end() const { return pos_; }
 
+        // leading bytes the caller may drop: scanned objects and anything outside them
+        size_t consumable() const { return depth_ > 0 ? begin_ : pos_; }
+
+        // the caller erased n leading bytes (n <= consumable())
+        void shift(size_t n) { pos_ -= n; begin_ = begin_ > n ? begin_ - n : 0; }
+
+    private:
+        size_t pos_ = 0;
+        size_t begin_ = 0;
+        int depth_ = 0;
+        bool inString_ = false;
+        bool escaped_ = false;
+    };
+};
 
-#endif //ENCRYPTEDMESSENGER_JSONUTILS_H
\ No newline at end of file
+#endif //ENCRYPTEDMESSENGER_JSONUTILS_H
@@ -1,20 +1,67 @@
 #ifndef ENCRYPTEDMESSENGER_LOGGER_H
 #define ENCRYPTEDMESSENGER_LOGGER_H
 
-#include <iostream>
-#include <mutex>
+#include <atomic>
+#include <cstdint>
 #include <string>
 
+// lowest level compiled in: 0 debug, 1 info, 2 warn, 3 error (set by CMake's LOG_LEVEL)
+#ifndef ENCRYPTEDMESSENGER_LOG_LEVEL
+#define ENCRYPTEDMESSENGER_LOG_LEVEL 1
+#endif
+
+// asynchronous logger
+// a call formats nothing and waits for nothing: the line is moved into a bounded lock-free
+// ring and a background thread timestamps, batches and writes it to stdout or a file.
+// If the ring is full the line is dropped and counted, the caller never blocks on the log.
+// The LOG_* macros below drop levels under ENCRYPTEDMESSENGER_LOG_LEVEL at compile time,
+// their argument is not even evaluated then
 class Logger {
 public:
-    // Thread-safe logging
-    static void log(const std::string& msg) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        std::cout << msg << std::endl;
+    enum class Level : uint8_t {
+        Debug,
+        Info,
+        Warn,
+        Error
+    };
+
+    static constexpr Level kCompiledLevel = static_cast<Level>(ENCRYPTEDMESSENGER_LOG_LEVEL);
+
+    // info line, kept for the many existing call sites
+    static void log(std::string msg) { write(Level::Info, std::move(msg)); }
+
+    // queue msg at level, no-op below the runtime level
+    static void write(Level level, std::string msg);
+
+    // runtime threshold on top of the compiled one, Info by default
+    static void setLevel(Level level) { level_.store(level, std::memory_order_relaxed); }
+    static bool enabled(Level level) {
+        return level >= kCompiledLevel && level >= level_.load(std::memory_order_relaxed);
     }
 
+    // append to path from now on, empty for stdout. False if it cannot be opened
+    static bool setOutput(const std::string& path);
+
+    // block until every line queued before the call is written (tests, shutdown)
+    static void flush();
+
+    // lines lost to a full ring since startup
+    static uint64_t dropped();
+
 private:
-    static std::mutex mutex_;
+    static std::atomic<Level> level_;
 };
 
-#endif
\ No newline at end of file
+#define ENCRYPTEDMESSENGER_LOG(level, msg)                                        \
+    do {                                                                          \
+        if constexpr ((level) >= Logger::kCompiledLevel) {                        \
+            if (Logger::enabled(level)) Logger::write((level), (msg));            \
+        }                                                                         \
+    } while (0)
+
+#define LOG_DEBUG(msg) ENCRYPTEDMESSENGER_LOG(Logger::Level::Debug, msg)
+#define LOG_INFO(msg)  ENCRYPTEDMESSENGER_LOG(Logger::Level::Info, msg)
+#define LOG_WARN(msg)  ENCRYPTEDMESSENGER_LOG(Logger::Level::Warn, msg)
+#define LOG_ERROR(msg) ENCRYPTEDMESSENGER_LOG(Logger::Level::Error, msg)
+
+#endif
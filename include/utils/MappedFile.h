@@ -0,0 +1,44 @@
+#ifndef ENCRYPTEDMESSENGER_MAPPEDFILE_H
+#define ENCRYPTEDMESSENGER_MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+// read-only memory mapping of a whole file
+// windows uses CreateFileMapping, everything else mmap
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    // map file at path, replaces any previous mapping
+    // an empty file maps successfully with data() == nullptr
+    bool open(const std::string& path);
+
+    // release the mapping
+    void close();
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool isOpen() const { return open_; }
+
+private:
+    void swap(MappedFile& other) noexcept;
+
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    bool open_ = false;
+#ifdef _WIN32
+    void* file_ = nullptr;      // HANDLE from CreateFile
+    void* mapping_ = nullptr;   // HANDLE from CreateFileMapping
+#else
+    int fd_ = -1;
+#endif
+};
+
+#endif //ENCRYPTEDMESSENGER_MAPPEDFILE_H
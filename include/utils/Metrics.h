@@ -0,0 +1,166 @@
+#ifndef ENCRYPTEDMESSENGER_METRICS_H
+#define ENCRYPTEDMESSENGER_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <json.hpp>
+
+// process wide counters and latency histograms
+// recording is a few relaxed atomic adds on a per-thread shard, no locks and no allocation,
+// so it can sit on every request. Metrics are registered once (usually into a static or a
+// member) and live until the process exits. Reading sums the shards, it is for the stats
+// action and the Prometheus file, not for the hot path
+namespace metrics {
+
+    // threads are spread over this many shards so they rarely share a cache line
+    constexpr size_t kShards = 8;
+
+    // next shard handed to a thread
+    size_t assignShard();
+
+    // shard of the calling thread, assigned round robin on its first recording
+    inline size_t shardIndex() {
+        thread_local size_t shard = assignShard();
+        return shard;
+    }
+
+    class Counter {
+    public:
+        void add(uint64_t n = 1) {
+            cells_[shardIndex()].value.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        uint64_t value() const;
+
+    private:
+        struct alignas(64) Cell {
+            std::atomic<uint64_t> value{0};
+        };
+        std::array<Cell, kShards> cells_;
+    };
+
+    // HDR style histogram of nanosecond values: 16 linear sub-buckets per power of two, so
+    // any recorded value is known within 1/16 (6%) from 1ns to hours, in a fixed 5 KiB per shard
+    class Histogram {
+    public:
+        static constexpr unsigned kSubBits = 4;
+        static constexpr uint64_t kSubBuckets = uint64_t(1) << kSubBits;
+        static constexpr unsigned kMaxBits = 44;   // values from 2^44 ns (~4.9h) are clamped
+        static constexpr size_t kBuckets = (kMaxBits - kSubBits + 1) * kSubBuckets;
+
+        void record(uint64_t nanos) {
+            Shard& shard = shards_[shardIndex()];
+            shard.buckets[bucketOf(nanos)].fetch_add(1, std::memory_order_relaxed);
+            shard.sum.fetch_add(nanos, std::memory_order_relaxed);
+        }
+
+        void record(std::chrono::steady_clock::duration elapsed) {
+            record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+
+        // merged view of all shards at one moment
+        struct Snapshot {
+            uint64_t count = 0;
+            uint64_t sum = 0;                          // nanoseconds
+            std::array<uint64_t, kBuckets> buckets{};
+
+            // upper bound of the bucket holding the q-th value (0..1), 0 when empty
+            uint64_t percentile(double q) const;
+            uint64_t max() const { return percentile(1.0); }
+        };
+
+        Snapshot snapshot() const;
+
+        static constexpr size_t bucketOf(uint64_t value) {
+            if (value < kSubBuckets) {
+                return static_cast<size_t>(value);
+            }
+            unsigned top = std::bit_width(value) - 1;
+            if (top >= kMaxBits) {
+                return kBuckets - 1;
+            }
+            unsigned shift = top - kSubBits;
+            return static_cast<size_t>((top - kSubBits + 1) * kSubBuckets + ((value >> shift) - kSubBuckets));
+        }
+
+        // largest value that lands in bucket
+        static constexpr uint64_t bucketUpperBound(size_t bucket) {
+            if (bucket < kSubBuckets) {
+                return bucket;
+            }
+            unsigned shift = static_cast<unsigned>(bucket / kSubBuckets) - 1;
+            uint64_t sub = bucket % kSubBuckets;
+            return ((kSubBuckets + sub + 1) << shift) - 1;
+        }
+
+    private:
+        struct alignas(64) Shard {
+            std::array<std::atomic<uint64_t>, kBuckets> buckets{};   // the count is their total
+            std::atomic<uint64_t> sum{0};
+        };
+        std::array<Shard, kShards> shards_;
+    };
+
+    // records the time until it goes out of scope
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(Histogram& histogram)
+            : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+        ~ScopedTimer() { histogram_.record(std::chrono::steady_clock::now() - start_); }
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+        Histogram& histogram_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    class Registry {
+    public:
+        // the process wide registry everything records into
+        static Registry& global();
+
+        // metric called name with labels (Prometheus syntax without braces, e.g.
+        // action="login"), created on first use. The same name and labels always give the
+        // same metric, so several servers in one process share it
+        Counter& counter(std::string_view name, std::string_view help, std::string_view labels = {});
+        Histogram& histogram(std::string_view name, std::string_view help, std::string_view labels = {});
+
+        // Prometheus text exposition, histograms as summaries in seconds (p50/p90/p99/p999)
+        std::string prometheus() const;
+
+        // same content for the stats action, latencies in microseconds
+        //   {"counters":{"name{labels}":n},"histograms":{"name{labels}":{"count":..,"p50_us":..}}}
+        nlohmann::json json() const;
+
+    private:
+        enum class Kind { Counter, Histogram };
+
+        struct Entry {
+            Kind kind;
+            std::string name;
+            std::string help;
+            std::string labels;
+            std::unique_ptr<Counter> counter;
+            std::unique_ptr<Histogram> histogram;
+        };
+
+        Entry& find(Kind kind, std::string_view name, std::string_view help, std::string_view labels);
+
+        mutable std::mutex mutex_;   // registration and reading only
+        std::deque<Entry> entries_;  // registration order, grouped by name when rendered
+    };
+
+}
+
+#endif //ENCRYPTEDMESSENGER_METRICS_H
@@ -0,0 +1,271 @@
+#ifndef ENCRYPTEDMESSENGER_TRACE_H
+#define ENCRYPTEDMESSENGER_TRACE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// per-request timing: stage breakdowns for the slow log, sampled traces in Chrome trace
+// format (chrome://tracing, ui.perfetto.dev)
+// every request carries a RequestTrace, the Span guards placed in the handlers, storage and
+// crypto add their time to its stage totals from whichever thread runs them. Only sampled
+// requests keep each span as an event, written to the Tracer's file when they finish. A
+// request slower than its threshold is written to the SlowLog with its breakdown
+namespace trace {
+
+    using Clock = std::chrono::steady_clock;
+
+    // what a span spends its time on, the Chrome category of its event
+    enum class Stage : uint8_t {
+        Request,   // the whole request, from its frame being parsed to its last reply
+        Handler,   // the action's handler on the io thread
+        Parse,
+        Lookup,    // users and public keys
+        Crypto,
+        Storage,
+        Write      // encoding and queueing replies
+    };
+
+    // stages from Parse on add up in the breakdown, Request and Handler span the others
+    constexpr size_t kFirstTimedStage = static_cast<size_t>(Stage::Parse);
+    constexpr size_t kStages = static_cast<size_t>(Stage::Write) + 1;
+
+    const char* stageName(Stage stage);
+
+    // small id of the calling thread, the Chrome "tid"
+    uint32_t threadId();
+
+    class Tracer;
+    class SlowLog;
+
+    // timing and sizes of one request
+    class RequestTrace {
+    public:
+        RequestTrace(std::string_view name, Clock::time_point start)
+            : name_(name), start_(start) {}
+
+        RequestTrace(const RequestTrace&) = delete;
+        RequestTrace& operator=(const RequestTrace&) = delete;
+
+        // the request the calling thread works for, nullptr when there is none
+        static RequestTrace* current() { return current_; }
+
+        // makes trace the current one until the scope ends
+        class Scope {
+        public:
+            explicit Scope(RequestTrace* trace) : previous_(std::exchange(current_, trace)) {}
+            ~Scope() { current_ = previous_; }
+
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+        private:
+            RequestTrace* previous_;
+        };
+
+        // keep every span as an event from now on, written to tracer at the end
+        void sample(std::shared_ptr<Tracer> tracer, uint64_t id);
+        bool sampled() const { return tracer_ != nullptr; }
+
+        // written to log at the end when it took threshold or longer
+        void watch(std::shared_ptr<SlowLog> log, Clock::duration threshold);
+
+        // a finished span, thread safe. name must outlive the trace (a literal or an action
+        // table name). counted is false for spans inside another span of this request on
+        // the same thread, their time is already in the outer one
+        void add(std::string_view name, Stage stage, Clock::time_point start, Clock::time_point end,
+                 bool counted = true);
+
+        // time in stage so far, outermost spans only
+        Clock::duration stageTime(Stage stage) const {
+            return Clock::duration(stages_[static_cast<size_t>(stage)].load(std::memory_order_relaxed));
+        }
+
+        // details for the slow log, thread safe except setUser (dispatch only)
+        void setUser(std::string user) { user_ = std::move(user); }
+        void addRequestBytes(size_t bytes) { requestBytes_.fetch_add(bytes, std::memory_order_relaxed); }
+        void addResponseBytes(size_t bytes) { responseBytes_.fetch_add(bytes, std::memory_order_relaxed); }
+        void setConversationSize(uint64_t messages) { conversationSize_.store(messages, std::memory_order_relaxed); }
+
+        // records the request's own span and hands it to the tracer and slow log
+        void finish(Clock::time_point end, bool error);
+
+    private:
+        friend class Span;
+        friend class Covered;
+        friend class Tracer;
+        friend class SlowLog;
+
+        struct Event {
+            std::string_view name;
+            Stage stage;
+            uint32_t thread;
+            Clock::time_point start;
+            Clock::time_point end;
+        };
+
+        static thread_local RequestTrace* current_;
+        static thread_local const RequestTrace* open_;   // owner of the outermost open span
+
+        std::string_view name_;
+        Clock::time_point start_;
+        std::array<std::atomic<Clock::rep>, kStages> stages_{};
+        std::atomic<uint64_t> requestBytes_{0};
+        std::atomic<uint64_t> responseBytes_{0};
+        std::atomic<uint64_t> conversationSize_{0};
+        std::string user_;
+
+        std::shared_ptr<SlowLog> slowLog_;
+        Clock::duration slowAfter_{};
+
+        // sampled requests only
+        std::shared_ptr<Tracer> tracer_;
+        uint64_t id_ = 0;
+        uint32_t thread_ = 0;        // where the request was dispatched
+        bool error_ = false;
+        std::mutex mutex_;           // spans may come from a worker and the io thread
+        std::vector<Event> events_;
+    };
+
+    // adds a finished span to the current request, for work timed across a callback
+    inline void record(std::string_view name, Stage stage, Clock::time_point start, Clock::time_point end) {
+        if (RequestTrace* trace = RequestTrace::current()) {
+            trace->add(name, stage, start, end);
+        }
+    }
+
+    // one span from construction to destruction, nothing outside of a request
+    class Span {
+    public:
+        Span(std::string_view name, Stage stage) : trace_(RequestTrace::current()), name_(name), stage_(stage) {
+            if (!trace_) {
+                return;
+            }
+            start_ = Clock::now();
+            // only the outermost span on this thread counts towards the breakdown
+            if (static_cast<size_t>(stage) >= kFirstTimedStage && RequestTrace::open_ != trace_) {
+                outer_ = RequestTrace::open_;
+                RequestTrace::open_ = trace_;
+                counted_ = true;
+            }
+        }
+
+        ~Span() {
+            if (!trace_) {
+                return;
+            }
+            trace_->add(name_, stage_, start_, Clock::now(), counted_);
+            if (counted_) {
+                RequestTrace::open_ = outer_;
+            }
+        }
+
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+    private:
+        RequestTrace* trace_;
+        std::string_view name_;
+        Stage stage_;
+        bool counted_ = false;
+        const RequestTrace* outer_ = nullptr;
+        Clock::time_point start_;
+    };
+
+    // spans started while it exists are details of an outer span recorded later (an
+    // asynchronous call timed from its start to its completion), traced but not counted again
+    class Covered {
+    public:
+        Covered() : trace_(RequestTrace::current()), outer_(RequestTrace::open_) {
+            if (trace_) {
+                RequestTrace::open_ = trace_;
+            }
+        }
+        ~Covered() {
+            if (trace_) {
+                RequestTrace::open_ = outer_;
+            }
+        }
+
+        Covered(const Covered&) = delete;
+        Covered& operator=(const Covered&) = delete;
+
+    private:
+        RequestTrace* trace_;
+        const RequestTrace* outer_;
+    };
+
+    // samples requests and appends their traces to a Chrome trace file (JSON array format)
+    // the array is closed when the tracer goes away, viewers also read a file cut short
+    class Tracer : public std::enable_shared_from_this<Tracer> {
+    public:
+        // truncates path, traces about sampleRate of the requests (0..1), evenly spread
+        static std::shared_ptr<Tracer> open(const std::string& path, double sampleRate);
+
+        ~Tracer();
+
+        Tracer(const Tracer&) = delete;
+        Tracer& operator=(const Tracer&) = delete;
+
+        // starts keeping trace's spans when this request is picked
+        void sample(RequestTrace& trace);
+
+        // push traces written so far to the file
+        void flush();
+
+        uint64_t traced() const { return traced_.load(std::memory_order_relaxed); }
+
+    private:
+        Tracer(std::FILE* file, double sampleRate);
+
+        friend class RequestTrace;
+        void write(const RequestTrace& trace);
+
+        std::FILE* file_;
+        double sampleRate_;
+        Clock::time_point epoch_;            // "ts" 0
+        std::atomic<uint64_t> requests_{0};
+        std::atomic<uint64_t> traced_{0};
+        std::mutex mutex_;                   // file_ and first_
+        bool first_ = true;
+    };
+
+    // one json line per request over its threshold:
+    //   {"time":"...","action":"send_message","user":"alice","total_ms":812.4,"threshold_ms":250,
+    //    "request_bytes":310,"response_bytes":46,"conversation_size":12800,"error":false,
+    //    "stages_ms":{"parse":0.01,"lookup":0.2,"crypto":3.1,"storage":801.9,"write":0.02,"other":7.2}}
+    // "other" is time in no stage, mostly waiting for a worker
+    class SlowLog {
+    public:
+        // appends to path
+        static std::shared_ptr<SlowLog> open(const std::string& path);
+
+        ~SlowLog();
+
+        SlowLog(const SlowLog&) = delete;
+        SlowLog& operator=(const SlowLog&) = delete;
+
+        uint64_t written() const { return written_.load(std::memory_order_relaxed); }
+
+    private:
+        explicit SlowLog(std::FILE* file) : file_(file) {}
+
+        friend class RequestTrace;
+        void write(const RequestTrace& trace, Clock::duration total, bool error);
+
+        std::FILE* file_;
+        std::mutex mutex_;
+        std::atomic<uint64_t> written_{0};
+    };
+
+}
+
+#endif //ENCRYPTEDMESSENGER_TRACE_H
@@ -1,39 +1,43 @@
 #ifndef ENCRYPTEDMESSENGER_BASE64_H
 #define ENCRYPTEDMESSENGER_BASE64_H
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
+// standard alphabet base64 with '=' padding
+// bulk input runs through AVX2 or SSE4.1 kernels picked once at runtime, the rest through
+// table-driven scalar code. nothing is allocated besides the returned containers
 namespace base64 {
 
-    static const std::string chars =
-        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    // characters produced for len bytes, padding included
+    constexpr size_t encodedLength(size_t len) {
+        return (len + 2) / 3 * 4;
+    }
 
-    inline std::string encode(const uint8_t* data, size_t len) {
-        std::string out;
-        out.reserve((len * 4 + 2) / 3);
+    // most bytes decode() can produce from len characters
+    constexpr size_t decodedMaxLength(size_t len) {
+        return len / 4 * 3 + (len % 4) * 3 / 4;
+    }
 
-        int val = 0;
-        int valb = -6;
+    // write encodedLength(len) characters to out, returns that count
+    size_t encode(const uint8_t* data, size_t len, char* out);
 
-        for (size_t i = 0; i < len; i++) {
-            uint8_t c = data[i];
-            val = (val << 8) + c;
-            valb += 8;
+    // decode text up to the first character outside the alphabet ('=' padding included)
+    // out needs room for decodedMaxLength(len) bytes, returns bytes written
+    size_t decode(const char* text, size_t len, uint8_t* out);
 
-            while (valb >= 0) {
-                out.push_back(chars[(val >> valb) & 0x3F]);
-                valb -= 6;
-            }
-        }
+    // "avx2", "sse4.1" or "scalar"
+    const char* implementation();
 
-        if (valb > -6) {
-            out.push_back(chars[((val << 8) >> (valb + 8)) & 0x3F]);
-        }
-        while (out.size() % 4) {
-            out.push_back('=');
-        }
+    // force an implementation (tests, benchmarks), false if this CPU or build lacks it
+    bool useImplementation(std::string_view name);
 
+    inline std::string encode(const uint8_t* data, size_t len) {
+        std::string out(encodedLength(len), '\0');
+        encode(data, len, out.data());
         return out;
     }
 
@@ -46,29 +50,11 @@ namespace base64 {
     }
 
     inline std::vector<uint8_t> decode(const std::string& s) {
-        std::vector<int> T(256, -1);
-        for (int i = 0; i < 64; i++) T[chars[i]] = i;
-
-        std::vector<uint8_t> out;
-        out.reserve(s.size() * 3 / 4);
-
-        int val = 0;
-        int valb = -8;
-
-        for (unsigned char c : s) {
-            if (T[c] == -1) break;
-            val = (val << 6) + T[c];
-            valb += 6;
-
-            if (valb >= 0) {
-                out.push_back(uint8_t((val >> valb) & 0xFF));
-                valb -= 8;
-            }
-        }
-
+        std::vector<uint8_t> out(decodedMaxLength(s.size()));
+        out.resize(decode(s.data(), s.size(), out.data()));
         return out;
     }
 
 }
 
-#endif //ENCRYPTEDMESSENGER_BASE64_H
\ No newline at end of file
+#endif //ENCRYPTEDMESSENGER_BASE64_H
@@ -2,19 +2,19 @@
 #include <openssl/sha.h>
 #include <sstream>
 #include <iomanip>
-#include <iostream>
 #include "utils/Logger.h"
 
 using json = nlohmann::json;
 
-Client::Client(std::shared_ptr<TcpConnection> connection)
-    : connection_(std::move(connection))
+Client::Client(std::shared_ptr<TcpConnection> connection, std::chrono::milliseconds timeout)
+    : connection_(std::move(connection)),
+      timeout_(timeout)
 {
     // install callback so tcpConnection can forward server responses to client
     connection_->onServerResponse_ =
-        [this](const std::string& status, const std::string& message)
+        [this](const json& response)
         {
-            this->handleResponse(status, message);
+            this->handleResponse(response);
         };
 }
 
@@ -27,9 +27,32 @@ std::string Client::hashPassword(const std::string& password) {
     return ss.str();
 }
 
+bool Client::hello(WireFormat format, Compression compression) {
+    if (!connection_ || !connection_->socket().is_open()) {
+        LOG_ERROR("[Client] Cannot negotiate encoding: no active connection");
+        return false;
+    }
+
+    pendingAction_ = "hello";
+    pendingFormat_ = format;
+    pendingCompression_ = compression;
+
+    json msg = {
+        {"action", "hello"},
+        {"encoding", wire::formatName(format)}
+    };
+    if (compression != Compression::None) {
+        msg["compression"] = compression::name(compression);
+    }
+
+    connection_->sendJson(msg);
+    connection_->beginRead();
+    return waitForResponse();
+}
+
 bool Client::createAccount(const std::string &username, const std::string &password) {
     if (!connection_ || !connection_->socket().is_open()) {
-        std::cerr << "[Client] Cannot create account: no active connection\n";
+        LOG_ERROR("[Client] Cannot create account: no active connection");
         return false;
     }
 
@@ -41,14 +64,14 @@ bool Client::createAccount(const std::string &username, const std::string &passw
         {"password_hash", hashPassword(password)}
     };
 
-    connection_->send(msg.dump());
+    connection_->sendJson(msg);
     connection_->beginRead();
     return waitForResponse();
 }
 
 bool Client::login(const std::string& username, const std::string& password) {
     if (!connection_ || !connection_->socket().is_open()) {
-        std::cerr << "[Client] Cannot login: no active connection\n";
+        LOG_ERROR("[Client] Cannot login: no active connection");
         return false;
     }
 
@@ -61,14 +84,14 @@ bool Client::login(const std::string& username, const std::string& password) {
         {"password_hash", hashPassword(password)}
     };
 
-    connection_->send(msg.dump());
+    connection_->sendJson(msg);
     connection_->beginRead();
     return waitForResponse();
 }
 
 bool Client::sendMessage(const std::string& to, const std::string& message) {
     if (!connection_ || !connection_->socket().is_open()) {
-        std::cerr << "[Client] Cannot send message: no active connection\n";
+        LOG_ERROR("[Client] Cannot send message: no active connection");
         return false;
     }
 
@@ -80,41 +103,199 @@ bool Client::sendMessage(const std::string& to, const std::string& message) {
         {"message", message}
     };
 
-    connection_->send(msg.dump());
+    connection_->sendJson(msg);
     return waitForResponse();
 }
 
 bool Client::getMessages(const std::string& withUser) {
     if (!connection_ || !connection_->socket().is_open()) {
-        std::cerr << "[Client] Cannot get messages: no active connection\n";
+        LOG_ERROR("[Client] Cannot get messages: no active connection");
         return false;
     }
 
     pendingAction_ = "get_messages";
+    {
+        std::lock_guard<std::mutex> lock(responseMutex_);
+        lastMessages_.clear();
+    }
 
     json msg = {
         {"action", "get_messages"},
         {"with", withUser}
     };
 
-    connection_->send(msg.dump());
+    connection_->sendJson(msg);
+    return waitForResponse();
+}
+
+bool Client::listConversations() {
+    if (!connection_ || !connection_->socket().is_open()) {
+        LOG_ERROR("[Client] Cannot list conversations: no active connection");
+        return false;
+    }
+
+    pendingAction_ = "list_conversations";
+
+    json msg = {
+        {"action", "list_conversations"}
+    };
+
+    connection_->sendJson(msg);
+    return waitForResponse();
+}
+
+bool Client::markRead(const std::string& withUser, uint64_t seq) {
+    if (!connection_ || !connection_->socket().is_open()) {
+        LOG_ERROR("[Client] Cannot mark read: no active connection");
+        return false;
+    }
+
+    pendingAction_ = "mark_read";
+
+    json msg = {
+        {"action", "mark_read"},
+        {"with", withUser},
+        {"seq", seq}
+    };
+
+    connection_->sendJson(msg);
     return waitForResponse();
 }
 
-void Client::handleResponse(const std::string& status, const std::string& message) {
+bool Client::ping() {
+    if (!connection_ || !connection_->socket().is_open()) {
+        LOG_ERROR("[Client] Cannot ping: no active connection");
+        return false;
+    }
+
+    pendingAction_ = "ping";
+
+    json msg = {
+        {"action", "ping"}
+    };
+
+    connection_->sendJson(msg);
+    return waitForResponse();
+}
+
+bool Client::createGroup(const std::string& group, const std::vector<std::string>& members) {
+    if (!connection_ || !connection_->socket().is_open()) {
+        LOG_ERROR("[Client] Cannot create group: no active connection");
+        return false;
+    }
+
+    pendingAction_ = "create_group";
+
+    json msg = {
+        {"action", "create_group"},
+        {"group", group},
+        {"members", members}
+    };
+
+    connection_->sendJson(msg);
+    return waitForResponse();
+}
+
+bool Client::sendGroupMessage(const std::string& group, const std::string& message) {
+    if (!connection_ || !connection_->socket().is_open()) {
+        LOG_ERROR("[Client] Cannot send group message: no active connection");
+        return false;
+    }
+
+    pendingAction_ = "send_group";
+
+    json msg = {
+        {"action", "send_group"},
+        {"group", group},
+        {"message", message}
+    };
+
+    connection_->sendJson(msg);
+    return waitForResponse();
+}
+
+bool Client::getGroup(const std::string& group) {
+    if (!connection_ || !connection_->socket().is_open()) {
+        LOG_ERROR("[Client] Cannot get group: no active connection");
+        return false;
+    }
+
+    pendingAction_ = "get_group";
+
+    json msg = {
+        {"action", "get_group"},
+        {"group", group}
+    };
+
+    connection_->sendJson(msg);
+    return waitForResponse();
+}
+
+bool Client::stats() {
+    if (!connection_ || !connection_->socket().is_open()) {
+        LOG_ERROR("[Client] Cannot get stats: no active connection");
+        return false;
+    }
+
+    pendingAction_ = "stats";
+
+    json msg = {
+        {"action", "stats"}
+    };
+
+    connection_->sendJson(msg);
+    return waitForResponse();
+}
+
+bool Client::waitForGroupMessages(size_t count) {
+    std::unique_lock<std::mutex> lock(responseMutex_);
+    return responseCv_.wait_for(lock, timeout_,
+                                [this, count] { return groupInbox_.size() >= count; });
+}
+
+void Client::handleResponse(const json& response) {
+    std::string status  = response.value("status", "unknown");
+    {
+        // pushed by the server at any time, not an answer to the pending request
+        std::lock_guard<std::mutex> lock(responseMutex_);
+        if (status == "group_message") {
+            groupInbox_.push_back(response["record"]);
+            responseCv_.notify_all();
+            return;
+        }
+    }
+
+    std::string message = response.value("message", "");
     {
         // lock before modifying state
         std::lock_guard<std::mutex> lock(responseMutex_);
         lastStatus_ = status;
         lastMessage_ = message;
 
+        // HELLO
+        if (pendingAction_ == "hello") {
+            if (status == "success") {
+                // switch before the next frame is read, the server already has
+                connection_->setWireFormat(pendingFormat_);
+                connection_->setCompression(pendingCompression_);
+                Logger::log(std::string("[Client] Encoding: ") + wire::formatName(pendingFormat_)
+                            + ", compression: " + compression::name(pendingCompression_));
+            } else {
+                LOG_WARN("[Client] Encoding negotiation failed: " + message);
+            }
+
+            pendingAction_.clear();
+            responseReady_ = true;
+            responseCv_.notify_one();
+            return;
+        }
         // LOGIN
         if (pendingAction_ == "login") {
             if (status == "success") {
                 username_ = lastLoginUsername_;
                 Logger::log("[Client] Logged in as: " + username_);
             } else {
-                std::cerr << "[Client] Login failed: " << message << "\n";
+                LOG_WARN("[Client] Login failed: " + message);
             }
 
             pendingAction_.clear();
@@ -127,7 +308,7 @@ void Client::handleResponse(const std::string& status, const std::string& messag
             if (status == "success") {
                 Logger::log("[Client] Account created successfully");
             } else {
-                std::cerr << "[Client] Failed to create account: " << message << "\n";
+                LOG_WARN("[Client] Failed to create account: " + message);
             }
 
             pendingAction_.clear();
@@ -140,7 +321,7 @@ void Client::handleResponse(const std::string& status, const std::string& messag
             if (status == "success") {
                 Logger::log("[Client] Message delivered");
             } else {
-                std::cerr << "[Client] Failed to send message: " << message << "\n";
+                LOG_WARN("[Client] Failed to send message: " + message);
             }
 
             pendingAction_.clear();
@@ -151,23 +332,66 @@ void Client::handleResponse(const std::string& status, const std::string& messag
         // GET MESSAGES
         if (pendingAction_ == "get_messages") {
             if (status == "success") {
-                // parse json list of messages
-                try {
-                    auto jsonObj = nlohmann::json::parse(message);
-
-                    lastMessages_.clear();
-                    if (jsonObj.contains("messages")) {
-                        for (auto& m : jsonObj["messages"])
-                            lastMessages_.push_back(m);
-                    }
-
-                    Logger::log("[Client] Retrieved " + std::to_string(lastMessages_.size()) + " messages");
+                // messages array, absent when the conversation is empty
+                if (response.contains("messages")) {
+                    for (auto& m : response["messages"])
+                        lastMessages_.push_back(m);
                 }
-                catch (...) {
-                    std::cerr << "[Client] Failed to parse message list JSON\n";
+
+                // binary encodings stream history as several frames, wait for the last
+                if (response.value("more", false)) {
+                    return;
                 }
+
+                Logger::log("[Client] Retrieved " + std::to_string(lastMessages_.size()) + " messages");
+            } else {
+                LOG_WARN("[Client] Failed to retrieve messages: " + message);
+            }
+
+            pendingAction_.clear();
+            responseReady_ = true;
+            responseCv_.notify_one();
+            return;
+        }
+
+        // GET GROUP
+        if (pendingAction_ == "get_group") {
+            if (status == "success") {
+                lastGroup_ = response;
+            } else {
+                LOG_WARN("[Client] Failed to get group: " + message);
+            }
+
+            pendingAction_.clear();
+            responseReady_ = true;
+            responseCv_.notify_one();
+            return;
+        }
+
+        // STATS
+        if (pendingAction_ == "stats") {
+            if (status == "success") {
+                lastStats_ = response["metrics"];
+            } else {
+                LOG_WARN("[Client] Failed to get stats: " + message);
+            }
+
+            pendingAction_.clear();
+            responseReady_ = true;
+            responseCv_.notify_one();
+            return;
+        }
+
+        // LIST CONVERSATIONS
+        if (pendingAction_ == "list_conversations") {
+            if (status == "success") {
+                lastConversations_.clear();
+                for (auto& c : response.value("conversations", json::array()))
+                    lastConversations_.push_back(c);
+
+                Logger::log("[Client] Retrieved " + std::to_string(lastConversations_.size()) + " conversations");
             } else {
-                std::cerr << "[Client] Failed to retrieve messages: " << message << "\n";
+                LOG_WARN("[Client] Failed to list conversations: " + message);
             }
 
             pendingAction_.clear();
@@ -180,7 +404,7 @@ void Client::handleResponse(const std::string& status, const std::string& messag
         if (status == "success") {
             Logger::log("[Client] SUCCESS: " + message);
         } else if (status == "error") {
-            std::cerr << "[Client] ERROR: " << message << "\n";
+            LOG_WARN("[Client] Error: " + message);
         } else {
             Logger::log("[Client] Response: " + message);
         }
@@ -197,9 +421,9 @@ bool Client::waitForResponse() {
     std::unique_lock<std::mutex> lock(responseMutex_);
 
     // wait until responseReady_ becomes true or timeout
-    if (!responseCv_.wait_for(lock, std::chrono::milliseconds(timeoutMs_),
+    if (!responseCv_.wait_for(lock, timeout_,
                               [this] { return responseReady_; })) {
-        std::cerr << "[Client] Response timed out\n";
+        LOG_WARN("[Client] Response timed out");
         return false;
     }
 
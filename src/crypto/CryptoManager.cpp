@@ -1,91 +1,161 @@
 #include "crypto/CryptoManager.h"
 
 #include <openssl/rsa.h>
-#include <openssl/pem.h>
 #include <openssl/evp.h>
-#include <openssl/bio.h>
 #include <openssl/rand.h>
-#include <openssl/err.h>
+#include <openssl/decoder.h>
+#include <openssl/encoder.h>
+#include <memory>
 #include <vector>
 #include <iostream>
+#include "utils/Metrics.h"
+#include "utils/Trace.h"
 
-CryptoManager::CryptoManager() {
-    OpenSSL_add_all_algorithms();
-    ERR_load_crypto_strings();
-}
-
-// -------------RSA KEY GENERATION-------------
+namespace {
 
-CryptoManager::RSAKeyPair CryptoManager::generateRSAKeyPair() {
-    RSAKeyPair kp;
+    // time spent in each operation, the server's request latencies break down into these
+    metrics::Histogram& latency(std::string_view op) {
+        return metrics::Registry::global().histogram(
+            "messenger_crypto_seconds", "Crypto operation latency, by operation",
+            "op=\"" + std::string(op) + "\"");
+    }
 
-    // create RSA key
-    RSA* rsa = RSA_new();
-    BIGNUM* bn = BN_new();
-    BN_set_word(bn, RSA_F4);
+    struct PkeyFree { void operator()(EVP_PKEY* key) const { EVP_PKEY_free(key); } };
+    struct PkeyCtxFree { void operator()(EVP_PKEY_CTX* ctx) const { EVP_PKEY_CTX_free(ctx); } };
+    using Pkey = std::unique_ptr<EVP_PKEY, PkeyFree>;
+    using PkeyCtx = std::unique_ptr<EVP_PKEY_CTX, PkeyCtxFree>;
 
-    if (!RSA_generate_key_ex(rsa, 2048, bn, nullptr)) {
-        BN_free(bn);
-        RSA_free(rsa);
-        throw std::runtime_error("RSA_generate_key_ex failed");
+    // public keys are SubjectPublicKeyInfo, private keys PKCS#1 ("RSA PRIVATE KEY" in PEM),
+    // the formats written before the EVP API was used
+    const char* structureOf(int selection) {
+        return selection == EVP_PKEY_PUBLIC_KEY ? "SubjectPublicKeyInfo" : "type-specific";
     }
 
-    // write public key to PEM string
-    {
-        BIO* bio = BIO_new(BIO_s_mem());
-        PEM_write_bio_RSA_PUBKEY(bio, rsa);
+    // key from PEM or DER text in any structure (PKCS#8 too), nullptr when it does not parse
+    Pkey decodeKey(const std::string& data, const char* format, int selection) {
+        EVP_PKEY* key = nullptr;
+        OSSL_DECODER_CTX* ctx = OSSL_DECODER_CTX_new_for_pkey(
+            &key, format, nullptr, "RSA", selection, nullptr, nullptr);
+        if (!ctx) {
+            return nullptr;
+        }
+        auto* in = reinterpret_cast<const unsigned char*>(data.data());
+        size_t len = data.size();
+        if (!OSSL_DECODER_from_data(ctx, &in, &len)) {
+            EVP_PKEY_free(key);
+            key = nullptr;
+        }
+        OSSL_DECODER_CTX_free(ctx);
+        return Pkey(key);
+    }
 
-        char* data;
-        long len = BIO_get_mem_data(bio, &data);
-        kp.publicKeyPem.assign(data, len);
+    std::string encodeKey(EVP_PKEY* key, const char* format, int selection) {
+        OSSL_ENCODER_CTX* ctx = OSSL_ENCODER_CTX_new_for_pkey(key, selection, format, structureOf(selection), nullptr);
+        unsigned char* data = nullptr;
+        size_t len = 0;
+        bool ok = ctx && OSSL_ENCODER_to_data(ctx, &data, &len);
+        OSSL_ENCODER_CTX_free(ctx);
+        if (!ok) {
+            throw std::runtime_error(std::string("Failed to encode key as ") + format);
+        }
+        std::string out(reinterpret_cast<char*>(data), len);
+        OPENSSL_free(data);
+        return out;
+    }
 
-        BIO_free(bio);
+    Pkey requireKey(const std::string& data, const char* format, int selection) {
+        Pkey key = decodeKey(data, format, selection);
+        if (!key) {
+            throw std::runtime_error(std::string("Failed to load ")
+                                     + (selection == EVP_PKEY_PUBLIC_KEY ? "public" : "private")
+                                     + " key " + format);
+        }
+        return key;
     }
 
-    // write private key to PEM string
-    {
-        BIO* bio = BIO_new(BIO_s_mem());
-        PEM_write_bio_RSAPrivateKey(bio, rsa, nullptr, nullptr, 0, nullptr, nullptr);
+}
 
-        char* data;
-        long len = BIO_get_mem_data(bio, &data);
-        kp.privateKeyPem.assign(data, len);
+// OpenSSL 3 loads its algorithms and error strings on first use
+CryptoManager::CryptoManager() = default;
 
-        BIO_free(bio);
-    }
+// -------------RSA KEY GENERATION-------------
 
-    BN_free(bn);
-    RSA_free(rsa);
+CryptoManager::RSAKeyPair CryptoManager::generateRSAKeyPair() {
+    static auto& histogram = latency("rsa_keygen");
+    metrics::ScopedTimer timer(histogram);
+    trace::Span span("rsa_keygen", trace::Stage::Crypto);
+    RSAKeyPair kp;
+
+    // create RSA key, public exponent 65537
+    PkeyCtx ctx(EVP_PKEY_CTX_new_from_name(nullptr, "RSA", nullptr));
+    EVP_PKEY* generated = nullptr;
+    if (!ctx || EVP_PKEY_keygen_init(ctx.get()) <= 0 ||
+        EVP_PKEY_CTX_set_rsa_keygen_bits(ctx.get(), 2048) <= 0 ||
+        EVP_PKEY_generate(ctx.get(), &generated) <= 0) {
+        throw std::runtime_error("RSA key generation failed");
+    }
+    Pkey key(generated);
 
+    kp.publicKeyPem = encodeKey(key.get(), "PEM", EVP_PKEY_PUBLIC_KEY);
+    kp.privateKeyPem = encodeKey(key.get(), "PEM", EVP_PKEY_KEYPAIR);
     return kp;
 }
 
+// -------------RSA KEY ENCODING-------------
+
+std::string CryptoManager::publicKeyPemToDer(const std::string& publicKeyPem) {
+    Pkey key = requireKey(publicKeyPem, "PEM", EVP_PKEY_PUBLIC_KEY);
+    return encodeKey(key.get(), "DER", EVP_PKEY_PUBLIC_KEY);
+}
+
+std::string CryptoManager::publicKeyDerToPem(const std::string& publicKeyDer) {
+    Pkey key = requireKey(publicKeyDer, "DER", EVP_PKEY_PUBLIC_KEY);
+    return encodeKey(key.get(), "PEM", EVP_PKEY_PUBLIC_KEY);
+}
+
+std::string CryptoManager::privateKeyPemToDer(const std::string& privateKeyPem) {
+    Pkey key = requireKey(privateKeyPem, "PEM", EVP_PKEY_KEYPAIR);
+    return encodeKey(key.get(), "DER", EVP_PKEY_KEYPAIR);
+}
+
+std::string CryptoManager::privateKeyDerToPem(const std::string& privateKeyDer) {
+    Pkey key = requireKey(privateKeyDer, "DER", EVP_PKEY_KEYPAIR);
+    return encodeKey(key.get(), "PEM", EVP_PKEY_KEYPAIR);
+}
+
 // -------------RSA ENCRYPT-------------
 
+CryptoManager::PublicKey CryptoManager::loadPublicKey(const std::string& publicKeyPem) {
+    return decodeKey(publicKeyPem, "PEM", EVP_PKEY_PUBLIC_KEY);
+}
+
 std::string CryptoManager::rsaEncrypt(const std::string& plaintext,
                                       const std::string& publicKeyPem) {
-    BIO* bio = BIO_new_mem_buf(publicKeyPem.data(), publicKeyPem.size());
-    RSA* pubKey = PEM_read_bio_RSA_PUBKEY(bio, nullptr, nullptr, nullptr);
-    BIO_free(bio);
-
-    if (!pubKey)
-        throw std::runtime_error("Failed to load public key PEM");
-
-    std::string output;
-    output.resize(RSA_size(pubKey));
+    return rsaEncrypt(plaintext, PublicKey(requireKey(publicKeyPem, "PEM", EVP_PKEY_PUBLIC_KEY)));
+}
 
-    int len = RSA_public_encrypt(
-        plaintext.size(),
-        (const unsigned char*)plaintext.data(),
-        (unsigned char*)output.data(),
-        pubKey,
-        RSA_PKCS1_OAEP_PADDING
-    );
+std::string CryptoManager::rsaEncrypt(const std::string& plaintext, const PublicKey& publicKey) {
+    static auto& histogram = latency("rsa_encrypt");
+    metrics::ScopedTimer timer(histogram);
+    trace::Span span("rsa_encrypt", trace::Stage::Crypto);
+    if (!publicKey) {
+        throw std::runtime_error("RSA encrypt failed: no public key");
+    }
 
-    RSA_free(pubKey);
+    PkeyCtx ctx(EVP_PKEY_CTX_new_from_pkey(nullptr, publicKey.get(), nullptr));
+    size_t len = 0;
+    if (!ctx || EVP_PKEY_encrypt_init(ctx.get()) <= 0 ||
+        EVP_PKEY_CTX_set_rsa_padding(ctx.get(), RSA_PKCS1_OAEP_PADDING) <= 0 ||
+        EVP_PKEY_encrypt(ctx.get(), nullptr, &len,
+                         (const unsigned char*)plaintext.data(), plaintext.size()) <= 0) {
+        throw std::runtime_error("RSA encrypt failed");
+    }
 
-    if (len == -1)
-        throw std::runtime_error("RSA_public_encrypt failed");
+    std::string output(len, '\0');
+    if (EVP_PKEY_encrypt(ctx.get(), (unsigned char*)output.data(), &len,
+                         (const unsigned char*)plaintext.data(), plaintext.size()) <= 0) {
+        throw std::runtime_error("RSA encrypt failed");
+    }
 
     output.resize(len);
     return output;
@@ -95,28 +165,25 @@ std::string CryptoManager::rsaEncrypt(const std::string& plaintext,
 
 std::string CryptoManager::rsaDecrypt(const std::string& ciphertext,
                                       const std::string& privateKeyPem) {
-    BIO* bio = BIO_new_mem_buf(privateKeyPem.data(), privateKeyPem.size());
-    RSA* privKey = PEM_read_bio_RSAPrivateKey(bio, nullptr, nullptr, nullptr);
-    BIO_free(bio);
-
-    if (!privKey)
-        throw std::runtime_error("Failed to load private key PEM");
-
-    std::string output;
-    output.resize(RSA_size(privKey));
-
-    int len = RSA_private_decrypt(
-        ciphertext.size(),
-        (const unsigned char*)ciphertext.data(),
-        (unsigned char*)output.data(),
-        privKey,
-        RSA_PKCS1_OAEP_PADDING
-    );
-
-    RSA_free(privKey);
+    static auto& histogram = latency("rsa_decrypt");
+    metrics::ScopedTimer timer(histogram);
+    trace::Span span("rsa_decrypt", trace::Stage::Crypto);
+    Pkey privKey = requireKey(privateKeyPem, "PEM", EVP_PKEY_KEYPAIR);
+
+    PkeyCtx ctx(EVP_PKEY_CTX_new_from_pkey(nullptr, privKey.get(), nullptr));
+    size_t len = 0;
+    if (!ctx || EVP_PKEY_decrypt_init(ctx.get()) <= 0 ||
+        EVP_PKEY_CTX_set_rsa_padding(ctx.get(), RSA_PKCS1_OAEP_PADDING) <= 0 ||
+        EVP_PKEY_decrypt(ctx.get(), nullptr, &len,
+                         (const unsigned char*)ciphertext.data(), ciphertext.size()) <= 0) {
+        throw std::runtime_error("RSA decrypt failed");
+    }
 
-    if (len == -1)
-        throw std::runtime_error("RSA_private_decrypt failed");
+    std::string output(len, '\0');
+    if (EVP_PKEY_decrypt(ctx.get(), (unsigned char*)output.data(), &len,
+                         (const unsigned char*)ciphertext.data(), ciphertext.size()) <= 0) {
+        throw std::runtime_error("RSA decrypt failed");
+    }
 
     output.resize(len);
     return output;
@@ -136,6 +203,9 @@ CryptoManager::AESEncrypted CryptoManager::aesEncrypt(
     const std::string& plaintext,
     const std::vector<uint8_t>& key
 ) {
+    static auto& histogram = latency("aes_encrypt");
+    metrics::ScopedTimer timer(histogram);
+    trace::Span span("aes_encrypt", trace::Stage::Crypto);
     AESEncrypted result;
 
     EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
@@ -179,6 +249,9 @@ std::string CryptoManager::aesDecrypt(const std::vector<uint8_t>& key,
                                       const std::vector<uint8_t>& iv,
                                       const std::vector<uint8_t>& ciphertext,
                                       const std::vector<uint8_t>& tag) {
+    static auto& histogram = latency("aes_decrypt");
+    metrics::ScopedTimer timer(histogram);
+    trace::Span span("aes_decrypt", trace::Stage::Crypto);
     EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
     EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), nullptr, nullptr, nullptr);
 
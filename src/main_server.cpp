@@ -1,5 +1,152 @@
+// usage: messenger_server [--port N] [--local PATH] [--metrics PATH] [--trace PATH]
+//                         [--trace-rate R] [--slow-log PATH] [--slow-ms MS] [--linger SECONDS]
+//                         [--tls-cert PATH --tls-key PATH] [--ticket-rotation SECONDS]
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "network/TlsContext.h"
+#include "server/Server.h"
+#include "utils/Logger.h"
 
+namespace {
 
-int main() {
+    constexpr const char* kUsage =
+        "usage: messenger_server [--port N] [--local PATH] [--metrics PATH] [--trace PATH]"
+        " [--trace-rate R] [--slow-log PATH] [--slow-ms MS] [--linger SECONDS]"
+        " [--tls-cert PATH --tls-key PATH] [--ticket-rotation SECONDS]";
+
+    // PEM files named by --tls-cert and --tls-key
+    struct TlsFiles {
+        std::string certificate;
+        std::string privateKey;
+    };
+
+    // thrown by value() when an option is the last argument
+    struct MissingValue {};
+
+    bool readFile(const std::string& path, std::string& out) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            return false;
+        }
+        std::ostringstream data;
+        data << in.rdbuf();
+        out = data.str();
+        return true;
+    }
+
+    // all of text as an integer in [min, max]
+    // throws std::invalid_argument for anything else, std::out_of_range outside the bounds
+    long parseInteger(const std::string& text, long min = 0, long max = std::numeric_limits<long>::max()) {
+        size_t used = 0;
+        long value = std::stol(text, &used);
+        if (used != text.size()) {
+            throw std::invalid_argument(text);
+        }
+        if (value < min || value > max) {
+            throw std::out_of_range(text);
+        }
+        return value;
+    }
+
+    // likewise for a number in [0, 1]
+    double parseFraction(const std::string& text) {
+        size_t used = 0;
+        double value = std::stod(text, &used);
+        if (used != text.size()) {
+            throw std::invalid_argument(text);
+        }
+        if (!(value >= 0.0 && value <= 1.0)) {
+            throw std::out_of_range(text);
+        }
+        return value;
+    }
+
+    // false (logged) on an unknown argument, a missing value or a value that does not parse
+    bool parseArgs(int argc, char* argv[], Server::Options& opts, TlsFiles& tls) {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw MissingValue{};
+                }
+                return argv[++i];
+            };
+
+            try {
+                if (arg == "--port") opts.port = static_cast<unsigned short>(parseInteger(value(), 0, 65535));
+                else if (arg == "--local") opts.network.localPath = value();
+                else if (arg == "--metrics") opts.network.metricsPath = value();
+                else if (arg == "--trace") opts.network.tracePath = value();
+                else if (arg == "--trace-rate") opts.network.traceSampleRate = parseFraction(value());
+                else if (arg == "--slow-log") opts.network.slowLogPath = value();
+                else if (arg == "--slow-ms") opts.network.slowThreshold = std::chrono::milliseconds(parseInteger(value()));
+                else if (arg == "--linger") opts.network.sessionLinger = std::chrono::seconds(parseInteger(value()));
+                else if (arg == "--tls-cert") tls.certificate = value();
+                else if (arg == "--tls-key") tls.privateKey = value();
+                else if (arg == "--ticket-rotation") opts.network.ticketKeyRotation = std::chrono::seconds(parseInteger(value()));
+                else {
+                    LOG_ERROR("[Server] Unknown argument: " + arg);
+                    return false;
+                }
+            } catch (const MissingValue&) {
+                LOG_ERROR("[Server] Missing value for " + arg);
+                return false;
+            } catch (const std::invalid_argument&) {
+                LOG_ERROR("[Server] Not a number for " + arg + ": " + argv[i]);
+                return false;
+            } catch (const std::out_of_range&) {
+                LOG_ERROR("[Server] Out of range for " + arg + ": " + argv[i]);
+                return false;
+            }
+        }
+        if (tls.certificate.empty() != tls.privateKey.empty()) {
+            LOG_ERROR("[Server] --tls-cert and --tls-key go together");
+            return false;
+        }
+        return true;
+    }
+
+    // TlsContext::server from the PEM files, nullptr (logged) if they do not load
+    std::shared_ptr<TlsContext> loadTls(const TlsFiles& files) {
+        TlsContext::Credentials credentials;
+        if (!readFile(files.certificate, credentials.certificatePem)) {
+            LOG_ERROR("[Server] Cannot read " + files.certificate);
+            return nullptr;
+        }
+        if (!readFile(files.privateKey, credentials.privateKeyPem)) {
+            LOG_ERROR("[Server] Cannot read " + files.privateKey);
+            return nullptr;
+        }
+        try {
+            return TlsContext::server(credentials);
+        } catch (const std::runtime_error& e) {
+            LOG_ERROR(std::string("[Server] ") + e.what());
+            return nullptr;
+        }
+    }
+
+}
+
+int main(int argc, char* argv[]) {
+    Server::Options opts;
+    TlsFiles tls;
+    if (!parseArgs(argc, argv, opts, tls)) {
+        LOG_ERROR(kUsage);
+        Logger::flush();
+        return 2;
+    }
+    if (!tls.certificate.empty()) {
+        opts.network.tls = loadTls(tls);
+        if (!opts.network.tls) {
+            Logger::flush();
+            return 1;
+        }
+    }
+
+    Server server(std::move(opts));
+    server.run();
     return 0;
-}
\ No newline at end of file
+}
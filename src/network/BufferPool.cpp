@@ -0,0 +1,41 @@
+#include "network/BufferPool.h"
+
+BufferPool::BufferPool(size_t maxFree)
+    : maxFree_(maxFree) {}
+
+BufferPool& BufferPool::shared() {
+    static BufferPool pool;
+    return pool;
+}
+
+std::string BufferPool::acquire() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!free_.empty()) {
+            std::string buffer = std::move(free_.back());
+            free_.pop_back();
+            return buffer;
+        }
+    }
+
+    std::string buffer;
+    buffer.reserve(kBufferSize);
+    return buffer;
+}
+
+void BufferPool::release(std::string buffer) {
+    if (buffer.capacity() < kBufferSize || buffer.capacity() > 4 * kBufferSize) {
+        return;
+    }
+    buffer.clear();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.size() < maxFree_) {
+        free_.push_back(std::move(buffer));
+    }
+}
+
+size_t BufferPool::freeCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return free_.size();
+}
@@ -0,0 +1,94 @@
+#include "network/Compression.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include "utils/ByteOrder.h"
+
+std::optional<Compression> compression::fromName(std::string_view name) {
+    if (name == "none") return Compression::None;
+    if (name == "deflate") return Compression::Deflate;
+    return std::nullopt;
+}
+
+const char* compression::name(Compression compression) {
+    return compression == Compression::Deflate ? "deflate" : "none";
+}
+
+compression::Deflater::Deflater() {
+    // raw deflate (negative window bits): blocks carry no zlib header or checksum
+    if (deflateInit2(&stream_, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("deflateInit2 failed");
+    }
+}
+
+compression::Deflater::~Deflater() {
+    deflateEnd(&stream_);
+}
+
+void compression::Deflater::appendBlock(std::string& out, std::string_view data) {
+    size_t header = out.size();
+    out.append(kBlockHeader, '\0');
+
+    if (data.size() < kThreshold) {
+        out.append(data);
+        out[header] = 0;
+        byteorder::setU32(out, header + 1, static_cast<uint32_t>(data.size()));
+        return;
+    }
+
+    stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream_.avail_in = static_cast<uInt>(data.size());
+
+    // sync flush ends the block on a byte boundary without resetting the window
+    size_t bound = deflateBound(&stream_, static_cast<uLong>(data.size())) + 16;
+    do {
+        size_t used = out.size();
+        out.resize(used + bound);
+        stream_.next_out = reinterpret_cast<Bytef*>(out.data() + used);
+        stream_.avail_out = static_cast<uInt>(bound);
+        deflate(&stream_, Z_SYNC_FLUSH);
+        out.resize(out.size() - stream_.avail_out);
+    } while (stream_.avail_out == 0);
+
+    out[header] = static_cast<char>(kDeflated);
+    byteorder::setU32(out, header + 1, static_cast<uint32_t>(out.size() - header - kBlockHeader));
+}
+
+compression::Inflater::Inflater() {
+    if (inflateInit2(&stream_, -15) != Z_OK) {
+        throw std::runtime_error("inflateInit2 failed");
+    }
+}
+
+compression::Inflater::~Inflater() {
+    inflateEnd(&stream_);
+}
+
+bool compression::Inflater::inflate(std::string_view payload, std::string& out, size_t maxOut) {
+    stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(payload.data()));
+    stream_.avail_in = static_cast<uInt>(payload.size());
+
+    // keep going while input is left or inflate filled all the room it was given
+    do {
+        if (out.size() >= maxOut) {
+            return false;
+        }
+
+        // grow in steps so a small block cannot claim a large allocation up front
+        size_t used = out.size();
+        size_t room = std::min<size_t>(std::max<size_t>(payload.size() * 4, 4096), maxOut - used);
+        out.resize(used + room);
+        stream_.next_out = reinterpret_cast<Bytef*>(out.data() + used);
+        stream_.avail_out = static_cast<uInt>(room);
+
+        int rc = ::inflate(&stream_, Z_SYNC_FLUSH);
+        out.resize(out.size() - stream_.avail_out);
+
+        // Z_BUF_ERROR only means nothing was left to do, a finished stream is not expected
+        if (rc != Z_OK && rc != Z_BUF_ERROR) {
+            return false;
+        }
+    } while (stream_.avail_in > 0 || stream_.avail_out == 0);
+
+    return true;
+}
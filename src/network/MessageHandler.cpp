@@ -1,8 +1,209 @@
 #include "network/MessageHandler.h"
+#include <algorithm>
+#include <cctype>
+#include <optional>
 #include "network/tcpServer.h"
+#include "network/BufferPool.h"
+#include "network/RequestContext.h"
 #include "utils/Logger.h"
 
-MessageHandler::MessageHandler(TcpServer* server, FileStorage& storage)
+namespace {
+
+    // messages loaded from storage per step of a streamed get_messages
+    constexpr size_t kHistoryBatch = 64;
+
+    // group names become (escaped) folder names, keep them short and readable
+    bool validGroupName(const std::string& group) {
+        if (group.empty() || group.size() > 64) {
+            return false;
+        }
+        return std::all_of(group.begin(), group.end(), [](char c) {
+            return std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_';
+        });
+    }
+
+    bool isMember(const MessageStore::GroupInfo& info, const std::string& username) {
+        return std::find(info.members.begin(), info.members.end(), username) != info.members.end();
+    }
+
+    // result of the worker half of send_message
+    struct SealedMessage {
+        bool keysFound = false;
+        CryptoManager::AESEncrypted ciphertext;
+        std::string aesForSender;
+        std::string aesForRecipient;
+    };
+
+    // get_messages response produced batch by batch as the socket accepts it
+    // json peers get the same single object as before, spread over several buffers:
+    //   {"messages":[...],"status":"success"}
+    // binary peers get one frame per batch with "more" set on all but the last
+    // a fetch holds one batch and one send buffer at a time, whatever the history length
+    class HistoryStream : public OutgoingStream, public std::enable_shared_from_this<HistoryStream> {
+    public:
+        HistoryStream(MessageStore& storage,
+                      const TcpConnection::pointer& requester,
+                      std::string user,
+                      std::string peer,
+                      size_t offset,
+                      size_t limit)
+            : storage_(storage),
+              request_(RequestContext::current()),
+              requester_(requester),
+              executor_(requester->executor()),
+              format_(requester->wireFormat()),
+              user_(std::move(user)),
+              peer_(std::move(peer)),
+              offset_(offset),
+              remaining_(limit),
+              unlimited_(limit == 0) {}
+
+        // fetch the first batch while earlier responses are still being written
+        void start() { load(); }
+
+        State next(std::string& buffer) override {
+            // batches after the first are written outside of the request's handler
+            RequestContext::Scope scope(request_);
+            trace::Span span("stream", trace::Stage::Write);
+            size_t before = buffer.size();
+            State state = format_ == WireFormat::Json ? nextJson(buffer) : nextBinary(buffer);
+            if (request_) {
+                request_->onReply(false, buffer.size() - before);
+            }
+            return state;
+        }
+
+    private:
+        State nextJson(std::string& buffer) {
+            for (;;) {
+                if (batchReady_ && batchPos_ < batch_.size()) {
+                    if (buffer.size() >= BufferPool::kBufferSize) {
+                        return State::Ready;
+                    }
+                    buffer.append(sentAny_ ? "," : R"({"messages":[)");
+                    sentAny_ = true;
+                    wire::appendFrame(buffer, batch_[batchPos_++], WireFormat::Json);
+                    continue;
+                }
+                releaseBatch();
+
+                if (exhausted_) {
+                    buffer.append(sentAny_ ? R"(],"status":"success"})"
+                                           : R"({"status":"success","message":"[]"})");
+                    return State::Done;
+                }
+                if (!loading_) {
+                    load();
+                }
+                return State::Pending;
+            }
+        }
+
+        State nextBinary(std::string& buffer) {
+            if (!batchReady_) {
+                if (!loading_) {
+                    load();
+                }
+                return State::Pending;
+            }
+
+            if (batch_.empty() && !sentAny_) {
+                releaseBatch();
+                wire::appendFrame(buffer, {{"status", "success"}, {"message", "[]"}}, format_);
+                return State::Done;
+            }
+
+            for (auto& message : batch_) {
+                wire::toBinaryFields(message);
+            }
+            bool more = !exhausted_;
+            wire::appendFrame(buffer, {
+                {"status", "success"},
+                {"messages", std::move(batch_)},
+                {"more", more}
+            }, format_);
+            sentAny_ = true;
+            releaseBatch();
+
+            if (!more) {
+                return State::Done;
+            }
+            load();
+            return State::Ready;
+        }
+
+        void load() {
+            size_t count = unlimited_ ? kHistoryBatch : std::min(kHistoryBatch, remaining_);
+            loading_ = true;
+
+            static auto& latency = MessageStore::callLatency("load_range");
+            auto self = shared_from_this();
+            auto start = std::chrono::steady_clock::now();
+            trace::Covered covered;   // recorded as a whole on completion
+            storage_.loadConversationRangeAsync(
+                user_, peer_, offset_, count, executor_,
+                [self, count, start](nlohmann::json messages) {
+                    auto end = std::chrono::steady_clock::now();
+                    latency.record(end - start);
+                    // batches after the first are loaded outside of the request's handler
+                    RequestContext::Scope scope(self->request_);
+                    trace::record("load_range", trace::Stage::Storage, start, end);
+                    self->onBatch(std::move(messages), count);
+                });
+        }
+
+        void onBatch(nlohmann::json messages, size_t requested) {
+            size_t received = messages.size();
+            batch_ = std::move(messages);
+            batchPos_ = 0;
+            batchReady_ = true;
+            loading_ = false;
+
+            offset_ += received;
+            if (request_) {
+                request_->trace().setConversationSize(offset_);   // exact once exhausted
+            }
+            if (!unlimited_) {
+                remaining_ -= std::min(remaining_, received);
+            }
+            // a short batch is the end of the conversation
+            if (received < requested || (!unlimited_ && remaining_ == 0)) {
+                exhausted_ = true;
+            }
+
+            if (auto requester = requester_.lock()) {
+                requester->resumeStream();
+            }
+        }
+
+        void releaseBatch() {
+            batchReady_ = false;
+            batchPos_ = 0;
+            batch_ = nlohmann::json();
+        }
+
+        MessageStore& storage_;
+        RequestContext::pointer request_;          // the get_messages request lasts as long as its stream
+        std::weak_ptr<TcpConnection> requester_;   // the connection owns this stream
+        asio::any_io_executor executor_;
+        WireFormat format_;
+        std::string user_;
+        std::string peer_;
+        size_t offset_;
+        size_t remaining_;
+        bool unlimited_;
+
+        nlohmann::json batch_;
+        size_t batchPos_ = 0;
+        bool batchReady_ = false;
+        bool loading_ = false;
+        bool exhausted_ = false;
+        bool sentAny_ = false;
+    };
+
+}
+
+MessageHandler::MessageHandler(TcpServer* server, MessageStore& storage)
     : server_(server), storage_(storage), crypto_() {}
 
 bool MessageHandler::processMessage(
@@ -10,7 +211,7 @@ bool MessageHandler::processMessage(
     const std::string& to,
     const std::string& message
 ) {
-    std::cout << "proccessMsg called" << "\n";
+    LOG_DEBUG("[MessageHandler] processMessage called");
 
     // server trusted sender
     std::string from = sender->getUsername();
@@ -31,53 +232,84 @@ bool MessageHandler::processMessage(
         return false;
     }
 
-    // fetch RSA public keys
-    std::string sender_pub    = storage_.getUserPublicKey(from);
-    std::string recipient_pub = storage_.getUserPublicKey(to);
+    // RSA public key lookups and two RSA encryptions, the slow part of a send, run on a worker
+    // keys come parsed from the sender's session once looked up, storage is read and the PEM
+    // parsed once per peer
+    return server_->offload(sender,
+        [this, session = sender->session(), from, to, message]() {
+            static auto& keyLatency = MessageStore::callLatency("public_key");
+            auto loadKey = [this](const std::string& user) {
+                metrics::ScopedTimer timer(keyLatency);
+                trace::Span span("public_key", trace::Stage::Lookup);
+                return storage_.getUserPublicKey(user);
+            };
+            SealedMessage sealed;
+            CryptoManager::PublicKey sender_pub    = session->publicKey(from, loadKey);
+            CryptoManager::PublicKey recipient_pub = session->publicKey(to, loadKey);
+            if (!sender_pub || !recipient_pub) {
+                return sealed;
+            }
 
-    if (sender_pub.empty() || recipient_pub.empty()) {
-        sender->send(R"({"status":"error","message":"Missing RSA keys"})");
-        return false;
-    }
+            CryptoManager crypto;
 
-    // encrypt message with AES
-    std::vector<uint8_t> aes_key = crypto_.generateAESKey();
-    CryptoManager::AESEncrypted ciphertext = crypto_.aesEncrypt(message, aes_key);
+            // encrypt message with AES
+            std::vector<uint8_t> aes_key = crypto.generateAESKey();
+            sealed.ciphertext = crypto.aesEncrypt(message, aes_key);
 
-    // Convert AES key to string using black magic
-    std::string aes_key_str(
-        reinterpret_cast<char*>(aes_key.data()),
-        aes_key.size()
-    );
+            // Convert AES key to string using black magic
+            std::string aes_key_str(
+                reinterpret_cast<char*>(aes_key.data()),
+                aes_key.size()
+            );
 
-    // encrypt AES key for both users
-    std::string aes_for_sender    = crypto_.rsaEncrypt(aes_key_str, sender_pub);
-    std::string aes_for_recipient = crypto_.rsaEncrypt(aes_key_str, recipient_pub);
+            // encrypt AES key for both users
+            sealed.aesForSender    = crypto.rsaEncrypt(aes_key_str, sender_pub);
+            sealed.aesForRecipient = crypto.rsaEncrypt(aes_key_str, recipient_pub);
+            sealed.keysFound = true;
+            return sealed;
+        },
+        [this, sender, from, to](SealedMessage sealed) {
+            if (!sealed.keysFound) {
+                sender->send(R"({"status":"error","message":"Missing RSA keys"})");
+                return;
+            }
 
-    long timestamp = std::chrono::system_clock::to_time_t(
-        std::chrono::system_clock::now()
-    );
+            long timestamp = std::chrono::system_clock::to_time_t(
+                std::chrono::system_clock::now()
+            );
 
-    bool stored = storage_.appendConversationMessage(
-        from,
-        to,
-        ciphertext,
-        aes_for_sender,
-        aes_for_recipient,
-        timestamp
+            // response is sent once the write completes, the event loop is not held up by the disk
+            static auto& appendLatency = MessageStore::callLatency("append_message");
+            auto start = std::chrono::steady_clock::now();
+            trace::Covered covered;   // recorded as a whole on completion
+            storage_.appendConversationMessageAsync(
+                from,
+                to,
+                sealed.ciphertext,
+                sealed.aesForSender,
+                sealed.aesForRecipient,
+                timestamp,
+                sender->executor(),
+                RequestContext::bind([sender, start](bool stored) {
+                    auto end = std::chrono::steady_clock::now();
+                    appendLatency.record(end - start);
+                    trace::record("append_message", trace::Stage::Storage, start, end);
+                    if (!stored) {
+                        sender->send(R"({"status":"error","message":"Failed to save message"})");
+                        return;
+                    }
+                    sender->send(R"({"status":"success","message":"Message stored"})");
+                })
+            );
+        }
     );
-    if (!stored) {
-        sender->send(R"({"status":"error","message":"Failed to save message"})");
-        return false;
-    }
-
-    sender->send(R"({"status":"success","message":"Message stored"})");
-    return true;
 }
 
 bool MessageHandler::fetchMessages(
     const TcpConnection::pointer requester,
-    const std::string& withUser
+    const std::string& withUser,
+    size_t offset,
+    size_t limit
 ) {
     std::string requesterName = requester->getUsername();
 
@@ -96,19 +328,316 @@ bool MessageHandler::fetchMessages(
         return false;
     }
 
-    // load conversation JSON
-    nlohmann::json convo = storage_.loadConversation(requesterName, withUser);
+    // written batch by batch as the socket drains, the history is never held in full
+    auto stream = std::make_shared<HistoryStream>(storage_, requester, requesterName, withUser, offset, limit);
+    stream->start();
+    requester->sendStream(stream);
+    return true;
+}
 
-    if (convo.is_null()) {
-        requester->send(R"({"status":"success","message":"[]"})");
-        return true;
+bool MessageHandler::listConversations(const TcpConnection::pointer requester) {
+    std::string requesterName = requester->getUsername();
+
+    if (requesterName.empty()) {
+        requester->send(R"({"status":"error","message":"Not logged in"})");
+        return false;
+    }
+
+    // one round trip for the whole chat list, no conversation files are read
+    static auto& latency = MessageStore::callLatency("list_summaries");
+    std::vector<MessageStore::ConversationSummary> summaries;
+    {
+        metrics::ScopedTimer timer(latency);
+        trace::Span span("list_summaries", trace::Stage::Storage);
+        summaries = storage_.listConversationSummaries(requesterName);
+    }
+
+    nlohmann::json conversations = nlohmann::json::array();
+    for (const auto& summary : summaries) {
+        conversations.push_back({
+            {"peer", summary.peer},
+            {"last_timestamp", summary.lastTimestamp},
+            {"last_seq", summary.lastSeq},
+            {"unread", summary.unread}
+        });
     }
 
-    // build response
     nlohmann::json response;
     response["status"] = "success";
-    response["messages"] = convo["messages"];
+    response["conversations"] = std::move(conversations);
 
-    requester->send(response.dump());
+    requester->sendJson(response);
     return true;
-}
\ No newline at end of file
+}
+
+bool MessageHandler::markRead(
+    const TcpConnection::pointer requester,
+    const std::string& withUser,
+    uint64_t seq
+) {
+    std::string requesterName = requester->getUsername();
+
+    if (requesterName.empty()) {
+        requester->send(R"({"status":"error","message":"Not logged in"})");
+        return false;
+    }
+
+    // cursors never move back, one at or below the session's last stored cursor is a no-op
+    // clients resend on every scroll, those no longer reach storage
+    Session& session = *requester->session();
+    uint64_t cached = session.readCursor(withUser);
+    if (cached > 0 && seq <= cached) {
+        requester->send(R"({"status":"success","message":"Marked as read"})");
+        return true;
+    }
+
+    static auto& latency = MessageStore::callLatency("mark_read");
+    std::optional<uint64_t> cursor;
+    {
+        metrics::ScopedTimer timer(latency);
+        trace::Span span("mark_read", trace::Stage::Storage);
+        cursor = storage_.markRead(requesterName, withUser, seq);
+    }
+    if (!cursor) {
+        requester->send(R"({"status":"error","message":"No conversation with user"})");
+        return false;
+    }
+    session.setReadCursor(withUser, *cursor);
+
+    requester->send(R"({"status":"success","message":"Marked as read"})");
+    return true;
+}
+
+bool MessageHandler::createGroup(
+    const TcpConnection::pointer requester,
+    const std::string& group,
+    const std::vector<std::string_view>& members
+) {
+    std::string creator = requester->getUsername();
+
+    if (!validGroupName(group)) {
+        requester->send(R"({"status":"error","message":"Invalid group name"})");
+        return false;
+    }
+
+    // creator first, then the listed users in order without repeats
+    std::vector<std::string> memberList{creator};
+    for (std::string_view member : members) {
+        if (!member.empty() && std::find(memberList.begin(), memberList.end(), member) == memberList.end()) {
+            memberList.emplace_back(member);
+        }
+    }
+
+    if (memberList.size() > kMaxGroupMembers) {
+        requester->send(R"({"status":"error","message":"Too many group members"})");
+        return false;
+    }
+
+    // creating the group waits for its file to reach the disk
+    return server_->offload(requester,
+        [this, group, memberList = std::move(memberList)]() -> nlohmann::json {
+            for (const auto& member : memberList) {
+                if (!storage_.userExists(member)) {
+                    return {{"status", "error"}, {"message", "User does not exist"}, {"user", member}};
+                }
+            }
+
+            static auto& latency = MessageStore::callLatency("create_group");
+            metrics::ScopedTimer timer(latency);
+            trace::Span span("create_group", trace::Stage::Storage);
+            if (!storage_.createGroup(group, memberList)) {
+                return {{"status", "error"}, {"message", "Group already exists"}};
+            }
+
+            return {
+                {"status", "success"},
+                {"message", "Group created"},
+                {"group", group},
+                {"members", memberList}
+            };
+        },
+        [requester](nlohmann::json reply) {
+            requester->sendJson(reply);
+        }
+    );
+}
+
+void MessageHandler::withEpochKey(
+    const TcpConnection::pointer& sender,
+    const std::string& group,
+    const MessageStore::GroupInfo& info,
+    EpochWaiter waiter
+) {
+    // info may have been read before an epoch this process started, a newer key is current too
+    auto it = epochKeys_.find(group);
+    if (it != epochKeys_.end() && it->second.epoch >= info.epoch) {
+        waiter(&it->second);
+        return;
+    }
+
+    auto pending = pendingEpochs_.find(group);
+    // waiters run later from another request's completion, each keeps its own request
+    if (pending != pendingEpochs_.end()) {
+        pending->second.push_back(RequestContext::bind(std::move(waiter)));
+        return;
+    }
+    pendingEpochs_[group].push_back(RequestContext::bind(std::move(waiter)));
+
+    // the only per-member work of a group: wrap the new key once for everyone
+    bool queued = server_->offload(sender,
+        [this, group, info]() -> std::optional<EpochKey> {
+            CryptoManager crypto;
+            EpochKey next{info.epoch + 1, crypto.generateAESKey()};
+            std::string rawKey(reinterpret_cast<const char*>(next.key.data()), next.key.size());
+
+            std::unordered_map<std::string, std::string> wrapped;
+            for (const auto& member : info.members) {
+                std::string publicKey = storage_.getUserPublicKey(member);
+                if (publicKey.empty()) {
+                    return std::nullopt;
+                }
+                wrapped.emplace(member, crypto.rsaEncrypt(rawKey, publicKey));
+            }
+
+            static auto& latency = MessageStore::callLatency("start_group_epoch");
+            metrics::ScopedTimer timer(latency);
+            trace::Span span("start_group_epoch", trace::Stage::Storage);
+            if (!storage_.startGroupEpoch(group, next.epoch, wrapped)) {
+                return std::nullopt;
+            }
+            return next;
+        },
+        [this, group](std::optional<EpochKey> next) {
+            auto waiters = std::move(pendingEpochs_[group]);
+            pendingEpochs_.erase(group);
+
+            const EpochKey* key = next ? &(epochKeys_[group] = std::move(*next)) : nullptr;
+            for (auto& waiting : waiters) {
+                waiting(key);
+            }
+        }
+    );
+    if (!queued) {
+        pendingEpochs_.erase(group);   // the sender was told the server is busy
+    }
+}
+
+bool MessageHandler::sendGroupMessage(
+    TcpConnection::pointer sender,
+    const std::string& group,
+    const std::string& message
+) {
+    std::string from = sender->getUsername();
+
+    // the group may have to be read from disk first
+    return server_->offload(sender,
+        [this, group]() {
+            static auto& latency = MessageStore::callLatency("get_group");
+            metrics::ScopedTimer timer(latency);
+            trace::Span span("get_group", trace::Stage::Lookup);
+            return storage_.getGroup(group);
+        },
+        [this, sender, group, from, message](std::optional<MessageStore::GroupInfo> info) {
+            if (!info) {
+                sender->send(R"({"status":"error","message":"Group does not exist"})");
+                return;
+            }
+            if (!isMember(*info, from)) {
+                sender->send(R"({"status":"error","message":"Not a group member"})");
+                return;
+            }
+
+            withEpochKey(sender, group, *info,
+                [this, sender, group, message, members = info->members](const EpochKey* key) mutable {
+                    if (!key) {
+                        sender->send(R"({"status":"error","message":"Missing RSA keys"})");
+                        return;
+                    }
+                    sealGroupMessage(sender, group, std::move(members), *key, message);
+                });
+        }
+    );
+}
+
+void MessageHandler::sealGroupMessage(
+    const TcpConnection::pointer& sender,
+    const std::string& group,
+    std::vector<std::string> members,
+    const EpochKey& key,
+    const std::string& message
+) {
+    // one encryption for the whole group, whatever its size
+    CryptoManager::AESEncrypted ciphertext = crypto_.aesEncrypt(message, key.key);
+    long timestamp = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+
+    static auto& latency = MessageStore::callLatency("append_group_message");
+    auto start = std::chrono::steady_clock::now();
+    trace::Covered covered;   // recorded as a whole on completion
+    storage_.appendGroupMessageAsync(
+        group, sender->getUsername(), key.epoch, ciphertext, timestamp, sender->executor(),
+        RequestContext::bind([this, sender, start, members = std::move(members)](nlohmann::json record) {
+            auto end = std::chrono::steady_clock::now();
+            latency.record(end - start);
+            trace::record("append_group_message", trace::Stage::Storage, start, end);
+            if (record.is_null()) {
+                sender->send(R"({"status":"error","message":"Failed to save message"})");
+                return;
+            }
+            if (auto* trace = trace::RequestTrace::current()) {
+                trace->setConversationSize(record["seq"].get<uint64_t>());
+            }
+            sender->sendJson({{"status", "success"}, {"message", "Message stored"}, {"seq", record["seq"]}});
+
+            // other connections of the sender get it too, they show the same conversation
+            server_->deliver(members, {
+                {"status", "group_message"},
+                {"record", std::move(record)}
+            }, sender.get());
+        })
+    );
+}
+
+bool MessageHandler::getGroup(
+    const TcpConnection::pointer requester,
+    const std::string& group,
+    size_t offset,
+    size_t limit
+) {
+    std::string requesterName = requester->getUsername();
+
+    // group file and messages may have to be read from disk
+    return server_->offload(requester,
+        [this, group, requesterName, offset, limit]() -> nlohmann::json {
+            static auto& latency = MessageStore::callLatency("load_group");
+            metrics::ScopedTimer timer(latency);
+            trace::Span span("load_group", trace::Stage::Storage);
+            std::optional<MessageStore::GroupInfo> info = storage_.getGroup(group);
+            if (!info || !isMember(*info, requesterName)) {
+                return {{"status", "error"}, {"message", "Group does not exist"}};
+            }
+
+            // only this member's wrapped keys, the others are of no use to them
+            nlohmann::json keys = nlohmann::json::object();
+            for (const auto& [epoch, wrapped] : storage_.groupKeys(group, requesterName)) {
+                keys[std::to_string(epoch)] = base64::encode(wrapped);
+            }
+
+            return {
+                {"status", "success"},
+                {"group", group},
+                {"members", info->members},
+                {"epoch", info->epoch},
+                {"keys", std::move(keys)},
+                {"messages", storage_.loadGroupMessages(group, offset, limit)}
+            };
+        },
+        [requester](nlohmann::json reply) {
+            if (requester->wireFormat() != WireFormat::Json && reply.contains("messages")) {
+                for (auto& message : reply["messages"]) {
+                    wire::toBinaryFields(message);
+                }
+            }
+            requester->sendJson(reply);
+        }
+    );
+}
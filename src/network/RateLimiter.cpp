@@ -0,0 +1,112 @@
+#include "network/RateLimiter.h"
+
+#include <algorithm>
+
+TokenBucket::Clock::duration TokenBucket::take(const RateLimit& limit, Clock::time_point now) {
+    if (limit.perSecond <= 0) {
+        return Clock::duration::zero();
+    }
+
+    // each token moves fullAt_ one interval later, the bucket is empty once that lands
+    // more than burst intervals in the future
+    const auto interval = static_cast<int64_t>(1e9 / limit.perSecond);
+    const auto capacity = static_cast<int64_t>(limit.burst * static_cast<double>(interval));
+    const int64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        now.time_since_epoch()).count();
+
+    int64_t fullAt = fullAt_.load(std::memory_order_relaxed);
+    for (;;) {
+        int64_t next = std::max(fullAt, nowNs) + interval;
+        if (next - nowNs > capacity) {
+            return std::chrono::duration_cast<Clock::duration>(
+                std::chrono::nanoseconds(next - nowNs - capacity));
+        }
+        if (fullAt_.compare_exchange_weak(fullAt, next, std::memory_order_relaxed)) {
+            return Clock::duration::zero();
+        }
+    }
+}
+
+void TokenBucket::giveBack(const RateLimit& limit) {
+    if (limit.perSecond <= 0) {
+        return;
+    }
+    // never credits more than one take(): fullAt_ only lands before now if it was full already
+    fullAt_.fetch_sub(static_cast<int64_t>(1e9 / limit.perSecond), std::memory_order_relaxed);
+}
+
+RateLimiter::Limits RateLimiter::Limits::defaults() {
+    using actions::RateClass;
+    auto index = [](RateClass rate) { return static_cast<size_t>(rate); };
+
+    Limits limits;
+    // Free stays unlimited, every account request costs an RSA keypair or a password hash
+    limits.perConnection[index(RateClass::Auth)]  = {0.5, 10};
+    limits.perConnection[index(RateClass::Write)] = {50, 200};
+    limits.perConnection[index(RateClass::Read)]  = {100, 200};
+
+    limits.perUser[index(RateClass::Auth)]  = {0.5, 10};
+    limits.perUser[index(RateClass::Write)] = {100, 400};
+    limits.perUser[index(RateClass::Read)]  = {200, 400};
+    return limits;
+}
+
+RateLimiter::RateLimiter(Limits limits)
+    : limits_(limits)
+{}
+
+std::shared_ptr<RateLimiter::Buckets> RateLimiter::userBuckets(const std::string& username) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto& entry = users_[username];
+    if (auto buckets = entry.lock()) {
+        return buckets;
+    }
+
+    auto buckets = std::make_shared<Buckets>();
+    entry = buckets;
+    sweep_NoLock();
+    return buckets;
+}
+
+size_t RateLimiter::trackedUsers() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return users_.size();
+}
+
+void RateLimiter::sweep_NoLock() {
+    // more map buckets per new entry than entries per map bucket (load factor <= 1), so
+    // users whose connections have all gone are cleared faster than new ones arrive
+    constexpr size_t kBucketsPerCall = 2;
+
+    std::vector<std::string> expired;
+    for (size_t i = 0; i < kBucketsPerCall; i++) {
+        size_t bucket = sweepBucket_++ % users_.bucket_count();
+        for (auto it = users_.begin(bucket); it != users_.end(bucket); ++it) {
+            if (it->second.expired()) {
+                expired.push_back(it->first);
+            }
+        }
+    }
+    for (const auto& username : expired) {
+        users_.erase(username);
+    }
+}
+
+RateLimiter::Clock::duration RateLimiter::check(Buckets& connection,
+                                                Buckets* user,
+                                                actions::RateClass rate,
+                                                Clock::time_point now) const {
+    const auto index = static_cast<size_t>(rate);
+
+    auto wait = connection[index].take(limits_.perConnection[index], now);
+    if (wait != Clock::duration::zero() || !user) {
+        return wait;
+    }
+    wait = (*user)[index].take(limits_.perUser[index], now);
+    if (wait != Clock::duration::zero()) {
+        // turned down, the connection is not charged for it
+        connection[index].giveBack(limits_.perConnection[index]);
+    }
+    return wait;
+}
@@ -0,0 +1,14 @@
+#include "network/RequestContext.h"
+#include <string>
+
+thread_local RequestContext::pointer RequestContext::current_;
+
+RequestContext::ActionMetrics RequestContext::ActionMetrics::forAction(std::string_view action) {
+    auto& registry = metrics::Registry::global();
+    std::string labels = "action=\"" + std::string(action) + "\"";
+    return {
+        &registry.counter("messenger_requests_total", "Requests dispatched, by action", labels),
+        &registry.counter("messenger_request_errors_total", "Requests answered with an error, by action", labels),
+        &registry.histogram("messenger_request_seconds", "Time from dispatch to the last reply, by action", labels)
+    };
+}
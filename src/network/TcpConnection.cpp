@@ -1,38 +1,85 @@
 #include "network/tcpConnection.h"
 #include "network/tcpServer.h"
-#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <limits>
 
+#include "network/BufferPool.h"
+#include "network/RequestContext.h"
+#include "utils/ByteOrder.h"
 #include "utils/Logger.h"
 
+const char* closeReasonName(CloseReason reason) {
+    switch (reason) {
+        case CloseReason::Closed:               return "closed";
+        case CloseReason::IdleTimeout:          return "idle_timeout";
+        case CloseReason::ReadTimeout:          return "read_timeout";
+        case CloseReason::WriteTimeout:         return "write_timeout";
+        case CloseReason::FrameTooLarge:        return "frame_too_large";
+        case CloseReason::InboundOverflow:      return "inbound_overflow";
+        case CloseReason::OutboundOverflow:     return "outbound_overflow";
+        case CloseReason::CompressionError:     return "compression_error";
+        case CloseReason::TlsHandshakeFailed:   return "tls_handshake_failed";
+    }
+    return "closed";
+}
+
+ConnectionLimits ConnectionLimits::unlimited() {
+    constexpr size_t none = std::numeric_limits<size_t>::max();
+    return ConnectionLimits{wire::kMaxFrame, none, none, none, none};
+}
+
 TcpConnection::TcpConnection(asio::io_context& io_context, TcpServer* server)
     : socket_(io_context),
       io_context_(io_context),
-      server_(server),
-      username_("")
+      server_(server)
 {}
 
+const std::string& TcpConnection::getUsername() const {
+    static const std::string none;
+    return session_ ? session_->username() : none;
+}
+
 TcpConnection::pointer TcpConnection::create(asio::io_context& io_context, TcpServer* server) {
     return pointer(new TcpConnection(io_context, server));
 }
 
-asio::ip::tcp::socket& TcpConnection::socket() {
+TcpConnection::Socket& TcpConnection::socket() {
     return socket_;
 }
 
+namespace {
+    bool isLocalEndpoint(const TcpConnection::Socket::endpoint_type& endpoint) {
+        return endpoint.protocol() == asio::generic::stream_protocol(asio::local::stream_protocol());
+    }
+
+    // "address:port" for tcp peers, unix domain peers are usually unnamed
+    std::string describePeer(const TcpConnection::Socket::endpoint_type& endpoint) {
+        if (isLocalEndpoint(endpoint)) {
+            return "local socket";
+        }
+
+        asio::ip::tcp::endpoint ip;
+        std::memcpy(ip.data(), endpoint.data(), std::min(endpoint.size(), ip.capacity()));
+        return ip.address().to_string() + ":" + std::to_string(ip.port());
+    }
+}
+
 bool TcpConnection::beginRead() {
     if (!socket_.is_open()) {
-        std::cerr << "[TcpConnection] Cannot start: socket is not open.\n";
+        LOG_ERROR("[TcpConnection] Cannot start: socket is not open.");
         return false;
     }
 
+    // one read loop per connection, overlapping reads would interleave frames in buffer_
+    if (reading_.exchange(true)) {
+        return true;
+    }
+
     try {
-        auto endpoint = socket_.remote_endpoint();
-        Logger::log("[TcpConnection] Started connection from: "
-                  + endpoint.address().to_string() + ":"
-                  + std::to_string(endpoint.port()));
+        LOG_DEBUG("[TcpConnection] Started connection from: " + describePeer(socket_.remote_endpoint()));
     } catch (const std::system_error& e) {
-        std::cerr << "[TcpConnection] Could not retrieve remote endpoint: "
-                  << e.what() << std::endl;
+        LOG_WARN(std::string("[TcpConnection] Could not retrieve remote endpoint: ") + e.what());
         // connection might still be valid
     }
 
@@ -42,160 +89,615 @@ bool TcpConnection::beginRead() {
 
 void TcpConnection::readAction() {
     auto self(shared_from_this());
-    socket_.async_read_some(
-        asio::buffer(buffer_),
-        [this, self](std::error_code ec, std::size_t length) {
-            if (ec) {
-                disconnect();
+    auto onRead = [this, self](std::error_code ec, std::size_t length) {
+        if (ec) {
+            disconnect();
+            return;
+        }
+
+        // append received bytes to stream buffer, unpacked first once compression is on
+        if (inflater_) {
+            if (!decodeBlocks(std::string_view(buffer_.data(), length))) {
                 return;
             }
-
-            // append received bytes to stream buffer
+        } else {
             incomingBuffer_.append(buffer_.data(), length);
+        }
+
+        if (wheel_) {
+            lastRead_ = TimerWheel::Clock::now();
+        }
 
-            size_t start = 0;
-            int depth = 0;
+        if (!processIncoming()) {
+            return;
+        }
 
-            for (size_t i = 0; i < incomingBuffer_.size(); ++i) {
+        // the read timeout runs from the start of a frame, bytes trickling in do not extend it
+        if (incomingBuffer_.empty()) {
+            partialSince_ = {};
+        } else if (partialSince_ == TimerWheel::Clock::time_point{} || lastFrame_ == lastRead_) {
+            partialSince_ = lastRead_;
+        }
 
-                char c = incomingBuffer_[i];
+        // a peer that does not read its responses is not allowed to queue more requests
+        if (pendingOutbound() > limits_.pauseReadsAbove) {
+            readPaused_ = true;
+            return;
+        }
 
-                if (c == '{') {
-                    if (depth == 0) {
-                        start = i;  // potential start of JSON object
-                    }
-                    depth++;
-                }
-                else if (c == '}') {
-                    depth--;
-                }
+        // continue reading
+        readAction();
+    };
 
-                // if depth = 0 means complete json object
-                if (depth == 0 && c == '}') {
+    // same loop over plain tcp or tls, the tls stream decrypts into buffer_
+    if (tls_) {
+        tls_->async_read_some(asio::buffer(buffer_), std::move(onRead));
+    } else {
+        socket_.async_read_some(asio::buffer(buffer_), std::move(onRead));
+    }
+}
 
-                    std::string jsonStr = incomingBuffer_.substr(start, i - start + 1);
+bool TcpConnection::processIncoming() {
+    size_t consumed = 0;
+    processing_ = true;
 
-                    try {
-                        nlohmann::json msg = nlohmann::json::parse(jsonStr);
-                        handleAction(msg);
-                    }
-                    catch (std::exception& e) {
-                        std::cerr << "[TcpConnection] JSON parse error: " << e.what() << "\n";
-                    }
-                }
+    // frames are views so nothing is copied, a hello frame switches the format of the rest
+    while (!blocksFollow_) {
+        if (format_ == WireFormat::Json) {
+            if (!scanner_.next(incomingBuffer_)) {
+                consumed = scanner_.consumable();
+                break;
             }
+            consumed = scanner_.end();
+            handleFrame(std::string_view(incomingBuffer_)
+                            .substr(scanner_.begin(), scanner_.end() - scanner_.begin()));
+            continue;
+        }
 
-            // remove json objects
-            // if depth != 0, keep partial object
-            if (depth == 0) {
-                incomingBuffer_.clear();
-            } else {
-                incomingBuffer_ = incomingBuffer_.substr(start);
-            }
+        size_t available = incomingBuffer_.size() - consumed;
+        if (available < wire::kFrameHeader) break;
 
-            // continue reading
-            readAction();
+        size_t length = byteorder::getU32(incomingBuffer_.data() + consumed);
+        if (length > limits_.maxFrame) {
+            LOG_WARN("[TcpConnection] Frame too large: " + std::to_string(length) + " bytes");
+            processing_ = false;
+            closeWithReason(CloseReason::FrameTooLarge);
+            return false;
         }
-    );
+        if (available - wire::kFrameHeader < length) break;
+
+        consumed += wire::kFrameHeader + length;
+        handleFrame(std::string_view(incomingBuffer_).substr(consumed - length, length));
+    }
+    processing_ = false;
+
+    // drop dispatched frames, keep a partial one
+    incomingBuffer_.erase(0, consumed);
+    if (format_ == WireFormat::Json) {
+        scanner_.shift(consumed);
+    } else {
+        scanner_ = JsonUtils::ObjectScanner();
+    }
+
+    // whatever followed the hello that turned compression on is already in blocks
+    if (blocksFollow_) {
+        blocksFollow_ = false;
+        std::string rest = std::move(incomingBuffer_);
+        incomingBuffer_.clear();
+        scanner_ = JsonUtils::ObjectScanner();
+        return decodeBlocks(rest) && processIncoming();
+    }
+
+    // json frames have no length prefix, an unterminated object is caught by its size so far
+    if (format_ == WireFormat::Json && incomingBuffer_.size() > limits_.maxFrame) {
+        LOG_WARN("[TcpConnection] Frame too large: over " + std::to_string(limits_.maxFrame) + " bytes");
+        closeWithReason(CloseReason::FrameTooLarge);
+        return false;
+    }
+    if (incomingBuffer_.size() > limits_.maxInbound) {
+        LOG_WARN("[TcpConnection] Inbound buffer over " + std::to_string(limits_.maxInbound) + " bytes");
+        closeWithReason(CloseReason::InboundOverflow);
+        return false;
+    }
+    return true;
+}
+
+bool TcpConnection::decodeBlocks(std::string_view data) {
+    blockBuffer_.append(data);
+
+    size_t consumed = 0;
+    while (blockBuffer_.size() - consumed >= compression::kBlockHeader) {
+        const char* header = blockBuffer_.data() + consumed;
+        uint8_t flags = static_cast<uint8_t>(header[0]);
+        size_t length = byteorder::getU32(header + 1);
+
+        if (length > std::min(limits_.maxInbound, wire::kMaxFrame)) {
+            LOG_WARN("[TcpConnection] Compressed block too large: " + std::to_string(length) + " bytes");
+            closeWithReason(CloseReason::FrameTooLarge);
+            return false;
+        }
+        if (blockBuffer_.size() - consumed - compression::kBlockHeader < length) break;
+
+        std::string_view payload(header + compression::kBlockHeader, length);
+        consumed += compression::kBlockHeader + length;
+
+        if (!(flags & compression::kDeflated)) {
+            incomingBuffer_.append(payload);
+        } else if (!inflater_->inflate(payload, incomingBuffer_, limits_.maxInbound)) {
+            LOG_WARN("[TcpConnection] Compressed block does not inflate");
+            closeWithReason(incomingBuffer_.size() >= limits_.maxInbound
+                                ? CloseReason::InboundOverflow : CloseReason::CompressionError);
+            return false;
+        }
+    }
+
+    blockBuffer_.erase(0, consumed);
+    return true;
+}
+
+void TcpConnection::setCompression(Compression compression) {
+    if (compression == Compression::None || inflater_) {
+        return;
+    }
+
+    inflater_ = std::make_unique<compression::Inflater>();
+    // the rest of the buffer being processed arrived after the switch
+    blocksFollow_ = processing_;
+    // responses already queued go out as they are, the switch takes its place in the queue
+    enqueue(WriteEntry{.startCompression = true});
 }
 
 void TcpConnection::send(const std::string& message) {
     if (message.empty()) {
-        std::cerr << "[TcpConnection] Cannot send: empty message.\n";
+        LOG_ERROR("[TcpConnection] Cannot send: empty message.");
+        return;
+    }
+    // fixed replies all start with their status
+    if (const auto& request = RequestContext::current()) {
+        request->onReply(message.starts_with(R"({"status":"error")"), message.size());
+    }
+    trace::Span span("send", trace::Stage::Write);
+
+    if (format_ == WireFormat::Json) {
+        write(message);
         return;
     }
 
+    // fixed status replies are written as json text, convert them for binary peers
+    nlohmann::json value = nlohmann::json::parse(message, nullptr, false);
+    if (value.is_discarded()) {
+        LOG_ERROR("[TcpConnection] Cannot send: message is not json.");
+        return;
+    }
+    write(wire::encodeFrame(value, format_));
+}
+
+void TcpConnection::sendJson(const nlohmann::json& value) {
+    trace::Span span("send", trace::Stage::Write);
+    std::string frame = wire::encodeFrame(value, format_);
+    if (const auto& request = RequestContext::current()) {
+        auto status = value.find("status");
+        request->onReply(status != value.end() && *status == "error", frame.size());
+    }
+    write(std::move(frame));
+}
+
+void TcpConnection::sendStream(std::shared_ptr<OutgoingStream> stream) {
+    enqueue(WriteEntry{.stream = std::move(stream)});
+}
+
+void TcpConnection::sendShared(std::shared_ptr<const std::string> frame) {
+    enqueue(WriteEntry{.shared = std::move(frame)});
+}
+
+void TcpConnection::resumeStream() {
+    auto self(shared_from_this());
+    asio::dispatch(socket_.get_executor(), [this, self]() { pumpWrites(); });
+}
+
+void TcpConnection::write(std::string frame) {
+    enqueue(WriteEntry{.data = std::move(frame)});
+}
+
+void TcpConnection::enqueue(WriteEntry entry) {
+    auto self(shared_from_this());
+
+    // the queue belongs to the socket's executor, client threads hand entries over to it
+    asio::dispatch(socket_.get_executor(), [this, self, entry = std::move(entry)]() mutable {
+        if (closing_) {
+            return;
+        }
+
+        // a shared frame counts fully against every queue it is in, like a copy would
+        queuedBytes_ += entry.data.size() + (entry.shared ? entry.shared->size() : 0);
+        writeQueue_.push_back(std::move(entry));
+
+        // reads are already paused by now, only output pushed by others (e.g. message
+        // deliveries) reaches this, a peer that lets it pile up is dropped
+        if (pendingOutbound() > limits_.maxOutbound) {
+            LOG_WARN("[TcpConnection] Outbound queue over " + std::to_string(limits_.maxOutbound) + " bytes");
+            closeWithReason(CloseReason::OutboundOverflow);
+            return;
+        }
+        pumpWrites();
+    });
+}
+
+void TcpConnection::closeWithReason(CloseReason reason) {
+    if (closing_) {
+        return;
+    }
+
+    writeQueue_.clear();
+    queuedBytes_ = 0;
+
+    nlohmann::json notice = {
+        {"status", "error"},
+        {"message", "Connection closed"},
+        {"reason", closeReasonName(reason)}
+    };
+    std::string frame = wire::encodeFrame(notice, format_);
+    queuedBytes_ += frame.size();
+    writeQueue_.push_back(WriteEntry{.data = std::move(frame)});
+
+    // pumpWrites() disconnects once the notice is written
+    closing_ = true;
+    closeReason_ = reason;
+    pumpWrites();
+}
+
+void TcpConnection::pumpWrites() {
+    // one write in flight keeps frames in order, a stream blocks everything queued behind it
+    while (!writing_ && !writeQueue_.empty()) {
+        if (!socket_.is_open()) {
+            writeQueue_.clear();
+            queuedBytes_ = 0;
+            return;
+        }
+
+        WriteEntry& front = writeQueue_.front();
+        if (front.startCompression) {
+            deflater_ = std::make_unique<compression::Deflater>();
+            writeQueue_.pop_front();
+            continue;
+        }
+        if (front.shared) {
+            auto shared = std::move(front.shared);
+            writeQueue_.pop_front();
+            queuedBytes_ -= shared->size();
+            startWrite(std::string(), std::move(shared));
+            return;
+        }
+        if (!front.stream) {
+            std::string data = std::move(front.data);
+            writeQueue_.pop_front();
+            queuedBytes_ -= data.size();
+            startWrite(std::move(data));
+            return;
+        }
+
+        std::string buffer = BufferPool::shared().acquire();
+        OutgoingStream::State state = front.stream->next(buffer);
+
+        if (state == OutgoingStream::State::Done) {
+            writeQueue_.pop_front();
+        }
+        if (buffer.empty()) {
+            BufferPool::shared().release(std::move(buffer));
+            if (state == OutgoingStream::State::Pending) {
+                return;   // resumeStream() continues once the stream has data
+            }
+            continue;
+        }
+        startWrite(std::move(buffer));
+    }
+}
+
+void TcpConnection::startWrite(std::string data, std::shared_ptr<const std::string> shared) {
     auto self(shared_from_this());
 
-    asio::async_write(
-        socket_,
-        asio::buffer(message),
-        [this, self](std::error_code ec, std::size_t /*bytes_transferred*/) {
-            if (ec) {
-                std::cerr << "[TcpConnection] Request failed: " << ec.message() << std::endl;
-                disconnect();
-            } else {
-                Logger::log("[TcpConnection] Outgoing request queued for delivery.\n");
+    // one block per write, the deflate stream sees writes in the order they reach the socket
+    // (a shared frame is compressed into this connection's own block)
+    if (deflater_) {
+        std::string block = BufferPool::shared().acquire();
+        deflater_->appendBlock(block, shared ? *shared : data);
+        BufferPool::shared().release(std::move(data));
+        data = std::move(block);
+        shared.reset();
+    }
+
+    // the buffer must live until the write completes
+    writing_ = true;
+    outgoing_ = std::move(data);
+    outgoingShared_ = std::move(shared);
+    if (wheel_) {
+        writeStarted_ = TimerWheel::Clock::now();
+    }
+
+    auto onWritten = [this, self](std::error_code ec, std::size_t /*bytes_transferred*/) {
+        writing_ = false;
+        BufferPool::shared().release(std::move(outgoing_));
+        outgoing_ = std::string();
+        outgoingShared_.reset();
+
+        if (ec) {
+            LOG_WARN("[TcpConnection] Request failed: " + ec.message());
+            writeQueue_.clear();
+            queuedBytes_ = 0;
+            disconnect();
+            return;
+        }
+
+        LOG_DEBUG("[TcpConnection] Outgoing request queued for delivery.");
+        pumpWrites();
+
+        if (closing_) {
+            if (!writing_ && writeQueue_.empty()) {
+                disconnect(closeReason_);
             }
+            return;
+        }
+
+        // the peer caught up, take requests again
+        if (readPaused_ && pendingOutbound() <= limits_.resumeReadsBelow) {
+            readPaused_ = false;
+            readAction();
         }
-    );
+    };
+
+    if (tls_) {
+        asio::async_write(*tls_, asio::buffer(outgoingBytes()), std::move(onWritten));
+    } else {
+        asio::async_write(socket_, asio::buffer(outgoingBytes()), std::move(onWritten));
+    }
 }
 
-bool TcpConnection::connect(const std::string& host, int port) {
+bool TcpConnection::connect(const std::string& host, int port, std::shared_ptr<TlsContext> tls) {
     asio::ip::tcp::resolver resolver(io_context_);
     asio::error_code ec;
 
     auto endpoints = resolver.resolve(host, std::to_string(port), ec);
     if (ec) {
-        std::cerr << "[TcpConnection] Resolve error: " << ec.message() << "\n";
+        LOG_ERROR("[TcpConnection] Resolve error: " + ec.message());
+        return false;
+    }
+
+    // the generic socket takes any endpoint, so try them one by one like asio::connect would
+    ec = asio::error::host_not_found;
+    for (const auto& entry : endpoints) {
+        asio::error_code ignored;
+        socket_.close(ignored);
+        socket_.connect(entry.endpoint(), ec);
+        if (!ec) break;
+    }
+    if (ec) {
+        LOG_ERROR("[TcpConnection] Connect error: " + ec.message());
         return false;
     }
 
-    asio::connect(socket_, endpoints, ec);
+    if (!tls) {
+        return true;
+    }
+
+    // client handshake is synchronous like the connect, before the read loop starts
+    tls_ = std::make_unique<TlsStream>(socket_, tls->context());
+    tlsContext_ = tls;
+    SSL* ssl = tls_->native_handle();
+    SSL_set_tlsext_host_name(ssl, host.c_str());
+    tls_->set_verify_callback(asio::ssl::host_name_verification(host));
+    tls->prepareClient(ssl, host + ":" + std::to_string(port));
+
+    tls_->handshake(asio::ssl::stream_base::client, ec);
     if (ec) {
-        std::cerr << "[TcpConnection] Connect error: " << ec.message() << "\n";
+        LOG_ERROR("[TcpConnection] TLS handshake error: " + ec.message());
+        socket_.close(ec);
         return false;
     }
 
     return true;
 }
 
-void TcpConnection::disconnect() {
+bool TcpConnection::connectLocal(const std::string& path) {
+    asio::error_code ec;
+    socket_.connect(asio::local::stream_protocol::endpoint(path), ec);
+    if (ec) {
+        LOG_ERROR("[TcpConnection] Connect error: " + ec.message());
+        return false;
+    }
+
+    return true;
+}
+
+bool TcpConnection::isLocal() const {
+    asio::error_code ec;
+    auto endpoint = socket_.local_endpoint(ec);
+    return !ec && isLocalEndpoint(endpoint);
+}
+
+void TcpConnection::handshake(std::shared_ptr<TlsContext> tls,
+                              std::function<void(const std::error_code&)> done) {
+    auto self(shared_from_this());
+    tls_ = std::make_unique<TlsStream>(socket_, tls->context());
+    tlsContext_ = std::move(tls);
+
+    // an unfinished handshake is a partial frame, the read timeout applies to it
+    if (wheel_) {
+        partialSince_ = TimerWheel::Clock::now();
+    }
+
+    tls_->async_handshake(asio::ssl::stream_base::server,
+        [this, self, done = std::move(done)](const std::error_code& ec) {
+            partialSince_ = {};
+            done(ec);
+        });
+}
+
+bool TcpConnection::tlsResumed() const {
+    return tls_ && SSL_session_reused(tls_->native_handle()) == 1;
+}
+
+void TcpConnection::disconnect(CloseReason reason) {
     if (!socket_.is_open()) {
         return; // already closed
     }
 
     asio::error_code ec;
 
+    // the socket closes right away so no close_notify goes out, but OpenSSL would otherwise
+    // treat the session as broken and refuse to resume it on the next connect
+    if (tls_ && SSL_is_init_finished(tls_->native_handle())) {
+        SSL_set_shutdown(tls_->native_handle(), SSL_SENT_SHUTDOWN);
+    }
+
     // Shutdown cleanly
-    socket_.shutdown(asio::ip::tcp::socket::shutdown_both, ec);
+    socket_.shutdown(Socket::shutdown_both, ec);
     socket_.close(ec);
 
-    Logger::log("[TcpConnection] Disconnected.\n");
+    LOG_DEBUG("[TcpConnection] Disconnected.");
 
     if (server_) {
-        server_->removeConnection(shared_from_this());
+        server_->removeConnection(shared_from_this(), reason);
     }
 }
 
-void TcpConnection::handleAction(const nlohmann::json& message) {
+void TcpConnection::startTimers(TimerWheel& wheel, const ConnectionTimeouts& timeouts) {
+    wheel_ = &wheel;
+    timeouts_ = timeouts;
+    lastFrame_ = lastPing_ = TimerWheel::Clock::now();
+
+    // the server cancels the timer before it lets go of the connection, so this stays valid
+    timer_.setCallback([this]() { checkTimeouts(); });
+    checkTimeouts();
+}
+
+void TcpConnection::stopTimers() {
+    if (wheel_) {
+        wheel_->cancel(timer_);
+    }
+}
+
+void TcpConnection::checkTimeouts() {
+    using Clock = TimerWheel::Clock;
+    if (!socket_.is_open()) {
+        return;
+    }
+
+    const auto now = Clock::now();
+    // a partial frame left unread while reads are paused is not the peer being slow
+    const bool partial = partialSince_ != Clock::time_point{} && !readPaused_;
+    // a response still being written or streamed is not idleness
+    const bool idle = !writing_ && writeQueue_.empty();
+
+    auto expired = [&](Clock::duration limit, Clock::time_point since) {
+        return limit > Clock::duration::zero() && now - since >= limit;
+    };
+
+    if (writing_ && expired(timeouts_.write, writeStarted_)) {
+        LOG_INFO("[TcpConnection] Write timed out.");
+        disconnect(CloseReason::WriteTimeout);
+        return;
+    }
+    if (partial && expired(timeouts_.read, partialSince_)) {
+        LOG_INFO("[TcpConnection] Read timed out.");
+        disconnect(CloseReason::ReadTimeout);
+        return;
+    }
+    if (idle && expired(timeouts_.idle, lastFrame_)) {
+        LOG_INFO("[TcpConnection] Idle timed out.");
+        disconnect(CloseReason::IdleTimeout);
+        return;
+    }
+    if (expired(timeouts_.heartbeat, std::max(lastFrame_, lastPing_))) {
+        lastPing_ = now;
+        send(R"({"status":"ping"})");
+    }
+
+    // sleep until the earliest deadline that could expire, the wheel rounds it up to a tick
+    Clock::time_point next = Clock::time_point::max();
+    auto consider = [&](Clock::duration limit, Clock::time_point since) {
+        if (limit > Clock::duration::zero()) next = std::min(next, since + limit);
+    };
+    // with no write in flight, look again within one write timeout in case one starts
+    consider(timeouts_.write, writing_ ? writeStarted_ : now);
+    if (partial) consider(timeouts_.read, partialSince_);
+    consider(timeouts_.idle, lastFrame_);
+    consider(timeouts_.heartbeat, std::max(lastFrame_, lastPing_));
+
+    if (next != Clock::time_point::max()) {
+        wheel_->schedule(timer_, next - now);
+    }
+}
+
+void TcpConnection::handleFrame(std::string_view frame) {
 
     // request (client to server)
-    if (message.contains("action")) {
-        if (server_) {
-            server_->handleAction(shared_from_this(), message);
+    if (server_) {
+        lastFrame_ = lastRead_;
+
+        auto received = RequestContext::Clock::now();
+        Request request;
+        nlohmann::json decoded;   // owns the strings request views for binary frames
+
+        bool parsed;
+        if (format_ == WireFormat::Json) {
+            parsed = JsonUtils::parseRequest(frame, request);
         } else {
-            std::cerr << "[TcpConnection] Received request but no server is attached.\n";
+            decoded = wire::decodePayload(frame, format_);
+            parsed = !decoded.is_discarded() && wire::requestFromJson(decoded, request);
+        }
+
+        if (!parsed) {
+            LOG_WARN(std::string("[TcpConnection] Parse error: malformed ")
+                      + wire::formatName(format_) + " request");
+            return;
+        }
+        if (request.action.empty()) {
+            LOG_WARN("[TcpConnection] Unknown message type: request without action");
+            return;
         }
+        server_->handleAction(shared_from_this(), request, received, frame.size());
         return;
     }
 
     // response (server to client)
+    nlohmann::json message = wire::decodePayload(frame, format_);
+    if (message.is_discarded()) {
+        LOG_WARN(std::string("[TcpConnection] Parse error: malformed ")
+                  + wire::formatName(format_) + " response");
+        return;
+    }
+
     if (message.contains("status")) {
         handleServerResponse(message);
         return;
     }
 
     // unknown message
-    std::cerr << "[TcpConnection] Unknown message type: " << message.dump() << "\n";
+    LOG_WARN("[TcpConnection] Unknown message type: " + message.dump());
 }
 
 void TcpConnection::handleServerResponse(const nlohmann::json& msg) {
     std::string status  = msg.value("status", "unknown");
     std::string message = msg.value("message", "");
 
+    // server heartbeat, answered here so it never reaches a pending request
+    if (status == "ping") {
+        sendJson({{"action", "pong"}});
+        return;
+    }
+
     // forward response to client callback
     if (onServerResponse_) {
-        onServerResponse_(status, message);
+        onServerResponse_(msg);
         return;
     }
 
     // fallback logging if no client callback
     if (status == "success") {
-        Logger::log("[TcpConnection] Server SUCCESS: " + message);
+        LOG_DEBUG("[TcpConnection] Server SUCCESS: " + message);
     } else if (status == "error") {
-        std::cerr << "[TcpConnection] Server ERROR: " << message << "\n";
+        LOG_WARN("[TcpConnection] Server ERROR: " + message);
     } else {
-        std::cout << "[TcpConnection] Server Response: " << message << "\n";
+        LOG_DEBUG("[TcpConnection] Server Response: " + message);
     }
 }
\ No newline at end of file
@@ -1,16 +1,178 @@
 #include "network/tcpServer.h"
-#include <iostream>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
 
+#include "storage/FileStorage.h"
 #include "utils/Logger.h"
 
 TcpServer::TcpServer(asio::io_context& io_context, unsigned short port)
+    : TcpServer(io_context, port, std::make_unique<FileStorage>())
+{}
+
+TcpServer::TcpServer(asio::io_context& io_context,
+                     unsigned short port,
+                     std::unique_ptr<MessageStore> storage,
+                     ServerOptions options)
     : io_context_(io_context),
       acceptor_(io_context, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port)),
-      storage_(),
-      messageHandler_(this, storage_)
+      localPath_(std::move(options.localPath)),
+      sessionLinger_(options.sessionLinger),
+      storage_(std::move(storage)),
+      messageHandler_(this, *storage_),
+      rateLimiter_(options.rateLimits),
+      timeouts_(options.timeouts),
+      limits_(options.limits),
+      tls_(std::move(options.tls)),
+      ticketKeyRotation_(options.ticketKeyRotation),
+      nextTicketKey_(TimerWheel::Clock::now() + ticketKeyRotation_),
+      timerWheel_(options.timerTick),
+      tickTimer_(io_context),
+      metricsPath_(std::move(options.metricsPath)),
+      metricsInterval_(options.metricsInterval),
+      metricsTimer_(io_context),
+      workers_(options.workerThreads, options.workerQueue)
 {
-    Logger::log("[TcpServer] Listening on port " + std::to_string(port));
+    for (const auto& action : actions()) {
+        actionMetrics_.push_back(RequestContext::ActionMetrics::forAction(action.name));
+    }
+    if (!options.tracePath.empty()) {
+        tracer_ = trace::Tracer::open(options.tracePath, options.traceSampleRate);
+    }
+    if (!options.slowLogPath.empty()) {
+        slowLog_ = trace::SlowLog::open(options.slowLogPath);
+        for (const auto& action : actions()) {
+            auto threshold = options.slowThresholds.find(std::string(action.name));
+            slowAfter_.push_back(threshold != options.slowThresholds.end() ? threshold->second
+                                                                           : options.slowThreshold);
+        }
+        for (const auto& [name, threshold] : options.slowThresholds) {
+            if (!findAction(name)) {
+                LOG_WARN("[TcpServer] Slow log threshold for unknown action: " + name);
+            }
+        }
+    }
+
+    LOG_INFO("[TcpServer] Listening on port " + std::to_string(port));
     startAccept();
+
+    if (!localPath_.empty()) {
+        // a file left behind by a previous run would make bind fail
+        std::error_code ec;
+        std::filesystem::remove(localPath_, ec);
+        localAcceptor_ = std::make_unique<asio::local::stream_protocol::acceptor>(
+            io_context, asio::local::stream_protocol::endpoint(localPath_));
+        LOG_INFO("[TcpServer] Listening on " + localPath_);
+        startAcceptLocal();
+    }
+
+    scheduleTick();
+    if (!metricsPath_.empty()) {
+        scheduleMetricsFile();
+    }
+}
+
+TcpServer::~TcpServer() {
+    // sessions and their connections point at each other until the connection closes
+    for (const auto& connection : active_connections_) {
+        connection->setSession(nullptr);
+    }
+    if (tracer_) {
+        tracer_->flush();   // closed once the requests still holding it are gone
+    }
+    if (localAcceptor_) {
+        std::error_code ec;
+        localAcceptor_->close(ec);
+        std::filesystem::remove(localPath_, ec);
+    }
+}
+
+void TcpServer::scheduleTick() {
+    // one asio timer for the whole server, connection timeouts live in the wheel
+    tickTimer_.expires_after(timerWheel_.tick());
+    tickTimer_.async_wait([this](const std::error_code& error) {
+        if (error) {
+            return;   // cancelled, server is going away
+        }
+        auto now = TimerWheel::Clock::now();
+        timerWheel_.advance(now);
+        expireSessions(now);
+        rotateTicketKeys(now);
+        scheduleTick();
+    });
+}
+
+void TcpServer::scheduleMetricsFile() {
+    metricsTimer_.expires_after(metricsInterval_);
+    metricsTimer_.async_wait([this](const std::error_code& error) {
+        if (error) {
+            return;
+        }
+        // rendering walks every histogram, written next to the file and renamed over it
+        // so a scraper never reads half of it
+        workers_.submit(
+            [this]() {
+                std::string tmp = metricsPath_ + ".tmp";
+                {
+                    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+                    out << metricsText();
+                    if (!out) {
+                        LOG_ERROR("[TcpServer] Cannot write metrics to " + tmp);
+                        return;
+                    }
+                }
+                std::error_code ec;
+                std::filesystem::rename(tmp, metricsPath_, ec);
+            },
+            io_context_.get_executor(), []() {});
+        scheduleMetricsFile();
+    });
+}
+
+std::vector<TcpServer::ServerMetric> TcpServer::serverMetrics() const {
+    const WorkerPool::Stats& workers = workers_.stats();
+    auto value = [](const std::atomic<uint64_t>& counter) { return static_cast<double>(counter.load()); };
+    return {
+        {"messenger_connections_accepted_total", "Connections accepted", "counter", value(stats_.accepted)},
+        {"messenger_connections_closed_total", "Connections closed, for any reason", "counter", value(stats_.closed)},
+        {"messenger_connection_timeouts_total", "Connections closed by the idle, read or write timeout", "counter",
+         value(stats_.idleTimeouts) + value(stats_.readTimeouts) + value(stats_.writeTimeouts)},
+        {"messenger_connection_overflows_total", "Connections closed by a frame or buffer limit", "counter",
+         value(stats_.framesTooLarge) + value(stats_.inboundOverflows) + value(stats_.outboundOverflows)},
+        {"messenger_tls_handshake_failures_total", "Failed TLS handshakes", "counter", value(stats_.tlsFailures)},
+        {"messenger_deliveries_total", "Frames pushed to online users", "counter", value(stats_.deliveries)},
+        {"messenger_sessions_created_total", "Sessions started by a login", "counter", value(stats_.sessionsCreated)},
+        {"messenger_sessions_resumed_total", "Logins that resumed a lingering session", "counter",
+         value(stats_.sessionsResumed)},
+        {"messenger_sessions_expired_total", "Sessions dropped after lingering", "counter", value(stats_.sessionsExpired)},
+        {"messenger_worker_queue_depth", "Tasks waiting for a worker", "gauge", value(workers.queued)},
+        {"messenger_worker_queue_peak", "Most tasks ever waiting for a worker", "gauge", value(workers.peakQueued)},
+        {"messenger_worker_rejected_total", "Tasks turned away by a full worker queue", "counter", value(workers.rejected)},
+        {"messenger_worker_wait_seconds_total", "Time tasks spent waiting for a worker", "counter",
+         value(workers.waitMicros) / 1e6},
+    };
+}
+
+std::string TcpServer::metricsText() const {
+    std::string out = metrics::Registry::global().prometheus();
+    for (const auto& metric : serverMetrics()) {
+        out += std::string("# HELP ") + metric.name + " " + metric.help + "\n";
+        out += std::string("# TYPE ") + metric.name + " " + metric.type + "\n";
+        char value[32];
+        std::snprintf(value, sizeof(value), "%.15g", metric.value);
+        out += std::string(metric.name) + " " + value + "\n";
+    }
+    return out;
+}
+
+nlohmann::json TcpServer::metricsJson() const {
+    nlohmann::json result = metrics::Registry::global().json();
+    nlohmann::json server = nlohmann::json::object();
+    for (const auto& metric : serverMetrics()) {
+        server[metric.name] = metric.value;
+    }
+    result["server"] = std::move(server);
+    return result;
 }
 
 void TcpServer::startAccept() {
@@ -21,130 +183,463 @@ void TcpServer::startAccept() {
     acceptor_.async_accept(
         new_connection->socket(),
         [this, new_connection](const std::error_code& error) {
+            if (error == asio::error::operation_aborted) {
+                return;   // acceptor closed
+            }
             handleAccept(new_connection, error);
+            startAccept();
+        }
+    );
+}
+
+void TcpServer::startAcceptLocal() {
+    auto new_connection = TcpConnection::create(io_context_, this);
+
+    // accepted into the same kind of connection, everything after the accept is shared
+    localAcceptor_->async_accept(
+        new_connection->socket(),
+        [this, new_connection](const std::error_code& error) {
+            if (error == asio::error::operation_aborted) {
+                return;
+            }
+            handleAccept(new_connection, error);
+            startAcceptLocal();
         }
     );
 }
 
 void TcpServer::handleAccept(TcpConnection::pointer new_connection, const std::error_code& error) {
     if (!error) {
-        Logger::log("[TcpServer] New connection accepted.\n");
+        LOG_DEBUG("[TcpServer] New connection accepted.");
         active_connections_.push_back(new_connection);
-        new_connection->beginRead();
+        stats_.accepted++;
+        new_connection->setLimits(limits_);
+        new_connection->startTimers(timerWheel_, timeouts_);
+
+        if (tls_ && !new_connection->isLocal()) {
+            new_connection->handshake(tls_, [this, new_connection](const std::error_code& ec) {
+                if (ec) {
+                    LOG_WARN("[TcpServer] TLS handshake failed: " + ec.message());
+                    stats_.tlsFailures++;
+                    new_connection->disconnect(CloseReason::TlsHandshakeFailed);
+                    return;
+                }
+                stats_.tlsHandshakes++;
+                if (new_connection->tlsResumed()) {
+                    stats_.tlsResumed++;
+                }
+                new_connection->beginRead();
+            });
+        } else {
+            new_connection->beginRead();
+        }
     } else {
-        std::cerr << "[TcpServer] Accept error: " << error.message() << std::endl;
+        LOG_ERROR("[TcpServer] Accept error: " + error.message());
     }
+}
 
-    // continue accepting next connections
-    startAccept();
+const auto& TcpServer::actionTable() {
+    using actions::RateClass;
+    using actions::Priority;
+    namespace field = actions::field;
+
+    // every protocol action, new ones are a row here plus their handler
+    static constexpr auto kActions = actions::makeTable<Handler>(std::array{
+        ActionSpec{.name = "hello", .handler = &TcpServer::handleHello,
+                   .rate = RateClass::Free, .priority = Priority::High},
+        ActionSpec{.name = "create_account", .handler = &TcpServer::handleCreateAccount,
+                   .rate = RateClass::Auth, .priority = Priority::Normal,
+                   .required = field::Username | field::PasswordHash,
+                   .missingReply = R"({"status":"error","message":"Missing credentials"})"},
+        ActionSpec{.name = "login", .handler = &TcpServer::handleLogin,
+                   .rate = RateClass::Auth, .priority = Priority::High},
+        ActionSpec{.name = "send_message", .handler = &TcpServer::handleSendMessage,
+                   .requiresAuth = true, .rate = RateClass::Write, .priority = Priority::Normal,
+                   .required = field::To | field::Message,
+                   .missingReply = R"({"status":"error","message":"Invalid message format"})"},
+        ActionSpec{.name = "get_messages", .handler = &TcpServer::handleGetMessages,
+                   .requiresAuth = true, .rate = RateClass::Read, .priority = Priority::Bulk,
+                   .required = field::With,
+                   .missingReply = R"({"status":"error","message":"Missing username"})"},
+        ActionSpec{.name = "list_conversations", .handler = &TcpServer::handleListConversations,
+                   .requiresAuth = true, .rate = RateClass::Read, .priority = Priority::Normal},
+        ActionSpec{.name = "mark_read", .handler = &TcpServer::handleMarkRead,
+                   .requiresAuth = true, .rate = RateClass::Write, .priority = Priority::Normal,
+                   .required = field::With | field::Seq,
+                   .missingReply = R"({"status":"error","message":"Missing 'with' or 'seq' field"})"},
+        ActionSpec{.name = "ping", .handler = &TcpServer::handlePing,
+                   .rate = RateClass::Free, .priority = Priority::High},
+        ActionSpec{.name = "pong", .handler = &TcpServer::handlePong,
+                   .rate = RateClass::Free, .priority = Priority::High},
+        ActionSpec{.name = "create_group", .handler = &TcpServer::handleCreateGroup,
+                   .requiresAuth = true, .rate = RateClass::Write, .priority = Priority::Normal,
+                   .required = field::Group | field::Members,
+                   .missingReply = R"({"status":"error","message":"Missing 'group' or 'members' field"})"},
+        ActionSpec{.name = "send_group", .handler = &TcpServer::handleSendGroup,
+                   .requiresAuth = true, .rate = RateClass::Write, .priority = Priority::Normal,
+                   .required = field::Group | field::Message,
+                   .missingReply = R"({"status":"error","message":"Missing 'group' or 'message' field"})"},
+        ActionSpec{.name = "get_group", .handler = &TcpServer::handleGetGroup,
+                   .requiresAuth = true, .rate = RateClass::Read, .priority = Priority::Bulk,
+                   .required = field::Group,
+                   .missingReply = R"({"status":"error","message":"Missing 'group' field"})"},
+        ActionSpec{.name = "stats", .handler = &TcpServer::handleStats,
+                   .rate = RateClass::Free, .priority = Priority::High},
+    });
+    static_assert(kActions.valid(), "action names must be unique");
+    static_assert(static_cast<unsigned>(Priority::Bulk) < WorkerPool::kPriorities,
+                  "every priority needs a worker pool level");
+
+    return kActions;
 }
 
-void TcpServer::handleAction(TcpConnection::pointer connection, const nlohmann::json& message) {
-    std::string action = message.value("action", "");
+const TcpServer::ActionSpec* TcpServer::findAction(std::string_view name) {
+    return actionTable().find(name);
+}
 
-    if (action == "create_account") {
-        handleCreateAccount(connection, message);
-    } else if (action == "login") {
-        handleLogin(connection, message);
-    } else if (action == "send_message") {
-        handleSendMessage(connection, message);
-    } else if (action == "get_messages") {
-        handleGetMessages(connection, message);
-    } else {
-        std::cerr << "[TcpServer] Unknown action: " << action << std::endl;
-    }
+std::span<const TcpServer::ActionSpec> TcpServer::actions() {
+    return {actionTable().begin(), actionTable().size()};
 }
 
-void TcpServer::handleCreateAccount(
-        TcpConnection::pointer connection,
-        const nlohmann::json& data) {
-    std::string username = data.value("username", "");
-    std::string password_hash = data.value("password_hash", "");
+void TcpServer::handleAction(TcpConnection::pointer connection, const Request& request,
+                             RequestContext::Clock::time_point received, size_t frameBytes) {
+    const ActionSpec* action = findAction(request.action);
+    if (!action) {
+        static auto& unknown = metrics::Registry::global().counter(
+            "messenger_unknown_actions_total", "Requests naming no known action");
+        unknown.add();
+        LOG_WARN("[TcpServer] Unknown action: " + std::string(request.action));
+        return;
+    }
+
+    // current until the handler returns, work it hands on carries it further
+    auto dispatched = RequestContext::Clock::now();
+    size_t row = action - actions().data();
+    auto context = std::make_shared<RequestContext>(actionMetrics_[row], action->name, received);
+    context->setPriority(static_cast<unsigned>(action->priority));
+    trace::RequestTrace& trace = context->trace();
+    trace.addRequestBytes(frameBytes);
+    if (tracer_) {
+        tracer_->sample(trace);
+    }
+    if (slowLog_) {
+        trace.watch(slowLog_, slowAfter_[row]);
+        trace.setUser(connection->getUsername().empty() ? std::string(request.username) : connection->getUsername());
+    }
+    RequestContext::Scope scope(std::move(context));
+    trace::record("parse", trace::Stage::Parse, received, dispatched);
 
-    if (username.empty() || password_hash.empty()) {
-        connection->send(R"({"status":"error","message":"Missing credentials"})");
+    if (action->requiresAuth && connection->getUsername().empty()) {
+        connection->send(R"({"status":"error","message":"Not logged in"})");
         return;
     }
 
-    // atomic operation start
-    std::lock_guard<std::mutex> guard(storage_.mutex());
+    // checked before any storage or crypto work so throttled requests stay cheap
+    auto wait = rateLimiter_.check(connection->rateBuckets(), connection->userRateBuckets(), action->rate);
+    if (wait != RateLimiter::Clock::duration::zero()) {
+        // whole milliseconds, rounded up so retrying after it succeeds
+        auto retryAfter = std::chrono::ceil<std::chrono::milliseconds>(wait).count();
+        connection->sendJson({
+            {"status", "error"},
+            {"message", "Rate limited"},
+            {"action", action->name},
+            {"retry_after", retryAfter}
+        });
+        return;
+    }
 
-    if (storage_.userExists_NoLock(username)) {
-        connection->send(R"({"status":"error","message":"User already exists"})");
+    if (!actions::hasFields(request, action->required)) {
+        connection->send(std::string(action->missingReply));
         return;
     }
 
-    // write user to json
-    if (!storage_.createUser_NoLock(username, password_hash)) {
-        connection->send(R"({"status":"error","message":"Failed to create user"})");
+    trace::Span span(action->name, trace::Stage::Handler);
+    (this->*action->handler)(connection, request);
+}
+
+void TcpServer::handleHello(TcpConnection::pointer connection, const Request& request) {
+    // either field may be left out, leaving that setting as it is
+    std::optional<WireFormat> format = connection->wireFormat();
+    std::optional<Compression> compression = connection->compression();
+    if (!request.encoding.empty()) format = wire::formatFromName(request.encoding);
+    if (!request.compression.empty()) compression = compression::fromName(request.compression);
+
+    if (request.encoding.empty() && request.compression.empty()) {
+        connection->send(R"({"status":"error","message":"Missing encoding or compression"})");
+        return;
+    }
+    if (!format) {
+        connection->send(R"({"status":"error","message":"Unsupported encoding"})");
+        return;
+    }
+    if (!compression) {
+        connection->send(R"({"status":"error","message":"Unsupported compression"})");
         return;
     }
 
-    // generate RSA key files
-    if (!storage_.createUserKeyFiles_NoLock(username)) {
-        // rollback user keys and json entry
-        storage_.deleteUserKeys_NoLock(username);
-        storage_.deleteUserJson_NoLock(username);
-        storage_.saveUser_NoLock();
-        connection->send(R"({"status":"error","message":"Failed to create user key files"})");
+    // negotiated once, switching again mid-stream could misread frames already in flight
+    if (!request.encoding.empty() && connection->wireFormat() != WireFormat::Json) {
+        connection->send(R"({"status":"error","message":"Encoding already negotiated"})");
         return;
     }
+    if (!request.compression.empty() && connection->compression() != Compression::None) {
+        connection->send(R"({"status":"error","message":"Compression already negotiated"})");
+        return;
+    }
+
+    // the answer still goes out in the old format and uncompressed, frames after it use the new ones
+    connection->sendJson({
+        {"status", "success"},
+        {"message", "Encoding set"},
+        {"encoding", wire::formatName(*format)},
+        {"compression", compression::name(*compression)}
+    });
+    connection->setWireFormat(*format);
+    connection->setCompression(*compression);
+}
+
+void TcpServer::handleCreateAccount(
+        TcpConnection::pointer connection,
+        const Request& request) {
+    std::string username(request.username);
+    std::string password_hash(request.passwordHash);
 
-    // Success
-    connection->send(R"({"status":"success","message":"Account created"})");
+    // storage engine checks, writes and rolls back atomically
+    // RSA key generation takes tens of milliseconds, it runs on a worker
+    offload(connection,
+        [this, username = std::move(username), password_hash = std::move(password_hash)]() {
+            static auto& latency = MessageStore::callLatency("create_account");
+            metrics::ScopedTimer timer(latency);
+            trace::Span span("create_account", trace::Stage::Storage);
+            return storage_->createAccount(username, password_hash);
+        },
+        [connection](MessageStore::CreateUserResult result) {
+            switch (result) {
+                case MessageStore::CreateUserResult::AlreadyExists:
+                    connection->send(R"({"status":"error","message":"User already exists"})");
+                    return;
+                case MessageStore::CreateUserResult::UserWriteFailed:
+                    connection->send(R"({"status":"error","message":"Failed to create user"})");
+                    return;
+                case MessageStore::CreateUserResult::KeyWriteFailed:
+                    connection->send(R"({"status":"error","message":"Failed to create user key files"})");
+                    return;
+                case MessageStore::CreateUserResult::Created:
+                    break;
+            }
+
+            // Success
+            connection->send(R"({"status":"success","message":"Account created"})");
+        });
 }
 
-void TcpServer::handleLogin(TcpConnection::pointer connection, const nlohmann::json& data) {
-    std::string username = data.value("username", "");
-    std::string password_hash = data.value("password_hash", "");
+void TcpServer::handleLogin(TcpConnection::pointer connection, const Request& request) {
+    std::string username(request.username);
+    std::string password_hash(request.passwordHash);
+
+    bool exists, valid;
+    {
+        static auto& latency = MessageStore::callLatency("login");
+        metrics::ScopedTimer timer(latency);
+        trace::Span span("login", trace::Stage::Lookup);
+        exists = storage_->userExists(username);
+        valid = exists && storage_->loginUser(username, password_hash);
+    }
 
-    if (!storage_.userExists(username)) {
+    if (!exists) {
         connection->send(R"({"status":"error","message":"Invalid username"})");
         return;
     }
 
-    if (!storage_.loginUser(username, password_hash)) {
+    if (!valid) {
         connection->send(R"({"status":"error","message":"Invalid password"})");
         return;
     }
-    // assign username to connection instance
-    connection->setUsername(username);
+    // a connection logged in before belongs to its new user from now on
+    closeSession(connection);
+    Session::pointer session = openSession(username);
+    session->attach(connection);
+    connection->setSession(std::move(session));
 
     connection->send(R"({"status":"success","message":"Login successful"})");
 }
 
-void TcpServer::handleSendMessage(TcpConnection::pointer connection, const nlohmann::json& data) {
-    std::string to = data.value("to", "");
-    std::string message = data.value("message", "");
+void TcpServer::handleSendMessage(TcpConnection::pointer connection, const Request& request) {
+    messageHandler_.processMessage(connection, std::string(request.to), std::string(request.message));
+}
 
-    if (to.empty() || message.empty()) {
-        connection->send(R"({"status":"error","message":"Invalid message format"})");
-        return;
-    }
+void TcpServer::handleGetMessages(
+    TcpConnection::pointer connection,
+    const Request& request
+) {
+    std::string withUser(request.with);
+    // optional paging, defaults return the whole conversation
+    size_t offset = static_cast<size_t>(request.offset);
+    size_t limit = static_cast<size_t>(request.limit);
 
-    messageHandler_.processMessage(connection, to, message);
+    // query storage
+    messageHandler_.fetchMessages(connection, withUser, offset, limit);
 }
 
-void TcpServer::handleGetMessages(
+void TcpServer::handleListConversations(
     TcpConnection::pointer connection,
-    const nlohmann::json& data
+    const Request& /*request*/
 ) {
-    std::string withUser = data.value("with", "");
+    messageHandler_.listConversations(connection);
+}
+
+void TcpServer::handleMarkRead(TcpConnection::pointer connection, const Request& request) {
+    std::string withUser(request.with);
+    messageHandler_.markRead(connection, withUser, request.seq);
+}
+
+void TcpServer::handlePing(TcpConnection::pointer connection, const Request& /*request*/) {
+    connection->send(R"({"status":"success","message":"pong"})");
+}
+
+void TcpServer::handlePong(TcpConnection::pointer /*connection*/, const Request& /*request*/) {
+    // answer to a heartbeat, receiving it already counted as activity
+    stats_.heartbeats++;
+}
 
-    if (withUser.empty()) {
-        connection->send(R"({"status":"error","message":"Missing username"})");
+void TcpServer::handleCreateGroup(TcpConnection::pointer connection, const Request& request) {
+    messageHandler_.createGroup(connection, std::string(request.group), request.members);
+}
+
+void TcpServer::handleSendGroup(TcpConnection::pointer connection, const Request& request) {
+    messageHandler_.sendGroupMessage(connection, std::string(request.group), std::string(request.message));
+}
+
+void TcpServer::handleGetGroup(TcpConnection::pointer connection, const Request& request) {
+    messageHandler_.getGroup(connection, std::string(request.group),
+                             static_cast<size_t>(request.offset), static_cast<size_t>(request.limit));
+}
+
+void TcpServer::handleStats(TcpConnection::pointer connection, const Request& /*request*/) {
+    // operators only: the unix domain socket is guarded by its file permissions, tcp is not
+    if (!connection->isLocal()) {
+        connection->send(R"({"status":"error","message":"Stats are only served on the local socket"})");
         return;
     }
+    connection->sendJson({{"status", "success"}, {"metrics", metricsJson()}});
+}
 
-    // query storage
-    messageHandler_.fetchMessages(connection, withUser);
+size_t TcpServer::deliver(const std::vector<std::string>& users, const nlohmann::json& frame,
+                          const TcpConnection* skip) {
+    trace::Span span("deliver", trace::Stage::Write);
+
+    // one encoded frame per wire format, created when the first connection using it is found
+    std::array<std::shared_ptr<const std::string>, 3> encoded;
+    size_t queued = 0;
+
+    for (const auto& user : users) {
+        auto session = sessions_.find(user);
+        if (session == sessions_.end()) {
+            continue;
+        }
+
+        for (const auto& connection : session->second->connections()) {
+            if (connection.get() == skip) {
+                continue;
+            }
+
+            WireFormat format = connection->wireFormat();
+            auto& slot = encoded[static_cast<size_t>(format)];
+            if (!slot) {
+                if (format == WireFormat::Json) {
+                    slot = std::make_shared<const std::string>(wire::encodeFrame(frame, format));
+                } else {
+                    nlohmann::json binary = frame;
+                    wire::toBinaryFields(binary["record"]);
+                    slot = std::make_shared<const std::string>(wire::encodeFrame(binary, format));
+                }
+                stats_.deliveryEncodings++;
+            }
+
+            connection->sendShared(slot);
+            queued++;
+        }
+    }
+
+    stats_.deliveries += queued;
+    return queued;
 }
 
-void TcpServer::removeConnection(TcpConnection::pointer connection) {
+void TcpServer::removeConnection(TcpConnection::pointer connection, CloseReason reason) {
     auto it = std::find(active_connections_.begin(), active_connections_.end(), connection);
     if (it != active_connections_.end()) {
+        connection->stopTimers();
         active_connections_.erase(it);
-        Logger::log("[TcpServer] Connection removed. Active connections: "
+
+        closeSession(connection);
+
+        stats_.closed++;
+        switch (reason) {
+            case CloseReason::IdleTimeout:      stats_.idleTimeouts++;      break;
+            case CloseReason::ReadTimeout:      stats_.readTimeouts++;      break;
+            case CloseReason::WriteTimeout:     stats_.writeTimeouts++;     break;
+            case CloseReason::FrameTooLarge:    stats_.framesTooLarge++;    break;
+            case CloseReason::InboundOverflow:  stats_.inboundOverflows++;  break;
+            case CloseReason::OutboundOverflow: stats_.outboundOverflows++; break;
+            case CloseReason::TlsHandshakeFailed:
+            case CloseReason::CompressionError:
+            case CloseReason::Closed:           break;
+        }
+        LOG_DEBUG("[TcpServer] Connection removed. Active connections: "
                   + std::to_string(active_connections_.size()));
     }
-}
\ No newline at end of file
+}
+
+Session::pointer TcpServer::openSession(const std::string& username) {
+    auto it = sessions_.find(username);
+    if (it != sessions_.end()) {
+        // a lingering session is resumed, its entry in lingering_ goes stale and is skipped
+        if (it->second->connections().empty()) {
+            stats_.sessionsResumed++;
+        }
+        return it->second;
+    }
+    auto session = std::make_shared<Session>(username, rateLimiter_.userBuckets(username));
+    sessions_.emplace(username, session);
+    stats_.sessionsCreated++;
+    return session;
+}
+
+void TcpServer::closeSession(const TcpConnection::pointer& connection) {
+    Session::pointer session = connection->session();
+    if (!session || !session->detach(connection.get())) {
+        return;
+    }
+    if (sessionLinger_ <= Session::Clock::duration::zero()) {
+        sessions_.erase(session->username());
+        return;
+    }
+    lingering_.emplace_back(session, session->detachedAt());
+}
+
+void TcpServer::rotateTicketKeys(TimerWheel::Clock::time_point now) {
+    if (!tls_ || ticketKeyRotation_ <= TimerWheel::Clock::duration::zero() || now < nextTicketKey_) {
+        return;
+    }
+    // tickets under the key before the previous one stop resuming, their clients run a full handshake
+    tls_->rotateTicketKeys();
+    nextTicketKey_ = now + ticketKeyRotation_;
+    stats_.tlsKeyRotations++;
+    LOG_INFO("[TcpServer] Rotated TLS ticket keys");
+}
+
+void TcpServer::expireSessions(Session::Clock::time_point now) {
+    while (!lingering_.empty() && now - lingering_.front().second >= sessionLinger_) {
+        auto [session, detachedAt] = std::move(lingering_.front());
+        lingering_.pop_front();
+        // skip sessions resumed since, or detached again later (queued once more then)
+        if (!session->connections().empty() || session->detachedAt() != detachedAt) {
+            continue;
+        }
+        auto it = sessions_.find(session->username());
+        if (it != sessions_.end() && it->second == session) {
+            sessions_.erase(it);
+            stats_.sessionsExpired++;
+        }
+    }
+}
@@ -0,0 +1,117 @@
+#include "network/TimerWheel.h"
+
+namespace {
+    constexpr uint64_t kSlotMask = TimerWheel::kSlots - 1;
+    constexpr uint64_t kMaxDelay = (uint64_t(1) << (TimerWheel::kSlotBits * TimerWheel::kLevels)) - 1;
+}
+
+TimerWheel::TimerWheel(Clock::duration tick, Clock::time_point start)
+    : tick_(tick),
+      start_(start)
+{}
+
+TimerWheel::~TimerWheel() {
+    // timers can outlive the wheel (connections still referenced by handlers), leave them unlinked
+    for (auto& level : slots_) {
+        for (Timer*& head : level) {
+            while (head) {
+                unlink(*head);
+            }
+        }
+    }
+}
+
+void TimerWheel::schedule(Timer& timer, Clock::duration delay) {
+    cancel(timer);
+
+    uint64_t ticks = 1;
+    if (delay > Clock::duration::zero()) {
+        ticks = static_cast<uint64_t>((delay + tick_ - Clock::duration(1)) / tick_);
+    }
+    if (ticks == 0) ticks = 1;
+    if (ticks > kMaxDelay) ticks = kMaxDelay;
+
+    timer.expiry_ = now_ + ticks;
+    insert(timer);
+    size_++;
+}
+
+void TimerWheel::cancel(Timer& timer) {
+    if (timer.wheel_ != this) {
+        return;
+    }
+    unlink(timer);
+    size_--;
+}
+
+size_t TimerWheel::advance(Clock::time_point now) {
+    if (now < start_) {
+        return 0;
+    }
+    const auto target = static_cast<uint64_t>((now - start_) / tick_);
+
+    size_t fired = 0;
+    while (now_ < target) {
+        now_++;
+
+        // a level wrapped, bring the next slot of the level above down
+        // (and of the one above that when it wrapped too)
+        for (size_t level = 1; level < kLevels; level++) {
+            if (((now_ >> (kSlotBits * (level - 1))) & kSlotMask) != 0) break;
+            cascade(level);
+        }
+
+        // level 0 slots only hold timers due on exactly this tick
+        Timer*& head = slots_[0][now_ & kSlotMask];
+        while (head) {
+            Timer& timer = *head;
+            unlink(timer);
+            size_--;
+            fired++;
+            if (timer.callback_) timer.callback_();
+        }
+    }
+    return fired;
+}
+
+void TimerWheel::insert(Timer& timer) {
+    uint64_t delta = timer.expiry_ > now_ ? timer.expiry_ - now_ : 0;
+
+    size_t level = 0;
+    while (level + 1 < kLevels && delta >= (uint64_t(1) << (kSlotBits * (level + 1)))) {
+        level++;
+    }
+
+    Timer*& head = slots_[level][(timer.expiry_ >> (kSlotBits * level)) & kSlotMask];
+    timer.wheel_ = this;
+    timer.head_ = &head;
+    timer.prev_ = nullptr;
+    timer.next_ = head;
+    if (head) head->prev_ = &timer;
+    head = &timer;
+}
+
+void TimerWheel::unlink(Timer& timer) {
+    if (timer.prev_) {
+        timer.prev_->next_ = timer.next_;
+    } else {
+        *timer.head_ = timer.next_;
+    }
+    if (timer.next_) timer.next_->prev_ = timer.prev_;
+
+    timer.wheel_ = nullptr;
+    timer.head_ = nullptr;
+    timer.prev_ = nullptr;
+    timer.next_ = nullptr;
+}
+
+void TimerWheel::cascade(size_t level) {
+    Timer* timer = slots_[level][(now_ >> (kSlotBits * level)) & kSlotMask];
+    slots_[level][(now_ >> (kSlotBits * level)) & kSlotMask] = nullptr;
+
+    while (timer) {
+        Timer* next = timer->next_;
+        insert(*timer);
+        timer = next;
+    }
+}
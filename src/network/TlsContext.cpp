@@ -0,0 +1,257 @@
+#include "network/TlsContext.h"
+
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rand.h>
+#include <openssl/x509v3.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+    // SSL_CTX slot pointing back at the owning TlsContext
+    // (asio keeps its own verify callback in the app data slot)
+    int contextIndex() {
+        static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+        return index;
+    }
+
+    // SSL slot holding the "host:port" a client connection resumes with, freed with the SSL
+    void freePeer(void* /*parent*/, void* ptr, CRYPTO_EX_DATA* /*ad*/, int /*idx*/,
+                  long /*argl*/, void* /*argp*/) {
+        delete static_cast<std::string*>(ptr);
+    }
+
+    int peerIndex() {
+        static const int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, freePeer);
+        return index;
+    }
+
+    std::string bioToString(BIO* bio) {
+        char* data;
+        long len = BIO_get_mem_data(bio, &data);
+        return std::string(data, len);
+    }
+
+    // certificates for an address need an IP entry, names a DNS one
+    std::string subjectAltName(const std::string& commonName) {
+        asio::error_code ec;
+        asio::ip::make_address(commonName, ec);
+        return (ec ? "DNS:" : "IP:") + commonName;
+    }
+}
+
+TlsContext::Credentials TlsContext::selfSigned(const std::string& commonName, int days) {
+    EVP_PKEY* key = EVP_EC_gen("P-256");
+    X509* cert = X509_new();
+    if (!key || !cert) {
+        EVP_PKEY_free(key);
+        X509_free(cert);
+        throw std::runtime_error("Failed to create TLS key");
+    }
+
+    unsigned char serial[16];
+    RAND_bytes(serial, sizeof(serial));
+    serial[0] &= 0x7f;
+    BIGNUM* serialNumber = BN_bin2bn(serial, sizeof(serial), nullptr);
+    BN_to_ASN1_INTEGER(serialNumber, X509_get_serialNumber(cert));
+    BN_free(serialNumber);
+
+    X509_set_version(cert, 2);
+    X509_gmtime_adj(X509_getm_notBefore(cert), -60);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 60L * 60 * 24 * days);
+    X509_set_pubkey(cert, key);
+
+    X509_NAME* name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_UTF8,
+                               reinterpret_cast<const unsigned char*>(commonName.c_str()), -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+
+    X509V3_CTX v3;
+    X509V3_set_ctx_nodb(&v3);
+    X509V3_set_ctx(&v3, cert, cert, nullptr, nullptr, 0);
+    X509_EXTENSION* san = X509V3_EXT_conf_nid(nullptr, &v3, NID_subject_alt_name,
+                                              subjectAltName(commonName).c_str());
+    bool ok = san && X509_add_ext(cert, san, -1) && X509_sign(cert, key, EVP_sha256());
+    X509_EXTENSION_free(san);
+
+    Credentials credentials;
+    if (ok) {
+        BIO* bio = BIO_new(BIO_s_mem());
+        PEM_write_bio_X509(bio, cert);
+        credentials.certificatePem = bioToString(bio);
+        BIO_free(bio);
+
+        bio = BIO_new(BIO_s_mem());
+        PEM_write_bio_PrivateKey(bio, key, nullptr, nullptr, 0, nullptr, nullptr);
+        credentials.privateKeyPem = bioToString(bio);
+        BIO_free(bio);
+    }
+
+    X509_free(cert);
+    EVP_PKEY_free(key);
+
+    if (!ok)
+        throw std::runtime_error("Failed to sign TLS certificate");
+    return credentials;
+}
+
+TlsContext::TlsContext(Role role, asio::ssl::context::method method)
+    : role_(role),
+      context_(method)
+{
+    context_.set_options(asio::ssl::context::default_workarounds
+                       | asio::ssl::context::no_sslv2
+                       | asio::ssl::context::no_sslv3
+                       | asio::ssl::context::no_tlsv1
+                       | asio::ssl::context::no_tlsv1_1);
+    SSL_CTX_set_ex_data(context_.native_handle(), contextIndex(), this);
+}
+
+TlsContext::~TlsContext() {
+    for (auto& [peer, session] : sessions_) {
+        SSL_SESSION_free(session);
+    }
+}
+
+std::shared_ptr<TlsContext> TlsContext::server(const Credentials& credentials, size_t sessionCacheSize) {
+    std::shared_ptr<TlsContext> tls(new TlsContext(Role::Server, asio::ssl::context::tls_server));
+    SSL_CTX* ctx = tls->context_.native_handle();
+
+    try {
+        tls->context_.use_certificate_chain(asio::buffer(credentials.certificatePem));
+        tls->context_.use_private_key(asio::buffer(credentials.privateKeyPem), asio::ssl::context::pem);
+    } catch (const std::system_error& e) {
+        throw std::runtime_error(std::string("Failed to load TLS credentials: ") + e.what());
+    }
+
+    // TLS 1.2 resumption by session id, looked up in OpenSSL's in-process cache
+    static const unsigned char sessionContext[] = "EncryptedMessenger";
+    SSL_CTX_set_session_id_context(ctx, sessionContext, sizeof(sessionContext) - 1);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, static_cast<long>(sessionCacheSize));
+
+    // TLS 1.2 and 1.3 tickets, sealed with our own rotating keys
+    tls->ticketKeys_.push_back(makeTicketKey());
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, &TlsContext::ticketKeyCallback);
+
+    return tls;
+}
+
+std::shared_ptr<TlsContext> TlsContext::client(const std::string& trustedCertificatePem) {
+    std::shared_ptr<TlsContext> tls(new TlsContext(Role::Client, asio::ssl::context::tls_client));
+    SSL_CTX* ctx = tls->context_.native_handle();
+
+    if (trustedCertificatePem.empty()) {
+        tls->context_.set_default_verify_paths();
+    } else {
+        tls->context_.add_certificate_authority(asio::buffer(trustedCertificatePem));
+    }
+    tls->context_.set_verify_mode(asio::ssl::verify_peer);
+
+    // sessions are kept per peer in sessions_, not in OpenSSL's own cache
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, &TlsContext::newSessionCallback);
+
+    return tls;
+}
+
+void TlsContext::rotateTicketKeys() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ticketKeys_.insert(ticketKeys_.begin(), makeTicketKey());
+    ticketKeys_.resize(2);
+}
+
+void TlsContext::prepareClient(SSL* ssl, const std::string& peer) {
+    SSL_set_ex_data(ssl, peerIndex(), new std::string(peer));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = sessions_.find(peer);
+    if (it != sessions_.end()) {
+        SSL_set_session(ssl, it->second);
+    }
+}
+
+size_t TlsContext::cachedSessions() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sessions_.size();
+}
+
+TlsContext::TicketKey TlsContext::makeTicketKey() {
+    TicketKey key;
+    if (RAND_bytes(key.name.data(), key.name.size()) != 1
+        || RAND_bytes(key.aesKey.data(), key.aesKey.size()) != 1
+        || RAND_bytes(key.hmacKey.data(), key.hmacKey.size()) != 1) {
+        throw std::runtime_error("Failed to generate TLS ticket key");
+    }
+    return key;
+}
+
+int TlsContext::ticketKeyCallback(SSL* ssl, unsigned char* keyName, unsigned char* iv,
+                                  EVP_CIPHER_CTX* cipher, EVP_MAC_CTX* mac, int encrypt) {
+    auto* tls = static_cast<TlsContext*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), contextIndex()));
+    if (!tls) {
+        return -1;
+    }
+
+    TicketKey key;
+    bool current = true;
+    {
+        std::lock_guard<std::mutex> lock(tls->mutex_);
+        if (encrypt) {
+            key = tls->ticketKeys_.front();
+        } else {
+            // unknown name: key rotated out or never ours, fall back to a full handshake
+            auto it = std::find_if(tls->ticketKeys_.begin(), tls->ticketKeys_.end(), [&](const TicketKey& k) {
+                return std::memcmp(k.name.data(), keyName, k.name.size()) == 0;
+            });
+            if (it == tls->ticketKeys_.end()) {
+                return 0;
+            }
+            key = *it;
+            current = it == tls->ticketKeys_.begin();
+        }
+    }
+
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmacKey.data(), key.hmacKey.size()),
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char*>("SHA256"), 0),
+        OSSL_PARAM_construct_end()
+    };
+
+    if (encrypt) {
+        std::memcpy(keyName, key.name.data(), key.name.size());
+        if (RAND_bytes(iv, EVP_CIPHER_get_iv_length(EVP_aes_256_cbc())) != 1
+            || !EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aesKey.data(), iv)
+            || !EVP_MAC_CTX_set_params(mac, params)) {
+            return -1;
+        }
+        return 1;
+    }
+
+    if (!EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aesKey.data(), iv)
+        || !EVP_MAC_CTX_set_params(mac, params)) {
+        return -1;
+    }
+    // 2 asks OpenSSL to issue a new ticket: always for TLS 1.3, whose clients use a ticket
+    // only once, otherwise when the ticket was sealed with the previous key
+    return current && SSL_version(ssl) != TLS1_3_VERSION ? 1 : 2;
+}
+
+int TlsContext::newSessionCallback(SSL* ssl, SSL_SESSION* session) {
+    auto* tls = static_cast<TlsContext*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), contextIndex()));
+    auto* peer = static_cast<std::string*>(SSL_get_ex_data(ssl, peerIndex()));
+    if (!tls || !peer) {
+        return 0;
+    }
+
+    // returning 1 hands our reference to sessions_, the newest session replaces the last
+    std::lock_guard<std::mutex> lock(tls->mutex_);
+    SSL_SESSION*& slot = tls->sessions_[*peer];
+    if (slot) {
+        SSL_SESSION_free(slot);
+    }
+    slot = session;
+    return 1;
+}
@@ -0,0 +1,123 @@
+#include "network/WireFormat.h"
+#include "utils/ByteOrder.h"
+#include "utils/base64.h"
+
+namespace {
+
+    // message fields holding bytes, stored and sent as base64 in json
+    constexpr const char* kByteFields[] = {
+        "ciphertext", "iv", "tag", "aes_for_sender", "aes_for_recipient"
+    };
+
+    bool readString(const nlohmann::json& value, const char* key, std::string_view& field) {
+        auto it = value.find(key);
+        if (it == value.end()) return true;
+        if (!it->is_string()) return false;
+        field = it->get_ref<const std::string&>();
+        return true;
+    }
+
+    bool readStringArray(const nlohmann::json& value, const char* key, std::vector<std::string_view>& field) {
+        auto it = value.find(key);
+        if (it == value.end()) return true;
+        if (!it->is_array()) return false;
+        field.clear();
+        for (const auto& element : *it) {
+            if (!element.is_string()) return false;
+            field.push_back(element.get_ref<const std::string&>());
+        }
+        return true;
+    }
+
+    bool readUnsigned(const nlohmann::json& value, const char* key, uint64_t& field) {
+        auto it = value.find(key);
+        if (it == value.end()) return true;
+        if (!it->is_number_unsigned()) return false;
+        field = it->get<uint64_t>();
+        return true;
+    }
+
+}
+
+std::optional<WireFormat> wire::formatFromName(std::string_view name) {
+    if (name == "json") return WireFormat::Json;
+    if (name == "msgpack") return WireFormat::MsgPack;
+    if (name == "cbor") return WireFormat::Cbor;
+    return std::nullopt;
+}
+
+const char* wire::formatName(WireFormat format) {
+    switch (format) {
+        case WireFormat::MsgPack: return "msgpack";
+        case WireFormat::Cbor:    return "cbor";
+        case WireFormat::Json:    break;
+    }
+    return "json";
+}
+
+std::string wire::encodeFrame(const nlohmann::json& value, WireFormat format) {
+    if (format == WireFormat::Json) {
+        return value.dump();
+    }
+    std::string frame;
+    appendFrame(frame, value, format);
+    return frame;
+}
+
+void wire::appendFrame(std::string& out, const nlohmann::json& value, WireFormat format) {
+    if (format == WireFormat::Json) {
+        nlohmann::detail::serializer<nlohmann::json> serializer(
+            nlohmann::detail::output_adapter<char>(out), ' ');
+        serializer.dump(value, false, false, 0);
+        return;
+    }
+
+    // payload is appended after a placeholder prefix, no second copy
+    size_t header = out.size();
+    out.append(kFrameHeader, '\0');
+    if (format == WireFormat::MsgPack) {
+        nlohmann::json::to_msgpack(value, out);
+    } else {
+        nlohmann::json::to_cbor(value, out);
+    }
+    byteorder::setU32(out, header, static_cast<uint32_t>(out.size() - header - kFrameHeader));
+}
+
+nlohmann::json wire::decodePayload(std::string_view payload, WireFormat format) {
+    const char* begin = payload.data();
+    const char* end = begin + payload.size();
+    switch (format) {
+        case WireFormat::MsgPack:
+            return nlohmann::json::from_msgpack(begin, end, true, false);
+        case WireFormat::Cbor:
+            return nlohmann::json::from_cbor(begin, end, true, false);
+        case WireFormat::Json:
+            break;
+    }
+    return nlohmann::json::parse(begin, end, nullptr, false);
+}
+
+bool wire::requestFromJson(const nlohmann::json& value, Request& request) {
+    if (!value.is_object()) return false;
+    return readString(value, "action", request.action)
+        && readString(value, "to", request.to)
+        && readString(value, "message", request.message)
+        && readString(value, "with", request.with)
+        && readString(value, "username", request.username)
+        && readString(value, "password_hash", request.passwordHash)
+        && readString(value, "encoding", request.encoding)
+        && readString(value, "compression", request.compression)
+        && readString(value, "group", request.group)
+        && readStringArray(value, "members", request.members)
+        && readUnsigned(value, "offset", request.offset)
+        && readUnsigned(value, "limit", request.limit)
+        && readUnsigned(value, "seq", request.seq);
+}
+
+void wire::toBinaryFields(nlohmann::json& message) {
+    for (const char* key : kByteFields) {
+        auto it = message.find(key);
+        if (it == message.end() || !it->is_string()) continue;
+        *it = nlohmann::json::binary(base64::decode(it->get_ref<const std::string&>()));
+    }
+}
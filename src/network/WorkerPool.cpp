@@ -0,0 +1,100 @@
+#include "network/WorkerPool.h"
+#include <algorithm>
+#include "utils/Logger.h"
+
+WorkerPool::WorkerPool(size_t threads, size_t maxQueued)
+    : maxQueued_(std::max<size_t>(maxQueued, 1)) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < threads; i++) {
+        workers_.emplace_back([this] { run(); });
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : workers_) t.join();
+}
+
+bool WorkerPool::enqueue(const void* order, unsigned priority, std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_ || pending_ >= maxQueued_) {
+            stats_.rejected++;
+            return false;
+        }
+
+        Task entry{order, priority, std::move(task), Clock::now()};
+        // a key present in ordered_ has a task queued or running, later ones wait behind it
+        auto waiting = order ? ordered_.find(order) : ordered_.end();
+        if (waiting != ordered_.end()) {
+            waiting->second.push_back(std::move(entry));
+        } else {
+            if (order) {
+                ordered_.emplace(order, std::deque<Task>());
+            }
+            ready_[priority].push_back(std::move(entry));
+        }
+
+        pending_++;
+        stats_.queued = pending_;
+        if (pending_ > stats_.peakQueued) {
+            stats_.peakQueued = pending_;
+        }
+    }
+    stats_.submitted++;
+    cv_.notify_one();
+    return true;
+}
+
+bool WorkerPool::hasReady() const {
+    return std::any_of(ready_.begin(), ready_.end(), [](const auto& level) { return !level.empty(); });
+}
+
+void WorkerPool::run() {
+    for (;;) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stopping_ || hasReady(); });
+            if (!hasReady()) return;
+            auto level = std::find_if(ready_.begin(), ready_.end(), [](const auto& l) { return !l.empty(); });
+            task = std::move(level->front());
+            level->pop_front();
+            pending_--;
+            stats_.queued = pending_;
+        }
+
+        auto waited = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - task.queuedAt);
+        stats_.waitMicros += static_cast<uint64_t>(waited.count());
+        stats_.running++;
+        try {
+            task.run();
+        } catch (const std::exception& e) {
+            // a throwing task must not take the worker down with it, submit() has already
+            // posted its failure continuation
+            LOG_ERROR(std::string("[WorkerPool] Task failed: ") + e.what());
+        }
+        stats_.running--;
+        stats_.completed++;
+
+        if (task.order) {
+            // hand the key over to its next task, if any
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto waiting = ordered_.find(task.order);
+            if (waiting->second.empty()) {
+                ordered_.erase(waiting);
+            } else {
+                Task& next = waiting->second.front();
+                ready_[next.priority].push_back(std::move(next));
+                waiting->second.pop_front();
+                cv_.notify_one();
+            }
+        }
+    }
+}
@@ -1 +1,31 @@
-#include "server/Server.h"
\ No newline at end of file
+#include "server/Server.h"
+#include "storage/FileStorage.h"
+#include "utils/Logger.h"
+
+Server::Server(Options options, std::unique_ptr<MessageStore> storage)
+    : signals_(io_, SIGINT, SIGTERM),
+      network_(std::make_unique<TcpServer>(io_, options.port, std::move(storage), std::move(options.network)))
+{
+    signals_.async_wait([this](const std::error_code& error, int signal) {
+        if (error) {
+            return;
+        }
+        LOG_INFO("[Server] Signal " + std::to_string(signal) + ", shutting down");
+        stop();
+    });
+}
+
+Server::Server(Options options)
+    : Server(std::move(options), std::make_unique<FileStorage>())
+{}
+
+void Server::run() {
+    LOG_INFO("[Server] Running");
+    io_.run();
+    // queued log lines reach the output before the process exits
+    Logger::flush();
+}
+
+void Server::stop() {
+    io_.stop();
+}
@@ -1 +1,61 @@
-#include "server/Session.h"
\ No newline at end of file
+#include "server/Session.h"
+#include <algorithm>
+
+Session::Session(std::string username, std::shared_ptr<RateLimiter::Buckets> rateBuckets)
+    : username_(std::move(username)), rateBuckets_(std::move(rateBuckets)) {}
+
+void Session::attach(const std::shared_ptr<TcpConnection>& connection) {
+    connections_.push_back(connection);
+}
+
+bool Session::detach(const TcpConnection* connection) {
+    auto it = std::find_if(connections_.begin(), connections_.end(),
+                           [connection](const auto& attached) { return attached.get() == connection; });
+    if (it == connections_.end()) {
+        return false;
+    }
+    connections_.erase(it);
+    if (!connections_.empty()) {
+        return false;
+    }
+    detachedAt_ = Clock::now();
+    return true;
+}
+
+CryptoManager::PublicKey Session::cachedKey(const std::string& user) {
+    std::lock_guard<std::mutex> lock(keysMutex_);
+    auto cached = keys_.find(user);
+    if (cached == keys_.end()) {
+        return nullptr;
+    }
+    keyOrder_.splice(keyOrder_.begin(), keyOrder_, cached->second);
+    return cached->second->second;
+}
+
+void Session::cacheKey(const std::string& user, CryptoManager::PublicKey key) {
+    std::lock_guard<std::mutex> lock(keysMutex_);
+    if (keys_.count(user)) {
+        return;   // another worker loaded it meanwhile, same key
+    }
+    if (keys_.size() >= kMaxCachedKeys) {
+        keys_.erase(keyOrder_.back().first);
+        keyOrder_.pop_back();
+    }
+    keyOrder_.emplace_front(user, std::move(key));
+    keys_.emplace(user, keyOrder_.begin());
+}
+
+size_t Session::cachedKeys() const {
+    std::lock_guard<std::mutex> lock(keysMutex_);
+    return keys_.size();
+}
+
+uint64_t Session::readCursor(const std::string& peer) const {
+    auto it = readCursors_.find(peer);
+    return it == readCursors_.end() ? 0 : it->second;
+}
+
+void Session::setReadCursor(const std::string& peer, uint64_t seq) {
+    uint64_t& cursor = readCursors_[peer];
+    cursor = std::max(cursor, seq);
+}
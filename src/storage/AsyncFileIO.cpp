@@ -0,0 +1,632 @@
+#include "storage/AsyncFileIO.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+#include "utils/Logger.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define ENCRYPTEDMESSENGER_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+    // ---------blocking primitives (thread pool engine)---------
+
+    std::error_code lastError() {
+        return std::error_code(errno, std::generic_category());
+    }
+
+    bool syncFile(FILE* f) {
+#ifdef _WIN32
+        return _commit(_fileno(f)) == 0;
+#else
+        return fsync(fileno(f)) == 0;
+#endif
+    }
+
+    std::error_code blockingRead(const std::string& path, std::string& out) {
+        FILE* f = std::fopen(path.c_str(), "rb");
+        if (!f) return lastError();
+
+        char buf[64 * 1024];
+        size_t n;
+        while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0) {
+            out.append(buf, n);
+        }
+
+        bool failed = std::ferror(f) != 0;
+        std::fclose(f);
+        return failed ? std::make_error_code(std::errc::io_error) : std::error_code{};
+    }
+
+    std::error_code blockingWrite(const std::string& path, const std::string& data,
+                                  const char* mode, bool sync) {
+        FILE* f = std::fopen(path.c_str(), mode);
+        if (!f) return lastError();
+
+        bool ok = std::fwrite(data.data(), 1, data.size(), f) == data.size() && std::fflush(f) == 0;
+        if (ok && sync) ok = syncFile(f);
+        ok = std::fclose(f) == 0 && ok;
+        return ok ? std::error_code{} : std::make_error_code(std::errc::io_error);
+    }
+
+    std::string tempPath(const std::string& path) {
+        return path + ".tmp";
+    }
+
+    // directory holding path, whose entry a rename changes
+    std::string parentDir(const std::string& path) {
+        std::string dir = std::filesystem::path(path).parent_path().string();
+        return dir.empty() ? "." : dir;
+    }
+
+    // a rename survives a crash once the directory is synced too
+    std::error_code syncParent(const std::string& path) {
+#ifdef _WIN32
+        (void)path;
+        return {};
+#else
+        int fd = ::open(parentDir(path).c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return lastError();
+        std::error_code ec = fsync(fd) == 0 ? std::error_code{} : lastError();
+        ::close(fd);
+        return ec;
+#endif
+    }
+
+    std::error_code runBlocking(AsyncFileIO::Op& op) {
+        switch (op.kind) {
+            case AsyncFileIO::OpKind::Read:
+                return blockingRead(op.path, op.data);
+            case AsyncFileIO::OpKind::Append:
+                return blockingWrite(op.path, op.data, "ab", op.sync);
+            case AsyncFileIO::OpKind::Replace: {
+                std::string tmp = tempPath(op.path);
+                if (auto ec = blockingWrite(tmp, op.data, "wb", op.sync)) return ec;
+                std::error_code ec;
+                std::filesystem::rename(tmp, op.path, ec);
+                if (!ec && op.sync) ec = syncParent(op.path);
+                return ec;
+            }
+        }
+        return std::make_error_code(std::errc::invalid_argument);
+    }
+
+    // ---------thread pool engine---------
+
+    class ThreadPoolEngine : public AsyncFileIO::Engine {
+    public:
+        ThreadPoolEngine(AsyncFileIO& io, size_t threads) : io_(io) {
+            for (size_t i = 0; i < std::max<size_t>(threads, 1); i++) {
+                workers_.emplace_back([this] { run(); });
+            }
+        }
+
+        ~ThreadPoolEngine() override {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+            }
+            cv_.notify_all();
+            for (auto& t : workers_) t.join();
+        }
+
+        void start(const std::shared_ptr<AsyncFileIO::Op>& op) override {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                queue_.push_back(op);
+            }
+            cv_.notify_one();
+        }
+
+    private:
+        void run() {
+            for (;;) {
+                std::shared_ptr<AsyncFileIO::Op> op;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+                    if (queue_.empty()) return;
+                    op = std::move(queue_.front());
+                    queue_.pop_front();
+                }
+                std::error_code ec = runBlocking(*op);
+                io_.complete(op, ec);
+            }
+        }
+
+        AsyncFileIO& io_;
+        std::vector<std::thread> workers_;
+        std::deque<std::shared_ptr<AsyncFileIO::Op>> queue_;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        bool stopping_ = false;
+    };
+
+#ifdef ENCRYPTEDMESSENGER_IO_URING
+
+    // ---------io_uring engine---------
+    // raw syscalls against <linux/io_uring.h>, no liburing dependency
+    // a submitter thread does open/fstat and queues the first SQE,
+    // a reaper thread waits for CQEs and drives each request through its stages
+
+    class UringEngine : public AsyncFileIO::Engine {
+    public:
+        static std::unique_ptr<UringEngine> create(AsyncFileIO& io, unsigned entries) {
+            io_uring_params params{};
+            int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+            if (fd < 0) return nullptr;
+
+            // IORING_OP_READ/WRITE arrived together with this feature (5.6)
+            if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+                close(fd);
+                return nullptr;
+            }
+
+            std::unique_ptr<UringEngine> engine(new UringEngine(io, fd, params));
+            if (!engine->mapRings()) return nullptr;
+            engine->startThreads();
+            return engine;
+        }
+
+        ~UringEngine() override {
+            if (reaper_.joinable()) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    stopping_ = true;
+                }
+                cv_.notify_all();
+                submitter_.join();
+
+                // wake the reaper with a NOP carrying no request
+                pushSqe(IORING_OP_NOP, -1, nullptr, 0, 0, nullptr);
+                reaper_.join();
+            }
+
+            if (sqes_) munmap(sqes_, sqesSize_);
+            if (cqRing_ && cqRing_ != sqRing_) munmap(cqRing_, cqRingSize_);
+            if (sqRing_) munmap(sqRing_, sqRingSize_);
+            close(ringFd_);
+        }
+
+        void start(const std::shared_ptr<AsyncFileIO::Op>& op) override {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                pending_.push_back(op);
+            }
+            cv_.notify_one();
+        }
+
+    private:
+        // a synced replace ends with SyncingDir: the temp file is renamed, then its directory synced
+        enum class Stage { Reading, Writing, Syncing, SyncingDir, Done };
+
+        struct Request {
+            std::shared_ptr<AsyncFileIO::Op> op;
+            int fd = -1;            // the file, or its directory while SyncingDir
+            size_t done = 0;        // bytes transferred so far
+            uint64_t offset = 0;    // file offset of the first byte
+            Stage stage = Stage::Done;
+            bool renamed = false;   // replace: temp file already moved over path
+        };
+
+        UringEngine(AsyncFileIO& io, int fd, const io_uring_params& params)
+            : io_(io), ringFd_(fd), params_(params) {}
+
+        bool mapRings() {
+            sqRingSize_ = params_.sq_off.array + params_.sq_entries * sizeof(unsigned);
+            cqRingSize_ = params_.cq_off.cqes + params_.cq_entries * sizeof(io_uring_cqe);
+            bool single = params_.features & IORING_FEAT_SINGLE_MMAP;
+            if (single) sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+
+            void* sq = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+            if (sq == MAP_FAILED) return false;
+            sqRing_ = static_cast<char*>(sq);
+
+            if (single) {
+                cqRing_ = sqRing_;
+            } else {
+                void* cq = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_CQ_RING);
+                if (cq == MAP_FAILED) return false;
+                cqRing_ = static_cast<char*>(cq);
+            }
+
+            sqesSize_ = params_.sq_entries * sizeof(io_uring_sqe);
+            void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+            if (sqes == MAP_FAILED) return false;
+            sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+            sqHead_  = reinterpret_cast<unsigned*>(sqRing_ + params_.sq_off.head);
+            sqTail_  = reinterpret_cast<unsigned*>(sqRing_ + params_.sq_off.tail);
+            sqMask_  = *reinterpret_cast<unsigned*>(sqRing_ + params_.sq_off.ring_mask);
+            sqArray_ = reinterpret_cast<unsigned*>(sqRing_ + params_.sq_off.array);
+            cqHead_  = reinterpret_cast<unsigned*>(cqRing_ + params_.cq_off.head);
+            cqTail_  = reinterpret_cast<unsigned*>(cqRing_ + params_.cq_off.tail);
+            cqMask_  = *reinterpret_cast<unsigned*>(cqRing_ + params_.cq_off.ring_mask);
+            cqes_    = reinterpret_cast<io_uring_cqe*>(cqRing_ + params_.cq_off.cqes);
+            return true;
+        }
+
+        void startThreads() {
+            submitter_ = std::thread([this] { runSubmitter(); });
+            reaper_ = std::thread([this] { runReaper(); });
+        }
+
+        // queue one SQE and submit it, false if the kernel rejected the submission
+        bool pushSqe(uint8_t opcode, int fd, const void* addr, unsigned len, uint64_t off, Request* req) {
+            std::lock_guard<std::mutex> lock(sqMutex_);
+
+            unsigned tail = *sqTail_;
+            unsigned index = tail & sqMask_;
+            io_uring_sqe& sqe = sqes_[index];
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = opcode;
+            sqe.fd = fd;
+            sqe.addr = reinterpret_cast<uint64_t>(addr);
+            sqe.len = len;
+            sqe.off = off;
+            sqe.user_data = reinterpret_cast<uint64_t>(req);
+            sqArray_[index] = index;
+            std::atomic_ref<unsigned>(*sqTail_).store(tail + 1, std::memory_order_release);
+
+            // without SQPOLL the kernel consumes the entry inside io_uring_enter
+            for (;;) {
+                long rc = syscall(__NR_io_uring_enter, ringFd_, 1, 0, 0, nullptr, 0);
+                if (rc >= 1) return true;
+                if (rc < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY)) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                return false;
+            }
+        }
+
+        // in-flight requests are capped at the SQ size so the CQ cannot overflow
+        void runSubmitter() {
+            for (;;) {
+                std::shared_ptr<AsyncFileIO::Op> op;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    cv_.wait(lock, [this] {
+                        return stopping_ || (!pending_.empty() && inFlight_ < params_.sq_entries);
+                    });
+                    if (stopping_) return;
+                    op = std::move(pending_.front());
+                    pending_.pop_front();
+                    inFlight_++;
+                }
+                begin(op);
+            }
+        }
+
+        // open the file and queue its first transfer
+        void begin(const std::shared_ptr<AsyncFileIO::Op>& op) {
+            auto* req = new Request{op};
+            int flags = 0;
+            std::string openPath = op->path;
+
+            switch (op->kind) {
+                case AsyncFileIO::OpKind::Read:    flags = O_RDONLY; break;
+                case AsyncFileIO::OpKind::Append:  flags = O_WRONLY | O_CREAT | O_APPEND; break;
+                case AsyncFileIO::OpKind::Replace:
+                    flags = O_WRONLY | O_CREAT | O_TRUNC;
+                    openPath = tempPath(op->path);
+                    break;
+            }
+
+            req->fd = ::open(openPath.c_str(), flags | O_CLOEXEC, 0644);
+            if (req->fd < 0) {
+                finish(req, lastError());
+                return;
+            }
+
+            struct stat st {};
+            if (fstat(req->fd, &st) != 0) {
+                finish(req, lastError());
+                return;
+            }
+
+            if (op->kind == AsyncFileIO::OpKind::Read) {
+                op->data.resize(static_cast<size_t>(st.st_size));
+                req->stage = Stage::Reading;
+            } else {
+                req->offset = (op->kind == AsyncFileIO::OpKind::Append) ? st.st_size : 0;
+                req->stage = Stage::Writing;
+            }
+            advance(req);
+        }
+
+        // queue the next SQE for req, or finish it
+        void advance(Request* req) {
+            auto& op = *req->op;
+            constexpr size_t kMaxChunk = 1u << 30;
+
+            if (req->stage == Stage::Reading || req->stage == Stage::Writing) {
+                if (req->done >= op.data.size()) {
+                    req->stage = (req->stage == Stage::Writing && op.sync) ? Stage::Syncing : Stage::Done;
+                    advance(req);
+                    return;
+                }
+
+                size_t len = std::min(op.data.size() - req->done, kMaxChunk);
+                uint8_t opcode = (req->stage == Stage::Reading) ? IORING_OP_READ : IORING_OP_WRITE;
+                if (!pushSqe(opcode, req->fd, op.data.data() + req->done,
+                             static_cast<unsigned>(len), req->offset + req->done, req)) {
+                    finish(req, lastError());
+                }
+                return;
+            }
+
+            if (req->stage == Stage::Syncing || req->stage == Stage::SyncingDir) {
+                if (!pushSqe(IORING_OP_FSYNC, req->fd, nullptr, 0, 0, req)) {
+                    finish(req, lastError());
+                }
+                return;
+            }
+
+            if (op.kind == AsyncFileIO::OpKind::Replace && op.sync && !req->renamed) {
+                // the file is on disk, move it into place and sync the directory entry
+                if (auto ec = renameTemp(req)) {
+                    finish(req, ec);
+                    return;
+                }
+                req->fd = ::open(parentDir(op.path).c_str(), O_RDONLY | O_CLOEXEC);
+                if (req->fd < 0) {
+                    finish(req, lastError());
+                    return;
+                }
+                req->stage = Stage::SyncingDir;
+                advance(req);
+                return;
+            }
+
+            finish(req, {});
+        }
+
+        // close the temp file and rename it over the target
+        std::error_code renameTemp(Request* req) {
+            if (req->fd >= 0) {
+                ::close(req->fd);
+                req->fd = -1;
+            }
+            std::error_code ec;
+            std::filesystem::rename(tempPath(req->op->path), req->op->path, ec);
+            req->renamed = !ec;
+            return ec;
+        }
+
+        void runReaper() {
+            for (;;) {
+                long rc = syscall(__NR_io_uring_enter, ringFd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+                if (rc < 0 && errno != EINTR) {
+                    LOG_ERROR(std::string("[AsyncFileIO] io_uring_enter failed: ") + std::strerror(errno));
+                }
+
+                unsigned head = *cqHead_;
+                unsigned tail = std::atomic_ref<unsigned>(*cqTail_).load(std::memory_order_acquire);
+                bool wake = false;
+
+                while (head != tail) {
+                    io_uring_cqe cqe = cqes_[head & cqMask_];
+                    head++;
+                    std::atomic_ref<unsigned>(*cqHead_).store(head, std::memory_order_release);
+
+                    auto* req = reinterpret_cast<Request*>(cqe.user_data);
+                    if (!req) {
+                        wake = true;
+                        continue;
+                    }
+                    onCompletion(req, cqe.res);
+                }
+
+                if (wake) {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (stopping_ && inFlight_ == 0) return;
+                }
+            }
+        }
+
+        void onCompletion(Request* req, int res) {
+            if (res < 0) {
+                finish(req, std::error_code(-res, std::generic_category()));
+                return;
+            }
+
+            switch (req->stage) {
+                case Stage::Reading:
+                    if (res == 0) {
+                        // file shrank since fstat
+                        req->op->data.resize(req->done);
+                    }
+                    req->done += res;
+                    if (res == 0) req->stage = Stage::Done;
+                    break;
+                case Stage::Writing:
+                    req->done += res;
+                    break;
+                case Stage::Syncing:
+                case Stage::SyncingDir:
+                    req->stage = Stage::Done;
+                    break;
+                case Stage::Done:
+                    break;
+            }
+            advance(req);
+        }
+
+        void finish(Request* req, std::error_code ec) {
+            if (!ec && req->op->kind == AsyncFileIO::OpKind::Replace && !req->renamed) {
+                ec = renameTemp(req);
+            }
+            if (req->fd >= 0) ::close(req->fd);
+
+            std::shared_ptr<AsyncFileIO::Op> op = std::move(req->op);
+            delete req;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                inFlight_--;
+            }
+            cv_.notify_one();
+
+            io_.complete(op, ec);
+        }
+
+        AsyncFileIO& io_;
+        int ringFd_;
+        io_uring_params params_;
+
+        char* sqRing_ = nullptr;
+        char* cqRing_ = nullptr;
+        io_uring_sqe* sqes_ = nullptr;
+        size_t sqRingSize_ = 0, cqRingSize_ = 0, sqesSize_ = 0;
+        unsigned* sqHead_ = nullptr;
+        unsigned* sqTail_ = nullptr;
+        unsigned* sqArray_ = nullptr;
+        unsigned sqMask_ = 0;
+        unsigned* cqHead_ = nullptr;
+        unsigned* cqTail_ = nullptr;
+        unsigned cqMask_ = 0;
+        io_uring_cqe* cqes_ = nullptr;
+        std::mutex sqMutex_;
+
+        std::thread submitter_;
+        std::thread reaper_;
+        std::deque<std::shared_ptr<AsyncFileIO::Op>> pending_;
+        size_t inFlight_ = 0;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        bool stopping_ = false;
+    };
+
+#endif // ENCRYPTEDMESSENGER_IO_URING
+
+}
+
+AsyncFileIO::AsyncFileIO(size_t threads, bool preferIoUring) {
+#ifdef ENCRYPTEDMESSENGER_IO_URING
+    if (preferIoUring) {
+        // containers often block io_uring_setup, fall back quietly
+        if (auto uring = UringEngine::create(*this, 256)) {
+            engine_ = std::move(uring);
+            backend_ = Backend::IoUring;
+            LOG_INFO("[AsyncFileIO] Using io_uring backend");
+            return;
+        }
+    }
+#endif
+    engine_ = std::make_unique<ThreadPoolEngine>(*this, threads);
+    backend_ = Backend::ThreadPool;
+    LOG_INFO("[AsyncFileIO] Using thread pool backend (" + std::to_string(threads) + " threads)");
+}
+
+AsyncFileIO::~AsyncFileIO() {
+    drain();
+    engine_.reset();
+}
+
+void AsyncFileIO::readFile(const std::string& path, ReadHandler handler) {
+    auto op = std::make_shared<Op>();
+    op->kind = OpKind::Read;
+    op->path = path;
+    op->onRead = std::move(handler);
+    submit(std::move(op));
+}
+
+void AsyncFileIO::writeFile(const std::string& path, std::string data, bool sync, WriteHandler handler) {
+    auto op = std::make_shared<Op>();
+    op->kind = OpKind::Replace;
+    op->path = path;
+    op->data = std::move(data);
+    op->sync = sync;
+    op->onWrite.push_back(std::move(handler));
+    submit(std::move(op));
+}
+
+void AsyncFileIO::appendFile(const std::string& path, std::string data, bool sync, WriteHandler handler) {
+    auto op = std::make_shared<Op>();
+    op->kind = OpKind::Append;
+    op->path = path;
+    op->data = std::move(data);
+    op->sync = sync;
+    op->onWrite.push_back(std::move(handler));
+    submit(std::move(op));
+}
+
+void AsyncFileIO::submit(std::shared_ptr<Op> op) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& queue = queues_[op->path];
+
+        // newer full contents make a queued replace redundant, keep both handlers
+        if (op->kind == OpKind::Replace && !queue.empty()) {
+            auto& last = queue.back();
+            if (!last->started && last->kind == OpKind::Replace) {
+                last->data = std::move(op->data);
+                last->sync = last->sync || op->sync;
+                for (auto& h : op->onWrite) last->onWrite.push_back(std::move(h));
+                return;
+            }
+        }
+
+        queue.push_back(op);
+        outstanding_++;
+        if (queue.size() > 1) {
+            // runs when the operation ahead of it completes
+            return;
+        }
+        op->started = true;
+    }
+    engine_->start(op);
+}
+
+void AsyncFileIO::complete(const std::shared_ptr<Op>& op, std::error_code ec) {
+    if (op->kind == OpKind::Read) {
+        if (op->onRead) op->onRead(ec, std::move(op->data));
+    } else {
+        for (auto& handler : op->onWrite) {
+            if (handler) handler(ec);
+        }
+    }
+
+    std::shared_ptr<Op> next;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = queues_.find(op->path);
+        if (it != queues_.end()) {
+            it->second.pop_front();
+            if (it->second.empty()) {
+                queues_.erase(it);
+            } else {
+                next = it->second.front();
+                next->started = true;
+            }
+        }
+        outstanding_--;
+        if (outstanding_ == 0) idle_.notify_all();
+    }
+
+    if (next) engine_->start(next);
+}
+
+void AsyncFileIO::drain() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return outstanding_ == 0; });
+}
@@ -0,0 +1,341 @@
+#include "storage/ConversationIndex.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <json.hpp>
+#include "server/MessageStore.h"
+#include "utils/ByteOrder.h"
+#include "utils/Logger.h"
+
+using namespace byteorder;
+
+namespace {
+    constexpr size_t kRecordLen = 8 + 8 + 8 + 8;
+}
+
+ConversationIndex::ConversationIndex(std::string messagesDir)
+    : messagesDir_(std::move(messagesDir)),
+      pairs_(messagesDir_ + "/index", "conversations"),
+      peers_(messagesDir_ + "/index", "peers") {}
+
+std::string ConversationIndex::pairKey(const std::string& userA, const std::string& userB) {
+    // the first name's length up front keeps the key unambiguous whatever bytes the names hold
+    const std::string& first = (userA < userB) ? userA : userB;
+    const std::string& second = (userA < userB) ? userB : userA;
+    std::string key;
+    key.reserve(4 + first.size() + second.size());
+    putU32(key, static_cast<uint32_t>(first.size()));
+    key += first;
+    key += second;
+    return key;
+}
+
+void ConversationIndex::setWriter(SnapshotTable::Writer* writer) {
+    pairs_.setWriter(writer);
+    peers_.setWriter(writer);
+}
+
+bool ConversationIndex::open() {
+    if (!pairs_.open() || !peers_.open()) {
+        LOG_ERROR("[ConversationIndex] Failed to open index tables in " + messagesDir_);
+        return false;
+    }
+
+    if (pairs_.fresh() && peers_.fresh()) {
+        // first start with the tables: derive them from the conversations
+        migrateFolders();
+        rebuildFromConversations();
+        pairs_.compact();
+        peers_.compact();
+    }
+    return true;
+}
+
+bool ConversationIndex::recordMessage(const std::string& from,
+                                      const std::string& to,
+                                      uint64_t seq,
+                                      long timestamp) {
+    applyMessage(from, to, seq, timestamp);
+    return true;
+}
+
+std::optional<uint64_t> ConversationIndex::markRead(const std::string& username, const std::string& peer,
+                                                    uint64_t seq) {
+    auto record = loadRecord(username, peer);
+    if (!record) {
+        return std::nullopt;
+    }
+
+    uint64_t clamped = std::min(seq, record->meta.lastSeq);
+    uint64_t& read = record->read[username < peer ? 0 : 1];
+    if (clamped <= read) {
+        // already acknowledged
+        return read;
+    }
+
+    read = clamped;
+    storeRecord(username, peer, *record);
+    return read;
+}
+
+std::vector<std::string> ConversationIndex::removeUser(const std::string& username) {
+    std::vector<std::string> removed = peersOf(username);
+
+    for (const auto& peer : removed) {
+        removePeer(peer, username);
+        pairs_.erase(pairKey(username, peer));
+    }
+    peers_.erase(username);
+    return removed;
+}
+
+std::vector<std::string> ConversationIndex::peersOf(const std::string& username) const {
+    auto value = peers_.get(username);
+    return value ? decodePeers(*value) : std::vector<std::string>{};
+}
+
+bool ConversationIndex::contains(const std::string& userA, const std::string& userB) const {
+    return pairs_.contains(pairKey(userA, userB));
+}
+
+std::optional<ConversationIndex::Meta> ConversationIndex::meta(const std::string& userA,
+                                                               const std::string& userB) const {
+    auto record = loadRecord(userA, userB);
+    if (!record) return std::nullopt;
+    return record->meta;
+}
+
+uint64_t ConversationIndex::readSeq(const std::string& username, const std::string& peer) const {
+    auto record = loadRecord(username, peer);
+    return record ? record->read[username < peer ? 0 : 1] : 0;
+}
+
+void ConversationIndex::applyMessage(const std::string& from,
+                                     const std::string& to,
+                                     uint64_t seq,
+                                     long timestamp) {
+    auto existing = loadRecord(from, to);
+    Record record = existing.value_or(Record{});
+
+    if (!existing) {
+        addPeer(from, to);
+        addPeer(to, from);
+    }
+
+    if (!existing || seq >= record.meta.lastSeq) {
+        record.meta.lastSeq = seq;
+        record.meta.lastTimestamp = timestamp;
+    }
+    // the sender has seen everything up to their own message, the recipient's cursor is kept
+    uint64_t& read = record.read[from < to ? 0 : 1];
+    read = std::max(read, seq);
+    storeRecord(from, to, record);
+}
+
+std::optional<ConversationIndex::Record> ConversationIndex::loadRecord(const std::string& userA,
+                                                                       const std::string& userB) const {
+    auto value = pairs_.get(pairKey(userA, userB));
+    return value ? decodeRecord(*value) : std::nullopt;
+}
+
+void ConversationIndex::storeRecord(const std::string& userA, const std::string& userB, const Record& record) {
+    pairs_.put(pairKey(userA, userB), encodeRecord(record));
+}
+
+void ConversationIndex::addPeer(const std::string& username, const std::string& peer) {
+    std::vector<std::string> peers = peersOf(username);
+    if (std::find(peers.begin(), peers.end(), peer) != peers.end()) return;
+
+    peers.push_back(peer);
+    peers_.put(username, encodePeers(peers));
+}
+
+void ConversationIndex::removePeer(const std::string& username, const std::string& peer) {
+    std::vector<std::string> peers = peersOf(username);
+    auto it = std::find(peers.begin(), peers.end(), peer);
+    if (it == peers.end()) return;
+
+    peers.erase(it);
+    if (peers.empty()) {
+        // drop users left without conversations
+        peers_.erase(username);
+    } else {
+        peers_.put(username, encodePeers(peers));
+    }
+}
+
+std::string ConversationIndex::encodeRecord(const Record& record) {
+    std::string value;
+    value.reserve(kRecordLen);
+    putU64(value, record.meta.lastSeq);
+    putU64(value, static_cast<uint64_t>(static_cast<int64_t>(record.meta.lastTimestamp)));
+    putU64(value, record.read[0]);
+    putU64(value, record.read[1]);
+    return value;
+}
+
+std::optional<ConversationIndex::Record> ConversationIndex::decodeRecord(const std::string& value) {
+    if (value.size() != kRecordLen) return std::nullopt;
+
+    Record record;
+    const char* p = value.data();
+    record.meta.lastSeq = getU64(p);
+    record.meta.lastTimestamp = static_cast<long>(static_cast<int64_t>(getU64(p + 8)));
+    record.read[0] = getU64(p + 16);
+    record.read[1] = getU64(p + 24);
+    return record;
+}
+
+std::vector<std::string> ConversationIndex::decodePeers(const std::string& value) {
+    std::vector<std::string> peers;
+    size_t pos = 0;
+    while (pos + 4 <= value.size()) {
+        uint32_t len = getU32(value.data() + pos);
+        if (pos + 4 + len > value.size()) break;
+        peers.emplace_back(value, pos + 4, len);
+        pos += 4 + len;
+    }
+    return peers;
+}
+
+std::string ConversationIndex::encodePeers(const std::vector<std::string>& peers) {
+    std::string value;
+    for (const auto& peer : peers) {
+        putU32(value, static_cast<uint32_t>(peer.size()));
+        value += peer;
+    }
+    return value;
+}
+
+void ConversationIndex::migrateFolders() {
+    // folders used to be named userA_userB unescaped, so (a_b, c) and (a, b_c) shared one.
+    // Move each conversation to its pair's folder, splitting shared ones by their members.
+    // Targets are written durably before the old folder goes, and a target already holding
+    // what would be written counts as moved, so a start interrupted half way can run it again
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    std::vector<fs::path> folders;
+    for (auto& entry : fs::directory_iterator(messagesDir_, ec)) {
+        if (entry.is_directory() && fs::exists(entry.path() / "conversation.json", ec)) {
+            folders.push_back(entry.path());
+        }
+    }
+
+    size_t moved = 0;
+    for (const auto& folder : folders) {
+        std::string name = folder.filename().string();
+        std::map<std::string, nlohmann::json> byPair;
+        try {
+            nlohmann::json convo;
+            std::ifstream(folder / "conversation.json") >> convo;
+            for (const auto& message : convo.at("messages")) {
+                std::string from = message.value("from", "");
+                std::string to = message.value("to", "");
+                std::string key = (from.empty() || to.empty()) ? name : MessageStore::conversationKey(from, to);
+                byPair.try_emplace(key, nlohmann::json::array()).first->second.push_back(message);
+            }
+        } catch (...) {
+            LOG_WARN("[ConversationIndex] Skipping unreadable conversation: " + name);
+            continue;
+        }
+
+        // each pair counts its own messages, older folders may not number them at all
+        bool renumbered = false;
+        for (auto& [key, messages] : byPair) {
+            uint64_t seq = 0;
+            for (auto& message : messages) {
+                ++seq;
+                if (message.value("seq", uint64_t{0}) != seq) {
+                    message["seq"] = seq;
+                    renumbered = true;
+                }
+            }
+        }
+        if (byPair.empty() || (byPair.size() == 1 && byPair.begin()->first == name && !renumbered)) {
+            continue;
+        }
+
+        // the folder itself is rewritten last, it may be one of the targets
+        bool keep = false, failed = false;
+        for (const auto& [key, messages] : byPair) {
+            if (key == name) {
+                keep = true;
+                continue;
+            }
+
+            nlohmann::json document = nlohmann::json::object({{"messages", messages}});
+            fs::path target = fs::path(messagesDir_) / key;
+            if (fs::exists(target, ec)) {
+                nlohmann::json existing;
+                try {
+                    std::ifstream(target / "conversation.json") >> existing;
+                } catch (...) {}
+                if (existing != document) {
+                    LOG_ERROR("[ConversationIndex] Cannot move " + name + " to existing " + key);
+                    failed = true;
+                }
+                continue;   // identical: moved by an earlier, interrupted start
+            }
+
+            fs::create_directories(target, ec);
+            if (ec || !SnapshotTable::syncReplace((target / "conversation.json").string(), document.dump(4))) {
+                LOG_ERROR("[ConversationIndex] Failed to write " + key + " while moving " + name);
+                failed = true;
+            }
+        }
+
+        // new folders are only durable once messagesDir's entries are
+        if (failed || !SnapshotTable::syncDirectory(messagesDir_)) {
+            continue;   // old folder left as it was, nothing is lost
+        }
+        if (keep) {
+            nlohmann::json document = nlohmann::json::object({{"messages", byPair[name]}});
+            if (!SnapshotTable::syncReplace((folder / "conversation.json").string(), document.dump(4))) {
+                LOG_ERROR("[ConversationIndex] Failed to rewrite " + name);
+                continue;
+            }
+        } else {
+            fs::remove_all(folder, ec);
+        }
+        moved++;
+    }
+
+    if (moved > 0) {
+        LOG_INFO("[ConversationIndex] Moved " + std::to_string(moved) + " conversation folders to escaped names");
+    }
+}
+
+void ConversationIndex::rebuildFromConversations() {
+    std::error_code ec;
+    size_t found = 0;
+
+    for (auto& entry : std::filesystem::directory_iterator(messagesDir_, ec)) {
+        if (ec) break;
+        if (!entry.is_directory()) continue;
+
+        // folder names are ambiguous with underscores, read the members from a message
+        std::ifstream in(entry.path() / "conversation.json");
+        if (!in.is_open()) continue;
+
+        try {
+            nlohmann::json convo;
+            in >> convo;
+            const auto& messages = convo.at("messages");
+            if (messages.empty()) continue;
+
+            // the newest message's sender is taken to have read the conversation
+            std::string a = messages.back().value("from", "");
+            std::string b = messages.back().value("to", "");
+            if (!a.empty() && !b.empty()) {
+                applyMessage(a, b, messages.size(), messages.back().value("timestamp", 0L));
+                found++;
+            }
+        } catch (...) {
+            LOG_WARN("[ConversationIndex] Skipping unreadable conversation: "
+                      + entry.path().filename().string());
+        }
+    }
+
+    LOG_INFO("[ConversationIndex] Rebuilt index from " + std::to_string(found) + " conversations");
+}
@@ -1,58 +1,152 @@
 #include "storage/FileStorage.h"
-#include <iostream>
-#include <direct.h>
+#include <future>
 #include "utils/Logger.h"
-#include "utils/base64.h"
-
-FileStorage::FileStorage() {
+#include "utils/Trace.h"
+
+FileStorage::FileStorage()
+    : FileStorage(USERS_PATH, KEY_PATH, MESSAGE_PATH, true) {}
+
+FileStorage::FileStorage(const std::string& dataDir, bool preferIoUring)
+    : FileStorage(dataDir + "/users.json", dataDir + "/keys", dataDir + "/messages", preferIoUring) {}
+
+FileStorage::FileStorage(std::string usersPath, std::string keyDir, std::string messageDir, bool preferIoUring)
+    : userFilePath_(std::move(usersPath)),
+      keyDir_(std::move(keyDir)),
+      messageDir_(std::move(messageDir)),
+      users_(std::filesystem::path(userFilePath_).parent_path().string(), "users"),
+      keyStore_(keyDir_),
+      conversationIndex_(messageDir_),
+      io_(2, preferIoUring) {
     initializeDirectories();
+
+    // every table maps its snapshot and replays a bounded log, nothing scales with data size
+    // table writes go through the same I/O queue as the conversations
+    keyStore_.setWriter(&tableWriter_);
+    if (keyStore_.open()) {
+        // migrate legacy data/keys/<username>/*.pem directories
+        keyStore_.importPemDirectory(keyDir_);
+    }
+    conversationIndex_.setWriter(&tableWriter_);
+    conversationIndex_.open();
     loadUser();
 }
 
+FileStorage::~FileStorage() {
+    // completions touch the cache, let them finish first
+    io_.drain();
+}
+
 void FileStorage::initializeDirectories() {
     std::error_code ec;
 
     // create root "data" directory
-    std::filesystem::create_directories(std::filesystem::path(USERS_PATH).parent_path(), ec);
+    std::filesystem::create_directories(std::filesystem::path(userFilePath_).parent_path(), ec);
 
     // create data/keys directory
-    std::filesystem::create_directories(KEY_PATH, ec);
+    std::filesystem::create_directories(keyDir_, ec);
 
     // create data/messages directory
-    std::filesystem::create_directories(MESSAGE_PATH, ec);
+    std::filesystem::create_directories(messageDir_, ec);
+}
+
+void FileStorage::TableWriter::append(const std::string& path, std::string bytes) {
+    io_.appendFile(path, std::move(bytes), false, [path](std::error_code ec) {
+        if (ec) {
+            LOG_ERROR("[FileStorage] Failed to append to " + path + ": " + ec.message());
+        }
+    });
+}
+
+void FileStorage::TableWriter::replace(const std::string& path, std::string bytes,
+                                       std::function<void(bool)> done) {
+    io_.writeFile(path, std::move(bytes), true, [done = std::move(done)](std::error_code ec) {
+        done(!ec);
+    });
 }
 
 bool FileStorage::loadUser() {
     std::lock_guard<std::mutex> lock(file_mutex_);
-    std::ifstream file(userFilePath_);
+    users_.setWriter(&tableWriter_);
 
-    if (!file.is_open()) {
-        // first run: initialise user.json
-        data_["users"] = nlohmann::json::array();
-        saveUser_NoLock();
-        return true;
+    if (!users_.open()) {
+        LOG_ERROR("[FileStorage] Failed to open user table.");
+        return false;
     }
 
-    // user.json exists but is empty
-    if (file.peek() == std::ifstream::traits_type::eof()) {
-        data_["users"] = nlohmann::json::array();
-        saveUser_NoLock();
-        return true;
+    // one-time migration from users.json
+    std::error_code ec;
+    if (std::filesystem::exists(userFilePath_, ec)) {
+        importUsersJson_NoLock();
     }
 
+    LOG_INFO("[FileStorage] Loaded " + std::to_string(users_.size()) + " users");
+    return true;
+}
+
+bool FileStorage::importUsersJson_NoLock() {
+    std::ifstream file(userFilePath_);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    nlohmann::json legacy;
     try {
-        file >> data_;
+        // empty users.json from a first run imports nothing
+        if (file.peek() != std::ifstream::traits_type::eof()) {
+            file >> legacy;
+        }
     } catch (...) {
-        std::cerr << "[FileStorage] Invalid JSON format in users file.\n";
-        file.close();
-        data_["users"] = nlohmann::json::array();
-        saveUser_NoLock();
+        LOG_ERROR("[FileStorage] Invalid JSON format in users file, not importing.");
         return false;
     }
+    file.close();
+
+    size_t imported = 0;
+    if (legacy.contains("users") && legacy["users"].is_array()) {
+        for (const auto& user : legacy["users"]) {
+            std::string username = user.value("username", "");
+            std::string hash = user.value("password_hash", "");
+            if (username.empty() || users_.contains(username)) continue;
 
+            users_.put(username, hash);
+            imported++;
+        }
+    }
+    users_.compact();
+
+    // keep the original around, it is no longer read
+    std::error_code ec;
+    std::filesystem::rename(userFilePath_, userFilePath_ + ".migrated", ec);
+    LOG_INFO("[FileStorage] Imported " + std::to_string(imported) + " users from users.json");
     return true;
 }
 
+MessageStore::CreateUserResult FileStorage::createAccount(
+    const std::string& username,
+    const std::string& password_hash) {
+    // atomic operation start
+    std::lock_guard<std::mutex> guard(file_mutex_);
+
+    if (userExists_NoLock(username)) {
+        return CreateUserResult::AlreadyExists;
+    }
+
+    // write user record
+    if (!createUser_NoLock(username, password_hash)) {
+        return CreateUserResult::UserWriteFailed;
+    }
+
+    // generate RSA keys
+    if (!createUserKeys_NoLock(username)) {
+        // rollback user keys and user record
+        deleteUserKeys_NoLock(username);
+        deleteUserRecord_NoLock(username);
+        return CreateUserResult::KeyWriteFailed;
+    }
+
+    return CreateUserResult::Created;
+}
+
 bool FileStorage::createUser(const std::string& username,
                              const std::string& password_hash) {
     std::lock_guard<std::mutex> lock(file_mutex_);
@@ -60,100 +154,53 @@ bool FileStorage::createUser(const std::string& username,
 }
 
 bool FileStorage::createUser_NoLock(const std::string& username, const std::string& password_hash) {
-    for (const auto& user : data_["users"]) {
-        if (user["username"] == username) {
-            std::cerr << "[FileStorage] Username already exists.\n";
-            return false;
-        }
+    if (users_.contains(username)) {
+        LOG_INFO("[FileStorage] Username already exists.");
+        return false;
     }
 
-    nlohmann::json new_user = {
-        {"username", username},
-        {"password_hash", password_hash}
-    };
-    data_["users"].push_back(new_user);
-    return saveUser_NoLock();
+    // one log record, no rewrite of the whole user list
+    users_.put(username, password_hash);
+    return true;
 }
 
-bool FileStorage::createUserKeyFiles_NoLock(
-    const std::string& username) {
-
-    // build "keys/username"
-    std::string userKeyDir = std::string(KEY_PATH) + "/" + username;
-
-    // create user directory in data/keys/
-    _mkdir(userKeyDir.c_str());
-
+bool FileStorage::createUserKeys_NoLock(const std::string& username) {
     // generate RSA keypair
     CryptoManager crypto;
     CryptoManager::RSAKeyPair keys;
     try {
         keys = crypto.generateRSAKeyPair();
     } catch (const std::exception& e) {
-        std::cerr << "[FileStorage] RSA key generation failed: " << e.what() << std::endl;
+        LOG_ERROR(std::string("[FileStorage] RSA key generation failed: ") + e.what());
         return false;
     }
 
-    std::string pubPath  = userKeyDir + "/public.pem";
-    std::string privPath = userKeyDir + "/private.pem";
-
-    // write public key
-    {
-        std::ofstream out(pubPath);
-        if (!out.is_open()) return false;
-        out << keys.publicKeyPem;
-    }
-
-    // write private key
-    {
-        std::ofstream out(privPath);
-        if (!out.is_open()) return false;
-        out << keys.privateKeyPem;
-    }
-
-    return true;
+    // one append to the shared keystore file
+    return keyStore_.put(username, keys);
 }
 
 bool FileStorage::loginUser(const std::string& username, const std::string& password_hash) {
     std::lock_guard<std::mutex> lock(file_mutex_);
-    for (const auto& user : data_["users"]) {
-        if (user["username"] == username && user["password_hash"] == password_hash) {
-            return true;
-        }
-    }
-    return false;
+    auto stored = users_.get(username);
+    return stored && *stored == password_hash;
 }
 
 std::string FileStorage::getUserPublicKey(const std::string& username) {
-    std::lock_guard<std::mutex> lock(file_mutex_);
-
-    // go to keys/username/public.pem
-    std::string pubPath = std::string(KEY_PATH) + "/" + username + "/public.pem";
-
-    std::ifstream file(pubPath);
-    if (!file.is_open()) {
-        std::cerr << "[FileStorage] Failed to open public key: " << pubPath << "\n";
-        return "";
+    // keystore has its own lock, no need to hold file_mutex_
+    trace::Span span("keystore_lookup", trace::Stage::Lookup);
+    std::string pem = keyStore_.publicKeyPem(username);
+    if (pem.empty()) {
+        LOG_WARN("[FileStorage] No public key for: " + username);
     }
-
-    std::string pem(
-        (std::istreambuf_iterator<char>(file)),
-        std::istreambuf_iterator<char>()
-    );
-
     return pem;
 }
 
 bool FileStorage::userExists_NoLock(const std::string &username) {
-    for (const auto& user : data_["users"]) {
-        if (user["username"] == username) {
-            return true;
-        }
-    }
-    return false;
+    return users_.contains(username);
 }
 
 bool FileStorage::userExists(const std::string &username) {
+    trace::Span span("user_exists", trace::Stage::Lookup);
     std::lock_guard<std::mutex> lock(file_mutex_);
     return userExists_NoLock(username);
 }
@@ -165,77 +212,195 @@ bool FileStorage::appendConversationMessage(
     const std::string& aesForSender,
     const std::string& aesForRecipient,
     long timestamp) {
+    nlohmann::json message = makeMessageEntry(
+        0, from, to, ciphertext, aesForSender, aesForRecipient, timestamp);
+
+    // same path as the async version, then wait for the write
+    std::promise<bool> stored;
+    std::future<bool> result = stored.get_future();
+    {
+        std::lock_guard<std::mutex> lock(file_mutex_);
+        appendConversation_NoLock(from, to, std::move(message), timestamp,
+                                  [&stored](bool ok) { stored.set_value(ok); });
+    }
+    return result.get();
+}
+
+void FileStorage::appendConversationMessageAsync(
+    const std::string& from,
+    const std::string& to,
+    const CryptoManager::AESEncrypted& ciphertext,
+    const std::string& aesForSender,
+    const std::string& aesForRecipient,
+    long timestamp,
+    asio::any_io_executor executor,
+    AppendHandler handler) {
+    // base64 encoding happens before taking the lock
+    nlohmann::json message;
+    {
+        trace::Span span("encode_message", trace::Stage::Storage);
+        message = makeMessageEntry(0, from, to, ciphertext, aesForSender, aesForRecipient, timestamp);
+    }
+
+    // keep the caller's executor alive until the handler is posted, like asio's own operations
+    auto work = asio::make_work_guard(executor);
+
+    trace::Span span("queue_append", trace::Stage::Storage);
     std::lock_guard<std::mutex> lock(file_mutex_);
+    appendConversation_NoLock(from, to, std::move(message), timestamp,
+        [work, handler = std::move(handler)](bool ok) mutable {
+            asio::post(work.get_executor(), [handler = std::move(handler), ok] { handler(ok); });
+            work.reset();
+        });
+}
 
-    // build folder: messages/userA_userB
+void FileStorage::appendConversation_NoLock(
+    const std::string& from,
+    const std::string& to,
+    nlohmann::json message,
+    long timestamp,
+    std::function<void(bool)> done) {
+    // build folder: messages/userA_userB, names escaped (conversationKey)
     // folder name always alphabetical
-    std::string folderName =
-        (from < to) ? (from + "_" + to) : (to + "_" + from);
+    std::string key = conversationKey(from, to);
 
-    std::string fullDir = std::string(MESSAGE_PATH) + "/" + folderName;
+    // only a new pair needs its directory
+    if (!conversationIndex_.contains(from, to)) {
+        std::string fullDir = messageDir_ + "/" + key;
 
-    /// Create directories recursively
-    std::error_code ec;
-    std::filesystem::create_directories(fullDir, ec);
+        /// Create directories recursively
+        std::error_code ec;
+        std::filesystem::create_directories(fullDir, ec);
 
-    if (ec) {
-        std::cerr << "[FileStorage] Failed to create directory: "
-                  << fullDir << " (" << ec.message() << ")\n";
-        return false;
+        if (ec) {
+            LOG_ERROR("[FileStorage] Failed to create directory: " + fullDir + " (" + ec.message() + ")");
+            done(false);
+            return;
+        }
     }
 
-    // path to conversation file
-    std::string convoFile = fullDir + "/conversation.json";
+    // the request waits for done, so its trace is still there when a deferred append runs
+    trace::RequestTrace* request = trace::RequestTrace::current();
+    appendMessage_NoLock(key, std::move(message),
+        [this, from, to, timestamp, request](const nlohmann::json& stored) {
+            uint64_t seq = stored["seq"].get<uint64_t>();
+            // keeps the conversation list metadata current, registers new pairs
+            conversationIndex_.recordMessage(from, to, seq, timestamp);
+            if (request) {
+                request->setConversationSize(seq);
+            }
+        },
+        std::move(done));
+}
+
+void FileStorage::appendMessage_NoLock(const std::string& key,
+                                       nlohmann::json message,
+                                       std::function<void(const nlohmann::json&)> appended,
+                                       std::function<void(bool)> done) {
+    withConversation_NoLock(key,
+        [this, key, message = std::move(message), appended = std::move(appended), done = std::move(done)]
+        (const ConversationPtr& convo) mutable {
+            // -------- Append new message --------
+            auto& messages = convo->document["messages"];
+            message["seq"] = messages.size() + 1;
+            messages.push_back(std::move(message));
+            convo->exists = true;
+            convo->pendingWrites++;
+            appended(messages.back());
+
+            // -------- Save back to file --------
+            // later appends queued behind this one replace it before it starts
+            std::string document;
+            {
+                trace::Span span("serialize_conversation", trace::Stage::Storage);
+                document = convo->document.dump(4);
+            }
+            io_.writeFile(conversationFile(key), std::move(document), true,
+                [this, convo, done = std::move(done)](std::error_code ec) {
+                    {
+                        std::lock_guard<std::mutex> lock(file_mutex_);
+                        convo->pendingWrites--;
+                    }
+                    if (ec) {
+                        LOG_ERROR("[FileStorage] Failed to write conversation file: " + ec.message());
+                    }
+                    done(!ec);
+                });
+        });
+}
 
-    nlohmann::json convoJson;
+void FileStorage::withConversation_NoLock(
+    const std::string& key,
+    std::function<void(const ConversationPtr&)> fn) {
+    auto it = conversationCache_.find(key);
+    if (it != conversationCache_.end()) {
+        ConversationPtr convo = it->second;
+        conversationLru_.splice(conversationLru_.begin(), conversationLru_, convo->lruPos);
+
+        if (convo->loaded) {
+            fn(convo);
+        } else {
+            convo->waiters.push_back([convo, fn = std::move(fn)] { fn(convo); });
+        }
+        return;
+    }
 
-    // if file exists load it
-    {
-        std::ifstream in(convoFile);
-        if (in.is_open() && in.peek() != std::ifstream::traits_type::eof()) {
+    auto convo = std::make_shared<CachedConversation>();
+    conversationLru_.push_front(key);
+    convo->lruPos = conversationLru_.begin();
+    convo->waiters.push_back([convo, fn = std::move(fn)] { fn(convo); });
+    conversationCache_.emplace(key, convo);
+    evictConversations_NoLock();
+
+    io_.readFile(conversationFile(key), [this, convo, key](std::error_code ec, std::string data) {
+        // parse on the I/O thread, outside the lock
+        nlohmann::json document;
+        bool exists = !ec;
+        if (exists && !data.empty()) {
             try {
-                in >> convoJson;
+                document = nlohmann::json::parse(data);
             } catch (...) {
-                std::cerr << "[FileStorage] Invalid JSON in conversation, resetting.\n";
-                convoJson = nlohmann::json::object();
+                LOG_WARN("[FileStorage] Invalid JSON in conversation " + key + ", resetting.");
             }
         }
-    }
-
-    // ensure structure exists
-    if (!convoJson.contains("messages"))
-        convoJson["messages"] = nlohmann::json::array();
+        if (!document.is_object() || !document.contains("messages")) {
+            document = nlohmann::json::object({{"messages", nlohmann::json::array()}});
+        }
 
-    // -------- Append new message --------
-    nlohmann::json entry;
-    entry["from"]              = from;
-    entry["to"]                = to;
-    entry["timestamp"]         = timestamp;
-    entry["ciphertext"]        = base64::encode(ciphertext.ciphertext);
-    entry["iv"]                = base64::encode(ciphertext.iv);
-    entry["tag"]               = base64::encode(ciphertext.tag);
-    entry["aes_for_sender"]    = base64::encode(aesForSender);
-    entry["aes_for_recipient"] = base64::encode(aesForRecipient);
+        std::lock_guard<std::mutex> lock(file_mutex_);
+        convo->document = std::move(document);
+        convo->exists = exists;
+        convo->loaded = true;
 
-    convoJson["messages"].push_back(entry);
+        auto waiters = std::move(convo->waiters);
+        convo->waiters.clear();
+        for (auto& waiter : waiters) {
+            waiter();
+        }
+    });
+}
 
-    // -------- Save back to file --------
-    std::ofstream out(convoFile);
-    if (!out.is_open()) {
-        std::cerr << "[FileStorage] Failed to write conversation file.\n";
-        return false;
+void FileStorage::evictConversations_NoLock() {
+    auto it = conversationLru_.end();
+    while (conversationCache_.size() > kConversationCacheSize && it != conversationLru_.begin()) {
+        --it;
+        auto entry = conversationCache_.find(*it);
+        const auto& convo = *entry->second;
+        if (!convo.loaded || convo.pendingWrites > 0) {
+            continue;
+        }
+        conversationCache_.erase(entry);
+        it = conversationLru_.erase(it);
     }
+}
 
-    out << convoJson.dump(4);
-    return true;
+std::string FileStorage::conversationFile(const std::string& key) const {
+    return messageDir_ + "/" + key + "/conversation.json";
 }
 
 bool FileStorage::saveUser_NoLock() {
-    std::ofstream file(userFilePath_);
-    if (!file.is_open()) return false;
-
-    file << data_.dump(4);
-    return true;
+    // changes are logged as they happen, this folds them into a fresh snapshot on disk
+    return users_.persist();
 }
 
 bool FileStorage::saveUser() {
@@ -243,23 +408,20 @@ bool FileStorage::saveUser() {
     return saveUser_NoLock();
 }
 
-bool FileStorage::deleteUserJson_NoLock(const std::string& username) {
-    auto& users = data_["users"];
-
-    for (auto it = users.begin(); it != users.end(); ++it) {
-        if ((*it)["username"] == username) {
-            users.erase(it);
-            return true;
-        }
-    }
-
-    // nothing to delete
+bool FileStorage::deleteUserRecord_NoLock(const std::string& username) {
+    // nothing to delete is fine too
+    users_.erase(username);
     return true;
 }
 
 bool FileStorage::deleteUserKeys_NoLock(const std::string& username) {
+    if (!keyStore_.remove(username)) {
+        return false;
+    }
+
+    // legacy PEM directory left from before the keystore
     std::error_code ec;
-    std::string userKeyDir = std::string(KEY_PATH) + "/" + username;
+    std::string userKeyDir = keyDir_ + "/" + username;
 
     if (!std::filesystem::exists(userKeyDir, ec)) {
         // nothing to delete
@@ -267,68 +429,173 @@ bool FileStorage::deleteUserKeys_NoLock(const std::string& username) {
     }
 
     if (!std::filesystem::remove_all(userKeyDir, ec) || ec) {
-        std::cerr << "[FileStorage] Failed to remove key dir '" << userKeyDir
-                  << "': " << ec.message() << "\n";
+        LOG_ERROR("[FileStorage] Failed to remove key dir '" + userKeyDir + "': " + ec.message());
         return false;
     }
     return true;
 }
 
 bool FileStorage::deleteUserConversations_NoLock(const std::string& username) {
-    std::filesystem::path messagesRoot = MESSAGE_PATH;
-    std::error_code ec;
-
-    if (!std::filesystem::exists(messagesRoot, ec)) {
-        // nothing to delete
-        return true;
-    }
+    bool ok = true;
+
+    // only folders of this user's partners, found through the index
+    for (const auto& peer : conversationIndex_.removeUser(username)) {
+        std::string key = conversationKey(username, peer);
+        auto cached = conversationCache_.find(key);
+        if (cached != conversationCache_.end()) {
+            conversationLru_.erase(cached->second->lruPos);
+            conversationCache_.erase(cached);
+        }
 
-    for (auto &entry : std::filesystem::directory_iterator(messagesRoot, ec)) {
-        if (ec) break;
-        if (!entry.is_directory()) continue;
+        std::filesystem::path convoDir = std::filesystem::path(messageDir_) / key;
 
-        std::string name = entry.path().filename().string();
-        // check both sides of underscore
-        bool matches = name.find(username + "_") == 0 ||
-            name.rfind("_" + username) == name.size() - username.size() - 1;
+        std::error_code ec;
+        std::filesystem::remove_all(convoDir, ec);
+        if (ec) {
+            LOG_ERROR("[FileStorage] Failed to delete conversation '"
+                      + convoDir.filename().string() + "': " + ec.message());
+            ok = false;
+        }
+    }
+    return ok;
+}
 
-        if (matches) {
-            std::error_code ec2;
-            std::filesystem::remove_all(entry.path(), ec2);
-            if (ec2) {
-                std::cerr << "[FileStorage] Failed to delete conversation '"
-                          << name << "': " << ec2.message() << "\n";
-                return false;
-            }
+bool FileStorage::conversationsBusy_NoLock(const std::string& username) const {
+    // escaped names hold no '_', so the key's halves are the members
+    std::string member = escapeName(username);
+    for (const auto& [key, convo] : conversationCache_) {
+        bool involved = key.compare(0, member.size() + 1, member + "_") == 0 ||
+                        (key.size() > member.size() && key.compare(key.size() - member.size() - 1,
+                                                                   std::string::npos, "_" + member) == 0);
+        if (involved && (!convo->loaded || convo->pendingWrites > 0)) {
+            return true;
         }
     }
-    return true;
+    return false;
 }
 
 bool FileStorage::deleteUser(const std::string& username) {
-    std::lock_guard<std::mutex> lock(file_mutex_);
+    // a load or write in flight for one of the user's conversations would recreate its folder
+    // after the removal. Their completions take the lock, so wait for them outside it, and
+    // delete once none is left: new ones can only be queued under the lock
+    std::unique_lock<std::mutex> lock(file_mutex_);
+    while (conversationsBusy_NoLock(username)) {
+        lock.unlock();
+        io_.drain();
+        lock.lock();
+    }
 
     // rollback safe delete everything
-    bool json = deleteUserJson_NoLock(username);
+    bool user = deleteUserRecord_NoLock(username);
     bool keys = deleteUserKeys_NoLock(username);
     bool convo = deleteUserConversations_NoLock(username);
 
-    saveUser_NoLock();
-
-    return json && keys && convo;
+    return user && keys && convo;
 }
 
 nlohmann::json FileStorage::loadConversation(
     const std::string& userA,
     const std::string& userB) {
     std::lock_guard<std::mutex> lock(file_mutex_);
+    return loadConversation_NoLock(userA, userB);
+}
 
-    std::string folderName = (userA < userB)
-        ? (userA + "_" + userB)
-        : (userB + "_" + userA);
+nlohmann::json FileStorage::loadConversationRange(
+    const std::string& userA,
+    const std::string& userB,
+    size_t offset,
+    size_t limit) {
+    std::lock_guard<std::mutex> lock(file_mutex_);
+    nlohmann::json convoJson = loadConversation_NoLock(userA, userB);
+    if (convoJson.is_null()) {
+        return nlohmann::json::array();
+    }
+    return sliceMessages(convoJson["messages"], offset, limit);
+}
+
+void FileStorage::loadConversationRangeAsync(
+    const std::string& userA,
+    const std::string& userB,
+    size_t offset,
+    size_t limit,
+    asio::any_io_executor executor,
+    RangeHandler handler) {
+    std::lock_guard<std::mutex> lock(file_mutex_);
+
+    // unknown pair, nothing to read
+    if (!conversationIndex_.contains(userA, userB)) {
+        asio::post(executor, [handler = std::move(handler)] { handler(nlohmann::json::array()); });
+        return;
+    }
 
-    std::string fullDir = std::string(MESSAGE_PATH) + "/" + folderName;
-    std::string convoFile = fullDir + "/conversation.json";
+    auto work = asio::make_work_guard(executor);
+    withConversation_NoLock(conversationKey(userA, userB),
+        [offset, limit, work, handler = std::move(handler)](const ConversationPtr& convo) mutable {
+            nlohmann::json range = sliceMessages(convo->document["messages"], offset, limit);
+            asio::post(work.get_executor(), [handler = std::move(handler), range = std::move(range)]() mutable {
+                handler(std::move(range));
+            });
+            work.reset();
+        });
+}
+
+std::vector<std::string> FileStorage::listConversations(const std::string& username) {
+    std::lock_guard<std::mutex> lock(file_mutex_);
+    return conversationIndex_.peersOf(username);
+}
+
+nlohmann::json FileStorage::exportConversations(const std::string& username) {
+    std::lock_guard<std::mutex> lock(file_mutex_);
+
+    nlohmann::json result = nlohmann::json::object();
+    for (const auto& peer : conversationIndex_.peersOf(username)) {
+        nlohmann::json convo = loadConversation_NoLock(username, peer);
+        result[peer] = convo.is_null() ? nlohmann::json::array() : convo["messages"];
+    }
+    return result;
+}
+
+std::vector<MessageStore::ConversationSummary> FileStorage::listConversationSummaries(
+    const std::string& username) {
+    std::lock_guard<std::mutex> lock(file_mutex_);
+
+    std::vector<ConversationSummary> summaries;
+    for (const auto& peer : conversationIndex_.peersOf(username)) {
+        auto meta = conversationIndex_.meta(username, peer);
+        if (!meta) continue;
+
+        ConversationSummary summary;
+        summary.peer = peer;
+        summary.lastTimestamp = meta->lastTimestamp;
+        summary.lastSeq = meta->lastSeq;
+        uint64_t read = conversationIndex_.readSeq(username, peer);
+        summary.unread = meta->lastSeq > read ? meta->lastSeq - read : 0;
+        summaries.push_back(std::move(summary));
+    }
+
+    sortSummaries(summaries);
+    return summaries;
+}
+
+std::optional<uint64_t> FileStorage::markRead(const std::string& username, const std::string& peer, uint64_t seq) {
+    std::lock_guard<std::mutex> lock(file_mutex_);
+    return conversationIndex_.markRead(username, peer, seq);
+}
+
+nlohmann::json FileStorage::loadConversation_NoLock(
+    const std::string& userA,
+    const std::string& userB) {
+    return loadDocument_NoLock(conversationKey(userA, userB));
+}
+
+nlohmann::json FileStorage::loadDocument_NoLock(const std::string& folderName) {
+    // cached copy is never older than the file
+    auto cached = conversationCache_.find(folderName);
+    if (cached != conversationCache_.end() && cached->second->loaded) {
+        return cached->second->exists ? cached->second->document : nlohmann::json();
+    }
+
+    std::string convoFile = conversationFile(folderName);
 
     nlohmann::json convoJson;
 
@@ -341,7 +608,7 @@ nlohmann::json FileStorage::loadConversation(
     try {
         in >> convoJson;
     } catch (...) {
-        std::cerr << "[FileStorage] Invalid JSON in " << convoFile << ", resetting\n";
+        LOG_WARN("[FileStorage] Invalid JSON in " + convoFile + ", resetting");
         return nlohmann::json();
     }
 
@@ -351,3 +618,200 @@ nlohmann::json FileStorage::loadConversation(
 
     return convoJson;
 }
+
+FileStorage::GroupRecord* FileStorage::loadGroup_NoLock(const std::string& group) {
+    auto cached = groups_.find(group);
+    if (cached != groups_.end()) {
+        return &cached->second;
+    }
+
+    std::ifstream in(messageDir_ + "/" + groupKey(group) + "/group.json");
+    if (!in.is_open()) {
+        return nullptr;
+    }
+
+    GroupRecord record;
+    try {
+        nlohmann::json document;
+        in >> document;
+        record.members = document.at("members").get<std::vector<std::string>>();
+        for (const auto& epoch : document.value("epochs", nlohmann::json::array())) {
+            std::unordered_map<std::string, std::string> keys;
+            for (const auto& [member, key] : epoch.items()) {
+                std::vector<uint8_t> raw = base64::decode(key.get<std::string>());
+                keys.emplace(member, std::string(raw.begin(), raw.end()));
+            }
+            record.epochs.push_back(std::move(keys));
+        }
+    } catch (...) {
+        LOG_ERROR("[FileStorage] Invalid group file for " + group);
+        return nullptr;
+    }
+
+    return &groups_.emplace(group, std::move(record)).first->second;
+}
+
+void FileStorage::writeGroup_NoLock(const std::string& group, const GroupRecord& record,
+                                    std::function<void(bool)> done) {
+    nlohmann::json epochs = nlohmann::json::array();
+    for (const auto& keys : record.epochs) {
+        nlohmann::json wrapped = nlohmann::json::object();
+        for (const auto& [member, key] : keys) {
+            wrapped[member] = base64::encode(key);
+        }
+        epochs.push_back(std::move(wrapped));
+    }
+    nlohmann::json document = {{"members", record.members}, {"epochs", std::move(epochs)}};
+
+    io_.writeFile(messageDir_ + "/" + groupKey(group) + "/group.json", document.dump(4), true,
+        [group, done = std::move(done)](std::error_code ec) {
+            if (ec) {
+                LOG_ERROR("[FileStorage] Failed to write group " + group + ": " + ec.message());
+            }
+            done(!ec);
+        });
+}
+
+bool FileStorage::createGroup(const std::string& group, const std::vector<std::string>& members) {
+    std::promise<bool> stored;
+    std::future<bool> result = stored.get_future();
+    {
+        std::lock_guard<std::mutex> lock(file_mutex_);
+        if (loadGroup_NoLock(group)) {
+            return false;
+        }
+
+        std::error_code ec;
+        std::filesystem::create_directories(messageDir_ + "/" + groupKey(group), ec);
+        if (ec) {
+            LOG_ERROR("[FileStorage] Failed to create group directory: " + ec.message());
+            return false;
+        }
+
+        // cached right away so a concurrent create of the same name is turned down
+        GroupRecord& record = groups_[group];
+        record.members = members;
+        writeGroup_NoLock(group, record, [&stored](bool ok) { stored.set_value(ok); });
+    }
+    if (result.get()) {
+        return true;
+    }
+
+    // never stored: forget it, a retry may create it again
+    std::lock_guard<std::mutex> lock(file_mutex_);
+    groups_.erase(group);
+    return false;
+}
+
+bool FileStorage::deleteGroup(const std::string& group) {
+    // writes in flight would recreate the folder being removed
+    io_.drain();
+    std::lock_guard<std::mutex> lock(file_mutex_);
+
+    bool existed = loadGroup_NoLock(group) != nullptr;
+    groups_.erase(group);
+
+    auto cached = conversationCache_.find(groupKey(group));
+    if (cached != conversationCache_.end()) {
+        conversationLru_.erase(cached->second->lruPos);
+        conversationCache_.erase(cached);
+    }
+
+    std::error_code ec;
+    std::filesystem::remove_all(messageDir_ + "/" + groupKey(group), ec);
+    return existed && !ec;
+}
+
+std::optional<MessageStore::GroupInfo> FileStorage::getGroup(const std::string& group) {
+    std::lock_guard<std::mutex> lock(file_mutex_);
+    const GroupRecord* record = loadGroup_NoLock(group);
+    if (!record) {
+        return std::nullopt;
+    }
+    return GroupInfo{record->members, record->epochs.size()};
+}
+
+bool FileStorage::startGroupEpoch(const std::string& group,
+                                  uint64_t epoch,
+                                  const std::unordered_map<std::string, std::string>& wrappedKeys) {
+    std::promise<bool> stored;
+    std::future<bool> result = stored.get_future();
+    {
+        std::lock_guard<std::mutex> lock(file_mutex_);
+        GroupRecord* record = loadGroup_NoLock(group);
+        if (!record || epoch != record->epochs.size() + 1) {
+            return false;
+        }
+
+        // durable before any message is sealed with the new key
+        record->epochs.push_back(wrappedKeys);
+        writeGroup_NoLock(group, *record, [&stored](bool ok) { stored.set_value(ok); });
+    }
+    return result.get();
+}
+
+std::map<uint64_t, std::string> FileStorage::groupKeys(const std::string& group, const std::string& member) {
+    std::lock_guard<std::mutex> lock(file_mutex_);
+    std::map<uint64_t, std::string> keys;
+    const GroupRecord* record = loadGroup_NoLock(group);
+    if (!record) {
+        return keys;
+    }
+
+    for (size_t i = 0; i < record->epochs.size(); i++) {
+        auto key = record->epochs[i].find(member);
+        if (key != record->epochs[i].end()) {
+            keys.emplace(i + 1, key->second);
+        }
+    }
+    return keys;
+}
+
+nlohmann::json FileStorage::appendGroupMessage(const std::string& group,
+                                               const std::string& from,
+                                               uint64_t epoch,
+                                               const CryptoManager::AESEncrypted& ciphertext,
+                                               long timestamp) {
+    std::promise<nlohmann::json> stored;
+    std::future<nlohmann::json> result = stored.get_future();
+    appendGroupMessageAsync(group, from, epoch, ciphertext, timestamp, asio::system_executor(),
+        [&stored](nlohmann::json record) { stored.set_value(std::move(record)); });
+    return result.get();
+}
+
+void FileStorage::appendGroupMessageAsync(const std::string& group,
+                                          const std::string& from,
+                                          uint64_t epoch,
+                                          const CryptoManager::AESEncrypted& ciphertext,
+                                          long timestamp,
+                                          asio::any_io_executor executor,
+                                          GroupAppendHandler handler) {
+    // seq is filled in once the group's messages are loaded
+    nlohmann::json message = makeGroupMessageEntry(0, group, from, epoch, ciphertext, timestamp);
+    auto work = asio::make_work_guard(executor);
+
+    std::lock_guard<std::mutex> lock(file_mutex_);
+    if (!loadGroup_NoLock(group)) {
+        asio::post(work.get_executor(), [handler = std::move(handler)] { handler(nlohmann::json()); });
+        return;
+    }
+
+    auto record = std::make_shared<nlohmann::json>();
+    appendMessage_NoLock(groupKey(group), std::move(message),
+        [record](const nlohmann::json& stored) { *record = stored; },
+        [record, work, handler = std::move(handler)](bool ok) mutable {
+            asio::post(work.get_executor(), [handler = std::move(handler), record, ok] {
+                handler(ok ? std::move(*record) : nlohmann::json());
+            });
+            work.reset();
+        });
+}
+
+nlohmann::json FileStorage::loadGroupMessages(const std::string& group, size_t offset, size_t limit) {
+    std::lock_guard<std::mutex> lock(file_mutex_);
+    nlohmann::json document = loadDocument_NoLock(groupKey(group));
+    if (document.is_null()) {
+        return nlohmann::json::array();
+    }
+    return sliceMessages(document["messages"], offset, limit);
+}
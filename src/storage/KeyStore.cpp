@@ -0,0 +1,167 @@
+#include "storage/KeyStore.h"
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <vector>
+#include "utils/ByteOrder.h"
+#include "utils/Logger.h"
+
+using namespace byteorder;
+
+namespace {
+    std::string makeValue(const std::string& pubDer, const std::string& privDer) {
+        std::string value;
+        value.reserve(4 + pubDer.size() + privDer.size());
+        putU32(value, static_cast<uint32_t>(pubDer.size()));
+        value += pubDer;
+        value += privDer;
+        return value;
+    }
+
+    std::string readFile(const std::filesystem::path& path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open()) return "";
+        return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    }
+}
+
+KeyStore::KeyStore(std::string dir)
+    : dir_(std::move(dir)), table_(dir_, "keys") {}
+
+void KeyStore::setWriter(SnapshotTable::Writer* writer) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    table_.setWriter(writer);
+}
+
+bool KeyStore::open() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+
+    if (!table_.open()) {
+        LOG_ERROR("[KeyStore] Failed to open key table in " + dir_);
+        return false;
+    }
+
+    LOG_INFO("[KeyStore] Loaded keys for " + std::to_string(table_.size()) + " users");
+    return true;
+}
+
+bool KeyStore::splitValue(const std::string& value, std::string& pubDer, std::string& privDer) {
+    if (value.size() < 4) return false;
+    uint32_t pubLen = getU32(value.data());
+    if (4 + uint64_t(pubLen) > value.size()) return false;
+
+    pubDer.assign(value, 4, pubLen);
+    privDer.assign(value, 4 + pubLen, std::string::npos);
+    return true;
+}
+
+bool KeyStore::put(const std::string& username, const CryptoManager::RSAKeyPair& keys) {
+    std::string pubDer, privDer;
+    try {
+        pubDer  = CryptoManager::publicKeyPemToDer(keys.publicKeyPem);
+        privDer = CryptoManager::privateKeyPemToDer(keys.privateKeyPem);
+    } catch (const std::exception& e) {
+        LOG_ERROR("[KeyStore] Invalid key for " + username + ": " + e.what());
+        return false;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    table_.put(username, makeValue(pubDer, privDer));
+    return true;
+}
+
+bool KeyStore::remove(const std::string& username) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    table_.erase(username);
+    return true;
+}
+
+bool KeyStore::contains(const std::string& username) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return table_.contains(username);
+}
+
+std::string KeyStore::publicKeyPem(const std::string& username) const {
+    std::string pubDer, privDer;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto value = table_.get(username);
+        if (!value || !splitValue(*value, pubDer, privDer)) return "";
+    }
+
+    try {
+        return CryptoManager::publicKeyDerToPem(pubDer);
+    } catch (const std::exception& e) {
+        LOG_ERROR("[KeyStore] Corrupt public key for " + username + ": " + e.what());
+        return "";
+    }
+}
+
+std::string KeyStore::privateKeyPem(const std::string& username) const {
+    std::string pubDer, privDer;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto value = table_.get(username);
+        if (!value || !splitValue(*value, pubDer, privDer)) return "";
+    }
+
+    try {
+        return CryptoManager::privateKeyDerToPem(privDer);
+    } catch (const std::exception& e) {
+        LOG_ERROR("[KeyStore] Corrupt private key for " + username + ": " + e.what());
+        return "";
+    }
+}
+
+size_t KeyStore::importPemDirectory(const std::string& keyDir) {
+    std::error_code ec;
+    std::vector<std::filesystem::path> imported;
+
+    for (auto& entry : std::filesystem::directory_iterator(keyDir, ec)) {
+        if (ec) break;
+        if (!entry.is_directory()) continue;
+
+        std::string username = entry.path().filename().string();
+        CryptoManager::RSAKeyPair keys;
+        keys.publicKeyPem  = readFile(entry.path() / "public.pem");
+        keys.privateKeyPem = readFile(entry.path() / "private.pem");
+
+        if (keys.publicKeyPem.empty() || keys.privateKeyPem.empty()) {
+            LOG_WARN("[KeyStore] Skipping incomplete key dir: " + username);
+            continue;
+        }
+
+        // already migrated, keep the stored copy
+        if (!contains(username) && !put(username, keys)) {
+            LOG_ERROR("[KeyStore] Failed to import keys for: " + username);
+            continue;
+        }
+        imported.push_back(entry.path());
+    }
+
+    if (imported.empty()) {
+        return 0;
+    }
+
+    // the PEM files are the only other copy of the private keys, they go once the table
+    // holding them is on disk
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (!table_.persist()) {
+            LOG_ERROR("[KeyStore] Keeping PEM key directories, the key table could not be written");
+            return 0;
+        }
+    }
+    for (const auto& path : imported) {
+        std::error_code removeEc;
+        std::filesystem::remove_all(path, removeEc);
+    }
+
+    LOG_INFO("[KeyStore] Imported " + std::to_string(imported.size()) + " PEM key directories");
+    return imported.size();
+}
+
+size_t KeyStore::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return table_.size();
+}
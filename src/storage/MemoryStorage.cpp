@@ -0,0 +1,275 @@
+#include "storage/MemoryStorage.h"
+#include "utils/Logger.h"
+#include "utils/Trace.h"
+
+MessageStore::CreateUserResult MemoryStorage::createAccount(
+    const std::string& username,
+    const std::string& password_hash) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (users_.count(username)) {
+            return CreateUserResult::AlreadyExists;
+        }
+    }
+
+    // generate keys outside the lock, RSA is the slow part
+    UserRecord record;
+    record.passwordHash = password_hash;
+    try {
+        CryptoManager crypto;
+        record.keys = crypto.generateRSAKeyPair();
+    } catch (const std::exception& e) {
+        LOG_ERROR(std::string("[MemoryStorage] RSA key generation failed: ") + e.what());
+        return CreateUserResult::KeyWriteFailed;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // another request may have taken the name meanwhile
+    if (!users_.emplace(username, std::move(record)).second) {
+        return CreateUserResult::AlreadyExists;
+    }
+    return CreateUserResult::Created;
+}
+
+bool MemoryStorage::loginUser(const std::string& username, const std::string& password_hash) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = users_.find(username);
+    return it != users_.end() && it->second.passwordHash == password_hash;
+}
+
+bool MemoryStorage::userExists(const std::string& username) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return users_.count(username) > 0;
+}
+
+bool MemoryStorage::deleteUser(const std::string& username) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    users_.erase(username);
+
+    auto it = peers_.find(username);
+    if (it == peers_.end()) {
+        return true;
+    }
+
+    for (const auto& [peer, read] : it->second) {
+        conversations_.erase(conversationKey(username, peer));
+        peers_[peer].erase(username);
+    }
+    peers_.erase(it);
+    return true;
+}
+
+std::string MemoryStorage::getUserPublicKey(const std::string& username) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = users_.find(username);
+    if (it == users_.end()) {
+        LOG_WARN("[MemoryStorage] No public key for: " + username);
+        return "";
+    }
+    return it->second.keys.publicKeyPem;
+}
+
+bool MemoryStorage::appendConversationMessage(
+    const std::string& from,
+    const std::string& to,
+    const CryptoManager::AESEncrypted& ciphertext,
+    const std::string& aesForSender,
+    const std::string& aesForRecipient,
+    long timestamp) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& messages = conversations_[conversationKey(from, to)];
+    messages.push_back(makeMessageEntry(
+        messages.size() + 1, from, to, ciphertext, aesForSender, aesForRecipient, timestamp));
+
+    // the sender has read up to their own message, emplace keeps the recipient's cursor
+    peers_[from][to] = messages.size();
+    peers_[to].emplace(from, 0);
+    if (auto* request = trace::RequestTrace::current()) {
+        request->setConversationSize(messages.size());
+    }
+    return true;
+}
+
+nlohmann::json MemoryStorage::loadConversation(const std::string& userA, const std::string& userB) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = conversations_.find(conversationKey(userA, userB));
+    if (it == conversations_.end()) {
+        // empty = no conversation
+        return nlohmann::json();
+    }
+    return nlohmann::json::object({{"messages", it->second}});
+}
+
+nlohmann::json MemoryStorage::loadConversationRange(
+    const std::string& userA,
+    const std::string& userB,
+    size_t offset,
+    size_t limit) {
+    nlohmann::json range = nlohmann::json::array();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = conversations_.find(conversationKey(userA, userB));
+    if (it == conversations_.end() || offset >= it->second.size()) {
+        return range;
+    }
+
+    const auto& messages = it->second;
+    size_t end = (limit == 0) ? messages.size() : offset + std::min(limit, messages.size() - offset);
+    for (size_t i = offset; i < end; ++i) {
+        range.push_back(messages[i]);
+    }
+    return range;
+}
+
+std::vector<std::string> MemoryStorage::listConversations(const std::string& username) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = peers_.find(username);
+    if (it == peers_.end()) {
+        return {};
+    }
+
+    std::vector<std::string> result;
+    for (const auto& [peer, read] : it->second) {
+        result.push_back(peer);
+    }
+    return result;
+}
+
+nlohmann::json MemoryStorage::exportConversations(const std::string& username) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    nlohmann::json result = nlohmann::json::object();
+    auto it = peers_.find(username);
+    if (it == peers_.end()) {
+        return result;
+    }
+
+    for (const auto& [peer, read] : it->second) {
+        result[peer] = conversations_[conversationKey(username, peer)];
+    }
+    return result;
+}
+
+std::vector<MessageStore::ConversationSummary> MemoryStorage::listConversationSummaries(
+    const std::string& username) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<ConversationSummary> summaries;
+    auto it = peers_.find(username);
+    if (it == peers_.end()) {
+        return summaries;
+    }
+
+    for (const auto& [peer, read] : it->second) {
+        const auto& messages = conversations_[conversationKey(username, peer)];
+
+        ConversationSummary summary;
+        summary.peer = peer;
+        summary.lastSeq = messages.size();
+        summary.lastTimestamp = messages.empty() ? 0 : messages.back().value("timestamp", 0L);
+        summary.unread = summary.lastSeq > read ? summary.lastSeq - read : 0;
+        summaries.push_back(std::move(summary));
+    }
+
+    sortSummaries(summaries);
+    return summaries;
+}
+
+std::optional<uint64_t> MemoryStorage::markRead(const std::string& username, const std::string& peer, uint64_t seq) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = peers_.find(username);
+    if (it == peers_.end() || !it->second.count(peer)) {
+        return std::nullopt;
+    }
+
+    // clamp to existing messages, never move backwards
+    uint64_t lastSeq = conversations_[conversationKey(username, peer)].size();
+    uint64_t& read = it->second[peer];
+    read = std::max(read, std::min(seq, lastSeq));
+    return read;
+}
+
+bool MemoryStorage::createGroup(const std::string& group, const std::vector<std::string>& members) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    GroupRecord record;
+    record.members = members;
+    return groups_.emplace(group, std::move(record)).second;
+}
+
+bool MemoryStorage::deleteGroup(const std::string& group) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return groups_.erase(group) > 0;
+}
+
+std::optional<MessageStore::GroupInfo> MemoryStorage::getGroup(const std::string& group) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = groups_.find(group);
+    if (it == groups_.end()) {
+        return std::nullopt;
+    }
+    return GroupInfo{it->second.members, it->second.epochs.size()};
+}
+
+bool MemoryStorage::startGroupEpoch(const std::string& group,
+                                    uint64_t epoch,
+                                    const std::unordered_map<std::string, std::string>& wrappedKeys) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = groups_.find(group);
+    if (it == groups_.end() || epoch != it->second.epochs.size() + 1) {
+        return false;
+    }
+    it->second.epochs.push_back(wrappedKeys);
+    return true;
+}
+
+std::map<uint64_t, std::string> MemoryStorage::groupKeys(const std::string& group, const std::string& member) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<uint64_t, std::string> keys;
+    auto it = groups_.find(group);
+    if (it == groups_.end()) {
+        return keys;
+    }
+
+    const auto& epochs = it->second.epochs;
+    for (size_t i = 0; i < epochs.size(); i++) {
+        auto key = epochs[i].find(member);
+        if (key != epochs[i].end()) {
+            keys.emplace(i + 1, key->second);
+        }
+    }
+    return keys;
+}
+
+nlohmann::json MemoryStorage::appendGroupMessage(const std::string& group,
+                                                 const std::string& from,
+                                                 uint64_t epoch,
+                                                 const CryptoManager::AESEncrypted& ciphertext,
+                                                 long timestamp) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = groups_.find(group);
+    if (it == groups_.end()) {
+        return nlohmann::json();
+    }
+
+    auto& messages = it->second.messages;
+    messages.push_back(makeGroupMessageEntry(messages.size() + 1, group, from, epoch, ciphertext, timestamp));
+    return messages.back();
+}
+
+nlohmann::json MemoryStorage::loadGroupMessages(const std::string& group, size_t offset, size_t limit) {
+    nlohmann::json range = nlohmann::json::array();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = groups_.find(group);
+    if (it == groups_.end() || offset >= it->second.messages.size()) {
+        return range;
+    }
+
+    const auto& messages = it->second.messages;
+    size_t end = (limit == 0) ? messages.size() : offset + std::min(limit, messages.size() - offset);
+    for (size_t i = offset; i < end; ++i) {
+        range.push_back(messages[i]);
+    }
+    return range;
+}
@@ -0,0 +1,445 @@
+#include "storage/SnapshotTable.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include "utils/Logger.h"
+#include <vector>
+#include "utils/ByteOrder.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace byteorder;
+
+namespace {
+    // snapshot: magic | u64 count | u64 capacity | capacity * {u64 hash, u64 offset} | records | footer
+    // record:   u32 keyLen | u32 valueLen | key | value
+    // log:      u8 op | u32 keyLen | u32 valueLen | key | value
+    constexpr char kSnapMagic[] = "EMSNAP01";
+    constexpr char kSnapFooter[] = "EMSNAPOK";
+    constexpr size_t kMagicLen = 8;
+    constexpr size_t kHeaderLen = kMagicLen + 16;
+    constexpr size_t kSlotLen = 16;
+    constexpr size_t kLogHeaderLen = 9;
+
+    constexpr uint8_t kOpPut = 1;
+    constexpr uint8_t kOpErase = 2;
+
+    // overlay sizes that trigger compaction, replay on open stays under the upper bound
+    constexpr size_t kMinCompact = 4096;
+    constexpr size_t kMaxCompact = 65536;
+
+    // FNV-1a, stable across builds since it is stored on disk
+    uint64_t hashKey(std::string_view key) {
+        uint64_t h = 1469598103934665603ull;
+        for (char c : key) {
+            h ^= static_cast<uint8_t>(c);
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    // "<prefix><digits>" -> digits
+    bool parseGen(const std::string& file, const std::string& prefix, uint64_t& gen) {
+        if (file.size() <= prefix.size() || file.compare(0, prefix.size(), prefix) != 0) return false;
+        std::string digits = file.substr(prefix.size());
+        if (!std::all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            return false;
+        }
+        gen = std::stoull(digits);
+        return true;
+    }
+
+    // written but not fsynced, a crash may lose the tail (open() truncates a torn record)
+    bool appendFile(const std::string& path, const std::string& bytes) {
+        FILE* f = std::fopen(path.c_str(), "ab");
+        if (!f) return false;
+        bool ok = std::fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+        return std::fclose(f) == 0 && ok;
+    }
+}
+
+bool SnapshotTable::syncReplace(const std::string& path, const std::string& bytes) {
+    std::string tmp = path + ".tmp";
+    FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+
+    bool ok = std::fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size() && std::fflush(f) == 0;
+#ifdef _WIN32
+    ok = ok && _commit(_fileno(f)) == 0;
+#else
+    ok = ok && fsync(fileno(f)) == 0;
+#endif
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok) return false;
+
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) return false;
+    // the rename survives a crash once the directory entry is on disk
+    return syncDirectory(std::filesystem::path(path).parent_path().string());
+}
+
+bool SnapshotTable::syncDirectory(const std::string& dir) {
+#ifdef _WIN32
+    (void)dir;
+    return true;
+#else
+    int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+SnapshotTable::SnapshotTable(std::string dir, std::string name)
+    : dir_(std::move(dir)), name_(std::move(name)) {}
+
+std::string SnapshotTable::snapPath(uint64_t gen) const {
+    return dir_ + "/" + name_ + ".snap." + std::to_string(gen);
+}
+
+std::string SnapshotTable::logPath(uint64_t gen) const {
+    return dir_ + "/" + name_ + ".log." + std::to_string(gen);
+}
+
+bool SnapshotTable::open() {
+    overlay_.clear();
+    mapped_.close();
+    built_.reset();
+    base_ = nullptr;
+    baseSize_ = 0;
+    capacity_ = 0;
+    size_ = 0;
+    gen_ = 0;
+
+    std::error_code ec;
+    std::filesystem::create_directories(dir_, ec);
+
+    std::vector<uint64_t> snaps, logs;
+    for (auto& entry : std::filesystem::directory_iterator(dir_, ec)) {
+        std::string file = entry.path().filename().string();
+        uint64_t gen;
+
+        if (file.size() > 4 && file.compare(file.size() - 4, 4, ".tmp") == 0 &&
+            file.compare(0, name_.size() + 1, name_ + ".") == 0) {
+            // unfinished snapshot write
+            std::filesystem::remove(entry.path(), ec);
+        } else if (parseGen(file, name_ + ".snap.", gen)) {
+            snaps.push_back(gen);
+        } else if (parseGen(file, name_ + ".log.", gen)) {
+            logs.push_back(gen);
+        }
+    }
+    fresh_ = snaps.empty() && logs.empty();
+
+    // newest readable snapshot wins, logs after an unreadable one are still present
+    std::sort(snaps.rbegin(), snaps.rend());
+    uint64_t snapGen = 0;
+    for (uint64_t gen : snaps) {
+        if (mapSnapshot(gen)) {
+            snapGen = gen;
+            break;
+        }
+        LOG_WARN("[SnapshotTable] Ignoring unreadable snapshot " + snapPath(gen));
+        std::filesystem::remove(snapPath(gen), ec);
+    }
+
+    std::sort(logs.begin(), logs.end());
+    gen_ = snapGen;
+    for (uint64_t gen : logs) {
+        if (gen < snapGen) continue;
+        if (!replayLog(gen)) return false;
+        gen_ = std::max(gen_, gen);
+    }
+
+    removeOlder(dir_, name_, snapGen);
+    return true;
+}
+
+bool SnapshotTable::mapSnapshot(uint64_t gen) {
+    MappedFile file;
+    if (!file.open(snapPath(gen))) return false;
+
+    const char* data = file.data();
+    size_t size = file.size();
+    if (size < kHeaderLen + kMagicLen ||
+        std::memcmp(data, kSnapMagic, kMagicLen) != 0 ||
+        std::memcmp(data + size - kMagicLen, kSnapFooter, kMagicLen) != 0) {
+        return false;
+    }
+
+    uint64_t count = getU64(data + kMagicLen);
+    uint64_t capacity = getU64(data + kMagicLen + 8);
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0 || count > capacity ||
+        kHeaderLen + capacity * kSlotLen > size - kMagicLen) {
+        return false;
+    }
+
+    mapped_ = std::move(file);
+    base_ = mapped_.data();
+    baseSize_ = mapped_.size();
+    capacity_ = capacity;
+    size_ = count;
+    return true;
+}
+
+bool SnapshotTable::replayLog(uint64_t gen) {
+    std::string path = logPath(gen);
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        LOG_ERROR("[SnapshotTable] Failed to read " + path);
+        return false;
+    }
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+
+    size_t pos = 0;
+    while (pos + kLogHeaderLen <= data.size()) {
+        uint8_t op = static_cast<uint8_t>(data[pos]);
+        uint32_t keyLen = getU32(data.data() + pos + 1);
+        uint32_t valueLen = getU32(data.data() + pos + 5);
+        uint64_t end = pos + kLogHeaderLen + uint64_t(keyLen) + valueLen;
+        if ((op != kOpPut && op != kOpErase) || end > data.size()) break;
+
+        std::string key = data.substr(pos + kLogHeaderLen, keyLen);
+        if (op == kOpPut) {
+            applyPut(key, data.substr(pos + kLogHeaderLen + keyLen, valueLen));
+        } else {
+            applyErase(key);
+        }
+        pos = end;
+    }
+
+    if (pos != data.size()) {
+        // torn record after a crash
+        LOG_WARN("[SnapshotTable] Truncating "
+                  + std::to_string((data.size() - pos)) + " trailing bytes in " + path);
+        std::error_code ec;
+        std::filesystem::resize_file(path, pos, ec);
+        if (ec) return false;
+    }
+    return true;
+}
+
+std::optional<std::string_view> SnapshotTable::findInBase(std::string_view key) const {
+    if (!base_ || capacity_ == 0) return std::nullopt;
+
+    uint64_t hash = hashKey(key);
+    uint64_t mask = capacity_ - 1;
+    size_t limit = baseSize_ - kMagicLen;
+
+    for (uint64_t i = hash & mask, probes = 0; probes < capacity_; i = (i + 1) & mask, probes++) {
+        const char* slot = base_ + kHeaderLen + i * kSlotLen;
+        uint64_t offset = getU64(slot + 8);
+        if (offset == 0) return std::nullopt;
+        if (getU64(slot) != hash || offset + 8 > limit) continue;
+
+        uint32_t keyLen = getU32(base_ + offset);
+        uint32_t valueLen = getU32(base_ + offset + 4);
+        if (offset + 8 + uint64_t(keyLen) + valueLen > limit) continue;
+
+        if (keyLen == key.size() && std::memcmp(base_ + offset + 8, key.data(), keyLen) == 0) {
+            return std::string_view(base_ + offset + 8 + keyLen, valueLen);
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<std::string> SnapshotTable::get(std::string_view key) const {
+    auto it = overlay_.find(key);
+    if (it != overlay_.end()) {
+        return it->second;
+    }
+
+    auto value = findInBase(key);
+    if (!value) return std::nullopt;
+    return std::string(*value);
+}
+
+bool SnapshotTable::contains(std::string_view key) const {
+    auto it = overlay_.find(key);
+    if (it != overlay_.end()) {
+        return it->second.has_value();
+    }
+    return findInBase(key).has_value();
+}
+
+void SnapshotTable::put(const std::string& key, std::string value) {
+    appendRecord(kOpPut, key, value);
+    applyPut(key, std::move(value));
+    maybeCompact();
+}
+
+void SnapshotTable::erase(const std::string& key) {
+    if (!contains(key)) {
+        // nothing to delete
+        return;
+    }
+    appendRecord(kOpErase, key, "");
+    applyErase(key);
+    maybeCompact();
+}
+
+void SnapshotTable::applyPut(const std::string& key, std::string value) {
+    auto it = overlay_.find(key);
+    if (it == overlay_.end()) {
+        if (!findInBase(key)) size_++;
+        overlay_.emplace(key, std::move(value));
+        return;
+    }
+
+    if (!it->second) size_++;
+    it->second = std::move(value);
+}
+
+void SnapshotTable::applyErase(const std::string& key) {
+    if (!contains(key)) return;
+    size_--;
+
+    // a tombstone is only needed to hide the snapshot copy
+    if (findInBase(key)) {
+        overlay_[key] = std::nullopt;
+    } else {
+        overlay_.erase(key);
+    }
+}
+
+void SnapshotTable::appendRecord(uint8_t op, const std::string& key, const std::string& value) {
+    std::string record;
+    record.reserve(kLogHeaderLen + key.size() + value.size());
+    record.push_back(static_cast<char>(op));
+    putU32(record, static_cast<uint32_t>(key.size()));
+    putU32(record, static_cast<uint32_t>(value.size()));
+    record += key;
+    record += value;
+
+    if (writer_) {
+        writer_->append(logPath(gen_), std::move(record));
+    } else if (!appendFile(logPath(gen_), record)) {
+        LOG_ERROR("[SnapshotTable] Failed to append to " + logPath(gen_));
+    }
+}
+
+void SnapshotTable::forEach(const std::function<void(std::string_view, std::string_view)>& fn) const {
+    if (base_) {
+        size_t limit = baseSize_ - kMagicLen;
+        for (uint64_t i = 0; i < capacity_; i++) {
+            uint64_t offset = getU64(base_ + kHeaderLen + i * kSlotLen + 8);
+            if (offset == 0 || offset + 8 > limit) continue;
+
+            uint32_t keyLen = getU32(base_ + offset);
+            uint32_t valueLen = getU32(base_ + offset + 4);
+            if (offset + 8 + uint64_t(keyLen) + valueLen > limit) continue;
+
+            std::string_view key(base_ + offset + 8, keyLen);
+            if (!overlay_.empty() && overlay_.find(key) != overlay_.end()) continue;
+            fn(key, std::string_view(base_ + offset + 8 + keyLen, valueLen));
+        }
+    }
+
+    for (const auto& [key, value] : overlay_) {
+        if (value) fn(key, *value);
+    }
+}
+
+void SnapshotTable::maybeCompact() {
+    size_t threshold = std::clamp(size_ / 4, kMinCompact, kMaxCompact);
+    if (overlay_.size() > threshold) {
+        compact();
+    }
+}
+
+void SnapshotTable::compact() {
+    uint64_t newGen = buildSnapshot();
+
+    // older files stay until the snapshot is on disk, open() falls back to them
+    std::string path = snapPath(newGen);
+    auto done = [dir = dir_, name = name_, newGen, path](bool ok) {
+        if (!ok) {
+            LOG_ERROR("[SnapshotTable] Failed to write " + path);
+            return;
+        }
+        removeOlder(dir, name, newGen);
+    };
+
+    if (writer_) {
+        writer_->replace(path, *built_, done);
+    } else {
+        done(syncReplace(path, *built_));
+    }
+}
+
+bool SnapshotTable::persist() {
+    uint64_t newGen = buildSnapshot();
+
+    // written here rather than through the writer, the caller waits for it
+    std::string path = snapPath(newGen);
+    if (!syncReplace(path, *built_)) {
+        LOG_ERROR("[SnapshotTable] Failed to write " + path);
+        return false;
+    }
+    removeOlder(dir_, name_, newGen);
+    return true;
+}
+
+uint64_t SnapshotTable::buildSnapshot() {
+    uint64_t capacity = 16;
+    while (capacity < size_ * 2) capacity <<= 1;
+
+    std::string out;
+    out.reserve(baseSize_ + overlay_.size() * 64 + capacity * kSlotLen);
+    out.append(kSnapMagic, kMagicLen);
+    putU64(out, size_);
+    putU64(out, capacity);
+    out.append(capacity * kSlotLen, '\0');
+
+    uint64_t mask = capacity - 1;
+    forEach([&](std::string_view key, std::string_view value) {
+        uint64_t offset = out.size();
+        putU32(out, static_cast<uint32_t>(key.size()));
+        putU32(out, static_cast<uint32_t>(value.size()));
+        out.append(key);
+        out.append(value);
+
+        uint64_t hash = hashKey(key);
+        uint64_t i = hash & mask;
+        while (getU64(out.data() + kHeaderLen + i * kSlotLen + 8) != 0) {
+            i = (i + 1) & mask;
+        }
+        setU64(out, kHeaderLen + i * kSlotLen, hash);
+        setU64(out, kHeaderLen + i * kSlotLen + 8, offset);
+    });
+    out.append(kSnapFooter, kMagicLen);
+
+    // serve from the new image right away, later changes go to the next log
+    uint64_t newGen = gen_ + 1;
+    built_ = std::make_shared<const std::string>(std::move(out));
+    mapped_.close();
+    base_ = built_->data();
+    baseSize_ = built_->size();
+    capacity_ = capacity;
+    overlay_.clear();
+    gen_ = newGen;
+    return newGen;
+}
+
+void SnapshotTable::removeOlder(const std::string& dir, const std::string& name, uint64_t gen) {
+    std::error_code ec;
+    for (auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        std::string file = entry.path().filename().string();
+        uint64_t fileGen;
+        if ((parseGen(file, name + ".snap.", fileGen) || parseGen(file, name + ".log.", fileGen)) &&
+            fileGen < gen) {
+            std::error_code removeEc;
+            std::filesystem::remove(entry.path(), removeEc);
+        }
+    }
+}
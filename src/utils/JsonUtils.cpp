@@ -1 +1,392 @@
-#include "utils/JsonUtils.h"
\ No newline at end of file
+#include "utils/JsonUtils.h"
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+    // nesting allowed inside skipped values
+    constexpr int kMaxDepth = 64;
+
+    // single pass over one object, the input is never copied unless a string has escapes
+    class RequestParser {
+    public:
+        RequestParser(std::string_view json, Request& request)
+            : p_(json.data()), end_(json.data() + json.size()), size_(json.size()), request_(request) {}
+
+        bool parse() {
+            skipWhitespace();
+            if (!consume('{')) return false;
+
+            skipWhitespace();
+            if (!consume('}')) {
+                for (;;) {
+                    std::string_view key;
+                    skipWhitespace();
+                    if (!parseString(key)) return false;
+                    skipWhitespace();
+                    if (!consume(':')) return false;
+                    skipWhitespace();
+                    if (!parseMember(key)) return false;
+                    skipWhitespace();
+                    if (consume(',')) continue;
+                    if (consume('}')) break;
+                    return false;
+                }
+            }
+
+            // only whitespace may follow the object
+            skipWhitespace();
+            return p_ == end_;
+        }
+
+    private:
+        bool parseMember(std::string_view key) {
+            if (std::string_view* field = stringField(key)) {
+                return parseString(*field);
+            }
+            if (uint64_t* field = numberField(key)) {
+                return parseUnsigned(*field);
+            }
+            if (key == "members") {
+                return parseStringArray(request_.members);
+            }
+            return skipValue(0);
+        }
+
+        std::string_view* stringField(std::string_view key) {
+            switch (key.size()) {
+                case 2:
+                    if (key == "to") return &request_.to;
+                    break;
+                case 4:
+                    if (key == "with") return &request_.with;
+                    break;
+                case 5:
+                    if (key == "group") return &request_.group;
+                    break;
+                case 6:
+                    if (key == "action") return &request_.action;
+                    break;
+                case 7:
+                    if (key == "message") return &request_.message;
+                    break;
+                case 8:
+                    if (key == "username") return &request_.username;
+                    if (key == "encoding") return &request_.encoding;
+                    break;
+                case 11:
+                    if (key == "compression") return &request_.compression;
+                    break;
+                case 13:
+                    if (key == "password_hash") return &request_.passwordHash;
+                    break;
+                default:
+                    break;
+            }
+            return nullptr;
+        }
+
+        uint64_t* numberField(std::string_view key) {
+            if (key == "seq") return &request_.seq;
+            if (key == "limit") return &request_.limit;
+            if (key == "offset") return &request_.offset;
+            return nullptr;
+        }
+
+        void skipWhitespace() {
+            while (p_ < end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t')) ++p_;
+        }
+
+        bool consume(char c) {
+            if (p_ < end_ && *p_ == c) {
+                ++p_;
+                return true;
+            }
+            return false;
+        }
+
+        bool consumeLiteral(const char* literal) {
+            size_t len = std::strlen(literal);
+            if (static_cast<size_t>(end_ - p_) < len || std::memcmp(p_, literal, len) != 0) return false;
+            p_ += len;
+            return true;
+        }
+
+        // string at p_, value views the input when there are no escapes
+        bool parseString(std::string_view& value) {
+            if (!consume('"')) return false;
+            const char* start = p_;
+            while (p_ < end_) {
+                unsigned char c = static_cast<unsigned char>(*p_);
+                if (c == '"') {
+                    value = std::string_view(start, p_ - start);
+                    ++p_;
+                    return true;
+                }
+                if (c == '\\') return unescapeString(start, value);
+                if (c < 0x20) return false;
+                ++p_;
+            }
+            return false;
+        }
+
+        // array of strings, each viewing the input or the arena like a string field
+        bool parseStringArray(std::vector<std::string_view>& values) {
+            if (!consume('[')) return false;
+            values.clear();
+            skipWhitespace();
+            if (consume(']')) return true;
+            for (;;) {
+                std::string_view value;
+                skipWhitespace();
+                if (!parseString(value)) return false;
+                values.push_back(value);
+                skipWhitespace();
+                if (consume(',')) continue;
+                return consume(']');
+            }
+        }
+
+        // decode the rest of a string that has escapes into the arena
+        // unescaped text is never longer than its source, so one frame-sized arena holds every string
+        bool unescapeString(const char* start, std::string_view& value) {
+            if (!request_.arena) {
+                request_.arena.reset(new char[size_]);
+                request_.arenaUsed = 0;
+            }
+            char* out = request_.arena.get() + request_.arenaUsed;
+            char* const begin = out;
+
+            std::memcpy(out, start, p_ - start);
+            out += p_ - start;
+
+            while (p_ < end_) {
+                unsigned char c = static_cast<unsigned char>(*p_++);
+                if (c == '"') {
+                    value = std::string_view(begin, out - begin);
+                    request_.arenaUsed += out - begin;
+                    return true;
+                }
+                if (c < 0x20) return false;
+                if (c != '\\') {
+                    *out++ = static_cast<char>(c);
+                    continue;
+                }
+                if (p_ == end_) return false;
+                switch (*p_++) {
+                    case '"':  *out++ = '"';  break;
+                    case '\\': *out++ = '\\'; break;
+                    case '/':  *out++ = '/';  break;
+                    case 'b':  *out++ = '\b'; break;
+                    case 'f':  *out++ = '\f'; break;
+                    case 'n':  *out++ = '\n'; break;
+                    case 'r':  *out++ = '\r'; break;
+                    case 't':  *out++ = '\t'; break;
+                    case 'u': {
+                        uint32_t code = 0;
+                        if (!parseHex4(code)) return false;
+                        if (code >= 0xD800 && code <= 0xDBFF) {
+                            // high surrogate, the low half must follow
+                            uint32_t low = 0;
+                            if (!consume('\\') || !consume('u') || !parseHex4(low)) return false;
+                            if (low < 0xDC00 || low > 0xDFFF) return false;
+                            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        } else if (code >= 0xDC00 && code <= 0xDFFF) {
+                            return false;
+                        }
+                        out = encodeUtf8(code, out);
+                        break;
+                    }
+                    default:
+                        return false;
+                }
+            }
+            return false;
+        }
+
+        bool parseHex4(uint32_t& code) {
+            if (end_ - p_ < 4) return false;
+            for (int i = 0; i < 4; i++) {
+                char c = *p_++;
+                code <<= 4;
+                if (c >= '0' && c <= '9') code |= c - '0';
+                else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+                else return false;
+            }
+            return true;
+        }
+
+        static char* encodeUtf8(uint32_t code, char* out) {
+            if (code < 0x80) {
+                *out++ = static_cast<char>(code);
+            } else if (code < 0x800) {
+                *out++ = static_cast<char>(0xC0 | (code >> 6));
+                *out++ = static_cast<char>(0x80 | (code & 0x3F));
+            } else if (code < 0x10000) {
+                *out++ = static_cast<char>(0xE0 | (code >> 12));
+                *out++ = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                *out++ = static_cast<char>(0x80 | (code & 0x3F));
+            } else {
+                *out++ = static_cast<char>(0xF0 | (code >> 18));
+                *out++ = static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+                *out++ = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                *out++ = static_cast<char>(0x80 | (code & 0x3F));
+            }
+            return out;
+        }
+
+        // non-negative integer that fits 64 bits
+        bool parseUnsigned(uint64_t& value) {
+            if (p_ == end_ || *p_ < '0' || *p_ > '9') return false;
+            if (*p_ == '0' && end_ - p_ > 1 && p_[1] >= '0' && p_[1] <= '9') return false;
+
+            uint64_t result = 0;
+            while (p_ < end_ && *p_ >= '0' && *p_ <= '9') {
+                uint64_t digit = static_cast<uint64_t>(*p_ - '0');
+                if (result > (UINT64_MAX - digit) / 10) return false;
+                result = result * 10 + digit;
+                ++p_;
+            }
+            // fractions and exponents are not valid here
+            if (p_ < end_ && (*p_ == '.' || *p_ == 'e' || *p_ == 'E')) return false;
+
+            value = result;
+            return true;
+        }
+
+        bool skipDigits() {
+            const char* start = p_;
+            while (p_ < end_ && *p_ >= '0' && *p_ <= '9') ++p_;
+            return p_ != start;
+        }
+
+        bool skipNumber() {
+            consume('-');
+            if (consume('0')) {
+                // no leading zeros
+            } else if (!skipDigits()) {
+                return false;
+            }
+            if (consume('.') && !skipDigits()) return false;
+            if (p_ < end_ && (*p_ == 'e' || *p_ == 'E')) {
+                ++p_;
+                if (!consume('+')) consume('-');
+                if (!skipDigits()) return false;
+            }
+            return true;
+        }
+
+        bool skipString() {
+            if (!consume('"')) return false;
+            while (p_ < end_) {
+                unsigned char c = static_cast<unsigned char>(*p_++);
+                if (c == '"') return true;
+                if (c < 0x20) return false;
+                if (c == '\\') {
+                    if (p_ == end_) return false;
+                    char e = *p_++;
+                    if (e == 'u') {
+                        uint32_t ignored = 0;
+                        if (!parseHex4(ignored)) return false;
+                    } else if (e == '\0' || !std::strchr("\"\\/bfnrt", e)) {
+                        return false;
+                    }
+                }
+            }
+            return false;
+        }
+
+        // validate and step over any value, nothing is stored
+        bool skipValue(int depth) {
+            if (p_ == end_) return false;
+            switch (*p_) {
+                case '"':
+                    return skipString();
+                case '{': {
+                    if (depth >= kMaxDepth) return false;
+                    ++p_;
+                    skipWhitespace();
+                    if (consume('}')) return true;
+                    for (;;) {
+                        skipWhitespace();
+                        if (!skipString()) return false;
+                        skipWhitespace();
+                        if (!consume(':')) return false;
+                        skipWhitespace();
+                        if (!skipValue(depth + 1)) return false;
+                        skipWhitespace();
+                        if (consume(',')) continue;
+                        return consume('}');
+                    }
+                }
+                case '[': {
+                    if (depth >= kMaxDepth) return false;
+                    ++p_;
+                    skipWhitespace();
+                    if (consume(']')) return true;
+                    for (;;) {
+                        skipWhitespace();
+                        if (!skipValue(depth + 1)) return false;
+                        skipWhitespace();
+                        if (consume(',')) continue;
+                        return consume(']');
+                    }
+                }
+                case 't':
+                    return consumeLiteral("true");
+                case 'f':
+                    return consumeLiteral("false");
+                case 'n':
+                    return consumeLiteral("null");
+                default:
+                    return skipNumber();
+            }
+        }
+
+        const char* p_;
+        const char* const end_;
+        const size_t size_;
+        Request& request_;
+    };
+
+}
+
+bool JsonUtils::parseRequest(std::string_view json, Request& request) {
+    return RequestParser(json, request).parse();
+}
+
+bool JsonUtils::ObjectScanner::next(std::string_view buffer) {
+    while (pos_ < buffer.size()) {
+        char c = buffer[pos_++];
+
+        if (inString_) {
+            if (escaped_) {
+                escaped_ = false;
+            } else if (c == '\\') {
+                escaped_ = true;
+            } else if (c == '"') {
+                inString_ = false;
+            }
+            continue;
+        }
+
+        if (depth_ == 0) {
+            // text between objects is ignored
+            if (c == '{') {
+                begin_ = pos_ - 1;
+                depth_ = 1;
+            }
+            continue;
+        }
+
+        if (c == '"') {
+            inString_ = true;
+        } else if (c == '{') {
+            depth_++;
+        } else if (c == '}' && --depth_ == 0) {
+            return true;
+        }
+    }
+    return false;
+}
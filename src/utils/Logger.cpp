@@ -1,3 +1,234 @@
 #include "utils/Logger.h"
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
-std::mutex Logger::mutex_;
+std::atomic<Logger::Level> Logger::level_{Logger::Level::Info};
+
+namespace {
+
+    constexpr std::array<const char*, 4> kLevelNames = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+
+    // bounded multi-producer ring with a sequence number per slot (Vyukov's queue), read by
+    // the writer thread only. A producer claims a slot with one CAS on tail_ and publishes it
+    // by bumping the slot's sequence, so producers never wait for each other or the writer
+    class LogRing {
+    public:
+        static constexpr size_t kSlots = 8192;   // power of two
+
+        LogRing() {
+            for (size_t i = 0; i < kSlots; i++) {
+                slots_[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        bool push(Logger::Level level, std::string text) {
+            size_t pos = tail_.load(std::memory_order_relaxed);
+            for (;;) {
+                Slot& slot = slots_[pos & (kSlots - 1)];
+                size_t sequence = slot.sequence.load(std::memory_order_acquire);
+                auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+                if (diff == 0) {
+                    if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        slot.level = level;
+                        slot.time = std::chrono::system_clock::now();
+                        slot.text = std::move(text);
+                        slot.sequence.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    return false;   // full, the writer is a whole ring behind
+                } else {
+                    pos = tail_.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // next published line, false when there is none yet
+        template <typename Fn>
+        bool pop(Fn&& consume) {
+            Slot& slot = slots_[head_ & (kSlots - 1)];
+            if (slot.sequence.load(std::memory_order_acquire) != head_ + 1) {
+                return false;
+            }
+            consume(slot.level, slot.time, slot.text);
+            slot.text.clear();
+            slot.sequence.store(head_ + kSlots, std::memory_order_release);
+            head_++;
+            return true;
+        }
+
+        bool empty() const {
+            const Slot& slot = slots_[head_ & (kSlots - 1)];
+            return slot.sequence.load(std::memory_order_acquire) != head_ + 1;
+        }
+
+    private:
+        struct alignas(64) Slot {
+            std::atomic<size_t> sequence{0};
+            Logger::Level level = Logger::Level::Info;
+            std::chrono::system_clock::time_point time;
+            std::string text;
+        };
+
+        std::array<Slot, kSlots> slots_;
+        alignas(64) std::atomic<size_t> tail_{0};   // next slot to claim, producers
+        alignas(64) size_t head_ = 0;               // next slot to read, writer thread only
+    };
+
+    class AsyncLog {
+    public:
+        AsyncLog() : writer_([this] { run(); }) {
+            writer_.detach();
+            // lines queued right before exit still reach the output
+            std::atexit([] { instance().flush(); });
+        }
+
+        // never destroyed, other statics may log while they are torn down
+        static AsyncLog& instance() {
+            static AsyncLog* log = new AsyncLog();
+            return *log;
+        }
+
+        void write(Logger::Level level, std::string text) {
+            if (!ring_.push(level, std::move(text))) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            queued_.fetch_add(1, std::memory_order_release);
+            wake();
+        }
+
+        bool setOutput(const std::string& path) {
+            FILE* file = stdout;
+            if (!path.empty() && !(file = std::fopen(path.c_str(), "ab"))) {
+                return false;
+            }
+            flush();
+            std::lock_guard<std::mutex> lock(outputMutex_);
+            if (output_ != stdout) {
+                std::fclose(output_);
+            }
+            output_ = file;
+            return true;
+        }
+
+        void flush() {
+            uint64_t target = queued_.load(std::memory_order_acquire);
+            uint64_t done = written_.load(std::memory_order_acquire);
+            while (done < target) {
+                wake();
+                written_.wait(done, std::memory_order_acquire);
+                done = written_.load(std::memory_order_acquire);
+            }
+        }
+
+        uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    private:
+        void wake() {
+            if (sleeping_.exchange(false)) {
+                wakeups_.fetch_add(1);
+                wakeups_.notify_one();
+            }
+        }
+
+        void run() {
+            std::string batch;
+            for (;;) {
+                uint64_t lines = 0;
+                while (ring_.pop([&](Logger::Level level, std::chrono::system_clock::time_point time,
+                                     const std::string& text) {
+                    append(batch, level, time, text);
+                })) {
+                    lines++;
+                    // bounded batches keep memory flat under a burst
+                    if (batch.size() >= 64 * 1024) break;
+                }
+
+                if (lines > 0) {
+                    {
+                        std::lock_guard<std::mutex> lock(outputMutex_);
+                        std::fwrite(batch.data(), 1, batch.size(), output_);
+                        std::fflush(output_);
+                    }
+                    batch.clear();
+                    written_.fetch_add(lines, std::memory_order_release);
+                    written_.notify_all();
+                    continue;
+                }
+
+                // announce the sleep, then look once more: a producer either sees the flag
+                // or its line is found here
+                uint32_t seen = wakeups_.load();
+                sleeping_.store(true);
+                if (!ring_.empty()) {
+                    sleeping_.store(false);
+                    continue;
+                }
+                wakeups_.wait(seen);
+            }
+        }
+
+        static void append(std::string& batch, Logger::Level level,
+                           std::chrono::system_clock::time_point time, const std::string& text) {
+            auto micros = std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+            std::time_t seconds = static_cast<std::time_t>(micros / 1000000);
+            std::tm local{};
+#ifdef _WIN32
+            localtime_s(&local, &seconds);
+#else
+            localtime_r(&seconds, &local);
+#endif
+
+            char prefix[48];
+            size_t n = std::strftime(prefix, sizeof(prefix), "%Y-%m-%d %H:%M:%S", &local);
+            std::snprintf(prefix + n, sizeof(prefix) - n, ".%06lld %s ",
+                          static_cast<long long>(micros % 1000000), kLevelNames[static_cast<size_t>(level)]);
+            batch += prefix;
+
+            // lines used to start or end with their own "\n", keep the log one line per entry
+            size_t begin = text.find_first_not_of('\n');
+            if (begin != std::string::npos) {
+                batch.append(text, begin, text.find_last_not_of('\n') + 1 - begin);
+            }
+            batch += '\n';
+        }
+
+        LogRing ring_;
+        std::atomic<uint64_t> queued_{0};
+        std::atomic<uint64_t> written_{0};
+        std::atomic<uint64_t> dropped_{0};
+        std::atomic<bool> sleeping_{false};
+        std::atomic<uint32_t> wakeups_{0};
+        std::mutex outputMutex_;   // writer thread and setOutput only
+        FILE* output_ = stdout;
+        std::thread writer_;
+    };
+
+}
+
+void Logger::write(Level level, std::string msg) {
+    if (!enabled(level)) {
+        return;
+    }
+    AsyncLog::instance().write(level, std::move(msg));
+}
+
+bool Logger::setOutput(const std::string& path) {
+    return AsyncLog::instance().setOutput(path);
+}
+
+void Logger::flush() {
+    AsyncLog::instance().flush();
+}
+
+uint64_t Logger::dropped() {
+    return AsyncLog::instance().dropped();
+}
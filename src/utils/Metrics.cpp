@@ -0,0 +1,176 @@
+#include "utils/Metrics.h"
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+namespace metrics {
+
+    size_t assignShard() {
+        static std::atomic<size_t> next{0};
+        return next.fetch_add(1, std::memory_order_relaxed) % kShards;
+    }
+
+    uint64_t Counter::value() const {
+        uint64_t total = 0;
+        for (const auto& cell : cells_) {
+            total += cell.value.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    Histogram::Snapshot Histogram::snapshot() const {
+        Snapshot merged;
+        for (const auto& shard : shards_) {
+            merged.sum += shard.sum.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < kBuckets; i++) {
+                uint64_t n = shard.buckets[i].load(std::memory_order_relaxed);
+                merged.buckets[i] += n;
+                merged.count += n;
+            }
+        }
+        return merged;
+    }
+
+    uint64_t Histogram::Snapshot::percentile(double q) const {
+        if (count == 0) {
+            return 0;
+        }
+
+        uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(count));
+        rank = std::max<uint64_t>(1, std::min(rank, count));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; i++) {
+            seen += buckets[i];
+            if (seen >= rank) {
+                return bucketUpperBound(i);
+            }
+        }
+        return bucketUpperBound(kBuckets - 1);
+    }
+
+    Registry& Registry::global() {
+        // never destroyed, metrics may be recorded by threads that outlive main's statics
+        static Registry* registry = new Registry();
+        return *registry;
+    }
+
+    Registry::Entry& Registry::find(Kind kind, std::string_view name, std::string_view help,
+                                    std::string_view labels) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& entry : entries_) {
+            if (entry.kind == kind && entry.name == name && entry.labels == labels) {
+                return entry;
+            }
+        }
+
+        Entry& entry = entries_.emplace_back();
+        entry.kind = kind;
+        entry.name = name;
+        entry.help = help;
+        entry.labels = labels;
+        if (kind == Kind::Counter) {
+            entry.counter = std::make_unique<Counter>();
+        } else {
+            entry.histogram = std::make_unique<Histogram>();
+        }
+        return entry;
+    }
+
+    Counter& Registry::counter(std::string_view name, std::string_view help, std::string_view labels) {
+        return *find(Kind::Counter, name, help, labels).counter;
+    }
+
+    Histogram& Registry::histogram(std::string_view name, std::string_view help, std::string_view labels) {
+        return *find(Kind::Histogram, name, help, labels).histogram;
+    }
+
+    namespace {
+
+        constexpr std::array<double, 4> kQuantiles = {0.5, 0.9, 0.99, 0.999};
+
+        std::string seriesName(const std::string& name, const std::string& labels,
+                               std::string_view extraLabel = {}) {
+            std::string series = name;
+            if (labels.empty() && extraLabel.empty()) {
+                return series;
+            }
+            series += '{';
+            series += labels;
+            if (!labels.empty() && !extraLabel.empty()) series += ',';
+            series += extraLabel;
+            series += '}';
+            return series;
+        }
+
+        std::string formatDouble(double value) {
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+            return buffer;
+        }
+
+    }
+
+    std::string Registry::prometheus() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string out;
+
+        // one HELP/TYPE block per name, the series of every label set under it
+        std::vector<bool> written(entries_.size(), false);
+        for (size_t i = 0; i < entries_.size(); i++) {
+            if (written[i]) continue;
+            const Entry& first = entries_[i];
+            bool counter = first.kind == Kind::Counter;
+            out += "# HELP " + first.name + " " + first.help + "\n";
+            out += "# TYPE " + first.name + (counter ? " counter\n" : " summary\n");
+
+            for (size_t j = i; j < entries_.size(); j++) {
+                const Entry& entry = entries_[j];
+                if (written[j] || entry.name != first.name || entry.kind != first.kind) continue;
+                written[j] = true;
+
+                if (counter) {
+                    out += seriesName(entry.name, entry.labels) + " " + std::to_string(entry.counter->value()) + "\n";
+                    continue;
+                }
+
+                Histogram::Snapshot snapshot = entry.histogram->snapshot();
+                for (double q : kQuantiles) {
+                    std::string quantile = "quantile=\"" + formatDouble(q) + "\"";
+                    out += seriesName(entry.name, entry.labels, quantile) + " "
+                         + formatDouble(static_cast<double>(snapshot.percentile(q)) / 1e9) + "\n";
+                }
+                out += seriesName(entry.name + "_sum", entry.labels) + " "
+                     + formatDouble(static_cast<double>(snapshot.sum) / 1e9) + "\n";
+                out += seriesName(entry.name + "_count", entry.labels) + " " + std::to_string(snapshot.count) + "\n";
+            }
+        }
+        return out;
+    }
+
+    nlohmann::json Registry::json() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        nlohmann::json counters = nlohmann::json::object();
+        nlohmann::json histograms = nlohmann::json::object();
+
+        for (const auto& entry : entries_) {
+            std::string series = seriesName(entry.name, entry.labels);
+            if (entry.kind == Kind::Counter) {
+                counters[series] = entry.counter->value();
+                continue;
+            }
+
+            Histogram::Snapshot snapshot = entry.histogram->snapshot();
+            histograms[series] = {
+                {"count", snapshot.count},
+                {"mean_us", snapshot.count ? static_cast<double>(snapshot.sum) / snapshot.count / 1e3 : 0.0},
+                {"p50_us", static_cast<double>(snapshot.percentile(0.5)) / 1e3},
+                {"p90_us", static_cast<double>(snapshot.percentile(0.9)) / 1e3},
+                {"p99_us", static_cast<double>(snapshot.percentile(0.99)) / 1e3},
+                {"p999_us", static_cast<double>(snapshot.percentile(0.999)) / 1e3},
+                {"max_us", static_cast<double>(snapshot.max()) / 1e3}
+            };
+        }
+        return {{"counters", std::move(counters)}, {"histograms", std::move(histograms)}};
+    }
+
+}
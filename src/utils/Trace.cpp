@@ -0,0 +1,180 @@
+#include "utils/Trace.h"
+#include <algorithm>
+#include <ctime>
+#include <json.hpp>
+#include "utils/Logger.h"
+
+namespace trace {
+
+    thread_local RequestTrace* RequestTrace::current_ = nullptr;
+    thread_local const RequestTrace* RequestTrace::open_ = nullptr;
+
+    const char* stageName(Stage stage) {
+        static constexpr std::array<const char*, 7> names = {
+            "request", "handler", "parse", "lookup", "crypto", "storage", "write"
+        };
+        return names[static_cast<size_t>(stage)];
+    }
+
+    uint32_t threadId() {
+        static std::atomic<uint32_t> next{1};
+        thread_local uint32_t id = next.fetch_add(1, std::memory_order_relaxed);
+        return id;
+    }
+
+    void RequestTrace::sample(std::shared_ptr<Tracer> tracer, uint64_t id) {
+        tracer_ = std::move(tracer);
+        id_ = id;
+        thread_ = threadId();
+    }
+
+    void RequestTrace::watch(std::shared_ptr<SlowLog> log, Clock::duration threshold) {
+        slowLog_ = std::move(log);
+        slowAfter_ = threshold;
+    }
+
+    void RequestTrace::add(std::string_view name, Stage stage, Clock::time_point start, Clock::time_point end,
+                           bool counted) {
+        if (counted && static_cast<size_t>(stage) >= kFirstTimedStage) {
+            stages_[static_cast<size_t>(stage)].fetch_add((end - start).count(), std::memory_order_relaxed);
+        }
+        if (tracer_) {
+            uint32_t thread = threadId();
+            std::lock_guard<std::mutex> lock(mutex_);
+            events_.push_back({name, stage, thread, start, end});
+        }
+    }
+
+    void RequestTrace::finish(Clock::time_point end, bool error) {
+        if (slowLog_ && end - start_ >= slowAfter_) {
+            slowLog_->write(*this, end - start_, error);
+        }
+        if (tracer_) {
+            error_ = error;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                events_.push_back({name_, Stage::Request, thread_, start_, end});
+            }
+            tracer_->write(*this);
+        }
+    }
+
+    std::shared_ptr<Tracer> Tracer::open(const std::string& path, double sampleRate) {
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        if (!file) {
+            LOG_ERROR("[Tracer] Cannot open " + path);
+            return nullptr;
+        }
+        return std::shared_ptr<Tracer>(new Tracer(file, sampleRate));
+    }
+
+    Tracer::Tracer(std::FILE* file, double sampleRate)
+        : file_(file), sampleRate_(sampleRate), epoch_(Clock::now()) {
+        std::fputs("[", file_);
+    }
+
+    Tracer::~Tracer() {
+        std::fputs("\n]\n", file_);
+        std::fclose(file_);
+    }
+
+    void Tracer::sample(RequestTrace& trace) {
+        // request n is traced when n * rate crosses a whole number, every 1/rate-th request
+        uint64_t n = requests_.fetch_add(1, std::memory_order_relaxed);
+        if (static_cast<uint64_t>((n + 1) * sampleRate_) == static_cast<uint64_t>(n * sampleRate_)) {
+            return;
+        }
+        trace.sample(shared_from_this(), traced_.fetch_add(1, std::memory_order_relaxed) + 1);
+    }
+
+    void Tracer::flush() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::fflush(file_);
+    }
+
+    void Tracer::write(const RequestTrace& trace) {
+        // complete ("X") events, microsecond timestamps from the tracer's start
+        auto micros = [this](Clock::time_point t) {
+            return std::chrono::duration<double, std::micro>(t - epoch_).count();
+        };
+
+        std::string out;
+        out.reserve(160 * trace.events_.size());
+        char line[320];
+        for (const auto& event : trace.events_) {
+            int n = std::snprintf(line, sizeof(line),
+                "{\"name\":\"%.*s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                "\"pid\":1,\"tid\":%u,\"args\":{\"request\":%llu",
+                static_cast<int>(event.name.size()), event.name.data(), stageName(event.stage),
+                micros(event.start), micros(event.end) - micros(event.start), event.thread,
+                static_cast<unsigned long long>(trace.id_));
+            out += ",\n";
+            out.append(line, static_cast<size_t>(n));
+            if (event.stage == Stage::Request && trace.error_) {
+                out += ",\"error\":true";
+            }
+            out += "}}";
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        // the array's first element has no separator
+        std::fwrite(out.data() + (first_ ? 1 : 0), 1, out.size() - (first_ ? 1 : 0), file_);
+        first_ = false;
+    }
+
+    std::shared_ptr<SlowLog> SlowLog::open(const std::string& path) {
+        std::FILE* file = std::fopen(path.c_str(), "ab");
+        if (!file) {
+            LOG_ERROR("[SlowLog] Cannot open " + path);
+            return nullptr;
+        }
+        return std::shared_ptr<SlowLog>(new SlowLog(file));
+    }
+
+    SlowLog::~SlowLog() {
+        std::fclose(file_);
+    }
+
+    void SlowLog::write(const RequestTrace& trace, Clock::duration total, bool error) {
+        auto millis = [](Clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); };
+
+        std::time_t now = std::time(nullptr);
+        std::tm local{};
+#ifdef _WIN32
+        localtime_s(&local, &now);
+#else
+        localtime_r(&now, &local);
+#endif
+        char time[32];
+        std::strftime(time, sizeof(time), "%Y-%m-%d %H:%M:%S", &local);
+
+        nlohmann::json entry = {
+            {"time", time},
+            {"action", trace.name_},
+            {"user", trace.user_},
+            {"total_ms", millis(total)},
+            {"threshold_ms", millis(trace.slowAfter_)},
+            {"request_bytes", trace.requestBytes_.load(std::memory_order_relaxed)},
+            {"response_bytes", trace.responseBytes_.load(std::memory_order_relaxed)},
+            {"conversation_size", trace.conversationSize_.load(std::memory_order_relaxed)},
+            {"error", error}
+        };
+        nlohmann::json stages = nlohmann::json::object();
+        Clock::duration staged{};
+        for (size_t stage = kFirstTimedStage; stage < kStages; stage++) {
+            Clock::duration spent = trace.stageTime(static_cast<Stage>(stage));
+            stages[stageName(static_cast<Stage>(stage))] = millis(spent);
+            staged += spent;
+        }
+        // stages on different threads may overlap, other never goes negative
+        stages["other"] = millis(std::max(total - staged, Clock::duration::zero()));
+        entry["stages_ms"] = std::move(stages);
+
+        std::string line = entry.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace) + "\n";
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::fwrite(line.data(), 1, line.size(), file_);
+        std::fflush(file_);   // rare, and operators tail it
+        written_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+}
@@ -0,0 +1,322 @@
+#include "utils/base64.h"
+#include <array>
+#include <atomic>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    #define BASE64_X86_KERNELS 1
+    #include <immintrin.h>
+#endif
+
+namespace {
+
+    constexpr char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    // character -> 6-bit value, 0xFF outside the alphabet
+    constexpr std::array<uint8_t, 256> makeDecodeTable() {
+        std::array<uint8_t, 256> table{};
+        for (auto& v : table) v = 0xFF;
+        for (int i = 0; i < 64; i++) table[static_cast<uint8_t>(kAlphabet[i])] = static_cast<uint8_t>(i);
+        return table;
+    }
+
+    constexpr std::array<uint8_t, 256> kDecodeTable = makeDecodeTable();
+
+    // ---------scalar---------
+
+    size_t encodeScalar(const uint8_t* in, size_t len, char* out) {
+        char* const begin = out;
+        size_t i = 0;
+        for (; i + 3 <= len; i += 3) {
+            uint32_t v = (uint32_t(in[i]) << 16) | (uint32_t(in[i + 1]) << 8) | in[i + 2];
+            *out++ = kAlphabet[(v >> 18) & 0x3F];
+            *out++ = kAlphabet[(v >> 12) & 0x3F];
+            *out++ = kAlphabet[(v >> 6) & 0x3F];
+            *out++ = kAlphabet[v & 0x3F];
+        }
+
+        size_t rest = len - i;
+        if (rest > 0) {
+            uint32_t v = uint32_t(in[i]) << 16;
+            if (rest == 2) v |= uint32_t(in[i + 1]) << 8;
+            *out++ = kAlphabet[(v >> 18) & 0x3F];
+            *out++ = kAlphabet[(v >> 12) & 0x3F];
+            *out++ = rest == 2 ? kAlphabet[(v >> 6) & 0x3F] : '=';
+            *out++ = '=';
+        }
+        return out - begin;
+    }
+
+    size_t decodeScalar(const char* in, size_t len, uint8_t* out) {
+        uint8_t* const begin = out;
+        size_t i = 0;
+
+        // whole groups of 4
+        for (; i + 4 <= len; i += 4) {
+            uint8_t a = kDecodeTable[static_cast<uint8_t>(in[i])];
+            uint8_t b = kDecodeTable[static_cast<uint8_t>(in[i + 1])];
+            uint8_t c = kDecodeTable[static_cast<uint8_t>(in[i + 2])];
+            uint8_t d = kDecodeTable[static_cast<uint8_t>(in[i + 3])];
+            if ((a | b | c | d) & 0x80) break;
+            uint32_t v = (uint32_t(a) << 18) | (uint32_t(b) << 12) | (uint32_t(c) << 6) | d;
+            *out++ = static_cast<uint8_t>(v >> 16);
+            *out++ = static_cast<uint8_t>(v >> 8);
+            *out++ = static_cast<uint8_t>(v);
+        }
+
+        // up to 3 trailing characters before padding or the first invalid character
+        uint32_t v = 0;
+        int bits = 0;
+        for (; i < len; i++) {
+            uint8_t x = kDecodeTable[static_cast<uint8_t>(in[i])];
+            if (x & 0x80) break;
+            v = (v << 6) | x;
+            bits += 6;
+            if (bits >= 8) {
+                bits -= 8;
+                *out++ = static_cast<uint8_t>(v >> bits);
+            }
+        }
+        return out - begin;
+    }
+
+#ifdef BASE64_X86_KERNELS
+
+    // ---------SSE4.1, 12 bytes <-> 16 characters---------
+    // bit shuffling and the pshufb lookups follow Mula and Lemire, "Faster Base64 Encoding
+    // and Decoding Using AVX2 Instructions"
+
+    __attribute__((target("ssse3,sse4.1")))
+    __m128i encodeLookupSse(__m128i indices) {
+        __m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+        __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+        result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+        const __m128i shift = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                            '/' - 63, 'A', 0, 0);
+        return _mm_add_epi8(_mm_shuffle_epi8(shift, result), indices);
+    }
+
+    __attribute__((target("ssse3,sse4.1")))
+    size_t encodeSse(const uint8_t* in, size_t len, char* out) {
+        const __m128i split = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+        size_t i = 0;
+
+        // each step reads 16 bytes and uses 12
+        for (; i + 16 <= len; i += 12, out += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            v = _mm_shuffle_epi8(v, split);
+            __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+            __m128i t1 = _mm_mullo_epi16(_mm_and_si128(v, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), encodeLookupSse(_mm_or_si128(t0, t1)));
+        }
+        return i;
+    }
+
+    // 16 characters -> 12 bytes, false if any is outside the alphabet
+    __attribute__((target("ssse3,sse4.1")))
+    bool decodeBlockSse(__m128i v, uint8_t* out) {
+        const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+        const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+        const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m128i nibble = _mm_set1_epi8(0x0f);
+
+        __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(v, 4), nibble);
+        __m128i loNibbles = _mm_and_si128(v, nibble);
+        if (!_mm_testz_si128(_mm_shuffle_epi8(lutLo, loNibbles), _mm_shuffle_epi8(lutHi, hiNibbles))) {
+            return false;
+        }
+
+        __m128i isSlash = _mm_cmpeq_epi8(v, _mm_set1_epi8('/'));
+        __m128i values = _mm_add_epi8(v, _mm_shuffle_epi8(lutRoll, _mm_add_epi8(isSlash, hiNibbles)));
+
+        __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+        merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+        merged = _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+
+        // exactly 12 bytes, out has no slack
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out), merged);
+        uint32_t tail = static_cast<uint32_t>(_mm_extract_epi32(merged, 2));
+        std::memcpy(out + 8, &tail, 4);
+        return true;
+    }
+
+    // returns characters consumed, stops before the first block with padding or invalid input
+    __attribute__((target("ssse3,sse4.1")))
+    size_t decodeSse(const char* in, size_t len, uint8_t* out) {
+        size_t i = 0;
+        for (; i + 16 <= len; i += 16, out += 12) {
+            if (!decodeBlockSse(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), out)) break;
+        }
+        return i;
+    }
+
+    // ---------AVX2, 24 bytes <-> 32 characters---------
+
+    __attribute__((target("avx2")))
+    size_t encodeAvx2(const uint8_t* in, size_t len, char* out) {
+        const __m256i split = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                               1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+        const __m256i shift = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                               '/' - 63, 'A', 0, 0,
+                                               'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                               '/' - 63, 'A', 0, 0);
+        size_t i = 0;
+
+        // lanes are loaded from in+i and in+i+12, so 28 bytes must be readable
+        for (; i + 28 <= len; i += 24, out += 32) {
+            __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 12));
+            __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+            v = _mm256_shuffle_epi8(v, split);
+
+            __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00)),
+                                            _mm256_set1_epi32(0x04000040));
+            __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0)),
+                                            _mm256_set1_epi32(0x01000010));
+            __m256i indices = _mm256_or_si256(t0, t1);
+
+            __m256i result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+            __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+            result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+            result = _mm256_add_epi8(_mm256_shuffle_epi8(shift, result), indices);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), result);
+        }
+        return i;
+    }
+
+    __attribute__((target("avx2")))
+    size_t decodeAvx2(const char* in, size_t len, uint8_t* out) {
+        const __m256i lutLo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                               0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                               0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                               0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+        const __m256i lutHi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                               0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                               0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                               0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+        const __m256i lutRoll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                                 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m256i nibble = _mm256_set1_epi8(0x0f);
+        const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                              2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+        size_t i = 0;
+
+        for (; i + 32 <= len; i += 32, out += 24) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+
+            __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(v, 4), nibble);
+            __m256i loNibbles = _mm256_and_si256(v, nibble);
+            if (!_mm256_testz_si256(_mm256_shuffle_epi8(lutLo, loNibbles),
+                                    _mm256_shuffle_epi8(lutHi, hiNibbles))) {
+                break;
+            }
+
+            __m256i isSlash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('/'));
+            __m256i values = _mm256_add_epi8(v, _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(isSlash, hiNibbles)));
+
+            __m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+            merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+            merged = _mm256_shuffle_epi8(merged, pack);
+            // 12 bytes per lane -> 24 contiguous bytes
+            merged = _mm256_permutevar8x32_epi32(merged, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_castsi256_si128(merged));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 16), _mm256_extracti128_si256(merged, 1));
+        }
+        return i;
+    }
+
+    // inputs too short for another AVX2 block still get the SSE kernel
+    // the upper register halves are cleared first, legacy SSE code after AVX2 is heavily penalized
+    __attribute__((target("avx2")))
+    size_t encodeAvx2Sse(const uint8_t* in, size_t len, char* out) {
+        size_t done = encodeAvx2(in, len, out);
+        _mm256_zeroupper();
+        return done + encodeSse(in + done, len - done, out + done / 3 * 4);
+    }
+
+    __attribute__((target("avx2")))
+    size_t decodeAvx2Sse(const char* in, size_t len, uint8_t* out) {
+        size_t done = decodeAvx2(in, len, out);
+        _mm256_zeroupper();
+        return done + decodeSse(in + done, len - done, out + done / 4 * 3);
+    }
+
+#endif
+
+    // bulk kernels return input consumed, the scalar code finishes the rest
+    struct Kernels {
+        const char* name;
+        size_t (*encodeBulk)(const uint8_t*, size_t, char*);
+        size_t (*decodeBulk)(const char*, size_t, uint8_t*);
+    };
+
+    size_t noBulkEncode(const uint8_t*, size_t, char*) { return 0; }
+    size_t noBulkDecode(const char*, size_t, uint8_t*) { return 0; }
+
+    constexpr Kernels kScalar{"scalar", noBulkEncode, noBulkDecode};
+#ifdef BASE64_X86_KERNELS
+    constexpr Kernels kSse{"sse4.1", encodeSse, decodeSse};
+    constexpr Kernels kAvx2{"avx2", encodeAvx2Sse, decodeAvx2Sse};
+#endif
+
+    bool supported(const Kernels& kernels) {
+#ifdef BASE64_X86_KERNELS
+        __builtin_cpu_init();
+        if (&kernels == &kAvx2) return __builtin_cpu_supports("avx2");
+        if (&kernels == &kSse) return __builtin_cpu_supports("sse4.1");
+#endif
+        return &kernels == &kScalar;
+    }
+
+    const Kernels* detect() {
+#ifdef BASE64_X86_KERNELS
+        if (supported(kAvx2)) return &kAvx2;
+        if (supported(kSse)) return &kSse;
+#endif
+        return &kScalar;
+    }
+
+    std::atomic<const Kernels*>& active() {
+        static std::atomic<const Kernels*> kernels{detect()};
+        return kernels;
+    }
+
+}
+
+size_t base64::encode(const uint8_t* data, size_t len, char* out) {
+    const Kernels* kernels = active().load(std::memory_order_relaxed);
+    size_t done = kernels->encodeBulk(data, len, out);
+    return done / 3 * 4 + encodeScalar(data + done, len - done, out + done / 3 * 4);
+}
+
+size_t base64::decode(const char* text, size_t len, uint8_t* out) {
+    const Kernels* kernels = active().load(std::memory_order_relaxed);
+    size_t done = kernels->decodeBulk(text, len, out);
+    return done / 4 * 3 + decodeScalar(text + done, len - done, out + done / 4 * 3);
+}
+
+const char* base64::implementation() {
+    return active().load(std::memory_order_relaxed)->name;
+}
+
+bool base64::useImplementation(std::string_view name) {
+    const Kernels* candidates[] = {
+#ifdef BASE64_X86_KERNELS
+        &kAvx2, &kSse,
+#endif
+        &kScalar
+    };
+    for (const Kernels* kernels : candidates) {
+        if (name == kernels->name && supported(*kernels)) {
+            active().store(kernels, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
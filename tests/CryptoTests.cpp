@@ -1,3 +1,113 @@
+#include <cassert>
+#include <random>
+#include <string>
+#include <vector>
+#include "utils/base64.h"
+#include "utils/Logger.h"
+
+// ===================================================
+// BASE64
+// ===================================================
+
+// bit-at-a-time reference the fast paths are compared against
+std::string referenceEncode(const std::string& data) {
+    static const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    int val = 0;
+    int bits = -6;
+    for (unsigned char c : data) {
+        val = (val << 8) + c;
+        bits += 8;
+        while (bits >= 0) {
+            out.push_back(alphabet[(val >> bits) & 0x3F]);
+            bits -= 6;
+        }
+    }
+    if (bits > -6) out.push_back(alphabet[((val << 8) >> (bits + 8)) & 0x3F]);
+    while (out.size() % 4) out.push_back('=');
+    return out;
+}
+
+std::string decodeToString(const std::string& text) {
+    std::vector<uint8_t> bytes = base64::decode(text);
+    return std::string(bytes.begin(), bytes.end());
+}
+
+void testBase64(const char* implementation) {
+    Logger::log(std::string("\n[Test] Running testBase64 (") + implementation + ")...");
+
+    // RFC 4648 vectors, every padding case
+    const char* vectors[][2] = {
+        {"", ""}, {"f", "Zg=="}, {"fo", "Zm8="}, {"foo", "Zm9v"},
+        {"foob", "Zm9vYg=="}, {"fooba", "Zm9vYmE="}, {"foobar", "Zm9vYmFy"}
+    };
+    for (auto& v : vectors) {
+        assert(base64::encode(std::string(v[0])) == v[1]);
+        assert(decodeToString(v[1]) == v[0]);
+    }
+
+    // missing padding decodes the same, decoding stops at padding or the first invalid character
+    assert(decodeToString("Zm8") == "fo");
+    assert(decodeToString("Zm9vYg") == "foob");
+    assert(decodeToString("Zg==Zm9v") == "f");
+    assert(decodeToString("Zm9v*mFy") == "foo");
+    assert(decodeToString("Z") == "");
+
+    // every length around the 12/16/24/32 byte block sizes, bytes of all values
+    std::mt19937 rng(1234);
+    for (size_t len = 0; len < 260; len++) {
+        std::string data(len, '\0');
+        for (auto& c : data) c = static_cast<char>(rng());
+
+        std::string encoded = base64::encode(data);
+        assert(encoded == referenceEncode(data));
+        assert(encoded.size() == base64::encodedLength(len));
+        assert(decodeToString(encoded) == data);
+
+        // an invalid character anywhere gives the same bytes as the text before it
+        if (len >= 30) {
+            std::string broken = encoded;
+            size_t at = rng() % broken.size();
+            broken[at] = '*';
+            std::string expected = decodeToString(encoded.substr(0, at));
+            assert(decodeToString(broken) == expected);
+        }
+    }
+
+    // caller-provided buffers are written exactly, nothing past the returned length
+    std::string data(1000, 'q');
+    std::vector<char> text(base64::encodedLength(data.size()) + 1, '#');
+    size_t written = base64::encode(reinterpret_cast<const uint8_t*>(data.data()), data.size(), text.data());
+    assert(written == text.size() - 1 && text.back() == '#');
+
+    std::vector<uint8_t> bytes(base64::decodedMaxLength(written) + 1, 0xEE);
+    size_t decoded = base64::decode(text.data(), written, bytes.data());
+    assert(decoded == data.size() && bytes[decoded] == 0xEE);
+
+    Logger::log("[Test] Base64 passed\n");
+}
+
+// ===================================================
+// Main Entry
+// ===================================================
+
 int main() {
+    Logger::log("=============================\n");
+    Logger::log(" Running Crypto Unit Tests\n");
+    Logger::log("=============================\n");
+
+    std::string detected = base64::implementation();
+    Logger::log("[Test] base64 implementation: " + detected);
+
+    for (const char* implementation : {"scalar", "sse4.1", "avx2"}) {
+        if (!base64::useImplementation(implementation)) {
+            Logger::log(std::string("[Test] Skipping base64 ") + implementation + ": not supported here");
+            continue;
+        }
+        testBase64(implementation);
+    }
+    base64::useImplementation(detected);
+
+    Logger::log("\nAll tests executed.\n");
     return 0;
-}
\ No newline at end of file
+}
@@ -1,12 +1,27 @@
 #include "network/tcpServer.h"
 #include "network/tcpConnection.h"
 #include "client/Client.h"
+#include "storage/FileStorage.h"
+#include "storage/MemoryStorage.h"
 #include <asio.hpp>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <optional>
+#include <set>
+#include <stdexcept>
 #include <thread>
 #include <chrono>
 #include <iostream>
 #include "utils/ClientTestContext.h"
+#include "utils/ByteOrder.h"
+#include "utils/JsonUtils.h"
+#include "utils/base64.h"
 #include "utils/Logger.h"
+#include "utils/Metrics.h"
+
+// response timeout of every test client, generous so a loaded machine does not fail tests
+constexpr std::chrono::milliseconds kClientTimeout{10000};
 
 // ===================================================
 // Delete Old User Data
@@ -16,12 +31,599 @@
 // a directory for test user data separate from normal data
 void resetUsers() {
     FileStorage storage = FileStorage();
-    for (int i = 0; i < 10; i++) {
+    for (int i = 0; i < 20; i++) {
         storage.deleteUser("test_user_" + std::to_string(i));
     }
     storage.saveUser();
 }
 
+// ===================================================
+// REQUEST PARSING
+// ===================================================
+
+void testParseRequest() {
+    Logger::log("\n[Test] Running testParseRequest...");
+
+    // plain strings view the input, unknown keys of any shape are skipped
+    std::string frame = R"({"action":"send_message","extra":{"a":[1,2.5e3,-0.1,{"b":null}],"c":"}"},)"
+                        R"("to":"bob","flag":true,"message":"hi there","seq":42})";
+    Request request;
+    assert(JsonUtils::parseRequest(frame, request));
+    assert(request.action == "send_message");
+    assert(request.to == "bob");
+    assert(request.message == "hi there");
+    assert(request.seq == 42);
+    assert(request.with.empty() && request.offset == 0);
+    assert(!request.arena && "no allocation without escapes");
+    assert(request.to.data() >= frame.data() && request.to.data() < frame.data() + frame.size());
+
+    // escaped strings share one arena
+    Request escaped;
+    assert(JsonUtils::parseRequest(
+        R"({ "action" : "login", "username":"a\"b\\c", "password_hash":"é😀\n" })", escaped));
+    assert(escaped.username == "a\"b\\c");
+    assert(escaped.passwordHash == "\xC3\xA9\xF0\x9F\x98\x80\n");
+    assert(escaped.arena);
+
+    // members is an array of strings, commas inside names are kept
+    Request group;
+    assert(JsonUtils::parseRequest(R"({"action":"create_group","members":[ "a,b" , "c\"d" ]})", group));
+    assert((group.members == std::vector<std::string_view>{"a,b", "c\"d"}));
+    Request noMembers;
+    assert(JsonUtils::parseRequest(R"({"members":[]})", noMembers) && noMembers.members.empty());
+
+    // malformed objects and wrongly typed fields are rejected
+    for (const char* bad : {R"({"action":"login")", R"({"action":1})", R"({"seq":"1"})", R"({"seq":-1})",
+                            R"({"seq":1.5})", R"({"action":"a",})", R"({"x":tru})", R"({"to":"\ud800"})",
+                            R"({"action":"a"} x)", R"([])", "{\"a\":\"\x01\"}",
+                            R"({"members":"a,b"})", R"({"members":["a",1]})", R"({"members":["a",]})"}) {
+        Request rejected;
+        assert(!JsonUtils::parseRequest(bad, rejected));
+    }
+
+    // objects split across reads, braces inside strings are not counted
+    JsonUtils::ObjectScanner scanner;
+    std::string buffer = R"(junk {"message":"{ \"}"})";
+    assert(scanner.next(buffer));
+    assert(buffer.substr(scanner.begin(), scanner.end() - scanner.begin()) == R"({"message":"{ \"}"})");
+    buffer += R"({"action":"log)";
+    assert(!scanner.next(buffer));
+    size_t consumed = scanner.consumable();
+    buffer.erase(0, consumed);
+    scanner.shift(consumed);
+    assert(buffer == R"({"action":"log)");
+    buffer += R"(in"})";
+    assert(scanner.next(buffer));
+    assert(scanner.begin() == 0 && scanner.end() == buffer.size());
+
+    Logger::log("[Test] ParseRequest passed\n");
+}
+
+void testActionTable() {
+    Logger::log("\n[Test] Running testActionTable...");
+
+    // every registered name finds its own row, near misses find nothing
+    for (const char* name : {"hello", "create_account", "login", "send_message",
+                             "get_messages", "list_conversations", "mark_read"}) {
+        const TcpServer::ActionSpec* action = TcpServer::findAction(name);
+        assert(action && action->name == name);
+    }
+    for (const char* name : {"", "hell", "helloo", "Login", "get_message", "mark_reads"}) {
+        assert(!TcpServer::findAction(name));
+    }
+
+    const TcpServer::ActionSpec* send = TcpServer::findAction("send_message");
+    assert(send->requiresAuth && send->rate == actions::RateClass::Write);
+    assert(!TcpServer::findAction("login")->requiresAuth);
+
+    Request request;
+    request.to = "bob";
+    assert(!actions::hasFields(request, send->required));
+    request.message = "hi";
+    assert(actions::hasFields(request, send->required));
+
+    // the perfect hash is searched at compile time, so many rows still cost one probe
+    constexpr auto table = actions::makeTable<int>(std::array{
+        actions::Spec<int>{.name = "a", .handler = 1}, actions::Spec<int>{.name = "b", .handler = 2},
+        actions::Spec<int>{.name = "ab", .handler = 3}, actions::Spec<int>{.name = "ba", .handler = 4},
+        actions::Spec<int>{.name = "abc", .handler = 5}, actions::Spec<int>{.name = "cab", .handler = 6},
+        actions::Spec<int>{.name = "delete_account", .handler = 7}, actions::Spec<int>{.name = "typing", .handler = 8},
+        actions::Spec<int>{.name = "presence", .handler = 9}, actions::Spec<int>{.name = "ping", .handler = 10},
+    });
+    static_assert(table.valid());
+    static_assert(table.find("cab")->handler == 6 && !table.find("c"));
+    for (const auto& spec : table) {
+        assert(table.find(spec.name) == &spec);
+    }
+
+    constexpr auto duplicate = actions::makeTable<int>(std::array{
+        actions::Spec<int>{.name = "x", .handler = 1}, actions::Spec<int>{.name = "x", .handler = 2},
+    });
+    static_assert(!duplicate.valid());
+
+    Logger::log("[Test] ActionTable passed\n");
+}
+
+void testRateLimiter() {
+    Logger::log("\n[Test] Running testRateLimiter...");
+
+    using actions::RateClass;
+    using namespace std::chrono_literals;
+
+    RateLimiter::Limits limits;
+    limits.perConnection[static_cast<size_t>(RateClass::Write)] = {10, 3};
+    limits.perUser[static_cast<size_t>(RateClass::Write)] = {10, 4};
+    RateLimiter limiter(limits);
+    auto now = RateLimiter::Clock::now();
+
+    // the burst is available at once, then one token per interval
+    RateLimiter::Buckets connection;
+    for (int i = 0; i < 3; i++) {
+        assert(limiter.check(connection, nullptr, RateClass::Write, now) == 0ns);
+    }
+    auto wait = limiter.check(connection, nullptr, RateClass::Write, now);
+    assert(wait > 0ns && wait <= 100ms);
+    assert(limiter.check(connection, nullptr, RateClass::Write, now + wait) == 0ns);
+
+    // unlimited classes never wait
+    for (int i = 0; i < 1000; i++) {
+        assert(limiter.check(connection, nullptr, RateClass::Free, now) == 0ns);
+    }
+
+    // connections of one user share its bucket, separate users do not
+    auto alice = limiter.userBuckets("alice");
+    assert(limiter.userBuckets("alice") == alice);
+    assert(limiter.userBuckets("bob") != alice);
+    RateLimiter::Buckets first, second;
+    assert(limiter.check(first, alice.get(), RateClass::Write, now) == 0ns);
+    assert(limiter.check(first, alice.get(), RateClass::Write, now) == 0ns);
+    assert(limiter.check(second, alice.get(), RateClass::Write, now) == 0ns);
+    assert(limiter.check(second, alice.get(), RateClass::Write, now) == 0ns);
+    assert(limiter.check(second, alice.get(), RateClass::Write, now) > 0ns);
+
+    // the user bucket's refusal left second's token in place
+    assert(limiter.check(second, nullptr, RateClass::Write, now) == 0ns);
+    assert(limiter.check(second, nullptr, RateClass::Write, now) > 0ns);
+
+    // users without connections are forgotten as others log in, a little at a time
+    alice.reset();
+    for (int i = 0; i < 1000; i++) {
+        limiter.userBuckets("gone_" + std::to_string(i));
+    }
+    assert(limiter.trackedUsers() < 100);
+
+    // concurrent takes never hand out more than the burst
+    TokenBucket shared;
+    std::atomic<int> taken{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < 100; i++) {
+                if (shared.take({1, 50}, now) == 0ns) taken++;
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    assert(taken == 50);
+
+    Logger::log("[Test] RateLimiter passed\n");
+}
+
+void testTimerWheel() {
+    Logger::log("\n[Test] Running testTimerWheel...");
+
+    using namespace std::chrono_literals;
+    auto start = TimerWheel::Clock::now();
+    TimerWheel wheel(10ms, start);
+
+    // delays across every level fire on their own tick, not before
+    std::vector<TimerWheel::Clock::duration> delays = {1ns, 20ms, 25ms, 630ms, 640ms, 650ms,
+                                                       41s, 45min, 2h};
+    std::vector<int> firedAt(delays.size(), -1);
+    std::vector<std::unique_ptr<TimerWheel::Timer>> timers;
+    for (size_t i = 0; i < delays.size(); i++) {
+        timers.push_back(std::make_unique<TimerWheel::Timer>());
+        timers[i]->setCallback([&, i]() { firedAt[i] = static_cast<int>(i); });
+        wheel.schedule(*timers[i], delays[i]);
+    }
+    assert(wheel.size() == delays.size());
+
+    for (size_t i = 0; i < delays.size(); i++) {
+        auto due = start + ((delays[i] + 10ms - 1ns) / 10ms) * 10ms;
+        wheel.advance(due - 1ns);
+        assert(firedAt[i] == -1);
+        wheel.advance(due);
+        assert(firedAt[i] == static_cast<int>(i));
+    }
+    assert(wheel.size() == 0);
+
+    // cancelled and rescheduled timers fire once at their new time
+    TimerWheel::Timer once;
+    int count = 0;
+    once.setCallback([&]() { count++; });
+    wheel.schedule(once, 50ms);
+    wheel.cancel(once);
+    assert(!once.scheduled());
+    wheel.schedule(once, 50ms);
+    wheel.schedule(once, 5s);
+    wheel.advance(start + 2h + 1s);
+    assert(count == 0);
+    wheel.advance(start + 2h + 6s);
+    assert(count == 1 && !once.scheduled());
+
+    // a callback may re-arm its own timer
+    TimerWheel::Timer repeating;
+    int repeats = 0;
+    repeating.setCallback([&]() {
+        if (++repeats < 5) wheel.schedule(repeating, 20ms);
+    });
+    wheel.schedule(repeating, 20ms);
+    wheel.advance(start + 3h);
+    assert(repeats == 5);
+
+    Logger::log("[Test] TimerWheel passed\n");
+}
+
+void testWorkerPool() {
+    Logger::log("\n[Test] Running testWorkerPool...");
+
+    asio::io_context io;
+    auto work = asio::make_work_guard(io);
+    std::thread ioThread([&]() { io.run(); });
+    std::thread::id ioId = ioThread.get_id();
+
+    {
+        WorkerPool pool(4, 64);
+
+        // work runs off the io thread, its result comes back on it
+        std::promise<std::pair<std::thread::id, std::thread::id>> threads;
+        assert(pool.submit([]() { return std::this_thread::get_id(); }, io.get_executor(),
+                           [&](std::thread::id worker) {
+                               threads.set_value({worker, std::this_thread::get_id()});
+                           }));
+        auto [worker, resumed] = threads.get_future().get();
+        assert(worker != ioId && resumed == ioId);
+
+        // one order key runs its tasks one at a time and completes them in order
+        int key = 0;
+        std::atomic<int> inside{0};
+        std::vector<int> done;
+        std::promise<void> finished;
+        for (int i = 0; i < 20; i++) {
+            assert(pool.submit(&key,
+                [&inside, i]() {
+                    assert(inside.fetch_add(1) == 0);
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                    inside--;
+                    return i;
+                },
+                io.get_executor(),
+                [&](int value) {
+                    done.push_back(value);
+                    if (done.size() == 20) finished.set_value();
+                }));
+        }
+        finished.get_future().get();
+        for (int i = 0; i < 20; i++) {
+            assert(done[i] == i);
+        }
+        // throwing work still answers, through failed() on the io thread
+        std::promise<std::pair<std::string, std::thread::id>> failure;
+        assert(pool.submit(&key, WorkerPool::kDefaultPriority,
+                           []() -> int { throw std::runtime_error("broken"); },
+                           io.get_executor(),
+                           [](int) { assert(false && "done() after a throw"); },
+                           [&](const std::string& what) {
+                               failure.set_value({what, std::this_thread::get_id()});
+                           }));
+        auto [what, failedOn] = failure.get_future().get();
+        assert(what == "broken" && failedOn == ioId);
+
+        // the worker counts a task after its completion is posted, wait for the last one
+        while (pool.stats().completed < 22) std::this_thread::yield();
+        assert(pool.stats().completed == 22 && pool.stats().queued == 0);
+    }
+
+    {
+        // ready tasks run lowest priority value first, in submission order within one
+        WorkerPool pool(1, 8);
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+        assert(pool.submit([released]() { released.wait(); }, io.get_executor(), []() {}));
+        while (pool.stats().running == 0) std::this_thread::yield();
+
+        std::vector<int> order;   // only the one worker appends
+        auto task = [&order](int id) { return [&order, id]() { order.push_back(id); }; };
+        int key = 0;
+        assert(pool.submit(nullptr, 2, task(1), io.get_executor(), []() {}));
+        assert(pool.submit(&key, 1, task(2), io.get_executor(), []() {}));
+        assert(pool.submit(&key, 0, task(3), io.get_executor(), []() {}));   // behind 2, its key
+        assert(pool.submit(nullptr, 0, task(4), io.get_executor(), []() {}));
+        assert(pool.submit(nullptr, 7, task(5), io.get_executor(), []() {}));   // clamped to 2
+        release.set_value();
+        while (pool.stats().completed < 6) std::this_thread::yield();
+        assert((order == std::vector<int>{4, 2, 3, 1, 5}));
+    }
+
+    std::atomic<int> ran{0};
+    {
+        // a full queue turns work away instead of growing
+        WorkerPool pool(1, 2);
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+        auto block = [released, &ran]() { released.wait(); ran++; };
+
+        assert(pool.submit(block, io.get_executor(), []() {}));
+        while (pool.stats().running == 0) std::this_thread::yield();
+        assert(pool.submit(block, io.get_executor(), []() {}));
+        assert(pool.submit(block, io.get_executor(), []() {}));
+        assert(!pool.submit(block, io.get_executor(), []() {}));
+        assert(pool.stats().rejected == 1 && pool.stats().peakQueued == 2);
+
+        release.set_value();
+    }
+    // the destructor still ran what was accepted
+    assert(ran == 3);
+
+    work.reset();
+    ioThread.join();
+
+    Logger::log("[Test] WorkerPool passed\n");
+}
+
+void testMetrics() {
+    Logger::log("\n[Test] Running testMetrics...");
+
+    using metrics::Histogram;
+
+    // buckets cover every value and keep it within 1/16
+    for (uint64_t value : {0ull, 1ull, 15ull, 16ull, 17ull, 1000ull, 123456789ull, 1ull << 43}) {
+        size_t bucket = Histogram::bucketOf(value);
+        assert(bucket < Histogram::kBuckets);
+        uint64_t upper = Histogram::bucketUpperBound(bucket);
+        assert(upper >= value && upper - value <= value / Histogram::kSubBuckets);
+        assert(bucket == 0 || Histogram::bucketUpperBound(bucket - 1) < value);
+    }
+    assert(Histogram::bucketOf(~0ull) == Histogram::kBuckets - 1);
+
+    // counters and histograms add up across threads
+    metrics::Counter counter;
+    Histogram histogram;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&]() {
+            for (uint64_t i = 1; i <= 1000; i++) {
+                counter.add();
+                histogram.record(i * 1000);   // 1us .. 1ms
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    assert(counter.value() == 4000);
+
+    Histogram::Snapshot snapshot = histogram.snapshot();
+    assert(snapshot.count == 4000);
+    assert(snapshot.sum == 4 * 1000 * 1001 / 2 * 1000);
+    auto near = [](uint64_t measured, uint64_t expected) {
+        return measured >= expected && measured - expected <= expected / 8;
+    };
+    assert(near(snapshot.percentile(0.5), 500000));
+    assert(near(snapshot.percentile(0.99), 990000));
+    assert(near(snapshot.max(), 1000000));
+
+    // the same name and labels give the same metric, rendered once per name
+    auto& registry = metrics::Registry::global();
+    auto& a = registry.counter("test_metric_total", "help text", "kind=\"a\"");
+    auto& b = registry.counter("test_metric_total", "help text", "kind=\"b\"");
+    assert(&a == &registry.counter("test_metric_total", "help text", "kind=\"a\""));
+    a.add(3);
+    b.add();
+    std::string text = registry.prometheus();
+    assert(text.find("# TYPE test_metric_total counter\ntest_metric_total{kind=\"a\"} 3\n"
+                     "test_metric_total{kind=\"b\"} 1\n") != std::string::npos);
+    assert(registry.json()["counters"]["test_metric_total{kind=\"a\"}"] == 3);
+
+    Logger::log("[Test] Metrics passed\n");
+}
+
+void testLogger() {
+    Logger::log("\n[Test] Running testLogger...");
+
+    std::filesystem::create_directories("temp");
+    std::string path = "temp/messenger_test.log";
+    std::filesystem::remove(path);
+    assert(Logger::setOutput(path));
+
+    // debug is below the runtime level, the rest is written in order with one line each
+    Logger::write(Logger::Level::Debug, "hidden");
+    LOG_INFO("first\n");
+    LOG_WARN("second");
+    LOG_ERROR("third");
+
+    // lines from several threads all arrive, each thread's in its own order
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([t]() {
+            for (int i = 0; i < 500; i++) {
+                LOG_INFO("thread " + std::to_string(t) + " line " + std::to_string(i));
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    Logger::flush();
+    assert(Logger::setOutput(""));
+
+    std::ifstream in(path);
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(in, line);) {
+        lines.push_back(line);
+    }
+    assert(lines.size() == 3 + 4 * 500);
+    assert(lines[0].ends_with(" INFO  first"));
+    assert(lines[1].ends_with(" WARN  second"));
+    assert(lines[2].ends_with(" ERROR third"));
+    assert(lines[0].size() == std::string("2024-01-01 00:00:00.000000 INFO  first").size());
+
+    std::vector<int> next(4, 0);
+    for (size_t i = 3; i < lines.size(); i++) {
+        size_t at = lines[i].find("thread ");
+        assert(at != std::string::npos);
+        int t = lines[i][at + 7] - '0';
+        assert(lines[i].ends_with(" line " + std::to_string(next[t])));
+        next[t]++;
+    }
+    assert(Logger::dropped() == 0);
+
+    Logger::log("[Test] Logger passed\n");
+}
+
+void testRequestTrace() {
+    Logger::log("\n[Test] Running testRequestTrace...");
+
+    using namespace std::chrono_literals;
+
+    // spans count towards their stage once, nested ones and covered calls are only details
+    trace::RequestTrace request("send_message", trace::Clock::now());
+    trace::Clock::duration lookupTime;
+    {
+        trace::RequestTrace::Scope scope(&request);
+        auto lookupStart = trace::Clock::now();
+        {
+            trace::Span outer("public_key", trace::Stage::Lookup);
+            trace::Span inner("keystore_lookup", trace::Stage::Lookup);
+            std::this_thread::sleep_for(2ms);
+        }
+        lookupTime = trace::Clock::now() - lookupStart;
+        auto start = trace::Clock::now();
+        {
+            trace::Covered covered;
+            trace::Span call("encode_message", trace::Stage::Storage);
+            std::this_thread::sleep_for(1ms);
+        }
+        trace::record("append_message", trace::Stage::Storage, start, start + 5ms);
+
+        // other threads add to the same request
+        std::thread worker([&]() {
+            trace::RequestTrace::Scope workerScope(&request);
+            trace::Span rsa("rsa_encrypt", trace::Stage::Crypto);
+            std::this_thread::sleep_for(1ms);
+        });
+        worker.join();
+    }
+    // nothing is recorded outside of a request
+    { trace::Span stray("send", trace::Stage::Write); }
+
+    assert(request.stageTime(trace::Stage::Lookup) >= 2ms && request.stageTime(trace::Stage::Lookup) <= lookupTime);
+    assert(request.stageTime(trace::Stage::Storage) == 5ms);
+    assert(request.stageTime(trace::Stage::Crypto) >= 1ms);
+    assert(request.stageTime(trace::Stage::Write) == trace::Clock::duration::zero());
+    assert(!request.sampled());
+
+    Logger::log("[Test] RequestTrace passed\n");
+}
+
+void testWireFormat() {
+    Logger::log("\n[Test] Running testWireFormat...");
+
+    nlohmann::json message = {
+        {"from", "a"}, {"to", "b"}, {"timestamp", 1700000000}, {"seq", 7},
+        {"ciphertext", base64::encode(std::string(300, 'x'))},
+        {"iv", base64::encode(std::string(12, 'i'))},
+        {"tag", base64::encode(std::string(16, 't'))},
+        {"aes_for_sender", base64::encode(std::string(256, 's'))},
+        {"aes_for_recipient", base64::encode(std::string(256, 'r'))}
+    };
+    std::string jsonFrame = wire::encodeFrame({{"status", "success"}, {"messages", {message}}}, WireFormat::Json);
+
+    nlohmann::json binary = message;
+    wire::toBinaryFields(binary);
+    assert(binary["ciphertext"].is_binary() && binary["ciphertext"].get_binary().size() == 300);
+
+    for (WireFormat format : {WireFormat::MsgPack, WireFormat::Cbor}) {
+        nlohmann::json response = {{"status", "success"}, {"messages", {binary}}};
+        std::string frame = wire::encodeFrame(response, format);
+
+        // length prefix, then a payload that round trips with raw bytes
+        assert(byteorder::getU32(frame.data()) == frame.size() - wire::kFrameHeader);
+        nlohmann::json decoded = wire::decodePayload(std::string_view(frame).substr(wire::kFrameHeader), format);
+        assert(decoded == response);
+        assert(frame.size() * 4 < jsonFrame.size() * 3 && "binary frame should be well below json size");
+
+        // requests decode into the same struct as json ones
+        std::string request = wire::encodeFrame({{"action", "get_messages"}, {"with", "b"}, {"limit", 50}}, format);
+        nlohmann::json value = wire::decodePayload(std::string_view(request).substr(wire::kFrameHeader), format);
+        Request parsed;
+        assert(wire::requestFromJson(value, parsed));
+        assert(parsed.action == "get_messages" && parsed.with == "b" && parsed.limit == 50);
+
+        std::string create = wire::encodeFrame({{"action", "create_group"}, {"members", {"a,b", "c"}}}, format);
+        value = wire::decodePayload(std::string_view(create).substr(wire::kFrameHeader), format);
+        Request group;
+        assert(wire::requestFromJson(value, group));
+        assert((group.members == std::vector<std::string_view>{"a,b", "c"}));
+        assert(!wire::requestFromJson({{"members", "a,b"}}, group));
+    }
+
+    assert(wire::formatFromName("msgpack") == WireFormat::MsgPack);
+    assert(!wire::formatFromName("xml"));
+    assert(wire::decodePayload("\xc1", WireFormat::MsgPack).is_discarded());
+
+    Logger::log("[Test] WireFormat passed\n");
+}
+
+// blocks round trip in order, repeats compress against the shared window
+void testCompression() {
+    Logger::log("\n[Test] Running testCompression...");
+
+    std::string response = wire::encodeFrame({{"status", "success"}, {"messages", nlohmann::json::array({
+        {{"from", "alice"}, {"to", "bob"}, {"seq", 1}, {"ciphertext", base64::encode(std::string(600, 'c'))}}
+    })}}, WireFormat::Json);
+    std::string small = R"({"status":"success"})";
+
+    compression::Deflater deflater;
+    std::string blocks;
+    deflater.appendBlock(blocks, response);
+    size_t first = blocks.size();
+    deflater.appendBlock(blocks, small);
+    size_t second = blocks.size();
+    deflater.appendBlock(blocks, response);
+    size_t third = blocks.size() - second;
+
+    assert(static_cast<uint8_t>(blocks[0]) == compression::kDeflated && first < response.size());
+    assert(static_cast<uint8_t>(blocks[first]) == 0 && "small writes are stored");
+    assert(third * 2 < first && "a repeat should compress against the first copy");
+
+    compression::Inflater inflater;
+    std::string out;
+    std::string_view rest(blocks);
+    while (!rest.empty()) {
+        uint8_t flags = static_cast<uint8_t>(rest[0]);
+        size_t length = byteorder::getU32(rest.data() + 1);
+        std::string_view payload = rest.substr(compression::kBlockHeader, length);
+        if (flags & compression::kDeflated) {
+            assert(inflater.inflate(payload, out, 1 << 20));
+        } else {
+            out.append(payload);
+        }
+        rest.remove_prefix(compression::kBlockHeader + length);
+    }
+    assert(out == response + small + response);
+
+    // output past the cap and garbage both fail
+    compression::Inflater capped;
+    std::string cappedOut;
+    assert(!capped.inflate(std::string_view(blocks).substr(compression::kBlockHeader, first - compression::kBlockHeader),
+                           cappedOut, 64));
+    compression::Inflater corrupt;
+    std::string corruptOut;
+    assert(!corrupt.inflate("\xff\xff\xff\xff", corruptOut, 1 << 20));
+
+    assert(compression::fromName("deflate") == Compression::Deflate);
+    assert(!compression::fromName("zstd"));
+
+    Logger::log("[Test] Compression passed\n");
+}
+
 // ===================================================
 // Set Up TcpServer
 // ===================================================
@@ -56,7 +658,7 @@ void testCreateAccountRequest() {
     auto conn = TcpConnection::create(ctx.io(), nullptr);
     assert(conn->connect("127.0.0.1", 5555));
 
-    Client client(conn);
+    Client client(conn, kClientTimeout);
     conn->beginRead();
 
     std::string u1 = makeUser();
@@ -80,7 +682,7 @@ void testLoginRequest() {
     auto conn = TcpConnection::create(ctx.io(), nullptr);
     assert(conn->connect("127.0.0.1", 5555));
 
-    Client client(conn);
+    Client client(conn, kClientTimeout);
     conn->beginRead();
 
     std::string user = makeUser();
@@ -103,13 +705,13 @@ void testSendMessageRequest() {
     // sender
     auto connA = TcpConnection::create(ctx.io(), nullptr);
     assert(connA->connect("127.0.0.1", 5555));
-    Client sender(connA);
+    Client sender(connA, kClientTimeout);
     connA->beginRead();
 
     // receiver
     auto connB = TcpConnection::create(ctx.io(), nullptr);
     assert(connB->connect("127.0.0.1", 5555));
-    Client receiver(connB);
+    Client receiver(connB, kClientTimeout);
     connB->beginRead();
 
     std::string userA = makeUser();
@@ -140,8 +742,8 @@ void testReceiveMessageResponse() {
     assert(connA->connect("127.0.0.1", 5555));
     assert(connB->connect("127.0.0.1", 5555));
 
-    Client sender(connA);
-    Client receiver(connB);
+    Client sender(connA, kClientTimeout);
+    Client receiver(connB, kClientTimeout);
     connA->beginRead();
     connB->beginRead();
 
@@ -174,6 +776,157 @@ void testReceiveMessageResponse() {
     std::this_thread::sleep_for(std::chrono::milliseconds(100));
 }
 
+// ===================================================
+// BINARY ENCODING TEST
+// ===================================================
+
+void testBinaryEncodingRequests() {
+    Logger::log("\n[Test] Running testBinaryEncodingRequests...");
+
+    for (WireFormat format : {WireFormat::MsgPack, WireFormat::Cbor}) {
+        ClientTestContext ctx;
+
+        auto connA = TcpConnection::create(ctx.io(), nullptr);
+        auto connB = TcpConnection::create(ctx.io(), nullptr);
+        assert(connA->connect("127.0.0.1", 5555));
+        assert(connB->connect("127.0.0.1", 5555));
+
+        Client sender(connA, kClientTimeout);
+        Client receiver(connB, kClientTimeout);
+        connA->beginRead();
+        connB->beginRead();
+
+        assert(sender.hello(format) && "Encoding negotiation failed");
+        assert(receiver.hello(format) && "Encoding negotiation failed");
+        assert(!sender.hello(WireFormat::Json) && "Second hello should be rejected");
+
+        std::string userA = makeUser();
+        std::string userB = makeUser();
+
+        assert(sender.createAccount(userA, "pw"));
+        assert(receiver.createAccount(userB, "pw"));
+        assert(sender.login(userA, "pw"));
+        assert(sender.sendMessage(userB, "binary hello"));
+
+        assert(receiver.login(userB, "pw"));
+        assert(receiver.getMessages(userA));
+        assert(!receiver.lastMessages_.empty());
+
+        // byte fields arrive raw
+        const nlohmann::json& msg = receiver.lastMessages_.back();
+        assert(msg["ciphertext"].is_binary());
+        assert(msg["iv"].is_binary());
+        assert(msg["from"] == userA);
+    }
+
+    Logger::log("[Test] BinaryEncodingRequests passed\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+}
+
+// ===================================================
+// STREAMED HISTORY TEST
+// ===================================================
+
+// history larger than several storage batches and send buffers arrives whole and in order
+void testStreamedHistory() {
+    Logger::log("\n[Test] Running testStreamedHistory...");
+
+    ClientTestContext ctx;
+
+    auto connA = TcpConnection::create(ctx.io(), nullptr);
+    assert(connA->connect("127.0.0.1", 5555));
+    Client sender(connA, kClientTimeout);
+    connA->beginRead();
+
+    std::string userA = makeUser();
+    std::string userB = makeUser();
+    assert(sender.createAccount(userA, "pw"));
+    assert(sender.createAccount(userB, "pw"));
+    assert(sender.login(userA, "pw"));
+
+    const size_t count = 150;
+    for (size_t i = 0; i < count; i++) {
+        assert(sender.sendMessage(userB, "message " + std::to_string(i)));
+    }
+
+    const std::pair<WireFormat, Compression> setups[] = {
+        {WireFormat::Json, Compression::None},
+        {WireFormat::MsgPack, Compression::None},
+        {WireFormat::Json, Compression::Deflate},
+        {WireFormat::MsgPack, Compression::Deflate},
+    };
+    for (auto [format, compression] : setups) {
+        auto conn = TcpConnection::create(ctx.io(), nullptr);
+        assert(conn->connect("127.0.0.1", 5555));
+        Client receiver(conn, kClientTimeout);
+        conn->beginRead();
+
+        if (format != WireFormat::Json || compression != Compression::None) {
+            assert(receiver.hello(format, compression));
+            assert(conn->compression() == compression);
+        }
+        assert(receiver.login(userB, "pw"));
+        assert(receiver.getMessages(userA));
+
+        assert(receiver.lastMessages_.size() == count && "Streamed history incomplete");
+        for (size_t i = 0; i < count; i++) {
+            assert(receiver.lastMessages_[i]["seq"] == i + 1);
+        }
+
+        // requests queued behind the stream are answered after it
+        assert(receiver.listConversations());
+    }
+
+    Logger::log("[Test] StreamedHistory passed\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+}
+
+// ===================================================
+// CONVERSATION LIST TEST
+// ===================================================
+
+void testListConversationsRequest() {
+    Logger::log("\n[Test] Running testListConversationsRequest...");
+
+    ClientTestContext ctx;
+
+    auto connA = TcpConnection::create(ctx.io(), nullptr);
+    auto connB = TcpConnection::create(ctx.io(), nullptr);
+    assert(connA->connect("127.0.0.1", 5555));
+    assert(connB->connect("127.0.0.1", 5555));
+
+    Client sender(connA, kClientTimeout);
+    Client receiver(connB, kClientTimeout);
+    connA->beginRead();
+    connB->beginRead();
+
+    std::string userA = makeUser();
+    std::string userB = makeUser();
+
+    assert(sender.createAccount(userA, "pw"));
+    assert(receiver.createAccount(userB, "pw"));
+    assert(sender.login(userA, "pw"));
+    assert(receiver.login(userB, "pw"));
+
+    assert(sender.sendMessage(userB, "one"));
+    assert(sender.sendMessage(userB, "two"));
+
+    // both messages unread for receiver
+    assert(receiver.listConversations() && "Receiver failed listConversations()");
+    assert(receiver.lastConversations_.size() == 1);
+    assert(receiver.lastConversations_[0]["peer"] == userA);
+    assert(receiver.lastConversations_[0]["last_seq"] == 2);
+    assert(receiver.lastConversations_[0]["unread"] == 2);
+
+    // acknowledge and list again
+    assert(receiver.markRead(userA, 2) && "Receiver failed markRead()");
+    assert(receiver.listConversations());
+    assert(receiver.lastConversations_[0]["unread"] == 0);
+
+    Logger::log("[Test] ListConversationsRequest passed\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+}
+
 // ===================================================
 // DISCONNECTED CLIENT TEST
 // ===================================================
@@ -186,7 +939,7 @@ void testHandleDisconnectedClient() {
     auto conn = TcpConnection::create(ctx.io(), nullptr);
     assert(conn->connect("127.0.0.1", 5555));
 
-    Client client(conn);
+    Client client(conn, kClientTimeout);
     conn->beginRead();
 
     conn->socket().close();
@@ -218,6 +971,532 @@ void testMultipleClientsSimultaneousConnections() {
     std::this_thread::sleep_for(std::chrono::milliseconds(100));
 }
 
+// ===================================================
+// CONNECTION TIMEOUTS TEST
+// ===================================================
+
+void testConnectionTimeouts() {
+    Logger::log("\n[Test] Running testConnectionTimeouts...");
+
+    using namespace std::chrono_literals;
+    ServerOptions options;
+    options.timeouts.idle = 400ms;
+    options.timeouts.read = 200ms;
+    options.timeouts.heartbeat = 100ms;
+    options.timerTick = 10ms;
+
+    asio::io_context serverIo;
+    TcpServer server(serverIo, 5556, std::make_unique<MemoryStorage>(), options);
+    std::thread serverThread([&]() { serverIo.run(); });
+
+    ClientTestContext ctx;
+
+    // silent peer that never answers heartbeats is dropped as idle
+    asio::ip::tcp::socket silent(ctx.io());
+    silent.connect({asio::ip::make_address("127.0.0.1"), 5556});
+
+    // peer that never finishes its frame is dropped on the read timeout
+    asio::ip::tcp::socket partial(ctx.io());
+    partial.connect({asio::ip::make_address("127.0.0.1"), 5556});
+    asio::write(partial, asio::buffer(std::string(R"({"action":"log)")));
+
+    // a client answers heartbeats, so it outlives the idle timeout
+    auto conn = TcpConnection::create(ctx.io(), nullptr);
+    assert(conn->connect("127.0.0.1", 5556));
+    Client client(conn, kClientTimeout);
+    conn->beginRead();
+
+    std::this_thread::sleep_for(1s);
+    assert(server.stats().accepted == 3);
+    assert(server.stats().readTimeouts == 1);
+    assert(server.stats().idleTimeouts == 1);
+    assert(server.stats().heartbeats > 0);
+    assert(client.ping());
+
+    serverIo.stop();
+    serverThread.join();
+
+    Logger::log("[Test] ConnectionTimeouts passed\n");
+}
+
+// ===================================================
+// CONNECTION LIMITS TEST
+// ===================================================
+
+// read until the server closes the socket, returns everything it sent
+std::string readUntilClosed(asio::ip::tcp::socket& socket) {
+    std::string received;
+    std::array<char, 1024> chunk;
+    asio::error_code ec;
+    while (!ec) {
+        size_t n = socket.read_some(asio::buffer(chunk), ec);
+        received.append(chunk.data(), n);
+    }
+    return received;
+}
+
+void testConnectionLimits() {
+    Logger::log("\n[Test] Running testConnectionLimits...");
+
+    ServerOptions options;
+    options.limits.maxFrame = 4096;
+    options.limits.maxOutbound = 16;   // smaller than any reply
+
+    asio::io_context serverIo;
+    TcpServer server(serverIo, 5557, std::make_unique<MemoryStorage>(), options);
+    std::thread serverThread([&]() { serverIo.run(); });
+
+    ClientTestContext ctx;
+
+    // an unterminated object is cut off at the frame limit and told why
+    asio::ip::tcp::socket flooding(ctx.io());
+    flooding.connect({asio::ip::make_address("127.0.0.1"), 5557});
+    asio::write(flooding, asio::buffer(R"({"action":"send_message","message":")" + std::string(8192, 'a')));
+    std::string notice = readUntilClosed(flooding);
+    assert(notice.find(R"("reason":"frame_too_large")") != std::string::npos);
+
+    // a reply that does not fit the outbound cap drops the connection instead of queueing
+    asio::ip::tcp::socket overflowing(ctx.io());
+    overflowing.connect({asio::ip::make_address("127.0.0.1"), 5557});
+    asio::write(overflowing, asio::buffer(std::string(R"({"action":"ping"})")));
+    notice = readUntilClosed(overflowing);
+    assert(notice.find("pong") == std::string::npos);
+    assert(notice.find(R"("reason":"outbound_overflow")") != std::string::npos);
+
+    // counted just after the socket closes
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    assert(server.stats().framesTooLarge == 1);
+    assert(server.stats().outboundOverflows == 1);
+    assert(server.stats().closed == 2);
+
+    serverIo.stop();
+    serverThread.join();
+
+    Logger::log("[Test] ConnectionLimits passed\n");
+}
+
+// ===================================================
+// TLS TEST
+// ===================================================
+
+void testTlsConnections() {
+    Logger::log("\n[Test] Running testTlsConnections...");
+
+    auto credentials = TlsContext::selfSigned("127.0.0.1");
+    ServerOptions options;
+    options.tls = TlsContext::server(credentials);
+
+    asio::io_context serverIo;
+    TcpServer server(serverIo, 5558, std::make_unique<MemoryStorage>(), options);
+    std::thread serverThread([&]() { serverIo.run(); });
+
+    ClientTestContext ctx;
+    auto clientTls = TlsContext::client(credentials.certificatePem);
+
+    // first connection runs the full handshake and is given a session to resume
+    std::string user = makeUser();
+    {
+        auto conn = TcpConnection::create(ctx.io(), nullptr);
+        assert(conn->connect("127.0.0.1", 5558, clientTls));
+        assert(!conn->tlsResumed());
+        Client client(conn, kClientTimeout);
+        conn->beginRead();
+        assert(client.createAccount(user, "pw"));
+        assert(client.login(user, "pw"));
+        conn->disconnect();
+    }
+    assert(clientTls->cachedSessions() == 1);
+
+    // reconnects resume, also with a ticket sealed under the previous ticket key
+    for (int i = 0; i < 2; i++) {
+        auto conn = TcpConnection::create(ctx.io(), nullptr);
+        assert(conn->connect("127.0.0.1", 5558, clientTls));
+        assert(conn->tlsResumed());
+        Client client(conn, kClientTimeout);
+        conn->beginRead();
+        assert(client.login(user, "pw"));
+        conn->disconnect();
+        options.tls->rotateTicketKeys();
+    }
+
+    // a client that does not trust the certificate never gets a connection
+    auto conn = TcpConnection::create(ctx.io(), nullptr);
+    assert(!conn->connect("127.0.0.1", 5558, TlsContext::client(TlsContext::selfSigned("127.0.0.1").certificatePem)));
+
+    // plain tcp to a tls port fails the handshake
+    asio::ip::tcp::socket plain(ctx.io());
+    plain.connect({asio::ip::make_address("127.0.0.1"), 5558});
+    asio::write(plain, asio::buffer(std::string(R"({"action":"ping"})" "\r\n\r\n")));
+    readUntilClosed(plain);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    assert(server.stats().tlsHandshakes == 3);
+    assert(server.stats().tlsResumed == 2);
+    assert(server.stats().tlsFailures == 2);
+    assert(server.stats().tlsKeyRotations == 0);
+
+    serverIo.stop();
+    serverThread.join();
+
+    // the server's timer replaces ticket keys by itself
+    ServerOptions rotating;
+    rotating.tls = TlsContext::server(credentials);
+    rotating.ticketKeyRotation = std::chrono::milliseconds(100);
+    asio::io_context rotatingIo;
+    TcpServer rotatingServer(rotatingIo, 5562, std::make_unique<MemoryStorage>(), rotating);
+    rotatingIo.run_for(std::chrono::milliseconds(450));
+    assert(rotatingServer.stats().tlsKeyRotations >= 2);
+
+    Logger::log("[Test] TlsConnections passed\n");
+}
+
+// ===================================================
+// GROUP CONVERSATION TEST
+// ===================================================
+
+// one encryption and one encoding per wire format, whatever the number of online members
+void testGroupConversations() {
+    Logger::log("\n[Test] Running testGroupConversations...");
+
+    asio::io_context serverIo;
+    TcpServer server(serverIo, 5560, std::make_unique<MemoryStorage>());
+    std::thread serverThread([&]() { serverIo.run(); });
+
+    ClientTestContext ctx;
+    struct Member {
+        std::string name;
+        TcpConnection::pointer conn;
+        std::unique_ptr<Client> client;
+    };
+    std::vector<Member> members;
+    const std::pair<WireFormat, Compression> setups[] = {
+        {WireFormat::Json, Compression::None},       // sender
+        {WireFormat::MsgPack, Compression::None},
+        {WireFormat::Json, Compression::Deflate},
+        {WireFormat::Json, Compression::None},
+    };
+    for (auto [format, compression] : setups) {
+        Member member{makeUser(), TcpConnection::create(ctx.io(), nullptr), nullptr};
+        assert(member.conn->connect("127.0.0.1", 5560));
+        member.client = std::make_unique<Client>(member.conn, kClientTimeout);
+        member.conn->beginRead();
+        if (format != WireFormat::Json || compression != Compression::None) {
+            assert(member.client->hello(format, compression));
+        }
+        assert(member.client->createAccount(member.name, "pw"));
+        assert(member.client->login(member.name, "pw"));
+        members.push_back(std::move(member));
+    }
+    Client& sender = *members[0].client;
+
+    // one member is offline, another user is not in the group
+    std::string offline = makeUser();
+    std::string outsider = makeUser();
+    std::string withComma = makeUser() + ",x";   // one member, not two
+    assert(sender.createAccount(offline, "pw"));
+    assert(sender.createAccount(outsider, "pw"));
+    assert(sender.createAccount(withComma, "pw"));
+
+    std::vector<std::string> names{members[1].name, members[2].name, members[3].name, offline, withComma};
+    assert(!sender.createGroup("bad/name", names));
+    assert(!sender.createGroup("team", {"no_such_user"}));
+    assert(sender.createGroup("team", names));
+    assert(!sender.createGroup("team", names));
+
+    assert(sender.sendGroupMessage("team", "hello group"));
+    assert(sender.sendGroupMessage("team", "second"));
+    for (size_t i = 1; i < members.size(); i++) {
+        assert(members[i].client->waitForGroupMessages(2));
+        const nlohmann::json& pushed = members[i].client->groupInbox_[0];
+        assert(pushed["from"] == members[0].name && pushed["group"] == "team");
+        assert(pushed["seq"] == 1 && pushed["epoch"] == 1);
+        assert(pushed["ciphertext"].is_binary() == (i == 1));
+    }
+    assert(sender.groupInbox_.empty() && "the sending connection gets no copy");
+
+    // 3 online members, 2 wire formats in use: 2 encodings per message
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    assert(server.stats().deliveries == 6);
+    assert(server.stats().deliveryEncodings == 4);
+    // account creation, RSA wraps and group storage ran on the worker pool
+    assert(server.workerStats().completed > 0 && server.workerStats().rejected == 0);
+
+    // history and this member's key are there for someone who was offline
+    {
+        auto conn = TcpConnection::create(ctx.io(), nullptr);
+        assert(conn->connect("127.0.0.1", 5560));
+        Client late(conn, kClientTimeout);
+        conn->beginRead();
+        assert(late.login(offline, "pw"));
+        assert(late.getGroup("team"));
+        assert(late.lastGroup_["members"].size() == 6);
+        assert(late.lastGroup_["members"][5] == withComma);
+        assert(late.lastGroup_["keys"].size() == 1 && late.lastGroup_["keys"].contains("1"));
+        assert(late.lastGroup_["messages"].size() == 2);
+
+        assert(late.login(outsider, "pw"));
+        assert(!late.sendGroupMessage("team", "let me in"));
+        assert(!late.getGroup("team"));
+        conn->disconnect();
+    }
+
+    for (auto& member : members) {
+        member.conn->disconnect();
+    }
+    serverIo.stop();
+    serverThread.join();
+
+    Logger::log("[Test] GroupConversations passed\n");
+}
+
+// ===================================================
+// SESSION TEST
+// ===================================================
+
+// key lookups and read cursors are kept per user, a reconnect within the linger period
+// picks them up again
+void testSessions() {
+    Logger::log("\n[Test] Running testSessions...");
+
+    // the key cache holds parsed keys and makes room by dropping the least recently used one
+    {
+        std::string pem = CryptoManager().generateRSAKeyPair().publicKeyPem;
+        Session session("cache", nullptr);
+        size_t loads = 0;
+        auto load = [&](const std::string&) { loads++; return pem; };
+        CryptoManager::PublicKey first = session.publicKey("user0", load);
+        assert(first && !CryptoManager().rsaEncrypt("secret", first).empty());
+        for (size_t i = 1; i < Session::kMaxCachedKeys; i++) {
+            session.publicKey("user" + std::to_string(i), load);
+        }
+        assert(session.publicKey("user0", load) == first && loads == Session::kMaxCachedKeys);
+        session.publicKey("extra", load);   // evicts user1, user0 was used since
+        assert(session.cachedKeys() == Session::kMaxCachedKeys);
+        session.publicKey("user0", load);
+        assert(loads == Session::kMaxCachedKeys + 1);
+        session.publicKey("user1", load);
+        assert(loads == Session::kMaxCachedKeys + 2);
+        assert(!session.publicKey("none", [](const std::string&) { return std::string(); }));
+        assert(!session.publicKey("bad", [](const std::string&) { return std::string("not a key"); }));
+        assert(session.cachedKeys() == Session::kMaxCachedKeys);
+    }
+
+    ServerOptions options;
+    options.sessionLinger = std::chrono::milliseconds(300);
+    asio::io_context serverIo;
+    TcpServer server(serverIo, 5561, std::make_unique<MemoryStorage>(), options);
+    std::thread serverThread([&]() { serverIo.run(); });
+
+    auto& keyLoads = MessageStore::callLatency("public_key");
+    auto& markReads = MessageStore::callLatency("mark_read");
+
+    ClientTestContext ctx;
+    std::string user = makeUser();
+    std::string peer = makeUser();
+    auto connect = [&]() {
+        auto conn = TcpConnection::create(ctx.io(), nullptr);
+        assert(conn->connect("127.0.0.1", 5561));
+        conn->beginRead();
+        return conn;
+    };
+
+    auto conn = connect();
+    auto client = std::make_unique<Client>(conn, kClientTimeout);
+    assert(client->createAccount(user, "pw") && client->createAccount(peer, "pw"));
+    assert(client->login(user, "pw"));
+    assert(server.stats().sessionsCreated == 1);
+
+    // both keys come from storage once, then from the session
+    uint64_t loads = keyLoads.snapshot().count;
+    assert(client->sendMessage(peer, "one"));
+    assert(keyLoads.snapshot().count == loads + 2);
+    assert(client->sendMessage(peer, "two"));
+    assert(keyLoads.snapshot().count == loads + 2);
+
+    // a cursor at or below the stored one is answered without storage
+    uint64_t marks = markReads.snapshot().count;
+    assert(client->markRead(peer, 2));
+    assert(client->markRead(peer, 1));
+    assert(client->markRead(peer, 2));
+    assert(markReads.snapshot().count == marks + 1);
+    assert(!client->markRead("no_such_user", 1));
+
+    // a reconnect resumes the session and its caches
+    conn->disconnect();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    conn = connect();
+    client = std::make_unique<Client>(conn, kClientTimeout);
+    assert(client->login(user, "pw"));
+    assert(server.stats().sessionsResumed == 1 && server.stats().sessionsCreated == 1);
+    assert(client->sendMessage(peer, "three"));
+    assert(client->markRead(peer, 2));
+    assert(keyLoads.snapshot().count == loads + 2);
+    assert(markReads.snapshot().count == marks + 2);
+
+    // past the linger period the next login starts over
+    conn->disconnect();
+    std::this_thread::sleep_for(std::chrono::milliseconds(600));
+    assert(server.stats().sessionsExpired == 1);
+    conn = connect();
+    client = std::make_unique<Client>(conn, kClientTimeout);
+    assert(client->login(user, "pw"));
+    assert(server.stats().sessionsCreated == 2 && server.stats().sessionsResumed == 1);
+    assert(client->sendMessage(peer, "four"));
+    assert(keyLoads.snapshot().count == loads + 4);
+
+    conn->disconnect();
+    serverIo.stop();
+    serverThread.join();
+
+    Logger::log("[Test] Sessions passed\n");
+}
+
+// ===================================================
+// UNIX DOMAIN SOCKET TEST
+// ===================================================
+
+// a local connection is handled like a tcp one and sees the same users and messages
+void testLocalConnections() {
+    Logger::log("\n[Test] Running testLocalConnections...");
+
+    std::string path = (std::filesystem::temp_directory_path() / "messenger_test.sock").string();
+    std::string metricsPath = (std::filesystem::temp_directory_path() / "messenger_test.prom").string();
+    std::string tracePath = (std::filesystem::temp_directory_path() / "messenger_test.trace.json").string();
+    std::filesystem::remove(metricsPath);
+    ServerOptions options;
+    options.localPath = path;
+    options.metricsPath = metricsPath;
+    options.metricsInterval = std::chrono::milliseconds(50);
+    options.tracePath = tracePath;
+    options.traceSampleRate = 1.0;
+    // only sends are slow enough for the slow log
+    std::string slowPath = (std::filesystem::temp_directory_path() / "messenger_test.slow.log").string();
+    std::filesystem::remove(slowPath);
+    options.slowLogPath = slowPath;
+    options.slowThreshold = std::chrono::hours(1);
+    options.slowThresholds["send_message"] = std::chrono::milliseconds(0);
+    // tls only applies to tcp, local connections skip it
+    auto credentials = TlsContext::selfSigned("127.0.0.1");
+    options.tls = TlsContext::server(credentials);
+
+    asio::io_context serverIo;
+    std::optional<TcpServer> server;
+    server.emplace(serverIo, 5559, std::make_unique<MemoryStorage>(), options);
+    std::thread serverThread([&]() { serverIo.run(); });
+
+    ClientTestContext ctx;
+    std::string userA = makeUser();
+    std::string userB = makeUser();
+
+    auto local = TcpConnection::create(ctx.io(), nullptr);
+    assert(local->connectLocal(path));
+    assert(local->isLocal());
+    Client sender(local, kClientTimeout);
+    local->beginRead();
+    assert(sender.createAccount(userA, "pw"));
+    assert(sender.createAccount(userB, "pw"));
+    assert(sender.login(userA, "pw"));
+    assert(sender.sendMessage(userB, "over a local socket"));
+    assert(sender.ping());
+
+    // the tcp listener of the same server delivers it
+    auto remote = TcpConnection::create(ctx.io(), nullptr);
+    assert(remote->connect("127.0.0.1", 5559, TlsContext::client(credentials.certificatePem)));
+    assert(!remote->isLocal());
+    Client receiver(remote, kClientTimeout);
+    remote->beginRead();
+    assert(receiver.login(userB, "pw"));
+    assert(receiver.getMessages(userA));
+    assert(receiver.lastMessages_.size() == 1);
+
+    assert(server->stats().accepted == 2);
+    assert(server->stats().tlsHandshakes == 1);
+
+    // metrics are for operators on the local socket only
+    assert(!receiver.stats());
+    assert(sender.stats());
+    const auto& histograms = sender.lastStats_["histograms"];
+    auto sendLatency = histograms["messenger_request_seconds{action=\"send_message\"}"];
+    assert(sendLatency["count"].get<uint64_t>() >= 1);
+    assert(sendLatency["p99_us"].get<double>() >= sendLatency["p50_us"].get<double>());
+    assert(histograms.contains("messenger_crypto_seconds{op=\"rsa_encrypt\"}"));
+    assert(histograms.contains("messenger_storage_seconds{op=\"append_message\"}"));
+    assert(sender.lastStats_["counters"]["messenger_request_errors_total{action=\"stats\"}"].get<uint64_t>() >= 1);
+    assert(sender.lastStats_["server"]["messenger_connections_accepted_total"] == 2);
+
+    // and written to the metrics file in Prometheus text format
+    std::string exposition;
+    for (int i = 0; i < 100 && exposition.find("messenger_request_seconds_count") == std::string::npos; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        std::ifstream in(metricsPath);
+        exposition.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    assert(exposition.find("# TYPE messenger_request_seconds summary") != std::string::npos);
+    assert(exposition.find("messenger_request_seconds{action=\"login\",quantile=\"0.99\"}") != std::string::npos);
+    assert(exposition.find("messenger_worker_queue_depth") != std::string::npos);
+
+    local->disconnect();
+    remote->disconnect();
+    serverIo.stop();
+    serverThread.join();
+
+    // the socket file goes with the server
+    assert(std::filesystem::exists(path));
+    server.reset();
+    assert(!std::filesystem::exists(path));
+    std::filesystem::remove(metricsPath);
+
+    // every request was traced, a send_message from parsing through crypto and storage to its reply
+    std::ifstream traceFile(tracePath);
+    std::string traceText((std::istreambuf_iterator<char>(traceFile)), std::istreambuf_iterator<char>());
+    // requests still in flight keep the array open, viewers accept that too
+    if (traceText.find(']') == std::string::npos) traceText += "]";
+    nlohmann::json events = nlohmann::json::parse(traceText);
+    assert(events.is_array());
+    const nlohmann::json* send = nullptr;
+    for (const auto& event : events) {
+        assert(event["ph"] == "X");
+        if (event["name"] == "send_message" && event["cat"] == "request") send = &event;
+    }
+    assert(send);
+    std::set<std::string> spans;
+    for (const auto& event : events) {
+        if (event["args"]["request"] != (*send)["args"]["request"] || &event == send) continue;
+        assert(event["ts"].get<double>() >= (*send)["ts"].get<double>());
+        assert(event["ts"].get<double>() + event["dur"].get<double>()
+               <= (*send)["ts"].get<double>() + (*send)["dur"].get<double>() + 1);
+        spans.insert(event["cat"].get<std::string>() + "/" + event["name"].get<std::string>());
+    }
+    for (const char* span : {"parse/parse", "handler/send_message", "lookup/public_key",
+                             "crypto/rsa_encrypt", "crypto/aes_encrypt", "storage/append_message",
+                             "write/send"}) {
+        assert(spans.count(span));
+    }
+    std::filesystem::remove(tracePath);
+
+    // one slow log line for the one send, broken down by stage
+    std::ifstream slowFile(slowPath);
+    std::vector<nlohmann::json> slow;
+    for (std::string line; std::getline(slowFile, line);) {
+        slow.push_back(nlohmann::json::parse(line));
+    }
+    assert(slow.size() == 1);
+    const auto& entry = slow[0];
+    assert(entry["action"] == "send_message" && entry["user"] == userA && entry["error"] == false);
+    assert(entry["request_bytes"].get<uint64_t>() > 0 && entry["response_bytes"].get<uint64_t>() > 0);
+    assert(entry["conversation_size"] == 1);
+    double staged = 0;
+    for (const char* stage : {"parse", "lookup", "crypto", "storage", "write", "other"}) {
+        assert(entry["stages_ms"].contains(stage));
+        staged += entry["stages_ms"][stage].get<double>();
+    }
+    assert(entry["stages_ms"]["crypto"].get<double>() > 0 && entry["stages_ms"]["storage"].get<double>() > 0);
+    assert(staged >= entry["total_ms"].get<double>() * 0.99);
+    std::filesystem::remove(slowPath);
+
+    Logger::log("[Test] LocalConnections passed\n");
+}
+
 // ===================================================
 // Main Entry
 // ===================================================
@@ -227,6 +1506,17 @@ int main() {
     Logger::log(" Running Network Unit Tests\n");
     Logger::log("=============================\n");
 
+    testParseRequest();
+    testActionTable();
+    testRateLimiter();
+    testTimerWheel();
+    testWorkerPool();
+    testMetrics();
+    testLogger();
+    testRequestTrace();
+    testWireFormat();
+    testCompression();
+
     resetUsers();
 
     unsigned short port = 5555;
@@ -240,8 +1530,17 @@ int main() {
     testLoginRequest();
     testSendMessageRequest();
     testReceiveMessageResponse();
+    testListConversationsRequest();
+    testBinaryEncodingRequests();
+    testStreamedHistory();
     testHandleDisconnectedClient();
     testMultipleClientsSimultaneousConnections();
+    testConnectionTimeouts();
+    testConnectionLimits();
+    testTlsConnections();
+    testLocalConnections();
+    testGroupConversations();
+    testSessions();
     std::this_thread::sleep_for(std::chrono::milliseconds(150));
 
     Logger::log("\nAll tests executed.\n");
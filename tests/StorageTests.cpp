@@ -0,0 +1,631 @@
+#include "server/MessageStore.h"
+#include "storage/FileStorage.h"
+#include "storage/MemoryStorage.h"
+#include "storage/KeyStore.h"
+#include "storage/AsyncFileIO.h"
+#include "storage/SnapshotTable.h"
+#include "crypto/CryptoManager.h"
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <memory>
+#include <string>
+#include "utils/Logger.h"
+
+// ===================================================
+// Helpers
+// ===================================================
+
+CryptoManager::AESEncrypted makeCiphertext(const std::string& text) {
+    CryptoManager crypto;
+    return crypto.aesEncrypt(text, crypto.generateAESKey());
+}
+
+// ===================================================
+// ACCOUNTS
+// ===================================================
+
+void testAccounts(MessageStore& store, const std::string& name) {
+    Logger::log("\n[Test] Running testAccounts (" + name + ")...");
+
+    store.deleteUser("test_store_a");
+
+    assert(store.createAccount("test_store_a", "hash") == MessageStore::CreateUserResult::Created);
+    assert(store.createAccount("test_store_a", "hash") == MessageStore::CreateUserResult::AlreadyExists);
+    assert(store.userExists("test_store_a"));
+    assert(store.loginUser("test_store_a", "hash"));
+    assert(!store.loginUser("test_store_a", "wrong"));
+    assert(!store.getUserPublicKey("test_store_a").empty());
+
+    assert(store.deleteUser("test_store_a"));
+    assert(!store.userExists("test_store_a"));
+
+    Logger::log("[Test] Accounts passed (" + name + ")\n");
+}
+
+// ===================================================
+// CONVERSATIONS
+// ===================================================
+
+void testConversationRange(MessageStore& store, const std::string& name) {
+    Logger::log("\n[Test] Running testConversationRange (" + name + ")...");
+
+    store.deleteUser("test_store_b");
+    store.deleteUser("test_store_c");
+    assert(store.createAccount("test_store_b", "hash") == MessageStore::CreateUserResult::Created);
+    assert(store.createAccount("test_store_c", "hash") == MessageStore::CreateUserResult::Created);
+
+    assert(store.loadConversation("test_store_b", "test_store_c").is_null());
+    assert(store.loadConversationRange("test_store_b", "test_store_c", 0, 0).empty());
+
+    for (long i = 0; i < 5; i++) {
+        assert(store.appendConversationMessage(
+            "test_store_b", "test_store_c", makeCiphertext("msg"), "k1", "k2", i));
+    }
+
+    // both orderings reach the same conversation
+    assert(store.loadConversation("test_store_c", "test_store_b")["messages"].size() == 5);
+
+    nlohmann::json range = store.loadConversationRange("test_store_b", "test_store_c", 1, 2);
+    assert(range.size() == 2);
+    assert(range[0]["timestamp"] == 1 && range[1]["timestamp"] == 2);
+
+    assert(store.loadConversationRange("test_store_b", "test_store_c", 3, 0).size() == 2);
+    assert(store.loadConversationRange("test_store_b", "test_store_c", 9, 1).empty());
+
+    // a limit near SIZE_MAX reads to the end instead of wrapping
+    constexpr size_t kHugeLimit = std::numeric_limits<size_t>::max();
+    assert(store.loadConversationRange("test_store_b", "test_store_c", 2, kHugeLimit).size() == 3);
+
+    // pair is indexed for both users
+    assert(store.listConversations("test_store_b") == std::vector<std::string>{"test_store_c"});
+    assert(store.listConversations("test_store_c") == std::vector<std::string>{"test_store_b"});
+    assert(store.exportConversations("test_store_c")["test_store_b"].size() == 5);
+
+    assert(store.deleteUser("test_store_b"));
+    assert(store.listConversations("test_store_c").empty());
+    assert(store.loadConversation("test_store_b", "test_store_c").is_null());
+    store.deleteUser("test_store_c");
+
+    Logger::log("[Test] ConversationRange passed (" + name + ")\n");
+}
+
+void testConversationSummaries(MessageStore& store, const std::string& name) {
+    Logger::log("\n[Test] Running testConversationSummaries (" + name + ")...");
+
+    for (const char* user : {"test_store_d", "test_store_e", "test_store_f"}) {
+        store.deleteUser(user);
+        assert(store.createAccount(user, "hash") == MessageStore::CreateUserResult::Created);
+    }
+
+    assert(store.appendConversationMessage("test_store_e", "test_store_d", makeCiphertext("1"), "k1", "k2", 10));
+    assert(store.appendConversationMessage("test_store_d", "test_store_e", makeCiphertext("2"), "k1", "k2", 11));
+    assert(store.appendConversationMessage("test_store_e", "test_store_d", makeCiphertext("3"), "k1", "k2", 12));
+    assert(store.appendConversationMessage("test_store_f", "test_store_d", makeCiphertext("4"), "k1", "k2", 20));
+
+    // newest first, sending reads everything before the sent message
+    auto list = store.listConversationSummaries("test_store_d");
+    assert(list.size() == 2);
+    assert(list[0].peer == "test_store_f" && list[0].lastSeq == 1 && list[0].lastTimestamp == 20);
+    assert(list[1].peer == "test_store_e" && list[1].lastSeq == 3 && list[1].unread == 1);
+    assert(store.listConversationSummaries("test_store_e")[0].unread == 0);
+
+    // cursor is clamped and never moves backwards
+    assert(store.markRead("test_store_d", "test_store_e", 2) == 2u);
+    assert(store.markRead("test_store_d", "test_store_e", 1) == 2u);
+    assert(store.listConversationSummaries("test_store_d")[1].unread == 1);
+    assert(store.markRead("test_store_d", "test_store_e", 99) == 3u);
+    assert(store.listConversationSummaries("test_store_d")[1].unread == 0);
+    assert(!store.markRead("test_store_e", "test_store_f", 1));
+
+    // own message is not unread for its sender
+    assert(store.appendConversationMessage("test_store_d", "test_store_e", makeCiphertext("5"), "k1", "k2", 13));
+    assert(store.listConversationSummaries("test_store_d")[1].unread == 0);
+    assert(store.listConversationSummaries("test_store_e")[0].unread == 1);
+
+    // stored records carry their sequence
+    assert(store.loadConversationRange("test_store_d", "test_store_e", 2, 1)[0]["seq"] == 3);
+
+    for (const char* user : {"test_store_d", "test_store_e", "test_store_f"}) {
+        store.deleteUser(user);
+    }
+
+    Logger::log("[Test] ConversationSummaries passed (" + name + ")\n");
+}
+
+// underscores must not make pairs share a conversation or deletion touch other users' ones
+void testDeleteWithUnderscores(MessageStore& store, const std::string& name) {
+    Logger::log("\n[Test] Running testDeleteWithUnderscores (" + name + ")...");
+
+    for (const char* user : {"test_store_x", "test_store_x_y", "test_store_z"}) {
+        store.deleteUser(user);
+        assert(store.createAccount(user, "hash") == MessageStore::CreateUserResult::Created);
+    }
+
+    assert(store.appendConversationMessage(
+        "test_store_x", "test_store_z", makeCiphertext("a"), "k1", "k2", 1));
+    assert(store.appendConversationMessage(
+        "test_store_x_y", "test_store_z", makeCiphertext("b"), "k1", "k2", 2));
+
+    assert(store.deleteUser("test_store_x"));
+    assert(store.loadConversation("test_store_x", "test_store_z").is_null());
+    assert(!store.loadConversation("test_store_x_y", "test_store_z").is_null());
+
+    store.deleteUser("test_store_x_y");
+    store.deleteUser("test_store_z");
+
+    // joined with '_' both pairs read a_b_c
+    const std::pair<const char*, const char*> pairs[] = {{"a_b", "c"}, {"a", "b_c"}};
+    for (const char* user : {"a_b", "c", "a", "b_c"}) {
+        store.deleteUser(user);
+        assert(store.createAccount(user, "hash") == MessageStore::CreateUserResult::Created);
+    }
+    for (const auto& [a, b] : pairs) {
+        assert(store.appendConversationMessage(a, b, makeCiphertext(a), "k1", "k2", 3));
+    }
+    for (const auto& [a, b] : pairs) {
+        auto messages = store.loadConversation(a, b)["messages"];
+        assert(messages.size() == 1 && messages[0]["seq"] == 1 && messages[0]["from"] == a);
+    }
+
+    // deleting a member of one leaves the other alone
+    assert(store.deleteUser("a"));
+    assert(store.loadConversation("a", "b_c").is_null());
+    assert(store.loadConversation("a_b", "c")["messages"].size() == 1);
+
+    for (const char* user : {"a_b", "c", "b_c"}) {
+        store.deleteUser(user);
+    }
+
+    Logger::log("[Test] DeleteWithUnderscores passed (" + name + ")\n");
+}
+
+// completions arrive on the caller's executor in submission order
+void testAsyncConversation(MessageStore& store, const std::string& name) {
+    Logger::log("\n[Test] Running testAsyncConversation (" + name + ")...");
+
+    store.deleteUser("test_store_g");
+    store.deleteUser("test_store_h");
+    assert(store.createAccount("test_store_g", "hash") == MessageStore::CreateUserResult::Created);
+    assert(store.createAccount("test_store_h", "hash") == MessageStore::CreateUserResult::Created);
+
+    asio::io_context io;
+    std::vector<long> completed;
+    const long count = 20;
+
+    for (long i = 0; i < count; i++) {
+        store.appendConversationMessageAsync(
+            "test_store_g", "test_store_h", makeCiphertext("async"), "k1", "k2", i,
+            io.get_executor(), [&completed, i](bool stored) {
+                assert(stored);
+                completed.push_back(i);
+            });
+    }
+
+    // read queued behind the writes sees all of them
+    nlohmann::json range;
+    store.loadConversationRangeAsync("test_store_h", "test_store_g", 0, 0, io.get_executor(),
+        [&range](nlohmann::json messages) { range = std::move(messages); });
+
+    io.run();
+
+    assert(completed.size() == static_cast<size_t>(count));
+    assert(range.size() == static_cast<size_t>(count));
+    for (long i = 0; i < count; i++) {
+        assert(completed[i] == i);
+        assert(range[i]["seq"] == static_cast<uint64_t>(i + 1) && range[i]["timestamp"] == i);
+    }
+
+    // synchronous calls observe the same state
+    assert(store.loadConversation("test_store_g", "test_store_h")["messages"].size() == static_cast<size_t>(count));
+    assert(store.listConversationSummaries("test_store_g")[0].lastSeq == static_cast<uint64_t>(count));
+
+    // writes still queued when a member is deleted do not bring the conversation back
+    for (long i = 0; i < count; i++) {
+        store.appendConversationMessageAsync(
+            "test_store_g", "test_store_h", makeCiphertext("late"), "k1", "k2", i,
+            io.get_executor(), [](bool) {});
+    }
+    assert(store.deleteUser("test_store_g"));
+    io.restart();
+    io.run();
+    assert(store.loadConversation("test_store_g", "test_store_h").is_null());
+
+    store.deleteUser("test_store_h");
+
+    Logger::log("[Test] AsyncConversation passed (" + name + ")\n");
+}
+
+// ===================================================
+// GROUPS
+// ===================================================
+
+void testGroups(MessageStore& store, const std::string& name) {
+    Logger::log("\n[Test] Running testGroups (" + name + ")...");
+
+    store.deleteGroup("test_store_group");
+    std::vector<std::string> members{"test_store_b", "test_store_c", "test_store_d"};
+
+    assert(!store.getGroup("test_store_group"));
+    assert(store.createGroup("test_store_group", members));
+    assert(!store.createGroup("test_store_group", members));
+
+    auto info = store.getGroup("test_store_group");
+    assert(info && info->members == members && info->epoch == 0);
+
+    // epochs only move forward one at a time
+    assert(!store.startGroupEpoch("test_store_group", 2, {}));
+    assert(store.startGroupEpoch("test_store_group", 1, {{"test_store_b", "k1b"}, {"test_store_c", "k1c"}}));
+    assert(store.startGroupEpoch("test_store_group", 2, {{"test_store_b", "k2b"}, {"test_store_d", "k2d"}}));
+    assert(store.getGroup("test_store_group")->epoch == 2);
+
+    auto keys = store.groupKeys("test_store_group", "test_store_b");
+    assert(keys.size() == 2 && keys[1] == "k1b" && keys[2] == "k2b");
+    keys = store.groupKeys("test_store_group", "test_store_d");
+    assert(keys.size() == 1 && keys[2] == "k2d");
+
+    for (long i = 0; i < 3; i++) {
+        nlohmann::json record = store.appendGroupMessage("test_store_group", "test_store_b", 2, makeCiphertext("msg"), i);
+        assert(record["seq"] == i + 1 && record["epoch"] == 2 && record["group"] == "test_store_group");
+    }
+    assert(store.appendGroupMessage("test_store_missing", "test_store_b", 1, makeCiphertext("msg"), 0).is_null());
+
+    // names differing only in case are separate groups, on any filesystem
+    store.deleteGroup("Test_store_group");
+    assert(store.createGroup("Test_store_group", members));
+    assert(store.appendGroupMessage("Test_store_group", "test_store_c", 0, makeCiphertext("msg"), 9)["seq"] == 1);
+    assert(store.loadGroupMessages("Test_store_group", 0, 0).size() == 1);
+    assert(store.deleteGroup("Test_store_group"));
+
+    nlohmann::json range = store.loadGroupMessages("test_store_group", 1, 5);
+    assert(range.size() == 2 && range[0]["timestamp"] == 1);
+    assert(store.loadGroupMessages("test_store_group", 0, 0).size() == 3);
+    assert(store.loadGroupMessages("test_store_group", 1, std::numeric_limits<size_t>::max()).size() == 2);
+
+    assert(store.deleteGroup("test_store_group"));
+    assert(!store.getGroup("test_store_group"));
+    assert(store.loadGroupMessages("test_store_group", 0, 0).empty());
+
+    Logger::log("[Test] Groups passed (" + name + ")\n");
+}
+
+// ===================================================
+// ASYNC FILE I/O
+// ===================================================
+
+void testAsyncFileIO(bool preferIoUring) {
+    Logger::log("\n[Test] Running testAsyncFileIO...");
+
+    auto dir = std::filesystem::temp_directory_path() / "em_asyncio_test";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    std::string path = (dir / "file.txt").string();
+
+    AsyncFileIO io(2, preferIoUring);
+    Logger::log(std::string("[Test] Backend: ") +
+                (io.backend() == AsyncFileIO::Backend::IoUring ? "io_uring" : "thread pool"));
+
+    // missing file reports an error
+    std::promise<std::error_code> missing;
+    io.readFile((dir / "missing.txt").string(), [&missing](std::error_code ec, std::string) {
+        missing.set_value(ec);
+    });
+    assert(missing.get_future().get() == std::errc::no_such_file_or_directory);
+
+    // same path runs in order, every handler of a superseded replace still runs
+    int writes = 0;
+    std::mutex mutex;
+    auto counted = [&](std::error_code ec) {
+        assert(!ec);
+        std::lock_guard<std::mutex> lock(mutex);
+        writes++;
+    };
+    io.writeFile(path, "first", true, counted);
+    io.writeFile(path, "second", false, counted);
+    io.writeFile(path, "third", false, counted);
+    io.appendFile(path, "+tail", true, counted);
+
+    std::promise<std::string> contents;
+    io.readFile(path, [&contents](std::error_code ec, std::string data) {
+        assert(!ec);
+        contents.set_value(std::move(data));
+    });
+    assert(contents.get_future().get() == "third+tail");
+
+    io.drain();
+    assert(writes == 4);
+
+    // a synced replace completes after the rename, nothing is left beside the file
+    std::promise<std::error_code> synced;
+    io.writeFile(path, "synced", true, [&synced](std::error_code ec) { synced.set_value(ec); });
+    assert(!synced.get_future().get());
+    assert(!std::filesystem::exists(path + ".tmp"));
+    std::promise<std::string> syncedRead;
+    io.readFile(path, [&syncedRead](std::error_code, std::string data) { syncedRead.set_value(std::move(data)); });
+    assert(syncedRead.get_future().get() == "synced");
+
+    // larger than one read chunk
+    std::string big(300 * 1024, 'x');
+    big.back() = 'y';
+    io.writeFile(path, big, false, nullptr);
+    std::promise<std::string> bigRead;
+    io.readFile(path, [&bigRead](std::error_code, std::string data) { bigRead.set_value(std::move(data)); });
+    assert(bigRead.get_future().get() == big);
+
+    io.drain();
+    std::filesystem::remove_all(dir);
+    Logger::log("[Test] AsyncFileIO passed\n");
+}
+
+// ===================================================
+// SNAPSHOT TABLE
+// ===================================================
+
+void testSnapshotTable() {
+    Logger::log("\n[Test] Running testSnapshotTable...");
+
+    auto dir = std::filesystem::temp_directory_path() / "em_snapshot_test";
+    std::filesystem::remove_all(dir);
+
+    {
+        SnapshotTable table(dir.string(), "t");
+        assert(table.open() && table.fresh());
+        for (int i = 0; i < 100; i++) {
+            table.put("key" + std::to_string(i), "value" + std::to_string(i));
+        }
+        table.compact();
+
+        // changes after the snapshot only live in the log
+        table.erase("key1");
+        table.put("key2", "changed");
+        table.put("new", std::string("bin\0ary", 7));
+        assert(table.size() == 100);
+    }
+
+    {
+        SnapshotTable table(dir.string(), "t");
+        assert(table.open() && !table.fresh());
+        assert(table.size() == 100);
+        assert(!table.contains("key1"));
+        assert(table.get("key2") == "changed");
+        assert(table.get("key99") == "value99");
+        assert(table.get("new")->size() == 7);
+
+        size_t visited = 0;
+        table.forEach([&](std::string_view, std::string_view) { visited++; });
+        assert(visited == 100);
+
+        // a torn record at the log tail is dropped
+        table.compact();
+        table.put("last", "ok");
+    }
+    for (auto& entry : std::filesystem::directory_iterator(dir)) {
+        if (entry.path().filename().string().rfind("t.log.", 0) == 0) {
+            std::ofstream(entry.path(), std::ios::app | std::ios::binary) << "\x01\x05";
+        }
+    }
+
+    SnapshotTable table(dir.string(), "t");
+    assert(table.open());
+    assert(table.get("last") == "ok");
+    assert(table.size() == 101);
+
+    // persist writes the snapshot itself, whatever the writer has not done yet
+    struct Stalled : SnapshotTable::Writer {
+        void append(const std::string&, std::string) override {}
+        void replace(const std::string&, std::string, std::function<void(bool)>) override {}
+    } stalled;
+    table.setWriter(&stalled);
+    table.put("kept", "yes");
+    assert(table.persist());
+    SnapshotTable reopened(dir.string(), "t");
+    assert(reopened.open() && reopened.get("kept") == "yes" && reopened.size() == 102);
+
+    std::filesystem::remove_all(dir);
+    Logger::log("[Test] SnapshotTable passed\n");
+}
+
+// users.json and conversation folders from older versions are imported once
+void testLegacyMigration() {
+    Logger::log("\n[Test] Running testLegacyMigration...");
+
+    auto dir = std::filesystem::temp_directory_path() / "em_migration_test";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir / "messages" / "old_a_old_b");
+
+    std::ofstream(dir / "users.json")
+        << R"({"users":[{"username":"old_a","password_hash":"ha"},{"username":"old_b","password_hash":"hb"}]})";
+    std::ofstream(dir / "messages" / "old_a_old_b" / "conversation.json") << R"({"messages":[
+        {"from":"old_a","to":"old_b","seq":1,"timestamp":10},
+        {"from":"old_b","to":"old_a","seq":2,"timestamp":20},
+        {"from":"old_a","to":"old_b","seq":3,"timestamp":30}]})";
+
+    {
+        FileStorage store(dir.string());
+        assert(store.loginUser("old_a", "ha") && store.loginUser("old_b", "hb"));
+        assert(!store.loginUser("old_a", "hb"));
+        assert(!std::filesystem::exists(dir / "users.json"));
+        assert(store.markRead("old_b", "old_a", 2) == 2u);
+    }
+
+    // second start reads only the tables
+    FileStorage store(dir.string());
+    assert(store.userExists("old_b"));
+    auto list = store.listConversationSummaries("old_b");
+    assert(list.size() == 1 && list[0].peer == "old_a" && list[0].lastSeq == 3 && list[0].lastTimestamp == 30);
+    assert(list[0].unread == 1);
+
+    std::filesystem::remove_all(dir);
+    Logger::log("[Test] LegacyMigration passed\n");
+}
+
+// folders named userA_userB by older versions move to escaped names, shared ones are split
+void testFolderMigration() {
+    Logger::log("\n[Test] Running testFolderMigration...");
+
+    auto dir = std::filesystem::temp_directory_path() / "em_folder_test";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir / "messages" / "a_b_c");
+    std::filesystem::create_directories(dir / "messages" / "Old_x");
+    std::filesystem::create_directories(dir / "messages" / "p_q_r");
+    std::filesystem::create_directories(dir / "messages" / "p%5Fq_r");
+
+    // (a_b, c) and (a, b_c) both wrote to a_b_c, with one seq counter
+    std::ofstream(dir / "messages" / "a_b_c" / "conversation.json") << R"({"messages":[
+        {"from":"a_b","to":"c","seq":1,"timestamp":10},
+        {"from":"a","to":"b_c","seq":2,"timestamp":20},
+        {"from":"c","to":"a_b","seq":3,"timestamp":30}]})";
+    // renamed without a split, older versions did not number messages
+    std::ofstream(dir / "messages" / "Old_x" / "conversation.json") << R"({"messages":[
+        {"from":"x","to":"Old","timestamp":40}]})";
+    // an earlier start stopped after writing (p_q, r) to its new folder
+    std::ofstream(dir / "messages" / "p_q_r" / "conversation.json") << R"({"messages":[
+        {"from":"p_q","to":"r","seq":1,"timestamp":50},
+        {"from":"p","to":"q_r","seq":2,"timestamp":60}]})";
+    std::ofstream(dir / "messages" / "p%5Fq_r" / "conversation.json") << R"({"messages":[
+        {"from":"p_q","to":"r","seq":1,"timestamp":50}]})";
+
+    {
+        FileStorage store(dir.string());
+        auto first = store.loadConversation("a_b", "c")["messages"];
+        assert(first.size() == 2 && first[0]["seq"] == 1 && first[1]["seq"] == 2 && first[1]["from"] == "c");
+        auto second = store.loadConversation("a", "b_c")["messages"];
+        assert(second.size() == 1 && second[0]["seq"] == 1);
+        auto renamed = store.loadConversation("Old", "x")["messages"];
+        assert(renamed.size() == 1 && renamed[0]["seq"] == 1);
+        assert(!std::filesystem::exists(dir / "messages" / "a_b_c"));
+        assert(!std::filesystem::exists(dir / "messages" / "Old_x"));
+
+        assert(store.loadConversation("p_q", "r")["messages"].size() == 1);
+        auto resumed = store.loadConversation("p", "q_r")["messages"];
+        assert(resumed.size() == 1 && resumed[0]["seq"] == 1);
+        assert(!std::filesystem::exists(dir / "messages" / "p_q_r"));
+
+        auto list = store.listConversationSummaries("c");
+        assert(list.size() == 1 && list[0].peer == "a_b" && list[0].lastSeq == 2);
+    }
+
+    // the index is built once, later starts do not scan again
+    FileStorage store(dir.string());
+    assert(store.listConversationSummaries("b_c").size() == 1);
+
+    std::filesystem::remove_all(dir);
+    Logger::log("[Test] FolderMigration passed\n");
+}
+
+// ===================================================
+// KEYSTORE
+// ===================================================
+
+void testKeyStore() {
+    Logger::log("\n[Test] Running testKeyStore...");
+
+    auto dir = std::filesystem::temp_directory_path() / "em_keystore_test";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir / "legacy_user");
+    std::string path = dir.string();
+
+    CryptoManager crypto;
+    CryptoManager::RSAKeyPair keys = crypto.generateRSAKeyPair();
+    CryptoManager::RSAKeyPair legacy = crypto.generateRSAKeyPair();
+
+    // legacy PEM layout
+    std::ofstream(dir / "legacy_user" / "public.pem") << legacy.publicKeyPem;
+    std::ofstream(dir / "legacy_user" / "private.pem") << legacy.privateKeyPem;
+
+    {
+        KeyStore store(path);
+        assert(store.open());
+        assert(store.put("alice", keys));
+        assert(store.put("bob", keys));
+        assert(store.remove("bob"));
+        assert(store.importPemDirectory(dir.string()) == 1);
+        assert(!std::filesystem::exists(dir / "legacy_user"));
+    }
+
+    // reopen and read back
+    KeyStore store(path);
+    assert(store.open());
+    assert(store.size() == 2);
+    assert(!store.contains("bob"));
+    assert(store.publicKeyPem("alice") == keys.publicKeyPem);
+    assert(store.privateKeyPem("alice") == keys.privateKeyPem);
+    assert(store.publicKeyPem("legacy_user") == legacy.publicKeyPem);
+    assert(store.publicKeyPem("nobody").empty());
+
+    // stored keys still work for encryption
+    std::string wrapped = crypto.rsaEncrypt("secret", store.publicKeyPem("alice"));
+    assert(crypto.rsaDecrypt(wrapped, store.privateKeyPem("alice")) == "secret");
+
+    std::filesystem::remove_all(dir);
+    Logger::log("[Test] KeyStore passed\n");
+}
+
+// ===================================================
+// Main Entry
+// ===================================================
+
+// a group whose file could not be written is not left behind in the cache
+void testGroupWriteFailure() {
+    Logger::log("\n[Test] Running testGroupWriteFailure...");
+
+    auto dir = std::filesystem::temp_directory_path() / "em_group_write_test";
+    std::filesystem::remove_all(dir);
+    // a directory where group.json goes makes its rename fail
+    auto blocked = dir / "messages" / "groups" / MessageStore::escapeName("team") / "group.json";
+    std::filesystem::create_directories(blocked);
+
+    {
+        FileStorage store(dir.string());
+        assert(!store.createGroup("team", {"a", "b"}));
+        assert(!store.getGroup("team"));
+
+        std::filesystem::remove_all(blocked);
+        assert(store.createGroup("team", {"a", "b"}));
+        assert(store.getGroup("team")->members.size() == 2);
+    }
+
+    std::filesystem::remove_all(dir);
+    Logger::log("[Test] GroupWriteFailure passed\n");
+}
+
+int main() {
+    Logger::log("=============================\n");
+    Logger::log(" Running Storage Unit Tests\n");
+    Logger::log("=============================\n");
+
+    testSnapshotTable();
+    testKeyStore();
+    testLegacyMigration();
+    testFolderMigration();
+    testGroupWriteFailure();
+    testAsyncFileIO(true);
+    testAsyncFileIO(false);
+
+    std::unique_ptr<MessageStore> memory = std::make_unique<MemoryStorage>();
+    testAccounts(*memory, "memory");
+    testConversationRange(*memory, "memory");
+    testDeleteWithUnderscores(*memory, "memory");
+    testConversationSummaries(*memory, "memory");
+    testAsyncConversation(*memory, "memory");
+    testGroups(*memory, "memory");
+
+    // a directory of its own, the cases create and delete accounts
+    auto dir = std::filesystem::temp_directory_path() / "em_file_store_test";
+    std::filesystem::remove_all(dir);
+    {
+        std::unique_ptr<MessageStore> file = std::make_unique<FileStorage>(dir.string());
+        testAccounts(*file, "file");
+        testConversationRange(*file, "file");
+        testDeleteWithUnderscores(*file, "file");
+        testConversationSummaries(*file, "file");
+        testAsyncConversation(*file, "file");
+        testGroups(*file, "file");
+    }
+    std::filesystem::remove_all(dir);
+
+    Logger::log("\nAll tests executed.\n");
+    return 0;
+}